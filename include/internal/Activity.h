@@ -46,6 +46,7 @@ class Schedule;
 class PersistToken;
 class PowerActivity;
 class ActivitySetAutoAssociation;
+class DeferredSpec;
 
 class Activity : public boost::enable_shared_from_this<Activity>
 {
@@ -72,6 +73,10 @@ public:
 
 	std::string GetStateString() const;
 
+	/* Population of each state, and the transitions taken between them
+	 * (including any not allowed by the transition table) */
+	static MojErr StateInfoToJson(MojObject& rep);
+
 	void SendCommand(ActivityCommand_t command, bool internal = false);
 
 	/* Subscription/Subscriber management */
@@ -83,6 +88,7 @@ public:
 
 	/* Subscription messaging & control */
 	MojErr BroadcastEvent(ActivityEvent_t event);
+	void RequestUpdateEvent();
 	void PlugAllSubscriptions();
 	void UnplugAllSubscriptions();
 
@@ -118,6 +124,21 @@ public:
 	void RequirementUnmet(boost::shared_ptr<Requirement> requirement);
 	void RequirementUpdated(boost::shared_ptr<Requirement> requirement);
 
+	/* A subscription or requirement was destroyed while still linked into
+	 * this Activity, and has unlinked itself */
+	void MemberUnlinked();
+
+	/* Deferred definition.  Loaded Activities may hold their trigger and
+	 * requirements unbuilt until they are scheduled, and their callback
+	 * until they run.  Materialize() builds them (or just the given
+	 * DeferredSpec parts) now, if they haven't been, and throws if they
+	 * can't be. */
+	void SetDeferredSpec(boost::shared_ptr<DeferredSpec> spec);
+	bool HasDeferredSpec() const;
+	void Materialize();
+	void Materialize(unsigned parts);
+	static MojErr DeferredSpecInfoToJson(MojObject& rep);
+
 	/* Parent Management */
 	void SetParent(boost::shared_ptr<Subscription> sub);
 	MojErr Adopt(boost::shared_ptr<Subscription> sub, bool wait, bool *adopted = NULL);
@@ -132,11 +153,13 @@ public:
 
 	void SetPersistToken(boost::shared_ptr<PersistToken> token);
 	boost::shared_ptr<PersistToken> GetPersistToken();
+	boost::shared_ptr<const PersistToken> GetPersistToken() const;
 	void ClearPersistToken();
 	bool IsPersistTokenSet() const;
 
 	void HookPersistCommand(boost::shared_ptr<PersistCommand> cmd);
 	void UnhookPersistCommand(boost::shared_ptr<PersistCommand> cmd);
+	void DropPersistCommand(boost::shared_ptr<PersistCommand> cmd);
 	bool IsPersistCommandHooked() const;
 	boost::shared_ptr<PersistCommand> GetHookedPersistCommand();
 
@@ -193,6 +216,27 @@ public:
 
 	MojErr IdentityToJson(MojObject& rep) const;
 	MojErr ActivityInfoToJson(MojObject& rep) const;
+
+	/* The "$activity" details, and the event replies sent to subscribers,
+	 * are built once and shared until InfoChanged() is called (or, for
+	 * state outside the Activity, AllInfoChanged()).  The returned object
+	 * is valid until the next call. */
+	MojErr GetActivityInfo(const MojObject*& info);
+	MojErr GetEventPayload(ActivityEvent_t event, bool detailed,
+		const MojObject*& payload);
+	void InfoChanged();
+	static void AllInfoChanged();
+	static MojErr EventPayloadInfoToJson(MojObject& rep);
+
+	/* Definition: what is persisted.  Status: state, focus, subscribers,
+	 * and schedule progress. */
+	void DefinitionChanged();
+	void StatusChanged();
+	static MojErr JsonCacheInfoToJson(MojObject& rep);
+	/* Output is memoized per combination of flags (other than
+	 * ACTIVITY_JSON_INTERNAL), and rebuilt once the definition, status,
+	 * or (for ACTIVITY_JSON_CURRENT) current details it includes have
+	 * changed.  Any existing contents of rep are replaced. */
 	MojErr ToJson(MojObject& rep, unsigned flags) const;
 	MojErr TypeToJson(MojObject& rep, unsigned flags) const;
 	MojErr TriggerToJson(MojObject& rep, unsigned flags) const;
@@ -234,8 +278,28 @@ private:
 	void DoRunActivity();
 	void DoCallback();
 
-	/* State is a computed property based on internal state */
+	bool MaterializeOrCancel(unsigned parts);
+
+	/* State is set explicitly by each transition, so reading it is
+	 * constant time.  Every transition is checked against the transition
+	 * table, and counted; one the table doesn't allow is logged as an
+	 * error.  The Waiting, Running, and Ending helpers pick the state
+	 * within those groups that a transition lands in. */
 	ActivityState_t GetState(void) const;
+	ActivityState_t WaitingState() const;
+	ActivityState_t RunningState() const;
+	ActivityState_t EndingState() const;
+	void UpdateWaitingState();
+	void SetState(ActivityState_t state);
+	void StateChanged(ActivityState_t from, ActivityState_t to);
+
+	static bool IsValidStateTransition(ActivityState_t from,
+		ActivityState_t to);
+
+	unsigned long long GetInfoGeneration() const;
+	unsigned long long GetJsonGeneration(unsigned flags) const;
+
+	MojErr BuildJson(MojObject& rep, unsigned flags) const;
 
 	/* DISALLOW */
 	Activity();
@@ -369,6 +433,9 @@ private:
 
 	bool			m_released;
 
+	/* Current state, set by SetState() */
+	ActivityState_t	m_state;
+
 	ActivityCommand_t	m_intCommand;
 	ActivityCommand_t	m_extCommand;
 	ActivityCommand_t	m_sentCommand;
@@ -390,6 +457,9 @@ private:
 
 	boost::shared_ptr<PersistToken>	m_persistToken;
 
+	/* Trigger, callback, and requirements not yet built */
+	boost::shared_ptr<DeferredSpec>	m_deferredSpec;
+
 	/* Activity Manager should arbitrate with Power Management to keep device
 	 * awake while Activity is running. */
 	boost::shared_ptr<PowerActivity>	m_powerActivity;
@@ -398,8 +468,17 @@ private:
 	 * when the association objects are deallocated when the Activity dies */
 	EntityAssociationSet	m_associations;
 
-	/* Index this in table of Activity names (and auto-unlink) */
-	ActivityTableItem	m_nameTableItem;
+	/* Listed in the Activity Manager's name index.  The index doesn't
+	 * auto-unlink, so the Activity removes itself on destruction. */
+	bool			m_nameRegistered;
+
+	/* Hashes of the ID, name, creator, and name/creator pair, computed
+	 * when they're set so the Activity Manager's indexes never rehash the
+	 * keys on lookup */
+	size_t			m_idHash;
+	size_t			m_nameHash;
+	size_t			m_creatorHash;
+	size_t			m_nameCreatorHash;
 
 	/* Index this in table of Activity IDs (and auto-unlink).  This includes
 	 * Activities that have been released but still have references. */
@@ -408,14 +487,83 @@ private:
 	/* Start/Ready/Run queue link */
 	ActivityListItem	m_runQueueItem;
 
+	/* While ready, link in its creator's queue for fair share */
+	ActivityListItem	m_readyCreatorItem;
+
+	/* Run queue the Activity is on (an ActivityManager::RunQueueId), and
+	 * when it was placed there (monotonic microseconds).  Used to track
+	 * queue residency, and to age the priority of ready Activities. */
+	int					m_runQueueId;
+	unsigned long long	m_queueTime;
+
 	/* List of Focused Activities */
 	ActivityListItem	m_focusedListItem;
 
+	/* List of Activities with an update event waiting to be broadcast */
+	ActivityListItem	m_updateListItem;
+
 	/* List of pending Persist commands */
 	CommandQueue		m_persistCommands;
 
 	boost::weak_ptr<ActivityManager>	m_am;
 
+	/* Generation of the "$activity" details, and the generation (if any)
+	 * the cached copy was built at */
+	unsigned long long	m_infoGeneration;
+	unsigned long long	m_infoCacheGeneration;
+	MojObject			m_infoCache;
+
+	/* Last event reply built, for plain and for detailed subscribers */
+	struct EventPayload {
+		EventPayload() : m_generation(0), m_event(MaxActivityEvent) {}
+
+		unsigned long long	m_generation;
+		ActivityEvent_t		m_event;
+		MojObject			m_reply;
+	};
+
+	EventPayload	m_eventPayloads[2];
+
+	/* JSON representations built by ToJson, one per combination of flags
+	 * requested, and the generation each was built at */
+	struct CachedJson {
+		unsigned			m_flags;
+		unsigned long long	m_generation;
+		MojObject			m_rep;
+	};
+
+	typedef std::vector<CachedJson> JsonCache;
+
+	unsigned long long	m_definitionGeneration;
+	unsigned long long	m_statusGeneration;
+	mutable JsonCache	m_jsonCache;
+
+	/* States each state may move to, as a mask of (1 << state) */
+	static const unsigned	s_stateTransitions[MaxActivityState];
+
+	static unsigned long long	s_stateCounts[MaxActivityState];
+	static unsigned long long	s_transitionCounts[MaxActivityState]
+		[MaxActivityState];
+	static unsigned long long	s_invalidTransitions;
+
+	/* Bumped when state outside the Activity that shows up in its details
+	 * changes, invalidating every cached payload */
+	static unsigned long long	s_allInfoGeneration;
+
+	/* Event replies built, and replies shared with another subscriber */
+	static unsigned long long	s_payloadsBuilt;
+	static unsigned long long	s_payloadsShared;
+
+	/* JSON representations built, and copied from the cache */
+	static unsigned long long	s_jsonBuilt;
+	static unsigned long long	s_jsonCached;
+
+	/* Activities holding a deferred definition now, and deferred
+	 * definitions built, or that failed to build */
+	static unsigned long long	s_deferredSpecs;
+	static unsigned long long	s_materialized;
+	static unsigned long long	s_materializeFailed;
+
 	static MojLogger	s_log;
 };
 
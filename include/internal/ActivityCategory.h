@@ -26,6 +26,8 @@
 
 #include "PersistProxy.h"
 
+#include <set>
+
 class Activity;
 class ActivityManager;
 class PowerManager;
@@ -33,6 +35,7 @@ class MojoTriggerManager;
 class MojoJsonConverter;
 class MasterResourceManager;
 class ContainerManager;
+class ConcurrencyController;
 class MojoSubscription;
 
 class ActivityCategoryHandler : public MojService::CategoryHandler
@@ -44,7 +47,8 @@ public:
 		boost::shared_ptr<MojoTriggerManager> triggerManager,
 		boost::shared_ptr<PowerManager> powerManager,
 		boost::shared_ptr<MasterResourceManager> resourceManager,
-		boost::shared_ptr<ContainerManager> containerManager);
+		boost::shared_ptr<ContainerManager> containerManager,
+		boost::shared_ptr<ConcurrencyController> concurrencyController);
 
     virtual ~ActivityCategoryHandler();
 
@@ -66,6 +70,11 @@ protected:
     MojErr CancelActivity(MojServiceMessage *msg, MojObject& payload);
     MojErr PauseActivity(MojServiceMessage *msg, MojObject& payload);
 
+	/* Batch Methods */
+	MojErr CreateBatch(MojServiceMessage *msg, MojObject& payload);
+	MojErr CancelBatch(MojServiceMessage *msg, MojObject& payload);
+	MojErr CompleteBatch(MojServiceMessage *msg, MojObject& payload);
+
 	/* Completion methods */
 	void FinishCreateActivity(MojRefCountedPtr<MojServiceMessage> msg,
 		const MojObject& payload, boost::shared_ptr<Activity> act,
@@ -82,6 +91,20 @@ protected:
 		const MojObject& payload, boost::shared_ptr<Activity> act,
 		bool succeeded);
 
+	/* Per-item results of a batch call, replied once every item has
+	 * finished (including persisting it) */
+	class BatchReply;
+
+	void FinishBatchCreate(boost::shared_ptr<BatchReply> batch,
+		size_t index, const MojObject& item, boost::shared_ptr<Activity> act,
+		bool succeeded);
+	void FinishBatchCancel(boost::shared_ptr<BatchReply> batch,
+		size_t index, const MojObject& item, boost::shared_ptr<Activity> act,
+		bool succeeded);
+	void FinishBatchComplete(boost::shared_ptr<BatchReply> batch,
+		size_t index, const MojObject& item, boost::shared_ptr<Activity> act,
+		bool succeeded);
+
     /* Focus Control Methods */
     MojErr FocusActivity(MojServiceMessage *msg, MojObject& payload);
     MojErr UnfocusActivity(MojServiceMessage *msg, MojObject& payload);
@@ -139,6 +162,21 @@ protected:
 		boost::shared_ptr<Activity> oldActivity,
 		boost::shared_ptr<Activity> newActivity);
 
+	bool GetBatchItems(MojServiceMessage *msg, const MojObject& payload,
+		MojObject& items);
+	MojErr PrepareBatchCreate(MojServiceMessage *msg, const MojObject& item,
+		boost::shared_ptr<Activity>& act, std::string& errorText);
+	MojErr LookupBatchActivity(MojServiceMessage *msg, const MojObject& item,
+		std::set<activityId_t>& seen, boost::shared_ptr<Activity>& act,
+		std::string& errorText);
+	MojErr PrepareBatchCancel(MojServiceMessage *msg, const MojObject& item,
+		boost::shared_ptr<Activity> act, std::string& errorText);
+	MojErr PrepareBatchComplete(MojServiceMessage *msg, const MojObject& item,
+		boost::shared_ptr<Activity> act, std::string& errorText);
+	void EnsureBatchCompletion(PersistProxy::CommandType type,
+		const PersistProxy::ActivityVec& activities,
+		const PersistProxy::CompletionVec& completions);
+
 	static MojLogger	s_log;
 
 	static const Method		s_methods[];
@@ -150,6 +188,7 @@ protected:
 	boost::shared_ptr<PowerManager>			m_powerManager;
 	boost::shared_ptr<MasterResourceManager>	m_resourceManager;
 	boost::shared_ptr<ContainerManager>		m_containerManager;
+	boost::shared_ptr<ConcurrencyController>	m_concurrencyController;
 };
 
 #endif /* __ACTIVITYMANAGER_ACTIVITYCATEGORY_H__ */
@@ -0,0 +1,76 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __ACTIVITYMANAGER_ACTIVITYIDALLOCATOR_H__
+#define __ACTIVITYMANAGER_ACTIVITYIDALLOCATOR_H__
+
+#include "Base.h"
+
+#include <map>
+
+/*
+ * Tracks the Activity IDs in use as a set of disjoint, non-adjacent ranges.
+ * The first free ID at or after any point is then the end of at most one
+ * range, so allocation never probes through the in-use IDs one at a time,
+ * however many Activities were restored from the database.  Allocating just
+ * past the last allocated range (the sequential case) doesn't search at all.
+ *
+ * An ID may be claimed more than once (an Activity being loaded may briefly
+ * share its ID with the instance it replaces).  Extra claims are counted,
+ * and the ID only becomes free once every claim has been released.
+ */
+class ActivityIdAllocator
+{
+public:
+	ActivityIdAllocator();
+
+	/* Claim and return the first free ID at or after 'from'.  ID 0 is
+	 * reserved and never returned. */
+	activityId_t Allocate(activityId_t from);
+
+	/* Claim a specific ID, even if it is already in use */
+	void Claim(activityId_t id);
+	void Release(activityId_t id);
+
+	bool IsClaimed(activityId_t id) const;
+
+	/* claimed, ranges */
+	MojErr ToJson(MojObject& rep) const;
+
+protected:
+	/* DISALLOW */
+	ActivityIdAllocator(const ActivityIdAllocator& copy);
+	ActivityIdAllocator& operator=(const ActivityIdAllocator& copy);
+
+	/* First ID in the range -> last ID in the range (inclusive) */
+	typedef std::map<activityId_t, activityId_t> RangeMap;
+	typedef std::map<activityId_t, unsigned> ClaimMap;
+
+	RangeMap::iterator FindRange(activityId_t id);
+	RangeMap::const_iterator FindRange(activityId_t id) const;
+
+	RangeMap	m_ranges;
+	ClaimMap	m_extraClaims;
+
+	/* Range the last ID was allocated from */
+	RangeMap::iterator	m_last;
+
+	unsigned long long	m_claimed;
+};
+
+#endif /* __ACTIVITYMANAGER_ACTIVITYIDALLOCATOR_H__ */
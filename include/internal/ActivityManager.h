@@ -26,6 +26,9 @@
 #include "Activity.h"
 #include "Subscriber.h"
 #include "Timeout.h"
+#include "OpenHashIndex.h"
+#include "LatencyHistogram.h"
+#include "ActivityIdAllocator.h"
 
 /*
  * Central Activity registry and control object.
@@ -39,7 +42,7 @@ public:
 	ActivityManager(boost::shared_ptr<MasterResourceManager> resourceManager);
 	virtual ~ActivityManager();
 
-	typedef std::map<activityId_t, boost::shared_ptr<Activity> > ActivityMap;
+	typedef OpenHashIndex<boost::shared_ptr<Activity> > ActivityMap;
 	typedef std::vector<boost::shared_ptr<const Activity> > ActivityVec;
 
 	void RegisterActivityId(boost::shared_ptr<Activity> act);
@@ -82,12 +85,16 @@ public:
 
 	bool IsEnabled() const;
 
-#ifdef ACTIVITYMANAGER_DEVELOPER_METHODS
 	unsigned int SetBackgroundConcurrencyLevel(unsigned int level);
+	unsigned int GetBackgroundConcurrencyLevel() const;
+
+#ifdef ACTIVITYMANAGER_DEVELOPER_METHODS
 	void EvictBackgroundActivity(boost::shared_ptr<Activity> act);
 	void EvictAllBackgroundActivities();
 	void RunReadyBackgroundActivity(boost::shared_ptr<Activity> act);
 	void RunAllReadyActivities();
+	unsigned int SetReadyQueueAgingSeconds(unsigned int seconds);
+	unsigned int SetCreatorWeight(const BusId& creator, unsigned int weight);
 #endif
 
 	/* INTERFACE:  ACTIVITY ----> ACTIVITY MANAGER */
@@ -128,6 +135,16 @@ public:
 	static const unsigned UnlimitedBackgroundConcurrency = 0;
 	static const unsigned DefaultBackgroundInteractiveYieldSeconds = 60;
 
+	/* Ready Activities gain one priority level for each interval they wait,
+	 * so lower priority work still runs under sustained load. */
+	static const unsigned DefaultReadyQueueAgingSeconds = 30;
+	static const unsigned NoReadyQueueAging = 0;
+
+	/* Share of background run slots given to each creator per round,
+	 * relative to other creators with Activities waiting */
+	static const unsigned DefaultCreatorWeight = 1;
+	static const unsigned MaxCreatorWeight = 1000;
+
 	/* Activity Manager info state gatherer */
 	MojErr InfoToJson(MojObject& rep) const;
 
@@ -138,6 +155,13 @@ private:
 
 protected:
 	void ScheduleAllActivities();
+	void RequestDispatch();
+	void DispatchPass();
+	static gboolean StaticDispatchIdle(gpointer data);
+	void RequestActivityUpdate(Activity& act);
+	void FlushActivityUpdates();
+	void SendPendingActivityUpdate(Activity& act, ActivityEvent_t event);
+	static gboolean StaticUpdateIdle(gpointer data);
 	void EvictQueue(boost::shared_ptr<Activity> act);
 	void RunActivity(Activity& act);
 	void RunReadyBackgroundActivity(Activity& act);
@@ -164,25 +188,58 @@ protected:
 		RunQueueMax
 	} RunQueueId;
 
-	/* Lightweight comparator object to search the Activity Name Table for
-	 * a particular name */
-	typedef std::pair<std::string, BusId>	ActivityKey;
-	struct ActivityNameComp {
-		bool operator()(const Activity& act1, const Activity& act2) const;
-		bool operator()(const ActivityKey& key, const Activity& act) const;
-		bool operator()(const Activity& act, const ActivityKey& key) const;
+	typedef enum {
+		ReadyQueueBackground = 0,
+		ReadyQueueInteractive,
+		ReadyQueueMax
+	} ReadyQueueId;
+
+	void QueueActivity(Activity& act, RunQueueId queue);
+	void DequeueActivity(Activity& act);
+	void EnqueueReadyActivity(Activity& act, ReadyQueueId queue);
+	Activity *SelectNextReadyActivity(ReadyQueueId queue);
+	Activity *SelectFairShareActivity(ReadyQueueId queue, int priority);
+	unsigned GetCreatorWeight(const BusId& creator) const;
+	bool IsReadyActivity(const Activity& act, ReadyQueueId queue) const;
+	bool IsReadyQueueEmpty(ReadyQueueId queue) const;
+	unsigned GetReadyActivitiesCount(ReadyQueueId queue) const;
+
+	/* Activity Name Table entries are hashed on the name and creator
+	 * together, so one creator's (or many creators') reuse of common names
+	 * doesn't pile them onto one probe chain.  Anonymous callers, who may
+	 * look up by name regardless of creator, use a second index hashed on
+	 * the name alone.  The creator hash is checked before any strings are
+	 * compared. */
+	typedef OpenHashIndex<Activity *> ActivityNameTable;
+
+	struct ActivityIdMatch {
+		ActivityIdMatch(activityId_t id) : m_id(id) {}
+		bool operator()(const boost::shared_ptr<Activity>& act) const;
+		activityId_t	m_id;
 	};
 
-	struct ActivityNameOnlyComp {
-		bool operator()(const ActivityKey& key, const Activity& act) const;
-		bool operator()(const Activity& act, const ActivityKey& key) const;
+	struct ActivityNameMatch {
+		ActivityNameMatch(const std::string& name, const BusId& creator,
+			size_t creatorHash, bool nameOnly)
+			: m_name(name), m_creator(creator), m_creatorHash(creatorHash)
+			, m_nameOnly(nameOnly) {}
+		bool operator()(const Activity *act) const;
+		const std::string&	m_name;
+		const BusId&		m_creator;
+		size_t				m_creatorHash;
+		bool				m_nameOnly;
 	};
 
-	typedef boost::intrusive::member_hook<Activity, Activity::ActivityTableItem,
-		&Activity::m_nameTableItem> ActivityNameTableOption;
-	typedef boost::intrusive::set<Activity, ActivityNameTableOption,
-		boost::intrusive::constant_time_size<false>,
-		boost::intrusive::compare<ActivityNameComp> > ActivityNameTable;
+	struct ActivityPtrMatch {
+		ActivityPtrMatch(const Activity *act) : m_act(act) {}
+		bool operator()(const Activity *act) const;
+		bool operator()(const boost::shared_ptr<Activity>& act) const;
+		const Activity	*m_act;
+	};
+
+	friend class Activity;
+	bool RemoveActivityName(Activity& act);
+	void ReleaseActivityId(activityId_t id);
 
 	/* Comparator object for the Activity Id Table */
 	struct ActivityIdComp {
@@ -207,6 +264,28 @@ protected:
 	typedef boost::intrusive::list<Activity, ActivityFocusedListOption,
 		boost::intrusive::constant_time_size<false> > ActivityFocusedList;
 
+	typedef boost::intrusive::member_hook<Activity, Activity::ActivityListItem,
+		&Activity::m_updateListItem> ActivityUpdateListOption;
+	typedef boost::intrusive::list<Activity, ActivityUpdateListOption,
+		boost::intrusive::constant_time_size<false> > ActivityUpdateList;
+
+	typedef boost::intrusive::member_hook<Activity, Activity::ActivityListItem,
+		&Activity::m_readyCreatorItem> ActivityCreatorQueueOption;
+	typedef boost::intrusive::list<Activity, ActivityCreatorQueueOption,
+		boost::intrusive::constant_time_size<false> > ActivityCreatorQueue;
+
+	/* One creator's ready Activities at one priority, oldest first, and
+	 * the run slots it has left in the current fair share round */
+	struct CreatorReadyQueue {
+		CreatorReadyQueue() : m_deficit(0) {}
+		ActivityCreatorQueue	m_queue;
+		unsigned				m_deficit;
+	};
+
+	typedef std::map<BusId, unsigned> CreatorWeightMap;
+	typedef std::map<BusId, boost::shared_ptr<CreatorReadyQueue> >
+		CreatorReadyMap;
+
 	static const char *RunQueueNames[];
 
 	/* Activity Name Table
@@ -214,8 +293,10 @@ protected:
 	 * in the Table, and all Activties in the table are currently live and
 	 * not ending.  Activities should be removed from the table as soon as
 	 * they enter an ending state through cancel, stop, or complete (if it
-	 * isn't going to restart the Activity). */
+	 * isn't going to restart the Activity).  Lookups by name/creator go
+	 * through this (hashed) index on every Luna call. */
 	ActivityNameTable	m_nameTable;
+	ActivityNameTable	m_anonNameTable;
 
 	/* Activity Id Table
 	 * Tracks currently instantiated Activities by Id.  This is slgihtly
@@ -225,13 +306,17 @@ protected:
 	 * which were otherwise leaked). */
 	ActivityIdTable		m_idTable;
 
+	/* IDs of the instantiated Activities, as free-range tracking for
+	 * allocating new ones */
+	ActivityIdAllocator	m_idAllocator;
+
 	/* Activity Run Queues
 	 * Start Queue: Activities may wait here if the Activity Manager isn't
 	 * 	prepared to schedule the Activity (generally, just on startup)
 	 * Ready Queue: Background Activities that are ready to run, but haven't
-	 * 	gotten permission to do so yet
+	 * 	gotten permission to do so yet (held in m_readyQueue)
 	 * Ready Interactive Queue: Ready Background Activities initiated by the
-	 * 	user
+	 * 	user (held in m_readyQueue)
 	 * Background Run Queue: Background Activities that are currently running
 	 * Background Interactive Run Queue: Background Interactive Activities
 	 * 	that are currently running
@@ -239,11 +324,51 @@ protected:
 	 */
 	ActivityRunQueue	m_runQueue[RunQueueMax];
 
+	/* Ready Queues, one FIFO per Activity priority.  The front of each is
+	 * the longest waiting Activity at that priority, so picking the next
+	 * Activity to run only has to compare the fronts. */
+	ActivityRunQueue	m_readyQueue[ReadyQueueMax][MaxActivityPriority];
+
+	/* Fair share (deficit round robin) state for the ready queues:  the
+	 * ready Activities of each priority queue again, split by creator,
+	 * with the run slots each creator may still take this round, and the
+	 * per-creator weights that refill them.  Creators without an explicit
+	 * weight get DefaultCreatorWeight. */
+	CreatorReadyMap		m_creatorReady[ReadyQueueMax][MaxActivityPriority];
+	CreatorWeightMap	m_creatorWeights;
+
+	/* Time spent on each run queue (microseconds), by Activity priority,
+	 * recorded as Activities leave the queue */
+	LatencyHistogram	m_queueLatency[RunQueueMax][MaxActivityPriority];
+
+	/* Pending idle dispatch pass, if any, and whether it should also
+	 * schedule the Activities waiting for the manager to be enabled */
+	GSource			*m_dispatchSource;
+	bool			m_schedulePending;
+
+	/* Dispatch passes requested, and actually run.  Requests made while a
+	 * pass is already pending are coalesced into it. */
+	unsigned long long	m_dispatchRequests;
+	unsigned long long	m_dispatchPasses;
+
+	/* Activities waiting to broadcast an update event, and the idle source
+	 * that will flush them.  An Activity is only listed once, however many
+	 * updates it requests before the flush. */
+	ActivityUpdateList	m_pendingUpdates;
+	GSource				*m_updateSource;
+
+	/* Update events requested, actually broadcast, and folded into one
+	 * already waiting or being sent */
+	unsigned long long	m_updateRequests;
+	unsigned long long	m_updatesSent;
+	unsigned long long	m_updatesCoalesced;
+
 	/* Background Interactive Queue yield timeout */
 	boost::shared_ptr<Timeout<ActivityManager> >	m_interactiveYieldTimeout;
 
 	ActivityFocusedList	m_focusedActivities;
 
+	/* Live Activities, hashed by ID */
 	ActivityMap		m_activities;
 
 	unsigned		m_enabled;
@@ -252,6 +377,7 @@ protected:
 	unsigned		m_backgroundInteractiveConcurrencyLevel;
 
 	unsigned		m_yieldTimeoutSeconds;
+	unsigned		m_readyAgingSeconds;
 
 #ifndef ACTIVITYMANAGER_RANDOM_IDS
 	activityId_t	m_nextActivityId;
@@ -71,6 +71,73 @@
 #define ACTIVITYMANAGER_CALL_CONFIGURATOR
 #endif
 
+/* Should the Activity Manager adapt the number of background Activities it
+ * allows to run concurrently to the system load, as reported by Linux
+ * pressure stall information?  If not (or the kernel doesn't provide it),
+ * the background concurrency level stays fixed.  Adapting may run up to
+ * ConcurrencyController::DefaultMaxLevel background Activities at once,
+ * rather than the usual one.  It can still be turned on at runtime through
+ * devel/adaptiveConcurrency.
+ */
+#if 0
+#define ACTIVITYMANAGER_ADAPTIVE_CONCURRENCY
+#endif
+
+/* Should the Activity Manager defer checking its ready queue (and scheduling
+ * Activities once enabled) to an idle callback, so a burst of Activities
+ * becoming ready or ending results in a single scheduling pass?  If not,
+ * the ready queue is checked synchronously on each change.
+ */
+#if 1
+#define ACTIVITYMANAGER_DEFERRED_DISPATCH
+#endif
+
+/* Should update events caused by requirement changes be coalesced, so an
+ * Activity whose requirements change several times in one main loop
+ * iteration sends its subscribers a single update?  If not, each change
+ * is broadcast as it happens.
+ */
+#if 1
+#define ACTIVITYMANAGER_COALESCE_UPDATES
+#endif
+
+/* Should the Activity Manager keep a local snapshot of its persisted
+ * Activities, and come online from it at startup instead of waiting for
+ * them all to be loaded from MojoDB?  The MojoDB load still runs, in the
+ * background, and is authoritative: snapshot Activities that have changed
+ * or been removed since are cancelled (and their subscribers told), and
+ * the current versions loaded in their place.
+ */
+#if 0
+#define ACTIVITYMANAGER_LOAD_SNAPSHOT
+#endif
+
+/* Should Activities loaded from persistent storage keep their trigger,
+ * callback, and requirements in JSON form until they are needed (the
+ * trigger and requirements until the Activity is scheduled, the callback
+ * until it runs), rather than building them all as they are loaded?
+ */
+#if 1
+#define ACTIVITYMANAGER_LAZY_MATERIALIZATION
+#endif
+
+/* Should the Activity Manager persist its Activities to a local append-only
+ * log instead of MojoDB?  This allows it to run without a MojoDB service,
+ * but Activities stored in MojoDB (including the static configuration
+ * loaded by the configurator) are not seen.
+ */
+#if 0
+#define ACTIVITYMANAGER_LOG_PERSISTENCE
+#endif
+
+/* Should triggers making the same subscription (same method and parameters,
+ * on behalf of the same caller) share a single call, rather than each
+ * opening its own?  Responses are passed on to all of them.
+ */
+#if 1
+#define ACTIVITYMANAGER_SHARED_TRIGGER_SUBSCRIPTIONS
+#endif
+
 /* ****************************************************************** */
 /* DEVELOPMENT FEATURES */
 /* ****************************************************************** */
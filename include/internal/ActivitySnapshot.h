@@ -0,0 +1,128 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_ACTIVITYSNAPSHOT_H__
+#define __ACTIVITYMANAGER_ACTIVITYSNAPSHOT_H__
+
+#include "Base.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+/*
+ * Local snapshot of the persisted Activity set, so startup doesn't have to
+ * wait on MojoDB.  Each record holds an Activity's MojoDB _id and _rev
+ * and its persisted JSON representation.
+ *
+ * The file is written to a temporary beside the snapshot and renamed into
+ * place, so a reader sees either the old snapshot or the new one.  It is
+ * read through a read-only mapping, and validated (length, record count,
+ * and hash of the records) before any record is handed out.  The format
+ * is native endian and only meant to be read on the machine that wrote it.
+ */
+class ActivitySnapshot
+{
+public:
+	ActivitySnapshot();
+	~ActivitySnapshot();
+
+	bool Open(const std::string& path);
+	void Close();
+
+	unsigned GetCount() const;
+
+	/* Record contents point into the mapping, and are only valid while
+	 * the snapshot is open.  Strings are not NUL terminated. */
+	struct Record {
+		int64_t		m_rev;
+		const char	*m_id;
+		size_t		m_idLength;
+		const char	*m_rep;
+		size_t		m_repLength;
+	};
+
+	/* Read the record at offset (start at 0), and advance the offset to
+	 * the next one.  Returns false after the last record. */
+	bool Next(size_t& offset, Record& record) const;
+
+protected:
+	friend class ActivitySnapshotWriter;
+
+	struct Header {
+		char		m_magic[8];
+		uint32_t	m_version;
+		uint32_t	m_count;
+		uint64_t	m_length;
+		uint64_t	m_hash;
+	};
+
+	struct RecordHeader {
+		int64_t		m_rev;
+		uint32_t	m_idLength;
+		uint32_t	m_repLength;
+	};
+
+	static const char		Magic[8];
+	static const uint32_t	Version = 1;
+
+	/* Records start on this boundary */
+	static const size_t		RecordAlignment = 8;
+
+	static size_t RecordSize(size_t idLength, size_t repLength);
+
+private:
+	/* DISALLOW */
+	ActivitySnapshot(const ActivitySnapshot& copy);
+	ActivitySnapshot& operator=(const ActivitySnapshot& copy);
+
+	void		*m_map;
+	size_t		m_mapLength;
+
+	const char	*m_records;
+	size_t		m_recordsLength;
+	unsigned	m_count;
+};
+
+class ActivitySnapshotWriter
+{
+public:
+	ActivitySnapshotWriter();
+	~ActivitySnapshotWriter();
+
+	void Add(const MojString& id, MojInt64 rev, const MojString& rep);
+
+	unsigned GetCount() const;
+
+	/* Write the snapshot beside path, sync it, rename it over path, and
+	 * sync the directory.  Only touches the writer's own records, so it
+	 * may be called from another thread. */
+	bool Commit(const std::string& path);
+
+private:
+	/* DISALLOW */
+	ActivitySnapshotWriter(const ActivitySnapshotWriter& copy);
+	ActivitySnapshotWriter& operator=(const ActivitySnapshotWriter& copy);
+
+	std::string	m_records;
+	unsigned	m_count;
+};
+
+#endif /* __ACTIVITYMANAGER_ACTIVITYSNAPSHOT_H__ */
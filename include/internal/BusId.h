@@ -31,23 +31,35 @@ enum BusIdType {
 
 class Subscriber;
 
+/*
+ * Bus identities are interned in a process wide symbol table, so a BusId is
+ * just a small (reference counted) handle.  Equality, hashing, and ordering
+ * are O(1) handle operations, and the formatted "appId:..." string is built
+ * once per symbol.  Ordering is by handle, not by name, and a handle may be
+ * reused once no BusId refers to its symbol.
+ */
 class BusId {
 public:
 	BusId();
 	BusId(const std::string& id, BusIdType type);
 	BusId(const char *id, BusIdType type);
 	BusId(const Subscriber& subscriber);
+	BusId(const BusId& rhs);
+	~BusId();
 
 	BusIdType GetType() const;
-	std::string GetId() const;
+	const std::string& GetId() const;
 
-	std::string GetString() const;
+	const std::string& GetString() const;
 	static std::string GetString(const std::string& id, BusIdType type);
 	static std::string GetString(const char *id, BusIdType type);
 
+	size_t Hash() const;
+
 	MojErr ToJson(MojObject& rep) const;
 
 	BusId& operator=(const Subscriber& rhs);
+	BusId& operator=(const BusId& rhs);
 
 	bool operator<(const BusId& rhs) const;
 	bool operator!=(const BusId& rhs) const;
@@ -59,9 +71,16 @@ public:
 	bool operator!=(const std::string& rhs) const;
 	bool operator==(const std::string& rhs) const;
 
+	/* Number of distinct bus identities currently interned */
+	static unsigned GetSymbolCount();
+
 protected:
-	std::string	m_id;
-	BusIdType	m_type;
+	typedef unsigned Handle;
+
+	static Handle Intern(const char *id, size_t len, BusIdType type);
+
+	/* Handle 0 is the null (invalid) BusId */
+	Handle	m_handle;
 };
 
 #endif /* __ACTIVITYMANAGER_BUSID_H__ */
@@ -108,6 +108,44 @@ protected:
 	boost::shared_ptr<Activity>	m_activity;
 };
 
+template<class T, class B>
+class MojoBatchCompletion : public Completion
+{
+public:
+	typedef void (T::* CallbackType)(boost::shared_ptr<B> batch,
+		size_t index, const MojObject& item,
+		boost::shared_ptr<Activity> activity, bool succeeded);
+
+	MojoBatchCompletion(T *target, CallbackType callback,
+		boost::shared_ptr<B> batch, size_t index, const MojObject& item,
+		boost::shared_ptr<Activity> activity)
+		: m_item(item)
+		, m_index(index)
+		, m_callback(callback)
+		, m_target(target)
+		, m_batch(batch)
+		, m_activity(activity)
+	{
+	}
+
+	virtual ~MojoBatchCompletion() {}
+
+	virtual void Complete(bool succeeded)
+	{
+		((*m_target.get()).*m_callback)(m_batch, m_index, m_item,
+			m_activity, succeeded);
+	}
+
+protected:
+	MojObject		m_item;
+	size_t			m_index;
+	CallbackType	m_callback;
+
+	MojRefCountedPtr<T>			m_target;
+	boost::shared_ptr<B>		m_batch;
+	boost::shared_ptr<Activity>	m_activity;
+};
+
 class ActivityCompletion : public Completion
 {
 public:
@@ -0,0 +1,102 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __ACTIVITYMANAGER_CONCURRENCYCONTROLLER_H__
+#define __ACTIVITYMANAGER_CONCURRENCYCONTROLLER_H__
+
+#include "Base.h"
+#include "Timeout.h"
+
+class ActivityManager;
+
+/*
+ * Adapts the Activity Manager's background concurrency level to system
+ * load, as reported by Linux Pressure Stall Information (PSI) in
+ * /proc/pressure/{cpu,memory,io}.
+ *
+ * The pressure is sampled periodically, and the highest "some avg10" of the
+ * three (the percentage of the last 10 seconds in which at least one task
+ * was stalled on that resource) is compared against two thresholds:
+ *
+ * - At or above the high threshold, the level is halved (down to the
+ *   minimum), so background work backs off quickly under pressure.
+ * - At or below the low threshold for several samples in a row, the level
+ *   is raised by one (up to the maximum), to drain the backlog while idle.
+ * - In between, the level is held.
+ *
+ * If the kernel doesn't provide PSI, the controller leaves the level alone.
+ * It also leaves alone a level configured outside its bounds, such as
+ * unlimited concurrency.
+ */
+class ConcurrencyController :
+	public boost::enable_shared_from_this<ConcurrencyController>
+{
+public:
+	ConcurrencyController(boost::shared_ptr<ActivityManager> am);
+	virtual ~ConcurrencyController();
+
+	void Enable();
+	void Disable();
+	bool IsEnabled() const;
+
+	void SetBounds(unsigned minLevel, unsigned maxLevel);
+	void SetThresholds(unsigned lowPressure, unsigned highPressure);
+
+	MojErr InfoToJson(MojObject& rep) const;
+
+	static const unsigned DefaultMinLevel = 1;
+	static const unsigned DefaultMaxLevel = 4;
+
+	/* Percent of time stalled (avg10) */
+	static const unsigned DefaultLowPressure = 5;
+	static const unsigned DefaultHighPressure = 25;
+
+	static const unsigned DefaultSampleSeconds = 10;
+
+	/* Consecutive low pressure samples before the level is raised */
+	static const unsigned IdleSamplesToRaise = 3;
+
+protected:
+	void Sample();
+	void Adjust(double pressure);
+
+	static bool ReadPressure(const char *path, double& some);
+
+	boost::weak_ptr<ActivityManager>	m_am;
+
+	boost::shared_ptr<Timeout<ConcurrencyController> >	m_sampleTimeout;
+
+	bool		m_enabled;
+	bool		m_available;
+
+	unsigned	m_minLevel;
+	unsigned	m_maxLevel;
+	unsigned	m_lowPressure;
+	unsigned	m_highPressure;
+
+	unsigned	m_idleSamples;
+
+	/* Most recent samples */
+	double		m_cpuPressure;
+	double		m_memoryPressure;
+	double		m_ioPressure;
+
+	static MojLogger	s_log;
+};
+
+#endif /* __ACTIVITYMANAGER_CONCURRENCYCONTROLLER_H__ */
@@ -0,0 +1,66 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_DEFERREDSPEC_H__
+#define __ACTIVITYMANAGER_DEFERREDSPEC_H__
+
+#include "Base.h"
+
+class Activity;
+
+/*
+ * Parts of a loaded Activity's definition (trigger, callback, and
+ * requirements) held in their persisted form until they are needed.  The
+ * requirements and trigger are built when the Activity is scheduled, as
+ * they have to be armed then; that is shortly after startup for most
+ * loaded Activities, so it only saves the work for those released or
+ * replaced before.  The callback isn't built until the Activity runs, so
+ * Activities that won't run for a while don't hold one.
+ *
+ * Materialize() builds the given parts into the Activity, and may throw if
+ * one is invalid.  A part that fails stays deferred.  Until they are
+ * built, ToJson() reproduces the parts for the Activity's JSON, so
+ * persisted and reported definitions are unchanged.
+ */
+class DeferredSpec
+{
+public:
+	static const unsigned RequirementsPart = 0x1;
+	static const unsigned TriggerPart = 0x2;
+	static const unsigned CallbackPart = 0x4;
+	static const unsigned AllParts = 0x7;
+
+	DeferredSpec();
+	virtual ~DeferredSpec();
+
+	/* Parts not built yet */
+	virtual unsigned GetParts() const = 0;
+
+	virtual void Materialize(boost::shared_ptr<Activity> activity,
+		unsigned parts) = 0;
+
+	virtual MojErr ToJson(MojObject& rep, unsigned flags) const = 0;
+
+private:
+	/* DISALLOW */
+	DeferredSpec(const DeferredSpec& copy);
+	DeferredSpec& operator=(const DeferredSpec& copy);
+};
+
+#endif /* __ACTIVITYMANAGER_DEFERREDSPEC_H__ */
@@ -28,6 +28,8 @@ class ActivityManager;
 class MojoJsonConverter;
 class MasterResourceManager;
 class ContainerManager;
+class ConcurrencyController;
+class PersistProxy;
 class Activity;
 
 class DevelCategoryHandler : public MojService::CategoryHandler
@@ -36,7 +38,9 @@ public:
     DevelCategoryHandler(boost::shared_ptr<ActivityManager> am,
 		boost::shared_ptr<MojoJsonConverter> json,
 		boost::shared_ptr<MasterResourceManager> resourceManager,
-		boost::shared_ptr<ContainerManager> containerManager);
+		boost::shared_ptr<ContainerManager> containerManager,
+		boost::shared_ptr<ConcurrencyController> concurrencyController,
+		boost::shared_ptr<PersistProxy> db);
     virtual ~DevelCategoryHandler();
 
     MojErr Init();
@@ -51,9 +55,24 @@ protected:
 	/* Set background Activity concurrency level for the Activity Manager */
 	MojErr SetConcurrency(MojServiceMessage *msg, MojObject& payload);
 
+	/* Configure adaptive background concurrency */
+	MojErr AdaptiveConcurrency(MojServiceMessage *msg, MojObject& payload);
+
+	/* Set how quickly waiting ready Activities gain priority */
+	MojErr SetReadyAging(MojServiceMessage *msg, MojObject& payload);
+
+	/* Set a creator's weighted share of background run slots */
+	MojErr SetFairShare(MojServiceMessage *msg, MojObject& payload);
+
 	/* Enable or disable priority control */
 	MojErr PriorityControl(MojServiceMessage *msg, MojObject& payload);
 
+	/* Compare Activity registry lookup latency at various table sizes */
+	MojErr BenchmarkLookup(MojServiceMessage *msg, MojObject& payload);
+
+	/* Set the persistence group commit window */
+	MojErr GroupCommit(MojServiceMessage *msg, MojObject& payload);
+
 	/* Map processes into containers */
 	MojErr MapProcess(MojServiceMessage *msg, MojObject& payload);
 
@@ -68,6 +87,8 @@ protected:
 	boost::shared_ptr<MojoJsonConverter>		m_json;
 	boost::shared_ptr<MasterResourceManager>	m_resourceManager;
 	boost::shared_ptr<ContainerManager>			m_containerManager;
+	boost::shared_ptr<ConcurrencyController>	m_concurrencyController;
+	boost::shared_ptr<PersistProxy>				m_db;
 };
 
 #endif /* __ACTIVITYMANAGER_DEVELCATEGORY_H__ */
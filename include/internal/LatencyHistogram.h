@@ -0,0 +1,66 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __ACTIVITYMANAGER_LATENCYHISTOGRAM_H__
+#define __ACTIVITYMANAGER_LATENCYHISTOGRAM_H__
+
+#include "Base.h"
+
+#include <vector>
+
+/*
+ * Log-linear (HDR style) histogram of latencies, in microseconds.
+ *
+ * Each power of two range is split into 2^SubBucketBits equal buckets, so
+ * any recorded value is known to within 1/2^SubBucketBits (12.5%) of its
+ * magnitude, at any scale, while a full 64-bit range needs only a few
+ * hundred buckets.  Buckets are only allocated up to the largest value
+ * recorded so far.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void Record(unsigned long long value);
+	void Merge(const LatencyHistogram& other);
+
+	unsigned long long GetCount() const;
+	unsigned long long GetMax() const;
+
+	/* Highest value equivalent (within the bucket precision) to the value
+	 * at the given percentile, ie. 99.0 for p99 */
+	unsigned long long GetPercentile(double percentile) const;
+
+	/* count, p50, p95, p99, max */
+	MojErr ToJson(MojObject& rep) const;
+
+	static const unsigned SubBucketBits = 3;
+	static const unsigned SubBucketCount = 1 << SubBucketBits;
+
+protected:
+	static unsigned BucketIndex(unsigned long long value);
+	static unsigned long long BucketUpperBound(unsigned index);
+
+	std::vector<unsigned long long>	m_counts;
+
+	unsigned long long	m_count;
+	unsigned long long	m_max;
+};
+
+#endif /* __ACTIVITYMANAGER_LATENCYHISTOGRAM_H__ */
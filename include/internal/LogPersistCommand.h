@@ -0,0 +1,87 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_LOGPERSISTCOMMAND_H__
+#define __ACTIVITYMANAGER_LOGPERSISTCOMMAND_H__
+
+#include "PersistCommand.h"
+
+class Activity;
+class Completion;
+class LogPersistProxy;
+
+/*
+ * Commands for the local record log.  The record is appended when the
+ * command is issued, and the command completes once the log has been
+ * synced to storage (see LogPersistProxy).
+ */
+class LogPersistCommand : public PersistCommand
+{
+public:
+	LogPersistCommand(boost::shared_ptr<LogPersistProxy> proxy,
+		boost::shared_ptr<Activity> activity,
+		boost::shared_ptr<Completion> completion);
+	virtual ~LogPersistCommand();
+
+	/* Called by the proxy once the appended record is durable (or the
+	 * append or sync has failed) */
+	virtual void Synced(bool success);
+
+protected:
+	boost::shared_ptr<LogPersistProxy>	m_proxy;
+};
+
+/* Appends the Activity's full persisted representation */
+class LogStoreCommand : public LogPersistCommand
+{
+public:
+	LogStoreCommand(boost::shared_ptr<LogPersistProxy> proxy,
+		boost::shared_ptr<Activity> activity,
+		boost::shared_ptr<Completion> completion);
+	virtual ~LogStoreCommand();
+
+	virtual void Persist();
+
+	virtual bool Supersedes(const PersistCommand& earlier) const;
+	virtual bool IsStore() const;
+
+protected:
+	virtual std::string GetMethod() const;
+};
+
+/* Appends a tombstone for the Activity's key */
+class LogDeleteCommand : public LogPersistCommand
+{
+public:
+	LogDeleteCommand(boost::shared_ptr<LogPersistProxy> proxy,
+		boost::shared_ptr<Activity> activity,
+		boost::shared_ptr<Completion> completion);
+	virtual ~LogDeleteCommand();
+
+	virtual void Persist();
+
+	virtual void Synced(bool success);
+
+	virtual bool Supersedes(const PersistCommand& earlier) const;
+
+protected:
+	virtual std::string GetMethod() const;
+};
+
+#endif /* __ACTIVITYMANAGER_LOGPERSISTCOMMAND_H__ */
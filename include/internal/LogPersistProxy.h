@@ -0,0 +1,202 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_LOGPERSISTPROXY_H__
+#define __ACTIVITYMANAGER_LOGPERSISTPROXY_H__
+
+#include "PersistProxy.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glib.h"
+
+class Activity;
+class ActivityManager;
+class ActivityManagerApp;
+class Completion;
+class LogPersistCommand;
+class LogPersistToken;
+class MojoJsonConverter;
+
+/*
+ * Local persistence backend, for running the Activity Manager without
+ * MojoDB.  Activities are kept in an append-only record log: a store
+ * appends the Activity's full persisted representation under its key, and
+ * a delete appends a tombstone for the key.  Replaying the log at startup
+ * rebuilds the live set, the last record for each key winning.
+ *
+ * Records are written as soon as their command is issued, but the command
+ * only completes once the log has been synced, which is done once per main
+ * loop iteration for everything appended during it.  Each record carries
+ * a hash of its contents, so a record torn by a crash is detected during
+ * replay, and the log is truncated back to the last complete record.
+ *
+ * Once enough of the log is made up of superseded records, it is
+ * compacted: the live records are copied, in log order, to a new log
+ * beside it, which is synced and renamed into place.
+ *
+ * The format is native endian and only meant to be read on the machine
+ * that wrote it.
+ */
+class LogPersistProxy : public PersistProxy
+{
+public:
+	LogPersistProxy(ActivityManagerApp *app,
+		boost::shared_ptr<ActivityManager> am,
+		boost::shared_ptr<MojoJsonConverter> json,
+		const std::string& path);
+	virtual ~LogPersistProxy();
+
+	virtual boost::shared_ptr<PersistCommand> PrepareStoreCommand(
+		boost::shared_ptr<Activity> activity,
+		boost::shared_ptr<Completion> completion);
+	virtual boost::shared_ptr<PersistCommand> PrepareDeleteCommand(
+		boost::shared_ptr<Activity> activity,
+		boost::shared_ptr<Completion> completion);
+
+	virtual boost::shared_ptr<PersistToken> CreateToken();
+
+	virtual void LoadActivities();
+
+	virtual MojErr InfoToJson(MojObject& rep) const;
+
+	uint64_t AllocateKey();
+
+	/* Append a record for the command, which will be told the outcome
+	 * through Synced() once the log has been synced.  A failed append is
+	 * reported immediately. */
+	void AppendStore(boost::shared_ptr<LogPersistCommand> command,
+		uint64_t key, const MojString& rep);
+	void AppendDelete(boost::shared_ptr<LogPersistCommand> command,
+		uint64_t key);
+
+	static const char *DefaultPath;
+
+	/* Compaction is considered this long after a sync, once at least
+	 * CompactMinDeadBytes of the log, and at least half of it, are
+	 * superseded records */
+	static const unsigned CompactDelaySeconds = 10;
+	static const unsigned long long CompactMinDeadBytes = 64 * 1024;
+
+protected:
+	struct Header {
+		char		m_magic[8];
+		uint32_t	m_version;
+		uint32_t	m_reserved;
+	};
+
+	enum RecordType { StoreRecord = 1, DeleteRecord = 2 };
+
+	/* The hash covers the key, type, length and payload */
+	struct RecordHeader {
+		uint64_t	m_key;
+		uint64_t	m_hash;
+		uint32_t	m_type;
+		uint32_t	m_length;
+	};
+
+	/* Where the live store record for a key is in the log */
+	struct LiveRecord {
+		off_t		m_offset;
+		uint32_t	m_length;
+	};
+
+	typedef std::map<uint64_t, LiveRecord> RecordMap;
+	typedef std::vector<boost::shared_ptr<LogPersistCommand> > SyncVec;
+	typedef std::vector<std::pair<off_t, uint64_t> > OrderVec;
+
+	static const char		Magic[8];
+	static const uint32_t	Version = 1;
+
+	/* Records start on this boundary */
+	static const size_t		RecordAlignment = 8;
+
+	static size_t RecordSize(size_t length);
+	static uint64_t RecordHash(uint64_t key, uint32_t type,
+		const char *data, size_t length);
+
+	static bool WriteHeader(int fd);
+
+	/* Open (or create) the log and replay it, leaving its contents up to
+	 * the last complete record in contents */
+	bool Open(std::string& contents);
+	void Replay(const std::string& contents);
+
+	/* Live records, in the order they were written */
+	void GetRecordOrder(OrderVec& order) const;
+
+	bool Append(uint64_t key, RecordType type, const char *data,
+		size_t length);
+	void AppendTombstone(uint64_t key);
+
+	boost::shared_ptr<Activity> LoadActivity(const MojObject& rep,
+		boost::shared_ptr<LogPersistToken> pt);
+	void RetireActivity(boost::shared_ptr<Activity> old);
+
+	void ScheduleSync();
+	void Sync();
+
+	bool ShouldCompact() const;
+	void ScheduleCompaction();
+	bool Compact();
+
+	static gboolean StaticSync(gpointer data);
+	static gboolean StaticCompactTimeout(gpointer data);
+
+	ActivityManagerApp	*m_app;
+
+	boost::shared_ptr<ActivityManager>		m_am;
+	boost::shared_ptr<MojoJsonConverter>	m_json;
+
+	std::string	m_path;
+	int			m_fd;
+
+	/* End of the last complete record */
+	off_t		m_length;
+
+	RecordMap			m_records;
+	unsigned long long	m_liveBytes;
+	uint64_t			m_nextKey;
+
+	/* Commands whose records are written but not yet synced */
+	SyncVec		m_syncPending;
+	bool		m_syncNeeded;
+
+	GSource		*m_syncSource;
+	GSource		*m_compactSource;
+
+	unsigned long long	m_stores;
+	unsigned long long	m_deletes;
+	unsigned long long	m_syncs;
+	unsigned long long	m_syncTime;
+	unsigned long long	m_maxSyncTime;
+	unsigned long long	m_compactions;
+	unsigned long long	m_truncatedBytes;
+	unsigned long long	m_loadTime;
+
+	static MojLogger	s_log;
+};
+
+#endif /* __ACTIVITYMANAGER_LOGPERSISTPROXY_H__ */
@@ -0,0 +1,53 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_LOGPERSISTTOKEN_H__
+#define __ACTIVITYMANAGER_LOGPERSISTTOKEN_H__
+
+#include "Base.h"
+#include "PersistToken.h"
+
+#include <stdint.h>
+
+/*
+ * Token for an Activity stored in the local record log.  The key names the
+ * Activity's records in the log, and is never reused.
+ */
+class LogPersistToken : public PersistToken
+{
+public:
+	LogPersistToken();
+	LogPersistToken(uint64_t key);
+	virtual ~LogPersistToken();
+
+	virtual bool IsValid() const;
+
+	void Set(uint64_t key);
+	void Clear();
+
+	uint64_t GetKey() const;
+
+	std::string GetString() const;
+
+protected:
+	bool		m_valid;
+	uint64_t	m_key;
+};
+
+#endif /* __ACTIVITYMANAGER_LOGPERSISTTOKEN_H__ */
@@ -70,6 +70,7 @@
 #define MSGID_OLD_ACTIVITY_NO_REPLACE                   "OLD_ACTIVITY_NO_REPLACE" /** activity already exists and in new activity replace was not specified*/
 #define MSGID_STOP_ACTIVITY_REQ_REPLY_FAIL              "STOP_ACTIVITY_REQ_REPLY_FAIL" /** Failed to generate reply to Stop activity request */
 #define MSGID_CANCEL_ACTIVITY_REQ_REPLY_FAIL            "CANCEL_ACTIVITY_REQ_REPLY_FAIL" /** Failed to generate reply to Cancel activity request */
+#define MSGID_BATCH_REQ_REPLY_FAIL                      "BATCH_REQ_REPLY_FAIL" /** Failed to generate reply to batch request */
 #define MSGID_SERIAL_NUM_MISMATCH                       "SERIAL_NUM_MISMATCH" /** call sequence serial numbers do not match */
 #define MSGID_NO_OLD_ACTIVITY                           "NO_OLD_ACTIVITY" /** Old activity to be replaced not specified */
 #define MSGID_NEW_ACTIVITY_PERSIST_TOKEN_SET            "NEW_ACTIVITY_PERSIST_TOKEN_SET" /** Persist token set in new activity which is to replace an existing old activity */
@@ -240,6 +241,8 @@
 #define MSGID_HOOK_PERSIST_CMD_ERR              "HOOK_PERSIST_CMD_ERR" /* Attempt to hook PersistCommand */
 #define MSGID_REQ_UNMET_OWNER_MISMATCH          "REQ_UNMET_OWNER_MISMATCH" /* Requirement owner mismatch */
 #define MSGID_REQ_MET_OWNER_MISMATCH            "REQ_MET_OWNER_MISMATCH" /* Requirement owner mismatch */
+#define MSGID_INVALID_STATE_TRANSITION          "INVALID_STATE_TRANSITION" /* Activity state transition not in transition table */
+#define MSGID_MATERIALIZE_FAILED                "MATERIALIZE_FAILED" /* Deferred trigger, callback, or requirements of a loaded Activity could not be built */
 
 #define MSGID_CANT_TRIGGER_DIFF_ACTIVITY        "CANT_TRIGGER_DIFF_ACTVTY" /** Can't arm trigger for a different Activity */
 #define MSGID_DISARM_TRIGGER_FOR_ACTIVITY       "DISARM_TRIGGER_FOR_ACTVTY" /** Can't disarm trigger for a different Activity */
@@ -257,6 +260,51 @@
 #define MSGID_RM_ASSOCIATION_NOT_FOUND      "RM_ASSOCIATION_NOTFOUND" /* can't remove association with Entity */
 
 #define MSGID_RM_REQ_NOT_FOUND              "RM_REQ_NOT_FOUND"  /* not found while trying to remove by name */
+
+/** ActivityManager.cpp */
+#define MSGID_DISPATCH_EXCEPTION            "DISPATCH_EXCEPTION" /* Unhandled exception during dispatch pass */
+#define MSGID_DISPATCH_ERR_UNKNOWN          "DISPATCH_ERR_UNKNOWN" /* Unhandled exception of unknown type during dispatch pass */
+#define MSGID_UPDATE_FLUSH_EXCEPTION        "UPDATE_FLUSH_EXCEPTION" /* Unhandled exception flushing update events */
+#define MSGID_UPDATE_FLUSH_ERR_UNKNOWN      "UPDATE_FLUSH_ERR_UNKNOWN" /* Unhandled exception of unknown type flushing update events */
+
+/** ConcurrencyController.cpp */
+#define MSGID_PRESSURE_UNAVAILABLE          "PRESSURE_UNAVAILABLE" /* Pressure stall information not available */
+
+/** MojoDBPersistCommand.cpp */
+#define MSGID_PERSIST_BATCH_ITEM_SKIPPED    "PERSIST_BATCH_ITEM_SKIPPED" /* Activity could not be included in batched persist call */
+#define MSGID_PERSIST_BATCH_RESULTS_SHORT   "PERSIST_BATCH_RESULTS_SHORT" /* Batched persist call returned fewer results than objects */
+#define MSGID_PERSIST_BATCH_ABANDONED       "PERSIST_BATCH_ABANDONED" /* Batch destroyed with commands still outstanding */
+#define MSGID_PERSIST_GROUP_GONE            "PERSIST_GROUP_GONE" /* Group commit stage destroyed before command was ready */
+#define MSGID_PERSIST_GROUP_EXCEPTION       "PERSIST_GROUP_EXCEPTION" /* Unhandled exception during group commit */
+#define MSGID_PERSIST_GROUP_ERR_UNKNOWN     "PERSIST_GROUP_ERR_UNKNOWN" /* Unhandled exception of unknown type during group commit */
+/** ActivitySnapshot.cpp */
+#define MSGID_SNAPSHOT_OPEN_FAIL            "SNAPSHOT_OPEN_FAIL" /* Activity snapshot could not be opened or mapped */
+#define MSGID_SNAPSHOT_INVALID              "SNAPSHOT_INVALID" /* Activity snapshot failed validation */
+#define MSGID_SNAPSHOT_WRITE_FAIL           "SNAPSHOT_WRITE_FAIL" /* Activity snapshot could not be written */
+/** MojoDBProxy.cpp */
+#define MSGID_SNAPSHOT_EXCEPTION            "SNAPSHOT_EXCEPTION" /* Unhandled exception writing Activity snapshot */
+#define MSGID_SNAPSHOT_ERR_UNKNOWN          "SNAPSHOT_ERR_UNKNOWN" /* Unhandled exception of unknown type writing Activity snapshot */
+#define MSGID_SNAPSHOT_THREAD_FAIL          "SNAPSHOT_THREAD_FAIL" /* Activity snapshot writer thread could not be started */
+#define MSGID_PURGE_EXCEPTION               "PURGE_EXCEPTION" /* Unhandled exception purging old Activities */
+#define MSGID_PURGE_ERR_UNKNOWN             "PURGE_ERR_UNKNOWN" /* Unhandled exception of unknown type purging old Activities */
+/** MojoDBRetryQueue.cpp */
+#define MSGID_PERSIST_BREAKER_OPEN          "PERSIST_BREAKER_OPEN" /* Repeated transient MojoDB failures, writes paused */
+#define MSGID_PERSIST_BREAKER_CLOSED        "PERSIST_BREAKER_CLOSED" /* MojoDB responding again, held writes released */
+#define MSGID_PERSIST_RETRY_CALL_FAIL       "PERSIST_RETRY_CALL_FAIL" /* Held or retried MojoDB write could not be issued */
+#define MSGID_PERSIST_RETRY_EXCEPTION       "PERSIST_RETRY_EXCEPTION" /* Unhandled exception retrying MojoDB writes */
+#define MSGID_PERSIST_RETRY_ERR_UNKNOWN     "PERSIST_RETRY_ERR_UNKNOWN" /* Unhandled exception of unknown type retrying MojoDB writes */
+/** MojoSharedSubscription.cpp */
+#define MSGID_SHARED_SUBSCRIPTION_EXCEPTION "SHARED_SUBSCRIPTION_EXCEPTION" /* Unhandled exception replaying a shared subscription response */
+#define MSGID_SHARED_SUBSCRIPTION_ERR_UNKNOWN "SHARED_SUBSCRIPTION_ERR_UNKNOWN" /* Unhandled exception of unknown type replaying a shared subscription response */
+/** LogPersistProxy.cpp */
+#define MSGID_PERSIST_LOG_OPEN_FAIL         "PERSIST_LOG_OPEN_FAIL" /* Activity log could not be opened or read */
+#define MSGID_PERSIST_LOG_INVALID           "PERSIST_LOG_INVALID" /* Activity log or one of its records failed validation */
+#define MSGID_PERSIST_LOG_TRUNCATED         "PERSIST_LOG_TRUNCATED" /* Incomplete records discarded from the end of the Activity log */
+#define MSGID_PERSIST_LOG_WRITE_FAIL        "PERSIST_LOG_WRITE_FAIL" /* Record could not be appended to the Activity log */
+#define MSGID_PERSIST_LOG_SYNC_FAIL         "PERSIST_LOG_SYNC_FAIL" /* Activity log could not be synced */
+#define MSGID_PERSIST_LOG_COMPACT_FAIL      "PERSIST_LOG_COMPACT_FAIL" /* Activity log could not be compacted */
+#define MSGID_PERSIST_LOG_EXCEPTION         "PERSIST_LOG_EXCEPTION" /* Unhandled exception syncing or compacting Activity log */
+#define MSGID_PERSIST_LOG_ERR_UNKNOWN       "PERSIST_LOG_ERR_UNKNOWN" /* Unhandled exception of unknown type syncing or compacting Activity log */
 /** list of logkey ID's */
 
 
@@ -20,33 +20,64 @@
 #define __ACTIVITYMANAGER_MOJODBPERSISTCOMMAND_H__
 
 #include "MojoPersistCommand.h"
+#include "PersistProxy.h"
+
+#include <vector>
+
+#include "glib.h"
 
 class Activity;
+class MojoDBBatch;
+class MojoDBGroupCommit;
+class MojoDBRetryQueue;
 
+/*
+ * Writes the Activity with palm://com.palm.db/put, or, once the object
+ * last written under its token is known, with palm://com.palm.db/merge
+ * carrying only the properties that changed since.  If nothing changed,
+ * nothing is written.
+ */
 class MojoDBStoreCommand : public MojoPersistCommand
 {
 public:
 	MojoDBStoreCommand(MojService *service,
+		boost::shared_ptr<MojoDBRetryQueue> retry,
 		boost::shared_ptr<Activity> activity,
 		boost::shared_ptr<Completion> completion);
 	virtual ~MojoDBStoreCommand();
 
+	virtual void Persist();
+
+	virtual bool Supersedes(const PersistCommand& earlier) const;
+	virtual bool IsStore() const;
+
+	/* Full and partial writes, for single and batched stores */
+	static MojErr InfoToJson(MojObject& rep);
+
 protected:
 	virtual std::string GetMethod() const;
 
 	virtual void UpdateParams(MojObject& params);
 	virtual void PersistResponse(MojServiceMessage *msg,
 		const MojObject& response, MojErr err);
+
+	/* Full representation being written */
+	MojObject	m_rep;
 };
 
 class MojoDBDeleteCommand : public MojoPersistCommand
 {
 public:
 	MojoDBDeleteCommand(MojService *service,
+		boost::shared_ptr<MojoDBRetryQueue> retry,
 		boost::shared_ptr<Activity> activity,
 		boost::shared_ptr<Completion> completion);
 	virtual ~MojoDBDeleteCommand();
 
+	virtual void Persist();
+
+	virtual bool Supersedes(const PersistCommand& earlier) const;
+
 protected:
 	virtual std::string GetMethod() const;
 
@@ -55,4 +86,150 @@ protected:
 		const MojObject& response, MojErr err);
 };
 
+/*
+ * Member of a MojoDBBatch.  Persist() doesn't issue anything itself, it
+ * only tells the batch (or the group commit stage, which will place it in
+ * a batch) that this command has reached the head of its Activity's
+ * command chain.  The batch completes it from the shared response.
+ */
+class MojoDBBatchCommand : public PersistCommand
+{
+public:
+	MojoDBBatchCommand(boost::shared_ptr<MojoDBBatch> batch,
+		boost::shared_ptr<Activity> activity,
+		boost::shared_ptr<Completion> completion);
+	MojoDBBatchCommand(boost::shared_ptr<MojoDBGroupCommit> group,
+		PersistProxy::CommandType type,
+		boost::shared_ptr<Activity> activity,
+		boost::shared_ptr<Completion> completion);
+	virtual ~MojoDBBatchCommand();
+
+	virtual void Persist();
+
+	virtual bool Supersedes(const PersistCommand& earlier) const;
+	virtual bool IsStore() const;
+
+	PersistProxy::CommandType GetType() const;
+
+protected:
+	friend class MojoDBBatch;
+
+	virtual std::string GetMethod() const;
+
+	boost::shared_ptr<MojoDBBatch>		m_batch;
+	boost::weak_ptr<MojoDBGroupCommit>	m_group;
+
+	/* Batch the group commit stage placed this command in.  Nothing else
+	 * holds it while its call is outstanding. */
+	boost::shared_ptr<MojoDBBatch>		m_groupBatch;
+
+	PersistProxy::CommandType	m_type;
+};
+
+/*
+ * Stores or deletes a set of Activities with a single palm://com.palm.db/put
+ * or palm://com.palm.db/del call.  The call is made once every member has
+ * been reached in its own Activity's command chain, so ordering against
+ * other commands on the same Activity is preserved.
+ */
+class MojoDBBatch : public boost::enable_shared_from_this<MojoDBBatch>
+{
+public:
+	MojoDBBatch(MojService *service, boost::shared_ptr<MojoDBRetryQueue> retry,
+		PersistProxy::CommandType type);
+	~MojoDBBatch();
+
+	void AddCommand(boost::shared_ptr<MojoDBBatchCommand> command);
+	void CommandReady();
+
+	/* Every member is already at the head of its chain */
+	void IssueAll();
+
+protected:
+	typedef std::vector<boost::shared_ptr<MojoDBBatchCommand> > CommandVec;
+
+	void Issue();
+
+	bool AddObject(boost::shared_ptr<Activity> activity, MojObject& objects,
+		MojObject& changes);
+	void UpdateToken(boost::shared_ptr<Activity> activity,
+		const MojObject& result);
+
+	void BatchResponse(MojServiceMessage *msg, const MojObject& response,
+		MojErr err);
+
+	void CompleteAll(bool success);
+	void ClearStored(boost::shared_ptr<Activity> activity);
+
+	MojService					*m_service;
+	PersistProxy::CommandType	m_type;
+
+	/* All members, and those actually included in the call */
+	CommandVec	m_commands;
+	CommandVec	m_issued;
+
+	size_t		m_ready;
+
+	/* Full representations of the stored Activities, in issued order.  The
+	 * batch is issued as a merge if every one of them could be. */
+	std::vector<MojObject>	m_reps;
+	bool					m_merge;
+
+	boost::shared_ptr<MojoCall>	m_call;
+
+	boost::shared_ptr<MojoDBRetryQueue>	m_retry;
+	unsigned							m_attempts;
+};
+
+/*
+ * Write-behind stage for single Activity stores and deletes.  Commands that
+ * reach the head of their Activity's chain are held for up to the commit
+ * window, then issued together as one MojoDBBatch per command type.  Reaching
+ * the object limit flushes early.
+ *
+ * A command is only ready while it is at the head of its chain, so an
+ * Activity is never pending more than once.
+ */
+class MojoDBGroupCommit
+{
+public:
+	MojoDBGroupCommit(MojService *service,
+		boost::shared_ptr<MojoDBRetryQueue> retry, unsigned windowMs,
+		unsigned maxObjects);
+	~MojoDBGroupCommit();
+
+	void CommandReady(boost::shared_ptr<MojoDBBatchCommand> command);
+	void Flush();
+
+	void SetWindow(unsigned windowMs, unsigned maxObjects);
+	unsigned GetWindowMs() const;
+	unsigned GetMaxObjects() const;
+
+	MojErr InfoToJson(MojObject& rep) const;
+
+protected:
+	typedef std::vector<boost::shared_ptr<MojoDBBatchCommand> > CommandVec;
+
+	void Flush(PersistProxy::CommandType type);
+	void CancelWindow();
+
+	static gboolean StaticWindowTimeout(gpointer data);
+
+	MojService	*m_service;
+
+	boost::shared_ptr<MojoDBRetryQueue>	m_retry;
+
+	unsigned	m_windowMs;
+	unsigned	m_maxObjects;
+
+	/* Pending stores and deletes */
+	CommandVec	m_pending[2];
+
+	GSource		*m_window;
+
+	/* Commands passed through, and batches issued for them */
+	unsigned long long	m_commands;
+	unsigned long long	m_batches;
+};
+
 #endif /* __ACTIVITYMANAGER_MOJODBPERSISTCOMMAND_H__ */
@@ -42,12 +42,26 @@ public:
 
 	MojErr ToJson(MojObject& rep) const;
 
+	/* The Activity representation last written to MojoDB under this
+	 * token, which later writes can be expressed as changes against. */
+	void SetStored(const MojObject& rep);
+	void ClearStored();
+
+	/* Fill in the top level properties of "rep" that differ from the
+	 * stored representation.  Returns false if the stored representation
+	 * isn't known, or if "rep" lacks a property it has - a merge can't
+	 * remove properties, so the whole object has to be put. */
+	bool GetChanges(const MojObject& rep, MojObject& changes) const;
+
 	std::string GetString() const;
 
 protected:
 	bool		m_valid;
 	MojString	m_id;
 	MojInt64	m_rev;
+
+	bool		m_storedValid;
+	MojObject	m_stored;
 };
 
 #endif /* __ACTIVITYMANAGER_MOJODBPERSISTTOKEN_H__ */
@@ -22,14 +22,22 @@
 #include "PersistProxy.h"
 
 #include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glib.h"
 
 class Activity;
 class ActivityManager;
+class ActivitySnapshotWriter;
 class ActivityManagerApp;
 class Completion;
 class MojoJsonConverter;
 class MojoCall;
 class MojoDBPersistToken;
+class MojoDBGroupCommit;
+class MojoDBRetryQueue;
 
 class MojoDBProxy : public PersistProxy
 {
@@ -46,27 +54,89 @@ public:
 		boost::shared_ptr<Activity> activity,
 		boost::shared_ptr<Completion> completion);
 
+	virtual void PrepareBatchCommands(CommandType type,
+		const ActivityVec& activities, const CompletionVec& completions,
+		CommandVec& commands);
+
 	virtual boost::shared_ptr<PersistToken> CreateToken();
 
 	virtual void LoadActivities();
 
+	virtual MojErr InfoToJson(MojObject& rep) const;
+
+	/* Single Activity stores and deletes are held for up to windowMs
+	 * milliseconds (or until maxObjects are waiting), and issued together.
+	 * A window of 0 issues each command on its own. */
+	void SetGroupCommit(unsigned windowMs, unsigned maxObjects);
+
 	static const char *ActivityKind;
 
+	/* Local snapshot of the persisted Activities, so the service can
+	 * come online before the MojoDB load has finished */
+	static const char *SnapshotDirectory;
+	static const char *SnapshotPath;
+
+	/* Delay between a persisted change and rewriting the snapshot */
+	static const unsigned SnapshotDelaySeconds = 30;
+
+	/* Stale Activity objects left in MojoDB are deleted in the background
+	 * once the load completes, one batch per interval, at low priority */
+	static const unsigned PurgeIntervalMs = 250;
+
+	static const unsigned DefaultGroupCommitWindowMs = 10;
+	static const unsigned DefaultGroupCommitMaxObjects = 64;
+
 protected:
+	void RequestLoadPage(const MojString& page);
 	void ActivityLoadResults(MojServiceMessage *msg, const MojObject& response,
 		MojErr err);
+	unsigned LoadPage(const MojObject& results);
+	boost::shared_ptr<Activity> LoadActivity(const MojObject& rep,
+		boost::shared_ptr<MojoDBPersistToken> pt, bool fromSnapshot);
+	void QueueOldToken(boost::shared_ptr<MojoDBPersistToken> pt,
+		bool fromSnapshot);
 	void ActivityPurgeComplete(MojServiceMessage *msg,
 		const MojObject& response, MojErr err);
 	void ActivityConfiguratorComplete(MojServiceMessage *msg,
 		const MojObject& response, MojErr err);
 
+	/* Stale Activities deleted per purge call */
 	static const int PurgeBatchSize;
 
 	void PreparePurgeCall();
 	void PrepareConfiguratorCall();
 
+	void SchedulePurge();
+	void PurgeBatch();
+
+	static gboolean StaticPurgeTimeout(gpointer data);
+
 	void PopulatePurgeIds(MojObject& ids);
 
+	/* Activities brought in from the snapshot, by MojoDB _id, until the
+	 * MojoDB load confirms them (or cancels and replaces them) */
+	struct SnapshotEntry {
+		boost::weak_ptr<Activity>			m_activity;
+		boost::weak_ptr<MojoDBPersistToken>	m_token;
+		MojInt64							m_rev;
+	};
+
+	typedef std::map<std::string, SnapshotEntry> SnapshotMap;
+
+	bool LoadSnapshot();
+	bool IsSnapshotCurrent(const MojString& id, MojInt64 rev,
+		const MojObject& rep);
+	void CancelSnapshotActivity(const SnapshotEntry& entry, bool replaced);
+	void CancelStaleSnapshot();
+
+	void WriteSnapshot();
+	void ScheduleSnapshot();
+	void SnapshotCommitted();
+
+	static gboolean StaticSnapshotTimeout(gpointer data);
+	static gpointer StaticSnapshotCommit(gpointer data);
+	static gboolean StaticSnapshotCommitted(gpointer data);
+
 	ActivityManagerApp	*m_app;
 	MojService			*m_service;
 
@@ -74,9 +144,65 @@ protected:
 	boost::shared_ptr<MojoJsonConverter>	m_json;
 
 	/* Callout for loading content from MojoDB in through the Proxy,
-	 * and later deleting bad data. */
+	 * and then running the configurator. */
 	boost::shared_ptr<MojoCall>	m_call;
 
+	/* Backoff and circuit breaker for writes failing transiently */
+	boost::shared_ptr<MojoDBRetryQueue>	m_retry;
+
+	/* Write-behind stage for single Activity stores and deletes */
+	boost::shared_ptr<MojoDBGroupCommit>	m_groupCommit;
+
+	/* Callout deleting the current batch of stale Activities.  Separate
+	 * from the load, which doesn't wait for the purge to finish. */
+	boost::shared_ptr<MojoCall>	m_purgeCall;
+	GSource						*m_purgeSource;
+
+	unsigned			m_purgeBatch;
+	unsigned long long	m_purged;
+	unsigned long long	m_purgeFailed;
+	unsigned long long	m_purgeBatches;
+	unsigned long long	m_purgeRetries;
+	unsigned long long	m_purgeStart;
+	unsigned long long	m_purgeTime;
+
+	/* Startup load timing.  Each page's latency runs from its request to
+	 * its response, which overlaps with decoding the previous page. */
+	struct LoadPageStats {
+		LoadPageStats() : m_activities(0), m_latency(0), m_decode(0) {}
+
+		unsigned			m_activities;
+		unsigned long long	m_latency;
+		unsigned long long	m_decode;
+	};
+
+	typedef std::vector<LoadPageStats> LoadPageVec;
+
+	unsigned long long	m_loadStart;
+	unsigned long long	m_loadPageRequested;
+	unsigned long long	m_loadTime;
+	LoadPageVec			m_loadPages;
+
+	bool		m_readySent;
+
+	SnapshotMap	m_snapshotActivities;
+	GSource		*m_snapshotSource;
+
+	/* Snapshot being written out by m_snapshotThread, and the idle source
+	 * the thread attaches to report back on the main loop.  The main loop
+	 * doesn't touch the writer again until it has joined the thread.  A
+	 * write requested in the meantime is rescheduled once it's done. */
+	boost::shared_ptr<ActivitySnapshotWriter>	m_snapshotWriter;
+	GThread		*m_snapshotThread;
+	GSource		*m_snapshotCommittedSource;
+	bool		m_snapshotRewrite;
+
+	unsigned			m_snapshotLoaded;
+	unsigned			m_snapshotConfirmed;
+	unsigned			m_snapshotRemoved;
+	unsigned long long	m_snapshotLoadTime;
+	unsigned long long	m_snapshotsWritten;
+
 	/* Track old Activities that should be purged */
 	typedef std::list<boost::shared_ptr<MojoDBPersistToken> > TokenQueue;
 	TokenQueue	m_oldTokens;
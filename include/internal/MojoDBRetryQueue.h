@@ -0,0 +1,134 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_MOJODBRETRYQUEUE_H__
+#define __ACTIVITYMANAGER_MOJODBRETRYQUEUE_H__
+
+#include "Base.h"
+
+#include <list>
+#include <map>
+
+#include "glib.h"
+
+class MojoCall;
+
+/*
+ * Paces MojoDB writes that fail with a transient error.  Rather than being
+ * re-issued straight from the error response, each retry waits out an
+ * exponentially increasing delay (with jitter, so writes that failed
+ * together don't retry together), up to MaxDelayMs.
+ *
+ * BreakerThreshold consecutive transient failures, across all writes, open
+ * a circuit breaker.  While it is open, new writes and retries that come due
+ * are held.  After a cooldown one held write is let through as a probe: any
+ * response other than a transient failure closes the breaker and releases
+ * everything held, another transient failure reopens it with twice the
+ * cooldown.
+ *
+ * Calls are tracked by weak reference; their commands own them.
+ */
+class MojoDBRetryQueue
+{
+public:
+	MojoDBRetryQueue();
+	~MojoDBRetryQueue();
+
+	/* Make a write's first attempt, unless the breaker is holding writes */
+	void Issue(boost::shared_ptr<MojoCall> call);
+
+	/* Record a write's response.  Anything other than a transient failure
+	 * shows MojoDB is responding, and closes the breaker. */
+	void Responded(bool succeeded);
+
+	/* Record a transient failure, and schedule attempt number 'attempt'
+	 * (the first retry being 1) */
+	void Retry(boost::shared_ptr<MojoCall> call, unsigned attempt);
+
+	/* Writes not going through the queue should wait while this is set */
+	bool IsPaused() const;
+
+	MojErr InfoToJson(MojObject& rep) const;
+
+	static const unsigned BaseDelayMs = 100;
+	static const unsigned MaxDelayMs = 30000;
+
+	static const unsigned BreakerThreshold = 5;
+	static const unsigned BreakerCooldownMs = 1000;
+	static const unsigned MaxBreakerCooldownMs = 60000;
+
+private:
+	/* DISALLOW */
+	MojoDBRetryQueue(const MojoDBRetryQueue& copy);
+	MojoDBRetryQueue& operator=(const MojoDBRetryQueue& copy);
+
+	enum BreakerState { BreakerClosed, BreakerOpen, BreakerHalfOpen };
+
+	struct Entry {
+		Entry(boost::weak_ptr<MojoCall> call, unsigned attempt)
+			: m_call(call), m_attempt(attempt) {}
+
+		boost::weak_ptr<MojoCall>	m_call;
+		unsigned					m_attempt;
+	};
+
+	typedef std::multimap<unsigned long long, Entry> RetryMap;
+	typedef std::list<Entry> EntryList;
+
+	bool Hold(const Entry& entry);
+	void Schedule(const Entry& entry);
+	void Dispatch(const Entry& entry);
+
+	void OpenBreaker();
+	void CloseBreaker();
+
+	void ProcessTimeout();
+	void Arm();
+	void CancelTimer();
+
+	static gboolean StaticTimeout(gpointer data);
+
+	static const char *BreakerStateToString(BreakerState state);
+
+	/* Retries waiting out their delay, by due time */
+	RetryMap	m_retries;
+
+	/* Writes held by the breaker, in the order they were held */
+	EntryList	m_held;
+
+	GSource				*m_timer;
+	unsigned long long	m_timerDue;
+
+	BreakerState		m_state;
+	unsigned			m_consecutiveFailures;
+	unsigned			m_cooldownMs;
+	unsigned long long	m_cooldownEnd;
+	bool				m_probing;
+
+	/* Counters */
+	unsigned long long	m_issued;
+	unsigned long long	m_queued;
+	unsigned long long	m_retried;
+	unsigned long long	m_transientFailures;
+	unsigned long long	m_failed;
+	unsigned long long	m_breakerOpens;
+	unsigned			m_maxAttempt;
+};
+
+#endif /* __ACTIVITYMANAGER_MOJODBRETRYQUEUE_H__ */
@@ -0,0 +1,59 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_MOJODEFERREDSPEC_H__
+#define __ACTIVITYMANAGER_MOJODEFERREDSPEC_H__
+
+#include "Base.h"
+#include "DeferredSpec.h"
+
+#include <core/MojObject.h>
+
+class MojoJsonConverter;
+
+/*
+ * Trigger, callback, and requirements of a loaded Activity, as the JSON
+ * they were loaded from.  They are built by the JSON converter when the
+ * Activity is materialized.  The converter lives as long as the service.
+ */
+class MojoDeferredSpec : public DeferredSpec
+{
+public:
+	MojoDeferredSpec(MojoJsonConverter *json, const MojObject& spec);
+	virtual ~MojoDeferredSpec();
+
+	virtual unsigned GetParts() const;
+
+	virtual void Materialize(boost::shared_ptr<Activity> activity,
+		unsigned parts);
+
+	virtual MojErr ToJson(MojObject& rep, unsigned flags) const;
+
+	/* True if the spec has any of the properties that can be deferred */
+	static bool HasDeferredProperties(const MojObject& spec);
+
+protected:
+	static const char	*s_properties[];
+	static const unsigned	s_parts[];
+
+	MojoJsonConverter	*m_json;
+	MojObject			m_spec;
+};
+
+#endif /* __ACTIVITYMANAGER_MOJODEFERREDSPEC_H__ */
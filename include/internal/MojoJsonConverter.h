@@ -64,6 +64,11 @@ public:
 	boost::shared_ptr<Schedule> CreateSchedule(
 		boost::shared_ptr<Activity> activity, const MojObject& spec);
 
+	/* Build the requirements, trigger, and callback in spec into the
+	 * Activity.  Loaded Activities defer this until they are scheduled. */
+	void BuildDeferredProperties(boost::shared_ptr<Activity> activity,
+		const MojObject& spec);
+
 	static BusId ProcessBusId(const MojObject& spec);
 
 protected:
@@ -25,16 +25,19 @@
 #include <core/MojService.h>
 
 class MojoCall;
+class MojoDBRetryQueue;
 class Completion;
 class Activity;
 
 class MojoPersistCommand : public PersistCommand
 {
 public:
-	MojoPersistCommand(MojService *service, const MojoURL& method,
+	MojoPersistCommand(MojService *service,
+		boost::shared_ptr<MojoDBRetryQueue> retry, const MojoURL& method,
 		boost::shared_ptr<Activity> activity,
 		boost::shared_ptr<Completion> completion);
-	MojoPersistCommand(MojService *service, const MojoURL& method,
+	MojoPersistCommand(MojService *service,
+		boost::shared_ptr<MojoDBRetryQueue> retry, const MojoURL& method,
 		const MojObject& params, boost::shared_ptr<Activity> activity,
 		boost::shared_ptr<Completion> completion);
 	virtual ~MojoPersistCommand();
@@ -48,11 +51,20 @@ protected:
 	virtual void PersistResponse(MojServiceMessage *msg,
 		const MojObject& response, MojErr err);
 
+	/* Fail the command from its response.  Unless the response was a
+	 * transient error, MojoDB answered, which the retry queue is told. */
+	void FailResponse(MojServiceMessage *msg, const MojObject& response,
+		MojErr err);
+
 	MojService	*m_service;
 	MojoURL		m_method;
 	MojObject	m_params;
 
 	boost::shared_ptr<MojoCall>		m_call;
+
+	/* Paces retries after transient failures */
+	boost::shared_ptr<MojoDBRetryQueue>	m_retry;
+	unsigned							m_attempts;
 };
 
 
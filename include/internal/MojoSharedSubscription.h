@@ -0,0 +1,122 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef __ACTIVITYMANAGER_MOJOSHAREDSUBSCRIPTION_H__
+#define __ACTIVITYMANAGER_MOJOSHAREDSUBSCRIPTION_H__
+
+#include "Base.h"
+#include "MojoURL.h"
+
+#include <list>
+#include <string>
+
+#include "glib.h"
+
+class MojoCall;
+class MojoTriggerManager;
+class MojoTriggerSubscription;
+
+/*
+ * A single upstream subscription, shared by every armed trigger subscribing
+ * to the same method with the same parameters on behalf of the same caller
+ * (so the call made is exactly the one each of them would have made).
+ * Responses are passed on to every attached trigger subscription.
+ *
+ * A subscription attaching after the first response has arrived didn't see
+ * the initial response its own call would have returned, so it is given
+ * that response instead, from an idle callback as if it had come off the
+ * bus.  Once a later response has arrived there's no telling whether it was
+ * a status or an event (a db8 watch firing, say), so it isn't replayed;
+ * the call is no longer joinable, and the trigger manager starts a new one
+ * for later subscriptions.  The upstream call is cancelled when the last
+ * subscription detaches, or dropped by the trigger manager (so later
+ * subscriptions start a call of their own) if it fails.
+ */
+class MojoSharedSubscription :
+	public boost::enable_shared_from_this<MojoSharedSubscription>
+{
+public:
+	MojoSharedSubscription(boost::shared_ptr<MojoTriggerManager> manager,
+		const std::string& key, MojService *service, const MojoURL& url,
+		const MojObject& params, bool usePublicBus,
+		const std::string& requester);
+	~MojoSharedSubscription();
+
+	void Attach(boost::shared_ptr<MojoTriggerSubscription> subscription);
+	void Detach(const MojoTriggerSubscription *subscription);
+
+	const std::string& GetKey() const;
+	size_t GetAttachedCount() const;
+
+	/* True until a response after the initial one has arrived */
+	bool IsJoinable() const;
+
+	/* Upstream calls made, and responses received, passed on to attached
+	 * subscriptions, and replayed to those attaching later */
+	static MojErr InfoToJson(MojObject& rep);
+
+protected:
+	/* DISALLOW */
+	MojoSharedSubscription(const MojoSharedSubscription& copy);
+	MojoSharedSubscription& operator=(const MojoSharedSubscription& copy);
+
+	typedef std::list<boost::weak_ptr<MojoTriggerSubscription> >
+		SubscriptionList;
+
+	void ProcessResponse(MojServiceMessage *msg, const MojObject& response,
+		MojErr err);
+
+	void Replay();
+	void CancelReplay();
+
+	static gboolean StaticReplay(gpointer data);
+
+	static bool Remove(SubscriptionList& subscriptions,
+		const MojoTriggerSubscription *subscription);
+	static bool Contains(const SubscriptionList& subscriptions,
+		const MojoTriggerSubscription *subscription);
+
+	boost::weak_ptr<MojoTriggerManager>	m_manager;
+	std::string							m_key;
+
+	MojService	*m_service;
+	MojoURL		m_url;
+	MojObject	m_params;
+	bool		m_usePublicBus;
+	std::string	m_requester;
+
+	boost::shared_ptr<MojoCall>	m_call;
+
+	SubscriptionList	m_subscriptions;
+
+	/* Initial response, and the subscriptions still waiting for it.  Once
+	 * another response follows, m_joinable is cleared. */
+	bool				m_responded;
+	bool				m_joinable;
+	MojObject			m_latest;
+	SubscriptionList	m_replays;
+	GSource				*m_replaySource;
+
+	static unsigned long long	s_calls;
+	static unsigned long long	s_responses;
+	static unsigned long long	s_deliveries;
+	static unsigned long long	s_replays;
+};
+
+#endif /* __ACTIVITYMANAGER_MOJOSHAREDSUBSCRIPTION_H__ */
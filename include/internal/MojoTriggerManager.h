@@ -21,12 +21,19 @@
 
 #include "Base.h"
 
+#include <map>
+#include <string>
+
 class Activity;
 class Trigger;
 class MojoMatcher;
 class MojoURL;
+class MojoSharedSubscription;
+class MojoTriggerSubscription;
 
-class MojoTriggerManager {
+class MojoTriggerManager :
+	public boost::enable_shared_from_this<MojoTriggerManager>
+{
 public:
 	MojoTriggerManager(MojService *service);
 	virtual ~MojoTriggerManager();
@@ -47,12 +54,36 @@ public:
 		boost::shared_ptr<Activity> activity, const MojoURL& url,
 		const MojObject& params, const MojObject& where);
 
+	/* Attach to the upstream subscription for the same method, parameters,
+	 * and caller, starting one if there isn't one already */
+	boost::shared_ptr<MojoSharedSubscription> AttachSubscription(
+		boost::shared_ptr<MojoTriggerSubscription> subscription,
+		const MojoURL& url, const MojObject& params,
+		boost::shared_ptr<const Activity> activity);
+	void RemoveSharedSubscription(const MojoSharedSubscription *shared);
+
+	MojErr InfoToJson(MojObject& rep) const;
+
 protected:
 	boost::shared_ptr<Trigger> CreateTrigger(
 		boost::shared_ptr<Activity> activity, const MojoURL& url,
 		const MojObject& params, boost::shared_ptr<MojoMatcher> matcher);
 
+	static std::string GetSubscriptionKey(const MojoURL& url,
+		const MojObject& params, bool usePublicBus,
+		const std::string& requester);
+
 	MojService	*m_service;
+
+	/* Upstream subscriptions, by method, canonical parameters, and caller */
+	typedef std::map<std::string, boost::weak_ptr<MojoSharedSubscription> >
+		SharedMap;
+
+	SharedMap	m_shared;
+
+	/* Subscriptions attached, and those that joined an existing call */
+	unsigned long long	m_attached;
+	unsigned long long	m_joined;
 };
 
 #endif /* __ACTIVITYMANAGER_TRIGGERMANAGER_H__ */
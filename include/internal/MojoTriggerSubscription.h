@@ -25,6 +25,8 @@
 class MojoTrigger;
 class MojoExclusiveTrigger;
 class MojoCall;
+class MojoSharedSubscription;
+class MojoTriggerManager;
 
 class MojoTriggerSubscription :
 	public boost::enable_shared_from_this<MojoTriggerSubscription>
@@ -42,6 +44,9 @@ public:
 
 	bool IsSubscribed() const;
 
+	/* Response from the shared upstream subscription */
+	void SharedResponse(const MojObject& response, MojErr err);
+
 	MojErr ToJson(MojObject& rep, unsigned flags) const;
 
 protected:
@@ -56,6 +61,9 @@ protected:
 
 	boost::shared_ptr<MojoCall>	m_call;
 
+	/* Set instead of the call while attached to a shared subscription */
+	boost::shared_ptr<MojoSharedSubscription>	m_shared;
+
 	static MojLogger	s_log;
 };
 
@@ -63,11 +71,14 @@ class MojoExclusiveTriggerSubscription : public MojoTriggerSubscription
 {
 public:
 	MojoExclusiveTriggerSubscription(boost::shared_ptr<MojoExclusiveTrigger>
-		trigger, MojService *service, const MojoURL& url,
-		const MojObject& params);
+		trigger, boost::shared_ptr<MojoTriggerManager> manager,
+		MojService *service, const MojoURL& url, const MojObject& params);
 	virtual ~MojoExclusiveTriggerSubscription();
 
 	virtual void Subscribe();
+
+protected:
+	boost::weak_ptr<MojoTriggerManager>	m_manager;
 };
 
 #endif /* __ACTIVITYMANAGER_MOJOTRIGGERSUBSCRIPTION_H__ */
@@ -22,12 +22,18 @@
 #include "Base.h"
 #include "MojoMatcher.h"
 
+#include <vector>
+
 /*
  * "where" : [{
  *     "prop" : <property name> | [{ <property name>, ... }]
  *     "op" : "<" | "<=" | "=" | ">=" | ">" | "!="
  *     "val" : <comparison value>
  * }]
+ *
+ * Once validated, the clauses are compiled into a flat program of nodes,
+ * with property paths, operations, and comparison values already extracted,
+ * so matching a response doesn't have to pick the clauses apart again.
  */
 class MojoNewWhereMatcher : public MojoMatcher
 {
@@ -37,6 +43,11 @@ public:
 
 	virtual bool Match(const MojObject& response);
 
+	/* Evaluates the clauses by walking their JSON, as Match did before they
+	 * were compiled.  Kept so test/where can check and time the compiled
+	 * program against it. */
+	bool MatchInterpreted(const MojObject& response) const;
+
 	virtual MojErr ToJson(MojObject& rep, unsigned long flags) const;
 
 protected:
@@ -72,7 +83,45 @@ protected:
 	MatchResult CheckMatch(const MojObject& rhs, const MojObject& op,
 		const MojObject& val) const;
 
+	enum CompareOp { LessOp, LessEqualOp, EqualOp, NotEqualOp, GreaterEqualOp,
+		GreaterOp, WhereOp };
+
+	/* A list of clauses (combined according to the mode), or a comparison
+	 * of the property at a key path against a value.  Children, keys, and
+	 * values are ranges of, or indexes into, the program's shared vectors. */
+	struct Node {
+		bool		m_compare;
+		MatchMode	m_mode;
+
+		unsigned	m_first;
+		unsigned	m_count;
+
+		/* Comparisons only.  A single property name is looked up directly,
+		 * a path descends through any arrays it meets. */
+		bool		m_path;
+		CompareOp	m_op;
+		unsigned	m_value;
+		unsigned	m_where;
+	};
+
+	unsigned Compile(const MojObject& clause, MatchMode mode);
+	unsigned CompileComparison(const MojObject& clause, MatchMode mode);
+	static CompareOp CompileOp(const MojObject& op);
+
+	MatchResult Evaluate(unsigned node, const MojObject& response) const;
+	MatchResult EvaluatePath(const Node& node, unsigned key,
+		const MojObject& response) const;
+	MatchResult EvaluateComparison(const Node& node,
+		const MojObject& rhs) const;
+
 	MojObject	m_where;
+
+	/* Compiled program, starting at m_root */
+	std::vector<Node>		m_nodes;
+	std::vector<unsigned>	m_children;
+	std::vector<MojString>	m_keys;
+	std::vector<MojObject>	m_values;
+	unsigned				m_root;
 };
 
 #endif /* __ACTIVITYMANAGER_MOJOWHEREMATCHER_H__ */
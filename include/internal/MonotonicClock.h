@@ -0,0 +1,29 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __ACTIVITYMANAGER_MONOTONICCLOCK_H__
+#define __ACTIVITYMANAGER_MONOTONICCLOCK_H__
+
+/*
+ * Readings of CLOCK_MONOTONIC, for measuring intervals and deadlines that
+ * must not move when the wall clock is set.
+ */
+unsigned long long GetMonotonicMicroseconds();
+unsigned long long GetMonotonicNanoseconds();
+
+#endif /* __ACTIVITYMANAGER_MONOTONICCLOCK_H__ */
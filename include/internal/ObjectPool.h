@@ -0,0 +1,160 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __ACTIVITYMANAGER_OBJECTPOOL_H__
+#define __ACTIVITYMANAGER_OBJECTPOOL_H__
+
+#include "Base.h"
+
+#include <stddef.h>
+#include <new>
+
+/*
+ * Fixed size block pool, carved from slabs of SlabBlocks blocks.  Freed
+ * blocks go on a free list and are handed back out before a new slab is
+ * allocated, so a steady create/release cycle of Activities (and the
+ * objects hanging off them) stops hitting the heap once the pools have
+ * grown to the working set.  Slabs are retained for the life of the
+ * process.
+ *
+ * There is one pool per allocated type.  All pools are linked together so
+ * their counters can be reported by the Activity Manager's "info" method.
+ */
+class ObjectPool
+{
+public:
+	ObjectPool(const char *name, size_t objectSize);
+
+	void *Allocate();
+	void Free(void *block);
+
+	template<class T>
+	static ObjectPool& Get(const char *name)
+	{
+		/* Never destroyed, objects may be released during static
+		 * destruction. */
+		static ObjectPool *pool = new ObjectPool(name, sizeof(T));
+		return *pool;
+	}
+
+	/* Counters, summed across all pools */
+	static MojErr InfoToJson(MojObject& rep);
+
+	static const unsigned SlabBlocks = 32;
+
+private:
+	/* DISALLOW */
+	ObjectPool(const ObjectPool& copy);
+	ObjectPool& operator=(const ObjectPool& copy);
+
+	void AllocateSlab();
+
+	MojErr ToJson(MojObject& rep) const;
+
+	struct FreeBlock {
+		FreeBlock	*m_next;
+	};
+
+	const char	*m_name;
+	size_t		m_objectSize;
+	size_t		m_blockSize;
+
+	FreeBlock	*m_freeList;
+
+	/* Objects handed out, and returned */
+	unsigned long long	m_allocations;
+	unsigned long long	m_frees;
+
+	/* Slabs allocated from the heap */
+	unsigned	m_slabs;
+
+	ObjectPool	*m_nextPool;
+
+	static ObjectPool	*s_pools;
+};
+
+/*
+ * Allocator for use with boost::allocate_shared, so the object and its
+ * shared count come from a per-type pool in a single block:
+ *
+ *   boost::allocate_shared<Foo>(POOL_ALLOCATOR(Foo), args...)
+ *
+ * The name is carried through rebinding, and labels the pool in "info".
+ */
+template<class T>
+class PoolAllocator
+{
+public:
+	typedef T			value_type;
+	typedef T*			pointer;
+	typedef const T*	const_pointer;
+	typedef T&			reference;
+	typedef const T&	const_reference;
+	typedef size_t		size_type;
+	typedef ptrdiff_t	difference_type;
+
+	template<class U>
+	struct rebind {
+		typedef PoolAllocator<U> other;
+	};
+
+	explicit PoolAllocator(const char *name) : m_name(name) {}
+
+	template<class U>
+	PoolAllocator(const PoolAllocator<U>& rhs) : m_name(rhs.GetName()) {}
+
+	pointer allocate(size_type n, const void *hint = 0)
+	{
+		if (n == 1) {
+			return static_cast<pointer>(ObjectPool::Get<T>(m_name).Allocate());
+		} else {
+			return static_cast<pointer>(::operator new(n * sizeof(T)));
+		}
+	}
+
+	void deallocate(pointer p, size_type n)
+	{
+		if (n == 1) {
+			ObjectPool::Get<T>(m_name).Free(p);
+		} else {
+			::operator delete(p);
+		}
+	}
+
+	void construct(pointer p, const T& val) { new (p) T(val); }
+	void destroy(pointer p) { p->~T(); }
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+
+	size_type max_size() const { return ((size_type)-1) / sizeof(T); }
+
+	const char *GetName() const { return m_name; }
+
+	template<class U>
+	bool operator==(const PoolAllocator<U>&) const { return true; }
+	template<class U>
+	bool operator!=(const PoolAllocator<U>&) const { return false; }
+
+private:
+	const char	*m_name;
+};
+
+#define POOL_ALLOCATOR(T) PoolAllocator<T>(#T)
+
+#endif /* __ACTIVITYMANAGER_OBJECTPOOL_H__ */
@@ -0,0 +1,248 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2009-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __ACTIVITYMANAGER_OPENHASHINDEX_H__
+#define __ACTIVITYMANAGER_OPENHASHINDEX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Hash helpers.  Hashes are computed once (when the key is set) and cached
+ * by the owner, so the index itself never has to touch the key to probe.
+ */
+inline size_t HashActivityId(unsigned long long id)
+{
+	/* 64-bit finalizer (splitmix64), so sequential IDs scatter */
+	uint64_t x = id;
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return (size_t)x;
+}
+
+inline size_t HashString(const char *str, size_t len)
+{
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return (size_t)hash;
+}
+
+inline size_t HashString(const std::string& str)
+{
+	return HashString(str.data(), str.size());
+}
+
+inline size_t HashCombine(size_t seed, size_t hash)
+{
+	return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+/*
+ * Open-addressed (linear probing) hash index.
+ *
+ * The index stores a precomputed hash alongside each value, and lookups
+ * are resolved by a caller supplied predicate, which is only invoked for
+ * slots whose stored hash matches.  Keys may therefore be hashed on a
+ * subset of their fields (ie. just the name of a name/creator pair), and
+ * multiple values may share a hash.  Duplicate detection is the caller's
+ * responsibility.
+ *
+ * The table is kept at most half full (live entries plus tombstones), so
+ * a probe always terminates at an empty slot.
+ */
+template<class Value>
+class OpenHashIndex
+{
+public:
+	OpenHashIndex(size_t initialCapacity = MinCapacity)
+		: m_size(0)
+		, m_used(0)
+	{
+		size_t capacity = MinCapacity;
+		while (capacity < initialCapacity) {
+			capacity <<= 1;
+		}
+
+		m_slots.resize(capacity);
+	}
+
+	size_t Size() const { return m_size; }
+	bool Empty() const { return m_size == 0; }
+	size_t Capacity() const { return m_slots.size(); }
+
+	void Insert(size_t hash, const Value& value)
+	{
+		if (((m_used + 1) * 2) > m_slots.size()) {
+			/* If most of the used slots are tombstones, rehashing at the
+			 * same size is enough to make room. */
+			if (((m_size + 1) * 4) > m_slots.size()) {
+				Rehash(m_slots.size() * 2);
+			} else {
+				Rehash(m_slots.size());
+			}
+		}
+
+		size_t mask = m_slots.size() - 1;
+		for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+			Slot& slot = m_slots[i];
+			if (slot.m_state != SlotFull) {
+				if (slot.m_state == SlotEmpty) {
+					m_used++;
+				}
+
+				slot.m_hash = hash;
+				slot.m_value = value;
+				slot.m_state = SlotFull;
+				m_size++;
+				return;
+			}
+		}
+	}
+
+	template<class Pred>
+	Value *Find(size_t hash, Pred pred)
+	{
+		size_t index = Probe(hash, pred);
+		return (index == NotFound) ? NULL : &m_slots[index].m_value;
+	}
+
+	template<class Pred>
+	const Value *Find(size_t hash, Pred pred) const
+	{
+		size_t index = Probe(hash, pred);
+		return (index == NotFound) ? NULL : &m_slots[index].m_value;
+	}
+
+	template<class Pred>
+	bool Erase(size_t hash, Pred pred)
+	{
+		size_t index = Probe(hash, pred);
+		if (index == NotFound) {
+			return false;
+		}
+
+		Slot& slot = m_slots[index];
+		slot.m_value = Value();
+		m_size--;
+
+		/* If the probe chain ends right after this slot, nothing can be
+		 * relying on it to continue a probe, so it can be emptied rather
+		 * than left as a tombstone. */
+		if (m_slots[(index + 1) & (m_slots.size() - 1)].m_state ==
+			SlotEmpty) {
+			slot.m_state = SlotEmpty;
+			m_used--;
+		} else {
+			slot.m_state = SlotDeleted;
+		}
+
+		return true;
+	}
+
+	template<class Func>
+	void ForEach(Func func) const
+	{
+		for (typename SlotVec::const_iterator iter = m_slots.begin();
+			iter != m_slots.end(); ++iter) {
+			if (iter->m_state == SlotFull) {
+				func(iter->m_value);
+			}
+		}
+	}
+
+	void Clear()
+	{
+		SlotVec slots(MinCapacity);
+		m_slots.swap(slots);
+		m_size = 0;
+		m_used = 0;
+	}
+
+	static const size_t MinCapacity = 16;
+
+protected:
+	enum SlotState { SlotEmpty, SlotFull, SlotDeleted };
+
+	struct Slot {
+		Slot() : m_hash(0), m_state(SlotEmpty) {}
+
+		size_t			m_hash;
+		Value			m_value;
+		unsigned char	m_state;
+	};
+
+	typedef std::vector<Slot> SlotVec;
+
+	static const size_t NotFound = (size_t)-1;
+
+	template<class Pred>
+	size_t Probe(size_t hash, Pred pred) const
+	{
+		size_t mask = m_slots.size() - 1;
+		for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+			const Slot& slot = m_slots[i];
+			if (slot.m_state == SlotEmpty) {
+				return NotFound;
+			} else if ((slot.m_state == SlotFull) && (slot.m_hash == hash) &&
+				pred(slot.m_value)) {
+				return i;
+			}
+		}
+	}
+
+	void Rehash(size_t capacity)
+	{
+		SlotVec old(capacity);
+		m_slots.swap(old);
+
+		size_t mask = m_slots.size() - 1;
+		for (typename SlotVec::iterator iter = old.begin();
+			iter != old.end(); ++iter) {
+			if (iter->m_state != SlotFull) {
+				continue;
+			}
+
+			size_t i = iter->m_hash & mask;
+			while (m_slots[i].m_state == SlotFull) {
+				i = (i + 1) & mask;
+			}
+
+			m_slots[i].m_hash = iter->m_hash;
+			m_slots[i].m_value = iter->m_value;
+			m_slots[i].m_state = SlotFull;
+		}
+
+		m_used = m_size;
+	}
+
+	SlotVec	m_slots;
+	size_t	m_size;
+	size_t	m_used;
+};
+
+#endif /* __ACTIVITYMANAGER_OPENHASHINDEX_H__ */
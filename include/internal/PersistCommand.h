@@ -21,6 +21,8 @@
 
 #include "Base.h"
 
+#include <list>
+
 class Completion;
 class Activity;
 
@@ -40,6 +42,13 @@ class Activity;
  *
  * Failure of a command is considered a serious error, and will result in
  * inconsistent state.
+ *
+ * A command appended directly behind a command for the same Activity that
+ * it supersedes (ie. a Store followed by another Store or a Delete) takes
+ * that command's place in the chain, provided it hasn't been issued yet.
+ * The superseded command is dropped without writing anything, and its
+ * completion runs, with the result of the later command, just before the
+ * later command's own.
  */
 class PersistCommand : public boost::enable_shared_from_this<PersistCommand>
 {
@@ -55,6 +64,20 @@ public:
 
 	void Append(boost::shared_ptr<PersistCommand> command);
 
+	/* Last command in the chain this command is on.  Commands with the
+	 * same tail are on the same chain. */
+	boost::shared_ptr<PersistCommand> GetTail();
+
+	/* True if this command, once issued, leaves nothing for an earlier
+	 * command for the same Activity to do.  Store commands write the
+	 * Activity's state at the time they are issued, so a later Store or
+	 * Delete supersedes them. */
+	virtual bool Supersedes(const PersistCommand& earlier) const;
+	virtual bool IsStore() const;
+
+	/* Counters for the writes saved by dropping superseded commands */
+	static MojErr InfoToJson(MojObject& rep);
+
 	/* Subclass should override this to issue the persistence operation.
 	 * The PeristToken of the Activity should be retrieved at the point the
 	 * command is issued (as opposed to when the command was created) because
@@ -69,12 +92,40 @@ protected:
 	void Complete(bool success);
 	void Validate(bool checkTokenValid) const;
 
+	/* True for a Delete that superseded the Store that would have created
+	 * the Activity's object, so there is nothing to delete.  It should
+	 * complete successfully without issuing anything. */
+	bool IsDeleteUnneeded();
+
+private:
+	boost::shared_ptr<PersistCommand> FindTail();
+	bool Coalesce(boost::shared_ptr<PersistCommand> tail,
+		boost::shared_ptr<PersistCommand> command);
+	void RunCompletion(boost::shared_ptr<Completion> completion,
+		bool success);
+
 protected:
+	typedef std::list<boost::shared_ptr<Completion> > CompletionList;
+
 	boost::shared_ptr<Activity>		m_activity;
 	boost::shared_ptr<Completion>	m_completion;
 
 	boost::shared_ptr<PersistCommand>	m_next;
 
+	/* Previous command in the chain, and the last known tail of the chain.
+	 * The tail is only a hint - appends continue from it to the real
+	 * tail, so they don't have to walk the whole chain each time. */
+	boost::weak_ptr<PersistCommand>	m_prev;
+	boost::weak_ptr<PersistCommand>	m_tail;
+
+	/* Completions of the commands this one superseded, in chain order */
+	CompletionList	m_superseded;
+	bool			m_dropped;
+
+	static unsigned long long	s_supersededByStore;
+	static unsigned long long	s_supersededByDelete;
+	static unsigned long long	s_deletesSkipped;
+
 	static MojLogger	s_log;
 };
 
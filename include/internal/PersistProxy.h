@@ -22,6 +22,8 @@
 #include "Base.h"
 #include "PersistCommand.h"
 
+#include <vector>
+
 class Activity;
 class Completion;
 class PersistToken;
@@ -49,10 +51,26 @@ public:
 		boost::shared_ptr<Activity> activity,
 		boost::shared_ptr<Completion> completion);
 
+	typedef std::vector<boost::shared_ptr<Activity> > ActivityVec;
+	typedef std::vector<boost::shared_ptr<Completion> > CompletionVec;
+	typedef std::vector<boost::shared_ptr<PersistCommand> > CommandVec;
+
+	/* Prepare one command per Activity (with the matching Completion).
+	 * The default just prepares independent commands.  Stores that support
+	 * multi-object operations may issue the whole set as one operation, so
+	 * an Activity may appear at most once in a batch, and all commands
+	 * must be hooked before any is persisted. */
+	virtual void PrepareBatchCommands(CommandType type,
+		const ActivityVec& activities, const CompletionVec& completions,
+		CommandVec& commands);
+
 	virtual boost::shared_ptr<PersistToken> CreateToken() = 0;
 
 	virtual void LoadActivities() = 0;
 
+	/* Backend specific state, for the Activity Manager's "info" method */
+	virtual MojErr InfoToJson(MojObject& rep) const;
+
 protected:
 	static MojLogger	s_log;
 };
@@ -38,6 +38,10 @@ public:
 	void Unmet();
 	void Updated();
 
+	/* The current value changed while unmet.  Subscribers aren't told,
+	 * but the Activity's cached info has to be rebuilt. */
+	void CurrentChanged();
+
 	bool IsMet() const;
 
 	boost::shared_ptr<Activity> GetActivity();
@@ -74,6 +74,9 @@ private:
 	Schedule& operator=(const Schedule& copy);
 
 protected:
+	/* The owning Activity's JSON representation changed */
+	void DefinitionChanged() const;
+	void StatusChanged() const;
 
 	typedef boost::intrusive::set_member_hook<
 		boost::intrusive::link_mode<
@@ -39,6 +39,7 @@ class MasterResourceManager;
 class PowerManager;
 class ControlGroupManager;
 class LunaBusProxy;
+class ConcurrencyController;
 
 class ActivityManagerApp : public MojReactorApp<MojGmainReactor>
 {
@@ -71,6 +72,7 @@ private:
 	boost::shared_ptr<PersistProxy>			m_db;
 	boost::shared_ptr<PowerManager>			m_powerManager;
 	boost::shared_ptr<ControlGroupManager>	m_controlGroupManager;
+	boost::shared_ptr<ConcurrencyController>	m_concurrencyController;
 #ifndef TARGET_DESKTOP
 	boost::shared_ptr<LunaBusProxy>			m_busProxy;
 #endif
@@ -36,7 +36,7 @@ public:
 	BusIdType GetType() const;
 	const BusId& GetId() const;
 
-	std::string GetString() const;
+	const std::string& GetString() const;
 
 	MojErr ToJson(MojObject& rep) const;
 
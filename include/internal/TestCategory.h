@@ -41,7 +41,7 @@ protected:
 	/* Grab an extra reference to an Activity (to force it to leak) */
 	MojErr Leak(MojServiceMessage *msg, MojObject& payload);
 
-	/* Wake Callback */
+	/* Test a response against a where clause, and optionally time it */
 	MojErr WhereMatchTest(MojServiceMessage *msg, MojObject &payload);
 
 	MojErr LookupActivity(MojServiceMessage *msg, MojObject& payload,
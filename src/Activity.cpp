@@ -26,7 +26,9 @@
 #include "Schedule.h"
 #include "ActivityJson.h"
 #include "Requirement.h"
+#include "DeferredSpec.h"
 #include "ActivityAutoAssociation.h"
+#include "OpenHashIndex.h"
 #include "Logging.h"
 #include <stdexcept>
 #include <functional>
@@ -34,6 +36,87 @@
 
 MojLogger Activity::s_log(_T("activitymanager.activity"));
 
+#define STATE_BIT(state) (1U << (state))
+
+/* Waiting to run: scheduled, waiting on requirements, or waiting in a
+ * ready queue */
+static const unsigned WaitingStates = STATE_BIT(ActivityWaiting) |
+	STATE_BIT(ActivityBlocked) | STATE_BIT(ActivityQueued);
+
+static const unsigned RunStates = STATE_BIT(ActivityStarting) |
+	STATE_BIT(ActivityRunning) | STATE_BIT(ActivityPaused);
+
+/* Ending states with subscribers still attached (or "complete", which
+ * doesn't distinguish), and "unknown", which is an ending Activity that
+ * wasn't sent an ending command (abandoned, yielding, or requeuing) */
+static const unsigned EndingStates = STATE_BIT(ActivityComplete) |
+	STATE_BIT(ActivityStopping) | STATE_BIT(ActivityCancelling) |
+	STATE_BIT(ActivityUnknown);
+
+static const unsigned EndedStates = STATE_BIT(ActivityStopped) |
+	STATE_BIT(ActivityCancelled);
+
+/*
+ * An Activity is scheduled, waits for its requirements, is queued, and
+ * runs, in that order, and may end from any of those states.  A running
+ * Activity only returns to waiting by ending first (yield, requeue, or
+ * restart).  An ending Activity moves on to the matching ended state as
+ * its last subscriber goes, and back if it gets one again.  Restarting
+ * returns it to waiting (for its schedule), never to "init", which is only
+ * for Activities that have never been scheduled.  An Activity that ended
+ * without an ending command, or was cancelled by the Activity Manager
+ * when orphaned, may be requeued, or resume running if adopted.
+ */
+const unsigned Activity::s_stateTransitions[MaxActivityState] =
+{
+	/* ActivityInit */
+	STATE_BIT(ActivityWaiting) | STATE_BIT(ActivityBlocked) | EndingStates |
+		EndedStates,
+	/* ActivityWaiting */
+	STATE_BIT(ActivityBlocked) | STATE_BIT(ActivityQueued) | EndingStates |
+		EndedStates,
+	/* ActivityBlocked */
+	STATE_BIT(ActivityWaiting) | EndingStates | EndedStates,
+	/* ActivityQueued */
+	STATE_BIT(ActivityBlocked) | STATE_BIT(ActivityStarting) |
+		EndingStates | EndedStates,
+	/* ActivityStarting */
+	STATE_BIT(ActivityRunning) | STATE_BIT(ActivityPaused) | EndingStates |
+		EndedStates,
+	/* ActivityRunning */
+	STATE_BIT(ActivityPaused) | EndingStates | EndedStates,
+	/* ActivityPaused */
+	STATE_BIT(ActivityRunning) | EndingStates | EndedStates,
+	/* ActivityComplete */
+	STATE_BIT(ActivityWaiting),
+	/* ActivityStopping */
+	STATE_BIT(ActivityStopped),
+	/* ActivityStopped */
+	STATE_BIT(ActivityStopping) | STATE_BIT(ActivityWaiting),
+	/* ActivityCancelling */
+	STATE_BIT(ActivityCancelled) | WaitingStates | RunStates,
+	/* ActivityCancelled */
+	STATE_BIT(ActivityCancelling) | STATE_BIT(ActivityWaiting),
+	/* ActivityUnknown */
+	WaitingStates | RunStates,
+};
+
+unsigned long long Activity::s_stateCounts[MaxActivityState];
+unsigned long long Activity::s_transitionCounts[MaxActivityState]
+	[MaxActivityState];
+unsigned long long Activity::s_invalidTransitions = 0;
+
+unsigned long long Activity::s_allInfoGeneration = 0;
+unsigned long long Activity::s_payloadsBuilt = 0;
+unsigned long long Activity::s_payloadsShared = 0;
+
+unsigned long long Activity::s_jsonBuilt = 0;
+unsigned long long Activity::s_jsonCached = 0;
+
+unsigned long long Activity::s_deferredSpecs = 0;
+unsigned long long Activity::s_materialized = 0;
+unsigned long long Activity::s_materializeFailed = 0;
+
 Activity::Activity(activityId_t id, boost::weak_ptr<ActivityManager> am)
 	: m_id(id)
 	, m_persistent(false)
@@ -56,16 +139,45 @@ Activity::Activity(activityId_t id, boost::weak_ptr<ActivityManager> am)
 	, m_requeue(false)
 	, m_yielding(false)
 	, m_released(true)
+	, m_state(ActivityInit)
 	, m_intCommand(ActivityNoCommand)
 	, m_extCommand(ActivityNoCommand)
 	, m_sentCommand(ActivityNoCommand)
+	, m_nameRegistered(false)
+	, m_idHash(HashActivityId(id))
+	, m_nameHash(HashString(m_name))
+	, m_creatorHash(m_creator.Hash())
+	, m_nameCreatorHash(HashCombine(m_nameHash, m_creatorHash))
+	, m_runQueueId(-1)
+	, m_queueTime(0)
 	, m_am(am)
+	, m_infoGeneration(1)
+	, m_infoCacheGeneration(0)
+	, m_definitionGeneration(1)
+	, m_statusGeneration(1)
 {
+	s_stateCounts[m_state]++;
 }
 
 Activity::~Activity()
 {
 	LOG_AM_DEBUG("[Activity %llu] Cleaning up", m_id);
+
+	s_stateCounts[m_state]--;
+
+	if (m_deferredSpec) {
+		s_deferredSpecs--;
+	}
+
+	if (!m_am.expired()) {
+		boost::shared_ptr<ActivityManager> am = m_am.lock();
+
+		if (m_nameRegistered) {
+			am->RemoveActivityName(*this);
+		}
+
+		am->ReleaseActivityId(m_id);
+	}
 }
 
 activityId_t Activity::GetId() const
@@ -77,7 +189,16 @@ void Activity::SetName(const std::string& name)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 
+	if (m_nameRegistered) {
+		throw std::runtime_error("Activity name may not be changed while "
+			"it is registered");
+	}
+
 	m_name = name;
+	m_nameHash = HashString(m_name);
+	m_nameCreatorHash = HashCombine(m_nameHash, m_creatorHash);
+	DefinitionChanged();
+	InfoChanged();
 }
 
 const std::string& Activity::GetName() const
@@ -87,12 +208,13 @@ const std::string& Activity::GetName() const
 
 bool Activity::IsNameRegistered() const
 {
-	return m_nameTableItem.is_linked();
+	return m_nameRegistered;
 }
 
 void Activity::SetDescription(const std::string& description)
 {
 	m_description = description;
+	DefinitionChanged();
 }
 
 const std::string& Activity::GetDescription() const
@@ -102,12 +224,21 @@ const std::string& Activity::GetDescription() const
 
 void Activity::SetCreator(const Subscriber& creator)
 {
-	m_creator = creator;
+	SetCreator(BusId(creator));
 }
 
 void Activity::SetCreator(const BusId& creator)
 {
+	if (m_nameRegistered) {
+		throw std::runtime_error("Activity creator may not be changed while "
+			"its name is registered");
+	}
+
 	m_creator = creator;
+	m_creatorHash = m_creator.Hash();
+	m_nameCreatorHash = HashCombine(m_nameHash, m_creatorHash);
+	DefinitionChanged();
+	InfoChanged();
 }
 
 const BusId& Activity::GetCreator() const
@@ -118,6 +249,7 @@ const BusId& Activity::GetCreator() const
 void Activity::SetImmediate(bool immediate)
 {
 	m_immediate = immediate;
+	DefinitionChanged();
 }
 
 bool Activity::IsImmediate() const
@@ -197,6 +329,11 @@ MojErr Activity::AddSubscription(boost::shared_ptr<Subscription> sub)
 		m_id, sub->GetSubscriber().GetString().c_str());
 
 	m_subscriptions.insert(*sub);
+	StatusChanged();
+
+	if (m_ending) {
+		SetState(EndingState());
+	}
 
 	SubscriberSet::const_iterator exists = m_subscribers.find(
 		sub->GetSubscriber());
@@ -232,6 +369,11 @@ MojErr Activity::RemoveSubscription(boost::shared_ptr<Subscription> sub)
 
 	if (subscription != m_subscriptions.end()) {
 		m_subscriptions.erase(subscription);
+		StatusChanged();
+
+		if (m_ending) {
+			SetState(EndingState());
+		}
 	} else {
 		LOG_AM_WARNING(MSGID_SUBSCRIBER_NOT_FOUND, 2, PMLOGKFV("activity","%llu",m_id),
 			    PMLOGKS("subscriber",sub->GetSubscriber().GetString().c_str()),
@@ -296,6 +438,9 @@ MojErr Activity::RemoveSubscription(boost::shared_ptr<Subscription> sub)
 		}
 	}
 
+	/* Parent and adopters may have changed */
+	StatusChanged();
+
 	if (m_subscriptions.empty()) {
 		Abandoned();
 	}
@@ -326,6 +471,17 @@ MojErr Activity::BroadcastEvent(ActivityEvent_t event)
 		ActivityEventNames[event]);
 
 	MojErr err = MojErrNone;
+
+	/* An update still waiting to be sent goes out first, rather than being
+	 * dropped, so subscribers that only see the event names don't miss
+	 * it, and events stay in order */
+	if (m_updateListItem.is_linked()) {
+		if (m_am.expired()) {
+			m_updateListItem.unlink();
+		} else {
+			m_am.lock()->SendPendingActivityUpdate(*this, event);
+		}
+	}
 	
 	for (SubscriptionSet::iterator iter = m_subscriptions.begin();
 		iter != m_subscriptions.end(); ++iter) {
@@ -342,6 +498,20 @@ MojErr Activity::BroadcastEvent(ActivityEvent_t event)
 	return MojErrNone;
 }
 
+void Activity::RequestUpdateEvent()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	InfoChanged();
+
+	if (m_am.expired()) {
+		BroadcastEvent(ActivityUpdateEvent);
+		return;
+	}
+
+	m_am.lock()->RequestActivityUpdate(*this);
+}
+
 void Activity::PlugAllSubscriptions()
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -367,6 +537,8 @@ void Activity::UnplugAllSubscriptions()
 void Activity::SetTrigger(boost::shared_ptr<Trigger> trigger)
 {
 	m_trigger = trigger;
+	DefinitionChanged();
+	InfoChanged();
 }
 
 boost::shared_ptr<Trigger> Activity::GetTrigger() const
@@ -377,6 +549,8 @@ boost::shared_ptr<Trigger> Activity::GetTrigger() const
 void Activity::ClearTrigger()
 {
 	m_trigger.reset();
+	DefinitionChanged();
+	InfoChanged();
 }
 
 bool Activity::HasTrigger() const
@@ -389,6 +563,8 @@ void Activity::Triggered(boost::shared_ptr<Trigger> trigger)
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("[Activity %llu] Triggered", m_id);
 
+	InfoChanged();
+
 	if (m_trigger == trigger) {
 		if (!m_running && !m_ready && IsRunnable()) {
 			RequestRunActivity();
@@ -408,6 +584,8 @@ bool Activity::IsTriggered() const
 void Activity::SetCallback(boost::shared_ptr<Callback> callback)
 {
 	m_callback = callback;
+	DefinitionChanged();
+	InfoChanged();
 }
 
 boost::shared_ptr<Callback> Activity::GetCallback()
@@ -417,7 +595,9 @@ boost::shared_ptr<Callback> Activity::GetCallback()
 
 bool Activity::HasCallback() const
 {
-	return m_callback;
+	/* A loaded callback that hasn't been built yet still counts */
+	return m_callback || (m_deferredSpec &&
+		(m_deferredSpec->GetParts() & DeferredSpec::CallbackPart));
 }
 
 void Activity::CallbackFailed(boost::shared_ptr<Callback> callback,
@@ -450,11 +630,13 @@ void Activity::CallbackSucceeded(boost::shared_ptr<Callback> callback)
 void Activity::SetSchedule(boost::shared_ptr<Schedule> schedule)
 {
 	m_schedule = schedule;
+	DefinitionChanged();
 }
 
 void Activity::ClearSchedule()
 {
 	m_schedule.reset();
+	DefinitionChanged();
 }
 
 void Activity::Scheduled()
@@ -490,7 +672,18 @@ void Activity::AddRequirement(boost::shared_ptr<Requirement> requirement)
 		throw std::runtime_error("Requirement owner mismatch");
 	}
 
-	m_requirements[requirement->GetName()] = requirement;
+	/* Unlink a requirement being replaced here, so it doesn't update the
+	 * state from its destructor halfway through the replacement */
+	boost::shared_ptr<Requirement>& slot =
+		m_requirements[requirement->GetName()];
+	if (slot && (slot != requirement) &&
+		slot->m_activityListItem.is_linked()) {
+		slot->m_activityListItem.unlink();
+	}
+
+	slot = requirement;
+	DefinitionChanged();
+	InfoChanged();
 
 	if (requirement->m_activityListItem.is_linked()) {
 		LOG_AM_DEBUG("Found linked requirement adding [Requirement %s] to [Activity %llu]",
@@ -505,7 +698,10 @@ void Activity::AddRequirement(boost::shared_ptr<Requirement> requirement)
 
 		if (!m_running && m_ready) {
 			m_ready = false;
+			UpdateWaitingState();
 			m_am.lock()->InformActivityNotReady(shared_from_this());
+		} else {
+			UpdateWaitingState();
 		}
 	}
 }
@@ -530,6 +726,10 @@ void Activity::RemoveRequirement(boost::shared_ptr<Requirement> requirement)
 		requirement->m_activityListItem.unlink();
 	}
 
+	InfoChanged();
+	DefinitionChanged();
+	UpdateWaitingState();
+
 	if (!m_running && !m_ready && IsRunnable()) {
 		RequestRunActivity();
 	}
@@ -559,6 +759,10 @@ void Activity::RemoveRequirement(const std::string& name)
 
 	m_requirements.erase(found);
 
+	InfoChanged();
+	DefinitionChanged();
+	UpdateWaitingState();
+
 	if (!m_running && !m_ready && IsRunnable()) {
 		RequestRunActivity();
 	}
@@ -598,11 +802,11 @@ void Activity::RequirementMet(boost::shared_ptr<Requirement> requirement)
 	}
 
 	m_metRequirements.push_back(*requirement);
+	UpdateWaitingState();
 
-	/* Not obvious from here it'll be time to start.
-	 * XXX use plug/unplug and the fact that an event will only be queued
-	 * if another isn't already... */
-	BroadcastEvent(ActivityUpdateEvent);
+	/* Not obvious from here it'll be time to start.  Requirements often
+	 * change together, so the update is deferred and coalesced. */
+	RequestUpdateEvent();
 
 	if (m_unmetRequirements.empty()) {
 		LOG_AM_DEBUG("[Activity %llu] All requirements met", m_id);
@@ -639,10 +843,13 @@ void Activity::RequirementUnmet(boost::shared_ptr<Requirement> requirement)
 
 	if (!m_running && m_ready) {
 		m_ready = false;
+		UpdateWaitingState();
 		m_am.lock()->InformActivityNotReady(shared_from_this());
+	} else {
+		UpdateWaitingState();
 	}
 
-	BroadcastEvent(ActivityUpdateEvent);
+	RequestUpdateEvent();
 }
 
 void Activity::RequirementUpdated(boost::shared_ptr<Requirement> requirement)
@@ -657,7 +864,77 @@ void Activity::RequirementUpdated(boost::shared_ptr<Requirement> requirement)
 		throw std::runtime_error("Requirement owner mismatch");
 	}
 
-	BroadcastEvent(ActivityUpdateEvent);
+	RequestUpdateEvent();
+}
+
+void Activity::MemberUnlinked()
+{
+	LOG_AM_DEBUG("[Activity %llu] Subscription or requirement unlinked on "
+		"destruction", m_id);
+
+	DefinitionChanged();
+	StatusChanged();
+	InfoChanged();
+
+	if (m_ending) {
+		SetState(EndingState());
+	} else {
+		UpdateWaitingState();
+	}
+}
+
+void Activity::SetDeferredSpec(boost::shared_ptr<DeferredSpec> spec)
+{
+	if (!m_deferredSpec && spec) {
+		s_deferredSpecs++;
+	} else if (m_deferredSpec && !spec) {
+		s_deferredSpecs--;
+	}
+
+	m_deferredSpec = spec;
+
+	DefinitionChanged();
+	InfoChanged();
+}
+
+bool Activity::HasDeferredSpec() const
+{
+	return m_deferredSpec;
+}
+
+void Activity::Materialize()
+{
+	Materialize(DeferredSpec::AllParts);
+}
+
+void Activity::Materialize(unsigned parts)
+{
+	if (!m_deferredSpec || !(m_deferredSpec->GetParts() & parts)) {
+		return;
+	}
+
+	LOG_AM_DEBUG("[Activity %llu] Building deferred definition (parts %x)",
+		m_id, m_deferredSpec->GetParts() & parts);
+
+	/* Each part leaves the spec as it's built.  One that fails stays, so
+	 * an update that hits it first doesn't lose it, and the Activity is
+	 * cancelled if it still can't be built when it's needed. */
+	boost::shared_ptr<DeferredSpec> spec = m_deferredSpec;
+
+	try {
+		spec->Materialize(shared_from_this(), parts);
+	} catch (...) {
+		s_materializeFailed++;
+		DefinitionChanged();
+		InfoChanged();
+		throw;
+	}
+
+	if (!spec->GetParts()) {
+		m_deferredSpec.reset();
+		s_deferredSpecs--;
+		s_materialized++;
+	}
 }
 
 void Activity::SetParent(boost::shared_ptr<Subscription> sub)
@@ -671,6 +948,7 @@ void Activity::SetParent(boost::shared_ptr<Subscription> sub)
 
 	m_parent = sub;
 	m_released = false;
+	StatusChanged();
 
 	LOG_AM_DEBUG("[Activity %llu] %s assigned as parent", m_id,
 		sub->GetSubscriber().GetString().c_str());
@@ -684,6 +962,7 @@ MojErr Activity::Adopt(boost::shared_ptr<Subscription> sub, bool wait, bool *ado
 		wait ? "and willing to wait" : "");
 
 	m_adopters.push_back(sub);
+	StatusChanged();
 
 	if (!m_parent.expired()) {
 		if (adopted)
@@ -733,6 +1012,7 @@ MojErr Activity::Release(const BusId& caller)
 	m_releasedParent = m_parent;
 	m_parent.reset();
 	m_released = true;
+	StatusChanged();
 
 	LOG_AM_DEBUG("[Activity %llu] Released by %s", m_id,
 		caller.GetString().c_str());
@@ -773,6 +1053,7 @@ MojErr Activity::Complete(const BusId& caller, bool force)
 void Activity::SetPersistent(bool persistent)
 {
 	m_persistent = persistent;
+	DefinitionChanged();
 }
 
 bool Activity::IsPersistent() const
@@ -790,6 +1071,11 @@ boost::shared_ptr<PersistToken> Activity::GetPersistToken()
 	return m_persistToken;
 }
 
+boost::shared_ptr<const PersistToken> Activity::GetPersistToken() const
+{
+	return m_persistToken;
+}
+
 void Activity::ClearPersistToken()
 {
 	m_persistToken.reset();
@@ -865,6 +1151,22 @@ void Activity::UnhookPersistCommand(boost::shared_ptr<PersistCommand> cmd)
 	}
 }
 
+/* Remove a command that was superseded before it was issued.  It can't be
+ * the first command hooked, so this never ends the Activity or releases
+ * held events. */
+void Activity::DropPersistCommand(boost::shared_ptr<PersistCommand> cmd)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("[Activity %llu] Dropping [PersistCommand %s]", m_id,
+		cmd->GetString().c_str());
+
+	CommandQueue::iterator found = std::find(m_persistCommands.begin(),
+		m_persistCommands.end(), cmd);
+	if (found != m_persistCommands.end()) {
+		m_persistCommands.erase(found);
+	}
+}
+
 bool Activity::IsPersistCommandHooked() const
 {
 	return (!m_persistCommands.empty());
@@ -885,6 +1187,7 @@ boost::shared_ptr<PersistCommand> Activity::GetHookedPersistCommand()
 void Activity::SetPriority(ActivityPriority_t priority)
 {
 	m_priority = priority;
+	DefinitionChanged();
 }
 
 ActivityPriority_t Activity::GetPriority() const
@@ -899,6 +1202,7 @@ void Activity::SetFocus(bool focused)
 	}
 
 	m_focused = focused;
+	StatusChanged();
 
 	/* Focus changed, update the sorting of all the Associations */
 	std::for_each(m_associations.begin(), m_associations.end(),
@@ -919,6 +1223,7 @@ bool Activity::IsFocused() const
 void Activity::SetExplicit(bool explicitActivity)
 {
 	m_explicit = explicitActivity;
+	DefinitionChanged();
 }
 
 bool Activity::IsExplicit() const
@@ -939,11 +1244,13 @@ void Activity::SetRestartFlag(bool restart)
 void Activity::SetUseSimpleType(bool useSimpleType)
 {
 	m_useSimpleType = useSimpleType;
+	DefinitionChanged();
 }
 
 void Activity::SetBusType(BusType bus)
 {
 	m_bus = bus;
+	DefinitionChanged();
 }
 
 Activity::BusType Activity::GetBusType() const
@@ -954,6 +1261,7 @@ Activity::BusType Activity::GetBusType() const
 void Activity::SetContinuous(bool continuous)
 {
 	m_continuous = continuous;
+	DefinitionChanged();
 }
 
 bool Activity::IsContinuous() const
@@ -964,6 +1272,7 @@ bool Activity::IsContinuous() const
 void Activity::SetUserInitiated(bool userInitiated)
 {
 	m_userInitiated = userInitiated;
+	DefinitionChanged();
 }
 
 bool Activity::IsUserInitiated() const
@@ -974,6 +1283,7 @@ bool Activity::IsUserInitiated() const
 void Activity::SetPowerActivity(boost::shared_ptr<PowerActivity> powerActivity)
 {
 	m_powerActivity = powerActivity;
+	DefinitionChanged();
 }
 
 boost::shared_ptr<PowerActivity> Activity::GetPowerActivity()
@@ -1017,6 +1327,7 @@ void Activity::PowerUnlockedNotification()
 void Activity::SetPowerDebounce(bool powerDebounce)
 {
 	m_powerDebounce = powerDebounce;
+	DefinitionChanged();
 }
 
 bool Activity::IsPowerDebounce() const
@@ -1027,11 +1338,15 @@ bool Activity::IsPowerDebounce() const
 void Activity::SetMetadata(const std::string& metadata)
 {
 	m_metadata = metadata;
+	DefinitionChanged();
+	InfoChanged();
 }
 
 void Activity::ClearMetadata()
 {
 	m_metadata.clear();
+	DefinitionChanged();
+	InfoChanged();
 }
 
 /* Automatic Association Management */
@@ -1117,6 +1432,12 @@ void Activity::BroadcastCommand(ActivityCommand_t command)
 		throw std::runtime_error("Request to Broadcast unknown command");
 
 	m_sentCommand = command;
+
+	/* Ending commands move the state on once the Activity ends */
+	if (m_running && !m_ending && ((command == ActivityStartCommand) ||
+		(command == ActivityPauseCommand))) {
+		SetState(RunningState());
+	}
 }
 
 void Activity::RestartActivity()
@@ -1143,6 +1464,7 @@ void Activity::RestartActivity()
 
 	if (m_focused) {
 		m_focused = false;
+		StatusChanged();
 		if (m_focusedListItem.is_linked()) {
 			m_focusedListItem.unlink();
 		} else {
@@ -1159,6 +1481,9 @@ void Activity::RestartActivity()
 	m_extCommand = ActivityNoCommand;
 	m_sentCommand = ActivityNoCommand;
 
+	/* Waiting to be scheduled again */
+	SetState(ActivityWaiting);
+
 	/* Re-issue start command */
 	SendCommand(ActivityStartCommand);
 }
@@ -1179,8 +1504,16 @@ void Activity::ScheduleActivity()
 	LOG_AM_DEBUG("[Activity %llu] Received permission to schedule",
 		m_id);
 
+	/* The trigger and requirements are armed now, so a loaded Activity
+	 * needs them built.  The callback waits until it runs. */
+	if (!MaterializeOrCancel(DeferredSpec::RequirementsPart |
+		DeferredSpec::TriggerPart)) {
+		return;
+	}
+
 	if (m_trigger) {
 		m_trigger->Arm(shared_from_this());
+		InfoChanged();
 	}
 
 	if (m_schedule) {
@@ -1188,6 +1521,7 @@ void Activity::ScheduleActivity()
 	}
 
 	m_scheduled = true;
+	SetState(WaitingState());
 
 	if (IsRunnable()) {
 		RequestRunActivity();
@@ -1201,6 +1535,8 @@ void Activity::RequestRunActivity()
 		m_id);
 
 	m_ready = true;
+	SetState(ActivityQueued);
+
 	m_am.lock()->InformActivityReady(shared_from_this());
 }
 
@@ -1210,6 +1546,7 @@ void Activity::RunActivity()
 	LOG_AM_DEBUG("[Activity %llu] Received permission to run", m_id);
 
 	m_running = true;
+	SetState(ActivityStarting);
 
 	if (m_powerActivity && (m_powerActivity->GetPowerState() !=
 		PowerActivity::PowerLocked)) {
@@ -1253,6 +1590,7 @@ void Activity::RequeueActivity()
 	} else {
 		/* Requirements aren't met, or the Activity is paused. */
 		m_ready = false;
+		SetState(WaitingState());
 		m_am.lock()->InformActivityNotReady(shared_from_this());
 	}
 }
@@ -1284,6 +1622,7 @@ void Activity::EndActivity()
 
 	if (!m_ending) {
 		m_ending = true;
+		SetState(EndingState());
 		m_am.lock()->InformActivityEnding(shared_from_this());
 	}
 
@@ -1294,6 +1633,7 @@ void Activity::EndActivity()
 	if (!requeue) {
 		if (m_trigger && m_trigger->IsArmed(shared_from_this())) {
 			m_trigger->Disarm(shared_from_this());
+			InfoChanged();
 		}
 
 		if (m_schedule && m_schedule->IsQueued()) {
@@ -1390,7 +1730,7 @@ bool Activity::IsYielding() const
 
 bool Activity::ShouldRestart() const
 {
-	if (m_callback && !m_terminate && (m_restart || m_persistent ||
+	if (HasCallback() && !m_terminate && (m_restart || m_persistent ||
 			m_explicit || (m_schedule && m_schedule->ShouldReschedule()))) {
 		return true;
 	} else {
@@ -1400,7 +1740,7 @@ bool Activity::ShouldRestart() const
 
 bool Activity::ShouldRequeue() const
 {
-	if (m_callback && !m_terminate && m_requeue && !m_restart) {
+	if (HasCallback() && !m_terminate && m_requeue && !m_restart) {
 		return true;
 	} else {
 		return false;
@@ -1418,7 +1758,7 @@ void Activity::Orphaned()
 		/* Activity should Cancel.  If persistent, it may re-queue */
 		SendCommand(ActivityCancelCommand, true);
 	} else if (m_scheduled) {
-		if (m_callback) {
+		if (HasCallback()) {
 			/* Activity is not running yet, but its callback will be used
 			 * (ultimately to aquire a parent) when it does start. */
 		} else {
@@ -1458,24 +1798,53 @@ void Activity::DoAdopt()
 
 	m_parent = m_adopters.front();
 	m_adopters.pop_front();
+	StatusChanged();
 
 	m_parent.lock()->QueueEvent(ActivityOrphanEvent);
 
 	m_released = false;
 	if(m_ending) {
 		LOG_AM_DEBUG("[Activity %llu] Removing ending flag since found new parent",m_id);
+		m_ending = false;
+		SetState(m_running ? RunningState() : WaitingState());
 	}
-	m_ending = false;
 
 	LOG_AM_DEBUG("[Activity %llu] Adopted by %s", m_id,
 		m_parent.lock()->GetSubscriber().GetString().c_str());
 }
 
+/* A loaded definition that can't be built is treated as an Activity that
+ * couldn't be loaded, and cancelled. */
+bool Activity::MaterializeOrCancel(unsigned parts)
+{
+	if (!m_deferredSpec) {
+		return true;
+	}
+
+	try {
+		Materialize(parts);
+		return true;
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_MATERIALIZE_FAILED, 2, PMLOGKFV("Activity","%llu",m_id),
+			  PMLOGKS("Exception",except.what()), "Failed to build deferred definition");
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_MATERIALIZE_FAILED, 1, PMLOGKFV("Activity","%llu",m_id),
+			  "Unknown exception building deferred definition");
+	}
+
+	SendCommand(ActivityCancelCommand, true);
+	return false;
+}
+
 void Activity::DoRunActivity()
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("[Activity %llu] Running", m_id);
 
+	if (!MaterializeOrCancel(DeferredSpec::CallbackPart)) {
+		return;
+	}
+
 	/* Power is now on, if Applicable.  Tell the Activity Manager we're
 	 * ready to go! */
 	m_am.lock()->InformActivityRunning(shared_from_this());
@@ -1508,56 +1877,144 @@ void Activity::DoCallback()
 
 ActivityState_t Activity::GetState() const
 {
-	if (m_ending) {
-		if (m_subscriptions.empty()) {
-			switch (m_sentCommand) {
-			case ActivityCancelCommand:
-				return ActivityCancelled;
-			case ActivityStopCommand:
-				return ActivityStopped;
-			case ActivityCompleteCommand:
-				return ActivityComplete;
-			default:
-				return ActivityUnknown;	/* Don't throw and cause trouble */
-			}
-		} else {
-			switch (m_sentCommand) {
-			case ActivityCancelCommand:
-				return ActivityCancelling;
-			case ActivityStopCommand:
-				return ActivityStopping;
-			case ActivityCompleteCommand:
-				return ActivityComplete;
-			default:
-				return ActivityUnknown;
-			}
-		}
+	return m_state;
+}
+
+/* Which of the waiting states a scheduled Activity is in */
+ActivityState_t Activity::WaitingState() const
+{
+	if (!m_unmetRequirements.empty()) {
+		return ActivityBlocked;
+	} else if (m_ready) {
+		return ActivityQueued;
+	} else {
+		return ActivityWaiting;
 	}
+}
 
-	if (m_running) {
-		if (m_sentCommand == ActivityPauseCommand) {
-			return ActivityPaused;
-		} else if (m_sentCommand == ActivityStartCommand) {
-			return ActivityRunning;
-		} else {
-			return ActivityStarting;
-		}
+/* Which of the running states a running Activity is in, by the last
+ * command its subscribers were sent */
+ActivityState_t Activity::RunningState() const
+{
+	if (m_sentCommand == ActivityPauseCommand) {
+		return ActivityPaused;
+	} else if (m_sentCommand == ActivityStartCommand) {
+		return ActivityRunning;
+	} else {
+		return ActivityStarting;
 	}
+}
 
-	if (m_scheduled) {
-		if (!m_unmetRequirements.empty()) {
-			return ActivityBlocked;
-		} else if (m_ready && !m_running) {
-			/* m_running check is redundant, but leave in to be safe in case of
-			 * later changes */
-			return ActivityQueued;
-		} else {
-			/* waiting for start command */
-			return ActivityWaiting;
+/* Which of the ending (or ended, once no subscribers remain) states an
+ * ending Activity is in, by the ending command its subscribers were sent */
+ActivityState_t Activity::EndingState() const
+{
+	bool ended = m_subscriptions.empty();
+
+	switch (m_sentCommand) {
+	case ActivityCancelCommand:
+		return ended ? ActivityCancelled : ActivityCancelling;
+	case ActivityStopCommand:
+		return ended ? ActivityStopped : ActivityStopping;
+	case ActivityCompleteCommand:
+		return ActivityComplete;
+	default:
+		return ActivityUnknown;	/* Don't throw and cause trouble */
+	}
+}
+
+/* Requirements of a waiting Activity changed */
+void Activity::UpdateWaitingState()
+{
+	if (STATE_BIT(m_state) & WaitingStates) {
+		SetState(WaitingState());
+	}
+}
+
+void Activity::SetState(ActivityState_t state)
+{
+	if (state == m_state) {
+		return;
+	}
+
+	/* Taken anyway, as the flags the transition acted on have already
+	 * changed, but reported so the path that got here can be fixed */
+	if (!IsValidStateTransition(m_state, state)) {
+		s_invalidTransitions++;
+		LOG_AM_ERROR(MSGID_INVALID_STATE_TRANSITION, 3,
+			PMLOGKFV("activity","%llu",m_id),
+			PMLOGKS("from",ActivityStateNames[m_state]),
+			PMLOGKS("to",ActivityStateNames[state]),
+			"Activity state transition not allowed by transition table");
+	}
+
+	ActivityState_t from = m_state;
+	m_state = state;
+	StateChanged(from, state);
+}
+
+void Activity::StateChanged(ActivityState_t from, ActivityState_t to)
+{
+	LOG_AM_DEBUG("[Activity %llu] State %s -> %s", m_id,
+		ActivityStateNames[from], ActivityStateNames[to]);
+
+	StatusChanged();
+
+	s_stateCounts[from]--;
+	s_stateCounts[to]++;
+	s_transitionCounts[from][to]++;
+}
+
+bool Activity::IsValidStateTransition(ActivityState_t from,
+	ActivityState_t to)
+{
+	return (s_stateTransitions[from] & STATE_BIT(to)) != 0;
+}
+
+MojErr Activity::StateInfoToJson(MojObject& rep)
+{
+	MojErr err;
+
+	MojObject states(MojObject::TypeObject);
+	MojObject transitions(MojObject::TypeArray);
+
+	for (int from = 0; from < MaxActivityState; from++) {
+		err = states.putInt(ActivityStateNames[from],
+			(MojInt64)s_stateCounts[from]);
+		MojErrCheck(err);
+
+		for (int to = 0; to < MaxActivityState; to++) {
+			if (!s_transitionCounts[from][to]) {
+				continue;
+			}
+
+			MojObject transition(MojObject::TypeObject);
+
+			err = transition.putString(_T("from"), ActivityStateNames[from]);
+			MojErrCheck(err);
+
+			err = transition.putString(_T("to"), ActivityStateNames[to]);
+			MojErrCheck(err);
+
+			err = transition.putInt(_T("count"),
+				(MojInt64)s_transitionCounts[from][to]);
+			MojErrCheck(err);
+
+			err = transitions.push(transition);
+			MojErrCheck(err);
 		}
 	}
 
-	return ActivityInit;
+	err = rep.put(_T("states"), states);
+	MojErrCheck(err);
+
+	err = rep.put(_T("transitions"), transitions);
+	MojErrCheck(err);
+
+	err = rep.putInt(_T("invalidTransitions"), (MojInt64)s_invalidTransitions);
+	MojErrCheck(err);
+
+	return MojErrNone;
 }
 
 MojErr Activity::IdentityToJson(MojObject& rep) const
@@ -1598,7 +2055,7 @@ MojErr Activity::ActivityInfoToJson(MojObject& rep) const
 	err = rep.putInt(_T("activityId"), (MojInt64)m_id);
 	MojErrCheck(err);
 
-	if (HasCallback()) {
+	if (m_callback) {
 		MojObject callbackRep;
 		err = m_callback->ToJson(callbackRep, ACTIVITY_JSON_CURRENT);
 		MojErrCheck(err);
@@ -1647,7 +2104,201 @@ MojErr Activity::ActivityInfoToJson(MojObject& rep) const
 	return MojErrNone;
 }
 
+MojErr Activity::GetActivityInfo(const MojObject*& info)
+{
+	unsigned long long generation = GetInfoGeneration();
+
+	if (m_infoCacheGeneration != generation) {
+		MojObject rep(MojObject::TypeObject);
+
+		MojErr err = ActivityInfoToJson(rep);
+		MojErrCheck(err);
+
+		m_infoCache = rep;
+		m_infoCacheGeneration = generation;
+	}
+
+	info = &m_infoCache;
+	return MojErrNone;
+}
+
+MojErr Activity::GetEventPayload(ActivityEvent_t event, bool detailed,
+	const MojObject*& payload)
+{
+	EventPayload& cached = m_eventPayloads[detailed ? 1 : 0];
+
+	/* Plain replies don't carry any details, so they stay valid as long
+	 * as the event is the same */
+	if ((cached.m_event == event) &&
+		(!detailed || (cached.m_generation == GetInfoGeneration()))) {
+		s_payloadsShared++;
+		payload = &cached.m_reply;
+		return MojErrNone;
+	}
+
+	MojErr err;
+	MojObject reply;
+
+	err = reply.putString(_T("event"), ActivityEventNames[event]);
+	MojErrCheck(err);
+
+	err = reply.putInt(_T("activityId"), m_id);
+	MojErrCheck(err);
+
+	err = reply.putBool(MojServiceMessage::ReturnValueKey, true);
+	MojErrCheck(err);
+
+	if (detailed) {
+		const MojObject *details;
+
+		err = GetActivityInfo(details);
+		MojErrCheck(err);
+
+		err = reply.put(_T("$activity"), *details);
+		MojErrCheck(err);
+	}
+
+	cached.m_reply = reply;
+	cached.m_event = event;
+	cached.m_generation = GetInfoGeneration();
+
+	s_payloadsBuilt++;
+
+	payload = &cached.m_reply;
+	return MojErrNone;
+}
+
+void Activity::InfoChanged()
+{
+	m_infoGeneration++;
+}
+
+void Activity::AllInfoChanged()
+{
+	s_allInfoGeneration++;
+}
+
+unsigned long long Activity::GetInfoGeneration() const
+{
+	/* Both only ever increase, so the sum changes whenever either does */
+	return m_infoGeneration + s_allInfoGeneration;
+}
+
+void Activity::DefinitionChanged()
+{
+	m_definitionGeneration++;
+}
+
+void Activity::StatusChanged()
+{
+	m_statusGeneration++;
+}
+
+unsigned long long Activity::GetJsonGeneration(unsigned flags) const
+{
+	unsigned long long generation = m_definitionGeneration;
+
+	/* Persisted output has no state, focus, or subscribers.  Current
+	 * schedule progress is tracked as part of the status, though. */
+	if (!(flags & ACTIVITY_JSON_PERSIST) || (flags & ACTIVITY_JSON_CURRENT)) {
+		generation += m_statusGeneration;
+	}
+
+	if (flags & ACTIVITY_JSON_CURRENT) {
+		generation += GetInfoGeneration();
+	}
+
+	return generation;
+}
+
+MojErr Activity::JsonCacheInfoToJson(MojObject& rep)
+{
+	MojErr err;
+
+	err = rep.put(_T("built"), (MojInt64)s_jsonBuilt);
+	MojErrCheck(err);
+
+	err = rep.put(_T("cached"), (MojInt64)s_jsonCached);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+MojErr Activity::DeferredSpecInfoToJson(MojObject& rep)
+{
+	MojErr err;
+
+	err = rep.put(_T("pending"), (MojInt64)s_deferredSpecs);
+	MojErrCheck(err);
+
+	err = rep.put(_T("materialized"), (MojInt64)s_materialized);
+	MojErrCheck(err);
+
+	err = rep.put(_T("failed"), (MojInt64)s_materializeFailed);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+MojErr Activity::EventPayloadInfoToJson(MojObject& rep)
+{
+	MojErr err;
+
+	err = rep.put(_T("built"), (MojInt64)s_payloadsBuilt);
+	MojErrCheck(err);
+
+	err = rep.put(_T("shared"), (MojInt64)s_payloadsShared);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
 MojErr Activity::ToJson(MojObject& rep, unsigned flags) const
+{
+	/* Internal state is only dumped for debugging, and depends on too many
+	 * flags to be worth tracking */
+	if (flags & ACTIVITY_JSON_INTERNAL) {
+		s_jsonBuilt++;
+		rep = MojObject(MojObject::TypeObject);
+		return BuildJson(rep, flags);
+	}
+
+	unsigned long long generation = GetJsonGeneration(flags);
+
+	JsonCache::iterator iter = m_jsonCache.begin();
+	for (; iter != m_jsonCache.end(); ++iter) {
+		if (iter->m_flags == flags) {
+			break;
+		}
+	}
+
+	if ((iter != m_jsonCache.end()) && (iter->m_generation == generation)) {
+		s_jsonCached++;
+		rep = iter->m_rep;
+		return MojErrNone;
+	}
+
+	MojObject built(MojObject::TypeObject);
+
+	MojErr err = BuildJson(built, flags);
+	MojErrCheck(err);
+
+	s_jsonBuilt++;
+
+	if (iter == m_jsonCache.end()) {
+		CachedJson cached;
+		cached.m_flags = flags;
+		iter = m_jsonCache.insert(m_jsonCache.end(), cached);
+	}
+
+	iter->m_generation = generation;
+	iter->m_rep = built;
+
+	rep = built;
+	return MojErrNone;
+}
+
+MojErr Activity::BuildJson(MojObject& rep, unsigned flags) const
 {
 	MojErr err = MojErrNone;
 
@@ -1775,6 +2426,11 @@ MojErr Activity::ToJson(MojObject& rep, unsigned flags) const
 			err = rep.put(_T("requirements"), requirementsRep);
 			MojErrCheck(err);
 		}
+
+		if (m_deferredSpec) {
+			err = m_deferredSpec->ToJson(rep, flags);
+			MojErrCheck(err);
+		}
 	}
 
 	if (flags & ACTIVITY_JSON_INTERNAL) {
@@ -1929,6 +2585,9 @@ MojErr Activity::InternalToJson(MojObject& rep, unsigned flags) const
 
 	err = rep.putBool(_T("m_userInitiated"), m_userInitiated);
 	MojErrCheck(err);
+
+	err = rep.putBool(_T("m_deferredSpec"), (bool)m_deferredSpec);
+	MojErrCheck(err);
 	
 	err = rep.putBool(_T("m_powerDebounce"), m_powerDebounce);
 	MojErrCheck(err);
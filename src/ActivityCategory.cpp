@@ -18,6 +18,7 @@
 
 #include "Activity.h"
 #include "Callback.h"
+#include "DeferredSpec.h"
 #include "ActivityManager.h"
 #include "PowerManager.h"
 #include "MojoTriggerManager.h"
@@ -32,12 +33,15 @@
 #include "Completion.h"
 #include "ResourceManager.h"
 #include "ContainerManager.h"
+#include "ObjectPool.h"
+#include "ConcurrencyController.h"
 #include "Logging.h"
 
 #ifdef ACTIVITYMANAGER_USE_PUBLIC_BUS
 #include <luna/MojLunaMessage.h>
 #endif
 
+#include <map>
 #include <stdexcept>
 
 /*!
@@ -54,6 +58,9 @@
  * - \ref com_palm_activitymanager_stop
  * - \ref com_palm_activitymanager_cancel
  * - \ref com_palm_activitymanager_pause
+ * - \ref com_palm_activitymanager_create_batch
+ * - \ref com_palm_activitymanager_cancel_batch
+ * - \ref com_palm_activitymanager_complete_batch
  * - \ref com_palm_activitymanager_focus
  * - \ref com_palm_activitymanager_unfocus
  * - \ref com_palm_activitymanager_addfocus
@@ -91,6 +98,9 @@ const ActivityCategoryHandler::Method ActivityCategoryHandler::s_methods[] = {
 	{ _T("stop"), (Callback) &ActivityCategoryHandler::StopActivity },
 	{ _T("cancel"), (Callback) &ActivityCategoryHandler::CancelActivity },
 	{ _T("pause"), (Callback) &ActivityCategoryHandler::PauseActivity },
+	{ _T("createBatch"), (Callback) &ActivityCategoryHandler::CreateBatch },
+	{ _T("cancelBatch"), (Callback) &ActivityCategoryHandler::CancelBatch },
+	{ _T("completeBatch"), (Callback) &ActivityCategoryHandler::CompleteBatch },
 	{ _T("focus"), (Callback) &ActivityCategoryHandler::FocusActivity },
 	{ _T("unfocus"), (Callback) &ActivityCategoryHandler::UnfocusActivity },
 	{ _T("addFocus"), (Callback) &ActivityCategoryHandler::AddFocus },
@@ -121,7 +131,8 @@ ActivityCategoryHandler::ActivityCategoryHandler(
 	boost::shared_ptr<MojoTriggerManager> triggerManager,
 	boost::shared_ptr<PowerManager> powerManager,
 	boost::shared_ptr<MasterResourceManager> resourceManager,
-	boost::shared_ptr<ContainerManager> containerManager)
+	boost::shared_ptr<ContainerManager> containerManager,
+	boost::shared_ptr<ConcurrencyController> concurrencyController)
 	: m_db(db)
 	, m_json(json)
 	, m_am(am)
@@ -129,6 +140,7 @@ ActivityCategoryHandler::ActivityCategoryHandler(
 	, m_powerManager(powerManager)
 	, m_resourceManager(resourceManager)
 	, m_containerManager(containerManager)
+	, m_concurrencyController(concurrencyController)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("Constructing");
@@ -1689,6 +1701,578 @@ ActivityCategoryHandler::PauseActivity(MojServiceMessage *msg, MojObject& payloa
 	return MojErrNone;
 }
 
+/*!
+\page com_palm_activitymanager
+\n
+\section com_palm_activitymanager_create_batch createBatch
+
+\e Public.
+
+com.palm.activitymanager/createBatch
+
+<b>Creates a set of Activities in one call.</b>
+
+Each entry in "activities" is processed as if it had been passed to
+\ref com_palm_activitymanager_create "create", and all of the new persistent
+Activities are stored together.  Since the batch only gets a single reply,
+entries may not subscribe, so each must specify "start" and have a callback.
+"replace" is not supported in a batch.
+
+Entries succeed or fail individually.  The call itself only fails if the
+"activities" array is missing.
+
+\subsection com_palm_activitymanager_create_batch_syntax Syntax:
+\code
+{
+    "activities": [
+        {
+            "activity": Activity object,
+            "start": boolean
+        }
+    ]
+}
+\endcode
+
+\param activities Array of create requests. \e Required.
+
+\subsection com_palm_activitymanager_create_batch_returns Returns:
+\code
+{
+    "errorCode": int,
+    "errorText": string,
+    "returnValue": boolean,
+    "results": [
+        {
+            "errorCode": int,
+            "errorText": string,
+            "returnValue": boolean,
+            "activityId": int
+        }
+    ]
+}
+\endcode
+
+\param errorCode Code for the error in case the call was not succesful.
+\param errorText Describes the error if the call was not succesful.
+\param returnValue Indicates if the call was succesful.
+\param results Result of each entry, in the order they were passed.
+
+\subsection com_palm_activitymanager_create_batch_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/createBatch '{ "activities": [ { "activity": { "name": "first", "description": "Test batch", "type": { "background": true, "persist": true }, "callback": { "method": "palm://com.palm.service/callback" }, "schedule": { "interval": "1d" } }, "start": true }, { "activity": { "name": "second", "description": "Test batch" }, "start": true } ] }'
+\endcode
+
+Example response:
+\code
+{
+    "results": [
+        {
+            "activityId": 412,
+            "returnValue": true
+        },
+        {
+            "errorCode": -986,
+            "errorText": "Created Activity must specify \"start\" and a Callback if not subscribed",
+            "returnValue": false
+        }
+    ],
+    "returnValue": true
+}
+\endcode
+*/
+
+/* Per-item results of a batch call.  Each item reports exactly once, as
+ * does the handler once it has queued every item, and the reply is sent
+ * when the last of those does. */
+class ActivityCategoryHandler::BatchReply
+{
+public:
+	BatchReply(MojServiceMessage *msg, size_t count)
+		: m_msg(msg)
+		, m_results(count)
+		, m_pending(count + 1)
+	{
+	}
+
+	void Succeeded(size_t index, activityId_t id)
+	{
+		MojObject& result = m_results[index];
+		result.putBool(MojServiceMessage::ReturnValueKey, true);
+		result.putInt(_T("activityId"), (MojInt64)id);
+		Finished();
+	}
+
+	void Failed(size_t index, MojErr errorCode, const std::string& errorText)
+	{
+		MojObject& result = m_results[index];
+		result.putBool(MojServiceMessage::ReturnValueKey, false);
+		result.putInt(MojServiceMessage::ErrorCodeKey, (MojInt64)errorCode);
+		result.putString(MojServiceMessage::ErrorTextKey, errorText.c_str());
+		Finished();
+	}
+
+	void Queued()
+	{
+		Finished();
+	}
+
+private:
+	void Finished()
+	{
+		if (--m_pending > 0) {
+			return;
+		}
+
+		MojObject results(MojObject::TypeArray);
+		for (std::vector<MojObject>::const_iterator iter = m_results.begin();
+			iter != m_results.end(); ++iter) {
+			results.push(*iter);
+		}
+
+		MojObject reply;
+		reply.putBool(MojServiceMessage::ReturnValueKey, true);
+		reply.put(_T("results"), results);
+
+		MojErr err = m_msg->reply(reply);
+		if (err) {
+			LOG_AM_ERROR(MSGID_BATCH_REQ_REPLY_FAIL, 0,
+				"Failed to generate reply to batch request");
+		}
+	}
+
+	MojRefCountedPtr<MojServiceMessage>	m_msg;
+	std::vector<MojObject>	m_results;
+	size_t					m_pending;
+};
+
+MojErr
+ActivityCategoryHandler::CreateBatch(MojServiceMessage *msg, MojObject& payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Create batch: Message from %s: %s",
+		MojoSubscription::GetSubscriberString(msg).c_str(),
+		MojoObjectJson(payload).c_str());
+
+	MojObject items;
+	if (!GetBatchItems(msg, payload, items)) {
+		return MojErrNone;
+	}
+
+	boost::shared_ptr<BatchReply> batch = boost::make_shared<BatchReply>(msg,
+		items.size());
+
+	PersistProxy::ActivityVec activities;
+	PersistProxy::CompletionVec completions;
+
+	size_t index = 0;
+	for (MojObject::ConstArrayIterator iter = items.arrayBegin();
+		iter != items.arrayEnd(); ++iter, ++index) {
+		boost::shared_ptr<Activity> act;
+		std::string errorText;
+		MojErr err;
+
+		try {
+			err = PrepareBatchCreate(msg, *iter, act, errorText);
+		} catch (const std::exception& except) {
+			err = MojErrInternal;
+			errorText = except.what();
+		}
+
+		if (err) {
+			batch->Failed(index, err, errorText);
+			continue;
+		}
+
+		activities.push_back(act);
+		completions.push_back(boost::make_shared<MojoBatchCompletion<
+			ActivityCategoryHandler, BatchReply> >(this,
+				&ActivityCategoryHandler::FinishBatchCreate, batch, index,
+				*iter, act));
+	}
+
+	EnsureBatchCompletion(PersistProxy::StoreCommandType, activities,
+		completions);
+
+	batch->Queued();
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
+void
+ActivityCategoryHandler::FinishBatchCreate(boost::shared_ptr<BatchReply> batch,
+	size_t index, const MojObject& item, boost::shared_ptr<Activity> act,
+	bool succeeded)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Create batch finishing: [Activity %llu]: %s",
+		act->GetId(), succeeded ? "succeeded" : "failed");
+
+	/* As with a single create, the Activity exists whether or not it was
+	 * persisted. */
+	batch->Succeeded(index, act->GetId());
+
+	try {
+		m_am->StartActivity(act);
+	} catch (const std::exception& except) {
+		LOG_AM_DEBUG("Create batch: Failed to start [Activity %llu]: %s",
+			act->GetId(), except.what());
+	}
+}
+
+/*!
+\page com_palm_activitymanager
+\n
+\section com_palm_activitymanager_cancel_batch cancelBatch
+
+\e Public.
+
+com.palm.activitymanager/cancelBatch
+
+<b>Cancels a set of Activities in one call.</b>
+
+Each entry in "activities" is processed as if it had been passed to
+\ref com_palm_activitymanager_cancel "cancel", and all of the cancelled
+persistent Activities are deleted together.  An Activity may only appear once
+in a batch.
+
+Entries succeed or fail individually.  The call itself only fails if the
+"activities" array is missing.
+
+\subsection com_palm_activitymanager_cancel_batch_syntax Syntax:
+\code
+{
+    "activities": [
+        {
+            "activityId": int,
+            "activityName": string
+        }
+    ]
+}
+\endcode
+
+\param activities Array of cancel requests. \e Required.
+
+\subsection com_palm_activitymanager_cancel_batch_returns Returns:
+\code
+{
+    "errorCode": int,
+    "errorText": string,
+    "returnValue": boolean,
+    "results": [
+        {
+            "errorCode": int,
+            "errorText": string,
+            "returnValue": boolean,
+            "activityId": int
+        }
+    ]
+}
+\endcode
+
+\param errorCode Code for the error in case the call was not succesful.
+\param errorText Describes the error if the call was not succesful.
+\param returnValue Indicates if the call was succesful.
+\param results Result of each entry, in the order they were passed.
+
+\subsection com_palm_activitymanager_cancel_batch_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/cancelBatch '{ "activities": [ { "activityId": 412 }, { "activityId": 413 } ] }'
+\endcode
+
+Example response:
+\code
+{
+    "results": [
+        {
+            "activityId": 412,
+            "returnValue": true
+        },
+        {
+            "errorCode": -1106,
+            "errorText": "activityId not found",
+            "returnValue": false
+        }
+    ],
+    "returnValue": true
+}
+\endcode
+*/
+
+MojErr
+ActivityCategoryHandler::CancelBatch(MojServiceMessage *msg, MojObject& payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Cancel batch: Message from %s: %s",
+		MojoSubscription::GetSubscriberString(msg).c_str(),
+		MojoObjectJson(payload).c_str());
+
+	MojObject items;
+	if (!GetBatchItems(msg, payload, items)) {
+		return MojErrNone;
+	}
+
+	boost::shared_ptr<BatchReply> batch = boost::make_shared<BatchReply>(msg,
+		items.size());
+
+	PersistProxy::ActivityVec activities;
+	PersistProxy::CompletionVec completions;
+	std::set<activityId_t> seen;
+
+	size_t index = 0;
+	for (MojObject::ConstArrayIterator iter = items.arrayBegin();
+		iter != items.arrayEnd(); ++iter, ++index) {
+		boost::shared_ptr<Activity> act;
+		std::string errorText;
+		MojErr err;
+
+		try {
+			err = LookupBatchActivity(msg, *iter, seen, act, errorText);
+			if (!err) {
+				err = PrepareBatchCancel(msg, *iter, act, errorText);
+			}
+		} catch (const std::exception& except) {
+			err = MojErrInternal;
+			errorText = except.what();
+		}
+
+		if (err) {
+			batch->Failed(index, err, errorText);
+			continue;
+		}
+
+		activities.push_back(act);
+		completions.push_back(boost::make_shared<MojoBatchCompletion<
+			ActivityCategoryHandler, BatchReply> >(this,
+				&ActivityCategoryHandler::FinishBatchCancel, batch, index,
+				*iter, act));
+	}
+
+	EnsureBatchCompletion(PersistProxy::DeleteCommandType, activities,
+		completions);
+
+	for (PersistProxy::ActivityVec::iterator iter = activities.begin();
+		iter != activities.end(); ++iter) {
+		(*iter)->UnplugAllSubscriptions();
+	}
+
+	batch->Queued();
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
+void
+ActivityCategoryHandler::FinishBatchCancel(boost::shared_ptr<BatchReply> batch,
+	size_t index, const MojObject& item, boost::shared_ptr<Activity> act,
+	bool succeeded)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Cancel batch finishing: [Activity %llu]: %s",
+		act->GetId(), succeeded ? "succeeded" : "failed");
+
+	if (act->IsNameRegistered()) {
+		m_am->UnregisterActivityName(act);
+	}
+
+	batch->Succeeded(index, act->GetId());
+}
+
+/*!
+\page com_palm_activitymanager
+\n
+\section com_palm_activitymanager_complete_batch completeBatch
+
+\e Public.
+
+com.palm.activitymanager/completeBatch
+
+<b>Completes a set of Activities in one call.</b>
+
+Each entry in "activities" is processed as if it had been passed to
+\ref com_palm_activitymanager_complete "complete".  All of the restarted
+persistent Activities are stored together, and all of the finished ones are
+deleted together.  An Activity may only appear once in a batch.
+
+Entries succeed or fail individually.  The call itself only fails if the
+"activities" array is missing.
+
+\subsection com_palm_activitymanager_complete_batch_syntax Syntax:
+\code
+{
+    "activities": [
+        {
+            "activityId": int,
+            "activityName": string,
+            "restart": boolean,
+            "callback": Callback object,
+            "schedule": Schedule object,
+            "trigger": Trigger object,
+            "metadata": any object
+        }
+    ]
+}
+\endcode
+
+\param activities Array of complete requests. \e Required.
+
+\subsection com_palm_activitymanager_complete_batch_returns Returns:
+\code
+{
+    "errorCode": int,
+    "errorText": string,
+    "returnValue": boolean,
+    "results": [
+        {
+            "errorCode": int,
+            "errorText": string,
+            "returnValue": boolean,
+            "activityId": int
+        }
+    ]
+}
+\endcode
+
+\param errorCode Code for the error in case the call was not succesful.
+\param errorText Describes the error if the call was not succesful.
+\param returnValue Indicates if the call was succesful.
+\param results Result of each entry, in the order they were passed.
+
+\subsection com_palm_activitymanager_complete_batch_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/completeBatch '{ "activities": [ { "activityId": 412, "restart": true }, { "activityId": 413 } ] }'
+\endcode
+
+Example response:
+\code
+{
+    "results": [
+        {
+            "activityId": 412,
+            "returnValue": true
+        },
+        {
+            "activityId": 413,
+            "returnValue": true
+        }
+    ],
+    "returnValue": true
+}
+\endcode
+*/
+
+MojErr
+ActivityCategoryHandler::CompleteBatch(MojServiceMessage *msg,
+	MojObject& payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Complete batch: Message from %s: %s",
+		MojoSubscription::GetSubscriberString(msg).c_str(),
+		MojoObjectJson(payload).c_str());
+
+	MojObject items;
+	if (!GetBatchItems(msg, payload, items)) {
+		return MojErrNone;
+	}
+
+	boost::shared_ptr<BatchReply> batch = boost::make_shared<BatchReply>(msg,
+		items.size());
+
+	/* Restarted Activities are stored, finished ones deleted */
+	PersistProxy::ActivityVec storeActivities;
+	PersistProxy::CompletionVec storeCompletions;
+	PersistProxy::ActivityVec deleteActivities;
+	PersistProxy::CompletionVec deleteCompletions;
+	std::set<activityId_t> seen;
+
+	size_t index = 0;
+	for (MojObject::ConstArrayIterator iter = items.arrayBegin();
+		iter != items.arrayEnd(); ++iter, ++index) {
+		boost::shared_ptr<Activity> act;
+		std::string errorText;
+		MojErr err;
+
+		try {
+			err = LookupBatchActivity(msg, *iter, seen, act, errorText);
+			if (!err) {
+				err = PrepareBatchComplete(msg, *iter, act, errorText);
+			}
+		} catch (const std::exception& except) {
+			err = MojErrInternal;
+			errorText = except.what();
+		}
+
+		if (err) {
+			batch->Failed(index, err, errorText);
+			continue;
+		}
+
+		boost::shared_ptr<Completion> completion = boost::make_shared<
+			MojoBatchCompletion<ActivityCategoryHandler, BatchReply> >(this,
+				&ActivityCategoryHandler::FinishBatchComplete, batch, index,
+				*iter, act);
+
+		bool restart = false;
+		iter->get(_T("restart"), restart);
+
+		if (restart) {
+			storeActivities.push_back(act);
+			storeCompletions.push_back(completion);
+		} else {
+			deleteActivities.push_back(act);
+			deleteCompletions.push_back(completion);
+		}
+	}
+
+	EnsureBatchCompletion(PersistProxy::StoreCommandType, storeActivities,
+		storeCompletions);
+	EnsureBatchCompletion(PersistProxy::DeleteCommandType, deleteActivities,
+		deleteCompletions);
+
+	for (PersistProxy::ActivityVec::iterator iter = storeActivities.begin();
+		iter != storeActivities.end(); ++iter) {
+		(*iter)->UnplugAllSubscriptions();
+	}
+
+	for (PersistProxy::ActivityVec::iterator iter = deleteActivities.begin();
+		iter != deleteActivities.end(); ++iter) {
+		(*iter)->UnplugAllSubscriptions();
+	}
+
+	batch->Queued();
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
+void
+ActivityCategoryHandler::FinishBatchComplete(
+	boost::shared_ptr<BatchReply> batch, size_t index, const MojObject& item,
+	boost::shared_ptr<Activity> act, bool succeeded)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Complete batch finishing: [Activity %llu]: %s",
+		act->GetId(), succeeded ? "succeeded" : "failed");
+
+	bool restart = false;
+	item.get(_T("restart"), restart);
+
+	if (!restart && act->IsNameRegistered()) {
+		m_am->UnregisterActivityName(act);
+	}
+
+	batch->Succeeded(index, act->GetId());
+}
+
 /*!
 \page com_palm_activitymanager
 \n
@@ -3061,9 +3645,32 @@ ActivityCategoryHandler::UnmapProcess(MojServiceMessage *msg, MojObject& payload
 com.palm.activitymanager/info
 
 Get activity manager related information:
-\li Activity Manager state:  Run queues and leaked Activities.
+\li Activity Manager state:  Run queues, dispatch pass counters, update
+event counters (requested, sent, coalesced, and pending), event replies built and
+shared between subscribers, Activity JSON representations built and
+reused, loaded Activities whose trigger, callback, and requirements are
+still deferred (and how many have been built, or failed), Activity IDs in use (and how many ranges they form), bus identities
+interned by the Activities and their subscribers, Activities
+in each state and the state transitions seen (including any not allowed by
+the transition table), time spent on each run queue (count, p50, p95, p99
+and max in microseconds, overall and by priority), and leaked Activities.
 \li List of Activities for which power is currently locked.
 \li State of the Resource Manager(s).
+\li Background concurrency level, and the state of its adaptive controller.
+\li Persistence backend state (group commit window and counters, how many
+Activity writes were full puts, partial merges, or skipped as unchanged,
+writes issued, held, and retried after transient failures, and the state of
+the circuit breaker that pauses writes while MojoDB is failing,
+the startup load time, in total and for each page, and the Activities
+loaded from, confirmed against, or cancelled from the local snapshot, and the
+progress of the background purge of stale Activity objects).  With
+the local log backend, the log's size and live records, appends, sync
+count and time, compactions, and bytes discarded during recovery.
+\li Trigger subscriptions: upstream calls open, triggers attached to them,
+and how many attached to a call already open, plus the responses received,
+passed on to triggers, and replayed to triggers attaching later.
+\li Persist commands dropped because a later Store or Delete superseded them.
+\li Object pool allocation counters.
 
 \subsection com_palm_activitymanager_info_syntax Syntax:
 \code
@@ -3202,6 +3809,26 @@ ActivityCategoryHandler::Info(MojServiceMessage *msg, MojObject& payload)
 	err = m_resourceManager->InfoToJson(reply);
 	MojErrCheck(err);
 
+	/* Get the background concurrency level and controller state */
+	err = m_concurrencyController->InfoToJson(reply);
+	MojErrCheck(err);
+
+	/* Get the persistence backend state */
+	err = m_db->InfoToJson(reply);
+	MojErrCheck(err);
+
+	/* Get the trigger subscriptions, and how many share a call */
+	err = m_triggerManager->InfoToJson(reply);
+	MojErrCheck(err);
+
+	/* Get the writes saved by dropping superseded persist commands */
+	err = PersistCommand::InfoToJson(reply);
+	MojErrCheck(err);
+
+	/* Get the object pool allocation counters */
+	err = ObjectPool::InfoToJson(reply);
+	MojErrCheck(err);
+
 	err = msg->reply(reply);
 	MojErrCheck(err);
 
@@ -3428,6 +4055,9 @@ ActivityCategoryHandler::CheckSerial(MojServiceMessage *msg,
 				"number match on Activity that does not have a callback");
 		}
 
+		/* A loaded Activity's callback isn't built until it's needed */
+		act->Materialize(DeferredSpec::CallbackPart);
+
 		if (act->GetCallback()->GetSerial() != serial) {
 			LOG_AM_ERROR(MSGID_SERIAL_NUM_MISMATCH, 4, PMLOGKFV("Activity","%llu",act->GetId()),
 				    PMLOGKS("subscriber_string",MojoSubscription::GetSubscriberString(msg).c_str()),
@@ -3607,3 +4237,289 @@ ActivityCategoryHandler::EnsureReplaceCompletion(MojServiceMessage *msg,
 	}
 }
 
+
+bool
+ActivityCategoryHandler::GetBatchItems(MojServiceMessage *msg,
+	const MojObject& payload, MojObject& items)
+{
+	if (!payload.get(_T("activities"), items) ||
+		(items.type() != MojObject::TypeArray)) {
+		MojErr err = msg->replyError(MojErrInvalidArg,
+			"Batch \"activities\" array not present");
+		if (err) {
+			LOG_AM_ERROR(MSGID_BATCH_REQ_REPLY_FAIL, 0,
+				"Failed to generate reply to batch request");
+		}
+		return false;
+	}
+
+	return true;
+}
+
+/* Parse, check and register one Activity from a createBatch call.  This
+ * follows CreateActivity, but reports errors rather than replying. */
+MojErr
+ActivityCategoryHandler::PrepareBatchCreate(MojServiceMessage *msg,
+	const MojObject& item, boost::shared_ptr<Activity>& act,
+	std::string& errorText)
+{
+	MojObject spec;
+	if (!item.get(_T("activity"), spec)) {
+		errorText = "Activity specification not present";
+		return MojErrInvalidArg;
+	}
+
+	bool subscribe = false;
+	item.get(_T("subscribe"), subscribe);
+
+	bool replace = false;
+	item.get(_T("replace"), replace);
+
+	if (subscribe || replace) {
+		errorText = "\"subscribe\" and \"replace\" are not supported in a "
+			"batch";
+		return MojErrInvalidArg;
+	}
+
+	try {
+#ifdef ACTIVITYMANAGER_USE_PUBLIC_BUS
+		MojLunaMessage *lunaMsg = dynamic_cast<MojLunaMessage *>(msg);
+		if (!lunaMsg) {
+			throw std::invalid_argument("Non-Luna Message passed in to "
+				"Create");
+		}
+
+		Activity::BusType bus = lunaMsg->isPublic() ? Activity::PublicBus :
+			Activity::PrivateBus;
+#else
+		Activity::BusType bus = Activity::PrivateBus;
+#endif
+
+		act = m_json->CreateActivity(spec, bus);
+
+		if (act->GetCreator().GetType() == BusNull) {
+			act->SetCreator(MojoSubscription::GetBusId(msg));
+		}
+	} catch (const std::exception& except) {
+		errorText = except.what();
+		return MojErrNoMem;
+	}
+
+	bool start = false;
+	item.get(_T("start"), start);
+
+	if (!(start && act->HasCallback())) {
+		m_am->ReleaseActivity(act);
+		errorText = "Created Activity must specify \"start\" and a Callback "
+			"if not subscribed";
+		return MojErrInvalidArg;
+	}
+
+	boost::shared_ptr<Activity> old;
+	try {
+		old = m_am->GetActivity(act->GetName(), act->GetCreator());
+	} catch (...) {
+		/* No Activity with that name/creator pair found. */
+	}
+
+	if (old) {
+		LOG_AM_WARNING(MSGID_OLD_ACTIVITY_NO_REPLACE, 3, PMLOGKS("activity_name",act->GetName().c_str()),
+			    PMLOGKS("creator_name",act->GetCreator().GetString().c_str()),
+			    PMLOGKFV("old_activity","%llu",old->GetId()), "");
+
+		m_am->ReleaseActivity(act);
+		errorText = "Activity with that name already exists";
+		return MojErrExists;
+	}
+
+	m_am->RegisterActivityId(act);
+	m_am->RegisterActivityName(act);
+
+	return MojErrNone;
+}
+
+MojErr
+ActivityCategoryHandler::LookupBatchActivity(MojServiceMessage *msg,
+	const MojObject& item, std::set<activityId_t>& seen,
+	boost::shared_ptr<Activity>& act, std::string& errorText)
+{
+	try {
+		act = m_json->LookupActivity(item, MojoSubscription::GetBusId(msg));
+	} catch (const std::exception& except) {
+		errorText = except.what();
+		return MojErrNotFound;
+	}
+
+	/* A second command for the same Activity would be chained behind the
+	 * first, which can't be issued until the whole batch is ready. */
+	if (!seen.insert(act->GetId()).second) {
+		errorText = "Activity appears more than once in batch";
+		return MojErrInvalidArg;
+	}
+
+	return MojErrNone;
+}
+
+MojErr
+ActivityCategoryHandler::PrepareBatchCancel(MojServiceMessage *msg,
+	const MojObject& item, boost::shared_ptr<Activity> act,
+	std::string& errorText)
+{
+	act->PlugAllSubscriptions();
+
+	act->SetTerminateFlag(true);
+
+	MojErr err = m_am->CancelActivity(act);
+	if (err) {
+		LOG_AM_DEBUG("Cancel batch: Failed to cancel [Activity %llu]",
+			act->GetId());
+		act->UnplugAllSubscriptions();
+		errorText = "Failed to cancel Activity";
+		return err;
+	}
+
+	LOG_AM_DEBUG("Cancel batch: [Activity %llu] cancelling", act->GetId());
+
+	return MojErrNone;
+}
+
+MojErr
+ActivityCategoryHandler::PrepareBatchComplete(MojServiceMessage *msg,
+	const MojObject& item, boost::shared_ptr<Activity> act,
+	std::string& errorText)
+{
+	MojErr err = CheckSerial(msg, item, act);
+	if (err) {
+		errorText = "Failed to check call sequence serial number";
+		return err;
+	}
+
+	bool force = false;
+	item.get(_T("force"), force);
+
+	bool restart = false;
+	item.get(_T("restart"), restart);
+	if (restart) {
+		m_json->UpdateActivity(act, item);
+		act->SetRestartFlag(true);
+	} else {
+		act->SetTerminateFlag(true);
+	}
+
+	act->PlugAllSubscriptions();
+
+	err = act->Complete(MojoSubscription::GetBusId(msg), force);
+	if (err) {
+		LOG_AM_DEBUG("Complete batch: %s failed to complete [Activity %llu]",
+			MojoSubscription::GetSubscriberString(msg).c_str(), act->GetId());
+
+		act->SetTerminateFlag(false);
+		act->UnplugAllSubscriptions();
+		errorText = "Failed to complete Activity";
+		return err;
+	}
+
+	LOG_AM_DEBUG("Complete batch: %s completing [Activity %llu]",
+		MojoSubscription::GetSubscriberString(msg).c_str(), act->GetId());
+
+	return MojErrNone;
+}
+
+/* Batch form of EnsureCompletion.  Persistent Activities get their commands
+ * from as few batches as their persist chains allow, so the store can
+ * write them in one operation each.  Every command is hooked before any is
+ * issued. */
+void
+ActivityCategoryHandler::EnsureBatchCompletion(PersistProxy::CommandType type,
+	const PersistProxy::ActivityVec& activities,
+	const PersistProxy::CompletionVec& completions)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	PersistProxy::ActivityVec persistActivities;
+	PersistProxy::CompletionVec persistCompletions;
+	PersistProxy::CompletionVec immediate;
+
+	for (size_t i = 0; i < activities.size(); i++) {
+		boost::shared_ptr<Activity> act = activities[i];
+
+		if (act->IsPersistent()) {
+			if (!act->IsPersistTokenSet()) {
+				act->SetPersistToken(m_db->CreateToken());
+			}
+
+			persistActivities.push_back(act);
+			persistCompletions.push_back(completions[i]);
+		} else if (act->IsPersistCommandHooked()) {
+			boost::shared_ptr<PersistCommand> cmd = m_db->PrepareNoopCommand(
+				act, completions[i]);
+
+			act->HookPersistCommand(cmd);
+			act->GetHookedPersistCommand()->Append(cmd);
+		} else {
+			immediate.push_back(completions[i]);
+		}
+	}
+
+	/* A batch can't complete until all of its commands have been issued.
+	 * If two of its Activities are on the same chain (one replaced the
+	 * other, say), the later command would wait behind the earlier one's
+	 * batch, which is itself, so split the Activities into rounds that
+	 * hold at most one Activity from each chain.  Each round is a batch
+	 * of its own, appended after the rounds before it. */
+	std::vector<PersistProxy::ActivityVec> roundActivities(1);
+	std::vector<PersistProxy::CompletionVec> roundCompletions(1);
+	std::map<PersistCommand *, size_t> nextRound;
+
+	for (size_t i = 0; i < persistActivities.size(); i++) {
+		boost::shared_ptr<Activity> act = persistActivities[i];
+
+		size_t round = 0;
+		if (act->IsPersistCommandHooked()) {
+			PersistCommand *tail =
+				act->GetHookedPersistCommand()->GetTail().get();
+			round = nextRound[tail]++;
+		}
+
+		if (round >= roundActivities.size()) {
+			roundActivities.resize(round + 1);
+			roundCompletions.resize(round + 1);
+		}
+
+		roundActivities[round].push_back(act);
+		roundCompletions[round].push_back(persistCompletions[i]);
+	}
+
+	PersistProxy::CommandVec ready;
+	for (size_t round = 0; round < roundActivities.size(); round++) {
+		if (roundActivities[round].empty()) {
+			continue;
+		}
+
+		PersistProxy::CommandVec commands;
+		m_db->PrepareBatchCommands(type, roundActivities[round],
+			roundCompletions[round], commands);
+
+		for (size_t i = 0; i < commands.size(); i++) {
+			boost::shared_ptr<Activity> act = roundActivities[round][i];
+
+			if (act->IsPersistCommandHooked()) {
+				act->HookPersistCommand(commands[i]);
+				act->GetHookedPersistCommand()->Append(commands[i]);
+			} else {
+				act->HookPersistCommand(commands[i]);
+				ready.push_back(commands[i]);
+			}
+		}
+	}
+
+	for (PersistProxy::CommandVec::iterator iter = ready.begin();
+		iter != ready.end(); ++iter) {
+		(*iter)->Persist();
+	}
+
+	for (PersistProxy::CompletionVec::iterator iter = immediate.begin();
+		iter != immediate.end(); ++iter) {
+		(*iter)->Complete(true);
+	}
+}
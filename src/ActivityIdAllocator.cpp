@@ -0,0 +1,181 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include "ActivityIdAllocator.h"
+
+#include <stdexcept>
+
+ActivityIdAllocator::ActivityIdAllocator()
+	: m_last(m_ranges.end())
+	, m_claimed(0)
+{
+}
+
+activityId_t ActivityIdAllocator::Allocate(activityId_t from)
+{
+	/* Activity ID 0 is reserved */
+	if (from == 0) {
+		from = 1;
+	}
+
+	/* Common sequential case: the ID just past the range the last ID came
+	 * from, with nothing in use immediately after it. */
+	if ((m_last != m_ranges.end()) && (m_last->second == (from - 1))) {
+		RangeMap::iterator next = m_last;
+		++next;
+
+		if ((next == m_ranges.end()) || (next->first > (from + 1))) {
+			m_last->second = from;
+			m_claimed++;
+			return from;
+		}
+	}
+
+	/* Ranges are never adjacent, so the ID just past the range containing
+	 * 'from' (if any) is free. */
+	RangeMap::iterator range = FindRange(from);
+	if (range != m_ranges.end()) {
+		if (range->second == (activityId_t)-1) {
+			throw std::runtime_error("Activity IDs exhausted");
+		}
+
+		from = range->second + 1;
+	}
+
+	Claim(from);
+
+	return from;
+}
+
+void ActivityIdAllocator::Claim(activityId_t id)
+{
+	RangeMap::iterator next = m_ranges.upper_bound(id);
+	RangeMap::iterator prev = m_ranges.end();
+
+	if (next != m_ranges.begin()) {
+		prev = next;
+		--prev;
+
+		if (prev->second >= id) {
+			m_extraClaims[id]++;
+			return;
+		}
+	}
+
+	bool joinPrev = (prev != m_ranges.end()) && (prev->second == (id - 1));
+	bool joinNext = (next != m_ranges.end()) && (next->first == (id + 1));
+
+	if (joinPrev && joinNext) {
+		prev->second = next->second;
+		m_ranges.erase(next);
+		m_last = prev;
+	} else if (joinPrev) {
+		prev->second = id;
+		m_last = prev;
+	} else if (joinNext) {
+		activityId_t last = next->second;
+		m_ranges.erase(next);
+		m_last = m_ranges.insert(std::make_pair(id, last)).first;
+	} else {
+		m_last = m_ranges.insert(std::make_pair(id, id)).first;
+	}
+
+	m_claimed++;
+}
+
+void ActivityIdAllocator::Release(activityId_t id)
+{
+	ClaimMap::iterator extra = m_extraClaims.find(id);
+	if (extra != m_extraClaims.end()) {
+		if (--extra->second == 0) {
+			m_extraClaims.erase(extra);
+		}
+		return;
+	}
+
+	RangeMap::iterator range = FindRange(id);
+	if (range == m_ranges.end()) {
+		return;
+	}
+
+	m_claimed--;
+
+	if (range->first == id) {
+		bool wasLast = (m_last == range);
+		activityId_t last = range->second;
+
+		m_ranges.erase(range);
+		m_last = m_ranges.end();
+
+		if (last != id) {
+			RangeMap::iterator rest = m_ranges.insert(
+				std::make_pair(id + 1, last)).first;
+			if (wasLast) {
+				m_last = rest;
+			}
+		}
+	} else if (range->second == id) {
+		range->second = id - 1;
+	} else {
+		/* Split.  The lower half keeps its node, so m_last stays valid. */
+		m_ranges.insert(std::make_pair(id + 1, range->second));
+		range->second = id - 1;
+	}
+}
+
+bool ActivityIdAllocator::IsClaimed(activityId_t id) const
+{
+	return FindRange(id) != m_ranges.end();
+}
+
+MojErr ActivityIdAllocator::ToJson(MojObject& rep) const
+{
+	MojErr err;
+
+	err = rep.putInt(_T("claimed"), (MojInt64)m_claimed);
+	MojErrCheck(err);
+
+	err = rep.putInt(_T("ranges"), (MojInt64)m_ranges.size());
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+ActivityIdAllocator::RangeMap::iterator
+ActivityIdAllocator::FindRange(activityId_t id)
+{
+	RangeMap::iterator range = m_ranges.upper_bound(id);
+	if (range == m_ranges.begin()) {
+		return m_ranges.end();
+	}
+
+	--range;
+	return (range->second >= id) ? range : m_ranges.end();
+}
+
+ActivityIdAllocator::RangeMap::const_iterator
+ActivityIdAllocator::FindRange(activityId_t id) const
+{
+	RangeMap::const_iterator range = m_ranges.upper_bound(id);
+	if (range == m_ranges.begin()) {
+		return m_ranges.end();
+	}
+
+	--range;
+	return (range->second >= id) ? range : m_ranges.end();
+}
@@ -18,14 +18,28 @@
 
 #include "ActivityManager.h"
 #include "ResourceManager.h"
+#include "ObjectPool.h"
+#include "MonotonicClock.h"
 #include "Logging.h"
 
-#include <boost/iterator/transform_iterator.hpp>
+#include <algorithm>
 #include <cstdlib>
 #include <stdexcept>
 
 MojLogger ActivityManager::s_log(_T("activitymanager.activitymanager"));
 
+static void PushActivity(ActivityManager::ActivityVec& out,
+	const boost::shared_ptr<Activity>& act)
+{
+	out.push_back(act);
+}
+
+static bool ActivityIdLess(const boost::shared_ptr<const Activity>& act1,
+	const boost::shared_ptr<const Activity>& act2)
+{
+	return act1->GetId() < act2->GetId();
+}
+
 const char *ActivityManager::RunQueueNames[] = {
 	"initialized",
 	"scheduled",
@@ -40,11 +54,20 @@ const char *ActivityManager::RunQueueNames[] = {
 
 ActivityManager::ActivityManager(boost::shared_ptr<MasterResourceManager>
 	resourceManager)
-	: m_enabled(EXTERNAL_ENABLE)
+	: m_dispatchSource(NULL)
+	, m_schedulePending(false)
+	, m_dispatchRequests(0)
+	, m_dispatchPasses(0)
+	, m_updateSource(NULL)
+	, m_updateRequests(0)
+	, m_updatesSent(0)
+	, m_updatesCoalesced(0)
+	, m_enabled(EXTERNAL_ENABLE)
 	, m_backgroundConcurrencyLevel(DefaultBackgroundConcurrencyLevel)
 	, m_backgroundInteractiveConcurrencyLevel
 		(DefaultBackgroundInteractiveConcurrencyLevel)
 	, m_yieldTimeoutSeconds(DefaultBackgroundInteractiveYieldSeconds)
+	, m_readyAgingSeconds(DefaultReadyQueueAgingSeconds)
 	, m_resourceManager(resourceManager)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -56,6 +79,23 @@ ActivityManager::ActivityManager(boost::shared_ptr<MasterResourceManager>
 
 ActivityManager::~ActivityManager()
 {
+	if (m_dispatchSource) {
+		if (!g_source_is_destroyed(m_dispatchSource)) {
+			g_source_destroy(m_dispatchSource);
+		}
+
+		m_dispatchSource = NULL;
+	}
+
+	if (m_updateSource) {
+		if (!g_source_is_destroyed(m_updateSource)) {
+			g_source_destroy(m_updateSource);
+		}
+
+		m_updateSource = NULL;
+	}
+
+	m_pendingUpdates.clear();
 }
 
 void ActivityManager::RegisterActivityId(boost::shared_ptr<Activity> act)
@@ -63,12 +103,11 @@ void ActivityManager::RegisterActivityId(boost::shared_ptr<Activity> act)
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("[Activity %llu] Registering ID", act->GetId());
 
-	ActivityMap::const_iterator found = m_activities.find(act->GetId());
-	if (found != m_activities.end()) {
+	if (m_activities.Find(act->m_idHash, ActivityIdMatch(act->GetId()))) {
 		throw std::runtime_error("Activity ID is already registered");
 	}
 
-	m_activities[act->GetId()] = act;
+	m_activities.Insert(act->m_idHash, act);
 }
 
 void ActivityManager::RegisterActivityName(boost::shared_ptr<Activity> act)
@@ -78,10 +117,15 @@ void ActivityManager::RegisterActivityName(boost::shared_ptr<Activity> act)
 		act->GetId(), act->GetCreator().GetString().c_str(),
 		act->GetName().c_str());
 
-	bool success = m_nameTable.insert(*act).second;
-	if (!success) {
+	if (act->m_nameRegistered || m_nameTable.Find(act->m_nameCreatorHash,
+		ActivityNameMatch(act->GetName(), act->GetCreator(),
+			act->m_creatorHash, false))) {
 		throw std::runtime_error("Activity name is already registed");
 	}
+
+	m_nameTable.Insert(act->m_nameCreatorHash, act.get());
+	m_anonNameTable.Insert(act->m_nameHash, act.get());
+	act->m_nameRegistered = true;
 }
 
 void ActivityManager::UnregisterActivityName(boost::shared_ptr<Activity> act)
@@ -91,38 +135,51 @@ void ActivityManager::UnregisterActivityName(boost::shared_ptr<Activity> act)
 		act->GetId(), act->GetCreator().GetString().c_str(),
 		act->GetName().c_str());
 
-	if (act->m_nameTableItem.is_linked()) {
-		act->m_nameTableItem.unlink();
-	} else {
+	if (!RemoveActivityName(*act)) {
 		throw std::runtime_error("Activity name is not registered");
 	}
 }
 
+bool ActivityManager::RemoveActivityName(Activity& act)
+{
+	if (!act.m_nameRegistered) {
+		return false;
+	}
+
+	act.m_nameRegistered = false;
+
+	m_anonNameTable.Erase(act.m_nameHash, ActivityPtrMatch(&act));
+	return m_nameTable.Erase(act.m_nameCreatorHash, ActivityPtrMatch(&act));
+}
+
 boost::shared_ptr<Activity> ActivityManager::GetActivity(
 	const std::string& name, const BusId& creator)
 {
-	ActivityNameTable::iterator iter;
-
+	Activity **found;
 	if (creator.GetType() == BusAnon) {
-		iter = m_nameTable.find(ActivityKey(name, creator), ActivityNameOnlyComp());
+		found = m_anonNameTable.Find(HashString(name),
+			ActivityNameMatch(name, creator, creator.Hash(), true));
 	} else {
-		iter = m_nameTable.find(ActivityKey(name, creator), ActivityNameComp());
+		size_t creatorHash = creator.Hash();
+		found = m_nameTable.Find(HashCombine(HashString(name), creatorHash),
+			ActivityNameMatch(name, creator, creatorHash, false));
 	}
 
-	if (iter == m_nameTable.end()) {
+	if (!found) {
 		throw std::runtime_error("Activity name/creator pair not found");
 	}
 
-	return iter->shared_from_this();
+	return (*found)->shared_from_this();
 }
 
 boost::shared_ptr<Activity> ActivityManager::GetActivity(activityId_t id)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 
-	ActivityMap::iterator iter = m_activities.find(id);
-	if (iter != m_activities.end()) {
-		return iter->second;
+	boost::shared_ptr<Activity> *found = m_activities.Find(
+		HashActivityId(id), ActivityIdMatch(id));
+	if (found) {
+		return *found;
 	}
 
 	throw std::runtime_error("activityId not found");
@@ -132,42 +189,20 @@ boost::shared_ptr<Activity> ActivityManager::GetNewActivity()
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 
-	boost::shared_ptr<Activity> act;
-
 #ifdef ACTIVITYMANAGER_RANDOM_IDS
-	/* Look for unused id */
-	while (true) {
-		activityId_t id = (activityId_t) ::random();
-
-		/* Activity ID 0 is reserved */
-		if (id == 0)
-			continue;
-
-		/* Either the searched for element, or the first higher one */
-		ActivityIdTable::const_iterator hint = m_idTable.lower_bound(id,
-			ActivityIdComp());
-		if ((hint == m_idTable.end()) || (hint->GetId() != id)) {
-			act = boost::make_shared<Activity>(id, shared_from_this());
-			m_idTable.insert(hint, *act);
-			break;
-		}
-	}
+	/* Random starting point; if that's taken, the allocator moves on to the
+	 * first unused id above it. */
+	activityId_t id = m_idAllocator.Allocate((activityId_t) ::random());
 #else
-	/* Use sequential ID */
-	while (true) {
-		ActivityIdTable::const_iterator hint = m_idTable.lower_bound(
-			m_nextActivityId, ActivityIdComp());
-		if ((hint == m_idTable.end()) || (hint->GetId() != m_nextActivityId)) {
-			act = boost::make_shared<Activity>(m_nextActivityId++,
-				shared_from_this());
-			m_idTable.insert(hint, *act);
-			break;
-		} else {
-			m_nextActivityId++;
-		}
-	}
+	/* Use sequential ID, skipping any in use (ie. loaded from the DB) */
+	activityId_t id = m_idAllocator.Allocate(m_nextActivityId);
+	m_nextActivityId = id + 1;
 #endif	/* ACTIVITYMANAGER_RANDOM_IDS */
 
+	boost::shared_ptr<Activity> act = boost::allocate_shared<Activity>(
+		POOL_ALLOCATOR(Activity), id, shared_from_this());
+	m_idTable.insert(*act);
+
 	LOG_AM_DEBUG("[Activity %llu] Allocated", act->GetId());
 
 	return act;
@@ -177,18 +212,24 @@ boost::shared_ptr<Activity> ActivityManager::GetNewActivity(activityId_t id)
 {
 	LOG_AM_DEBUG("[Activity %llu] Forcing allocation", id);
 
-	ActivityMap::iterator iter = m_activities.find(id);
-	if (iter != m_activities.end()) {
+	if (m_activities.Find(HashActivityId(id), ActivityIdMatch(id))) {
 		LOG_AM_WARNING(MSGID_SAME_ACTIVITY_ID_FOUND, 1, PMLOGKFV("Activity","%llu",id), "");
 	}
 
-	boost::shared_ptr<Activity> act = boost::make_shared<Activity>(id,
-		shared_from_this());
+	m_idAllocator.Claim(id);
+
+	boost::shared_ptr<Activity> act = boost::allocate_shared<Activity>(
+		POOL_ALLOCATOR(Activity), id, shared_from_this());
 	m_idTable.insert(*act);
 
 	return act;
 }
 
+void ActivityManager::ReleaseActivityId(activityId_t id)
+{
+	m_idAllocator.Release(id);
+}
+
 void ActivityManager::ReleaseActivity(boost::shared_ptr<Activity> act)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -196,17 +237,14 @@ void ActivityManager::ReleaseActivity(boost::shared_ptr<Activity> act)
 
 	EvictQueue(act);
 
-	ActivityMap::iterator iter = m_activities.find(act->GetId());
-	if (iter == m_activities.end()) {
-		LOG_AM_WARNING(MSGID_RELEASE_ACTIVITY_NOTFOUND, 1, PMLOGKFV("Activity","%llu",act->GetId()),
-			"Not found in Activity table while attempting to release");
-	} else {
-		if (iter->second == act) {
-			m_activities.erase(iter);
+	if (!m_activities.Erase(act->m_idHash, ActivityPtrMatch(act.get()))) {
+		if (!m_activities.Find(act->m_idHash, ActivityIdMatch(act->GetId()))) {
+			LOG_AM_WARNING(MSGID_RELEASE_ACTIVITY_NOTFOUND, 1, PMLOGKFV("Activity","%llu",act->GetId()),
+				"Not found in Activity table while attempting to release");
 		}
 	}
 
-	CheckReadyQueue();
+	RequestDispatch();
 }
 
 ActivityManager::ActivityVec ActivityManager::GetActivities() const
@@ -214,11 +252,12 @@ ActivityManager::ActivityVec ActivityManager::GetActivities() const
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 
 	ActivityVec out;
-	out.reserve(m_activities.size());
+	out.reserve(m_activities.Size());
 
-	std::transform(m_activities.begin(), m_activities.end(),
-		std::back_inserter(out),
-		boost::bind(&ActivityMap::value_type::second, _1));
+	m_activities.ForEach(boost::bind(&PushActivity, boost::ref(out), _1));
+
+	/* The index is unordered; keep listing in Activity ID order */
+	std::sort(out.begin(), out.end(), &ActivityIdLess);
 
 	return out;
 }
@@ -366,7 +405,8 @@ void ActivityManager::Enable(unsigned mask)
 	m_enabled |= (mask & ENABLE_MASK);
 
 	if (IsEnabled()) {
-		ScheduleAllActivities();
+		m_schedulePending = true;
+		RequestDispatch();
 	}
 }
 
@@ -395,8 +435,6 @@ bool ActivityManager::IsEnabled() const
 	return (m_enabled & ENABLE_MASK) == ENABLE_MASK;
 }
 
-#ifdef ACTIVITYMANAGER_DEVELOPER_METHODS
-
 unsigned int ActivityManager::SetBackgroundConcurrencyLevel(unsigned int level)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -411,11 +449,18 @@ unsigned int ActivityManager::SetBackgroundConcurrencyLevel(unsigned int level)
 	m_backgroundConcurrencyLevel = level;
 
 	/* May want to run more Background Activities */
-	CheckReadyQueue();
+	RequestDispatch();
 
 	return oldLevel;
 }
 
+unsigned int ActivityManager::GetBackgroundConcurrencyLevel() const
+{
+	return m_backgroundConcurrencyLevel;
+}
+
+#ifdef ACTIVITYMANAGER_DEVELOPER_METHODS
+
 void ActivityManager::EvictBackgroundActivity(
 	boost::shared_ptr<Activity> act)
 {
@@ -433,14 +478,14 @@ void ActivityManager::EvictBackgroundActivity(
 	}
 
 	if (iter != m_runQueue[RunQueueBackground].end()) {
-		act->m_runQueueItem.unlink();
-		m_runQueue[RunQueueLongBackground].push_back(*act);
+		DequeueActivity(*act);
+		QueueActivity(*act, RunQueueLongBackground);
 	} else {
 		LOG_AM_ERROR(MSGID_ACTIVITY_NOT_ON_BACKGRND_Q, 1, PMLOGKFV("Activity","%llu",act->GetId()), "");
 		throw std::runtime_error("Activity not on background queue");
 	}
 
-	CheckReadyQueue();
+	RequestDispatch();
 }
 
 void ActivityManager::EvictAllBackgroundActivities()
@@ -450,11 +495,11 @@ void ActivityManager::EvictAllBackgroundActivities()
 
 	while (!m_runQueue[RunQueueBackground].empty()) {
 		Activity& act = m_runQueue[RunQueueBackground].front();
-		act.m_runQueueItem.unlink();
-		m_runQueue[RunQueueLongBackground].push_back(act);
+		DequeueActivity(act);
+		QueueActivity(act, RunQueueLongBackground);
 	}
 
-	CheckReadyQueue();
+	RequestDispatch();
 }
 
 void ActivityManager::RunReadyBackgroundActivity(
@@ -464,28 +509,13 @@ void ActivityManager::RunReadyBackgroundActivity(
 	LOG_AM_DEBUG("Attepting to run ready [Activity %llu]",
 		act->GetId());
 
-	ActivityRunQueue::iterator iter;
-	for (iter = m_runQueue[RunQueueReady].begin();
-		iter != m_runQueue[RunQueueReady].end(); ++iter) {
-		if (&(*iter) == &(*act)) {
-			break;
-		}
-	}
-
-	if (iter != m_runQueue[RunQueueReady].end()) {
-		RunReadyBackgroundActivity(*iter);
+	if (IsReadyActivity(*act, ReadyQueueBackground)) {
+		RunReadyBackgroundActivity(*act);
 		return;
 	}
 
-	for (iter = m_runQueue[RunQueueReadyInteractive].begin();
-		iter != m_runQueue[RunQueueReadyInteractive].end(); ++iter) {
-		if (&(*iter) == &(*act)) {
-			break;
-		}
-	}
-
-	if (iter != m_runQueue[RunQueueReadyInteractive].end()) {
-		RunReadyBackgroundInteractiveActivity(*iter);
+	if (IsReadyActivity(*act, ReadyQueueInteractive)) {
+		RunReadyBackgroundInteractiveActivity(*act);
 		return;
 	}
 
@@ -499,14 +529,55 @@ void ActivityManager::RunAllReadyActivities()
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("Running all Activities currently in the Ready state");
 
-	while (!m_runQueue[RunQueueReadyInteractive].empty()) {
+	while (!IsReadyQueueEmpty(ReadyQueueInteractive)) {
 		RunReadyBackgroundInteractiveActivity(
-			m_runQueue[RunQueueReadyInteractive].front());
+			*SelectNextReadyActivity(ReadyQueueInteractive));
+	}
+
+	while (!IsReadyQueueEmpty(ReadyQueueBackground)) {
+		RunReadyBackgroundActivity(
+			*SelectNextReadyActivity(ReadyQueueBackground));
+	}
+}
+
+unsigned int ActivityManager::SetReadyQueueAgingSeconds(unsigned int seconds)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	if (seconds != NoReadyQueueAging) {
+		LOG_AM_DEBUG("Ready queue aging set to one priority level every %u seconds",
+			seconds);
+	} else {
+		LOG_AM_DEBUG("Ready queue aging disabled");
+	}
+
+	unsigned int oldSeconds = m_readyAgingSeconds;
+	m_readyAgingSeconds = seconds;
+
+	return oldSeconds;
+}
+
+unsigned int ActivityManager::SetCreatorWeight(const BusId& creator,
+	unsigned int weight)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Fair share weight for [BusId %s] set to %u",
+		creator.GetString().c_str(), weight);
+
+	unsigned int oldWeight = GetCreatorWeight(creator);
+
+	if (weight == 0) {
+		weight = DefaultCreatorWeight;
+	} else if (weight > MaxCreatorWeight) {
+		weight = MaxCreatorWeight;
 	}
 
-	while (!m_runQueue[RunQueueReady].empty()) {
-		RunReadyBackgroundActivity(m_runQueue[RunQueueReady].front());
+	if (weight == DefaultCreatorWeight) {
+		m_creatorWeights.erase(creator);
+	} else {
+		m_creatorWeights[creator] = weight;
 	}
+
+	return oldWeight;
 }
 
 #endif /* ACTIVITYMANAGER_DEVELOPER_METHODS */
@@ -521,16 +592,16 @@ void ActivityManager::InformActivityInitialized(
 	/* If an Activity is restarting, it will be parked (temporarily) in
 	 * the ended queue. */
 	if (act->m_runQueueItem.is_linked()) {
-		act->m_runQueueItem.unlink();
+		DequeueActivity(*act);
 	}
 
 	/* If the Activity Manager isn't enabled yet, just queue the Activities.
 	 * otherwise, schedule them immediately. */
 	if (IsEnabled()) {
-		m_runQueue[RunQueueScheduled].push_back(*act);
+		QueueActivity(*act, RunQueueScheduled);
 		act->ScheduleActivity();
 	} else {
-		m_runQueue[RunQueueInitialized].push_back(*act);
+		QueueActivity(*act, RunQueueInitialized);
 	}
 }
 
@@ -540,23 +611,23 @@ void ActivityManager::InformActivityReady(boost::shared_ptr<Activity> act)
 	LOG_AM_DEBUG("[Activity %llu] Now ready to run", act->GetId());
 
 	if (act->m_runQueueItem.is_linked()) {
-		act->m_runQueueItem.unlink();
+		DequeueActivity(*act);
 	} else {
 		LOG_AM_DEBUG("[Activity %llu] not found on any run queue when moving to ready state",
 			act->GetId());
 	}
 
 	if (act->IsImmediate()) {
-		m_runQueue[RunQueueImmediate].push_back(*act);
+		QueueActivity(*act, RunQueueImmediate);
 		RunActivity(*act);
 	} else {
 		if (act->IsUserInitiated()) {
-			m_runQueue[RunQueueReadyInteractive].push_back(*act);
+			EnqueueReadyActivity(*act, ReadyQueueInteractive);
 		} else {
-			m_runQueue[RunQueueReady].push_back(*act);
+			EnqueueReadyActivity(*act, ReadyQueueBackground);
 		}
 
-		CheckReadyQueue();
+		RequestDispatch();
 	}
 }
 
@@ -567,13 +638,13 @@ void ActivityManager::InformActivityNotReady(boost::shared_ptr<Activity> act)
 		act->GetId());
 
 	if (act->m_runQueueItem.is_linked()) {
-		act->m_runQueueItem.unlink();
+		DequeueActivity(*act);
 	} else {
 		LOG_AM_DEBUG("[Activity %llu] not found on any run queue when moving to not ready state",
 			act->GetId());
 	}
 
-	m_runQueue[RunQueueScheduled].push_back(*act);
+	QueueActivity(*act, RunQueueScheduled);
 }
 
 void ActivityManager::InformActivityRunning(boost::shared_ptr<Activity> act)
@@ -599,15 +670,15 @@ void ActivityManager::InformActivityEnd(boost::shared_ptr<Activity> act)
 	/* If Activity was never fully initialized, it's ok for it not to be on
 	 * a queue here */
 	if (act->m_runQueueItem.is_linked()) {
-		act->m_runQueueItem.unlink();
+		DequeueActivity(*act);
 	}
 
-	m_runQueue[RunQueueEnded].push_back(*act);
+	QueueActivity(*act, RunQueueEnded);
 
 	m_resourceManager->Dissociate(act);
 
 	/* Could be room to run more background Activities */
-	CheckReadyQueue();
+	RequestDispatch();
 }
 
 void ActivityManager::InformActivityGainedSubscriberId(
@@ -637,16 +708,153 @@ void ActivityManager::ScheduleAllActivities()
 
 	while (!m_runQueue[RunQueueInitialized].empty()) {
 		Activity& act = m_runQueue[RunQueueInitialized].front();
-		act.m_runQueueItem.unlink();
+		DequeueActivity(act);
 
 		LOG_AM_DEBUG("Granting [Activity %llu] permission to schedule",
 			act.GetId());
 
-		m_runQueue[RunQueueScheduled].push_back(act);
+		QueueActivity(act, RunQueueScheduled);
 		act.ScheduleActivity();
 	}
 }
 
+void ActivityManager::RequestDispatch()
+{
+#ifdef ACTIVITYMANAGER_DEFERRED_DISPATCH
+	m_dispatchRequests++;
+
+	/* Already pending, this request will be handled by that pass */
+	if (m_dispatchSource) {
+		return;
+	}
+
+	LOG_AM_DEBUG("Scheduling dispatch pass");
+
+	GSource *source = g_idle_source_new();
+	g_source_set_callback(source, ActivityManager::StaticDispatchIdle, this,
+		NULL);
+	g_source_attach(source, g_main_context_default());
+
+	m_dispatchSource = source;
+#else
+	m_dispatchRequests++;
+	DispatchPass();
+#endif
+}
+
+void ActivityManager::DispatchPass()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	m_dispatchPasses++;
+
+	if (m_schedulePending) {
+		m_schedulePending = false;
+
+		if (IsEnabled()) {
+			ScheduleAllActivities();
+		}
+	}
+
+	CheckReadyQueue();
+}
+
+gboolean ActivityManager::StaticDispatchIdle(gpointer data)
+{
+	ActivityManager *am = static_cast<ActivityManager *>(data);
+
+	/* Reset now, so any dispatch requested during the pass gets a new one */
+	am->m_dispatchSource = NULL;
+
+	try {
+		am->DispatchPass();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_DISPATCH_EXCEPTION, 0, "Unhandled exception \"%s\" occurred during dispatch pass", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_DISPATCH_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred during dispatch pass");
+	}
+
+	return false;
+}
+
+void ActivityManager::RequestActivityUpdate(Activity& act)
+{
+	m_updateRequests++;
+
+#ifdef ACTIVITYMANAGER_COALESCE_UPDATES
+	/* Already waiting, the pending update will carry this change too */
+	if (act.m_updateListItem.is_linked()) {
+		m_updatesCoalesced++;
+		return;
+	}
+
+	LOG_AM_DEBUG("[Activity %llu] Deferring update event", act.GetId());
+
+	m_pendingUpdates.push_back(act);
+
+	if (!m_updateSource) {
+		GSource *source = g_idle_source_new();
+		g_source_set_callback(source, ActivityManager::StaticUpdateIdle,
+			this, NULL);
+		g_source_attach(source, g_main_context_default());
+
+		m_updateSource = source;
+	}
+#else
+	m_updatesSent++;
+	act.BroadcastEvent(ActivityUpdateEvent);
+#endif
+}
+
+void ActivityManager::FlushActivityUpdates()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	while (!m_pendingUpdates.empty()) {
+		/* Hold a reference, subscribers may be cancelled (and the Activity
+		 * released) as events are sent */
+		boost::shared_ptr<Activity> act =
+			m_pendingUpdates.front().shared_from_this();
+		m_pendingUpdates.pop_front();
+
+		m_updatesSent++;
+		act->BroadcastEvent(ActivityUpdateEvent);
+	}
+}
+
+void ActivityManager::SendPendingActivityUpdate(Activity& act,
+	ActivityEvent_t event)
+{
+	act.m_updateListItem.unlink();
+
+	/* An update being broadcast anyway carries the pending one too */
+	if (event == ActivityUpdateEvent) {
+		m_updatesCoalesced++;
+		return;
+	}
+
+	m_updatesSent++;
+	act.BroadcastEvent(ActivityUpdateEvent);
+}
+
+gboolean ActivityManager::StaticUpdateIdle(gpointer data)
+{
+	ActivityManager *am = static_cast<ActivityManager *>(data);
+
+	/* Reset now, so any update requested during the flush gets a new one */
+	am->m_updateSource = NULL;
+
+	try {
+		am->FlushActivityUpdates();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_UPDATE_FLUSH_EXCEPTION, 0, "Unhandled exception \"%s\" occurred while flushing update events", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_UPDATE_FLUSH_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred while flushing update events");
+	}
+
+	return false;
+}
+
 void ActivityManager::EvictQueue(boost::shared_ptr<Activity> act)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -654,7 +862,7 @@ void ActivityManager::EvictQueue(boost::shared_ptr<Activity> act)
 	if (act->m_runQueueItem.is_linked()) {
 		LOG_AM_DEBUG("[Activity %llu] evicted from run queue on release",
 			act->GetId());
-		act->m_runQueueItem.unlink();
+		DequeueActivity(*act);
 	}
 }
 
@@ -673,12 +881,12 @@ void ActivityManager::RunReadyBackgroundActivity(Activity& act)
 	LOG_AM_DEBUG("Running background [Activity %llu]", act.GetId());
 
 	if (act.m_runQueueItem.is_linked()) {
-		act.m_runQueueItem.unlink();
+		DequeueActivity(act);
 	} else {
 		LOG_AM_WARNING(MSGID_ATTEMPT_RUN_BACKGRND_ACTIVITY, 1, PMLOGKFV("Activity","%llu",act.GetId()), "");
 	}
 
-	m_runQueue[RunQueueBackground].push_back(act);
+	QueueActivity(act, RunQueueBackground);
 
 	RunActivity(act);
 }
@@ -690,13 +898,13 @@ void ActivityManager::RunReadyBackgroundInteractiveActivity(Activity& act)
 		act.GetId());
 
 	if (act.m_runQueueItem.is_linked()) {
-		act.m_runQueueItem.unlink();
+		DequeueActivity(act);
 	} else {
 		LOG_AM_DEBUG("[Activity %llu] was not queued attempting to run background interactive Activity",
 			 act.GetId());
 	}
 
-	m_runQueue[RunQueueBackgroundInteractive].push_back(act);
+	QueueActivity(act, RunQueueBackgroundInteractive);
 
 	RunActivity(act);
 }
@@ -718,13 +926,13 @@ void ActivityManager::CheckReadyQueue()
 				< m_backgroundInteractiveConcurrencyLevel) ||
 			(m_backgroundInteractiveConcurrencyLevel
 				== UnlimitedBackgroundConcurrency))
-			&& !m_runQueue[RunQueueReadyInteractive].empty()) {
+			&& !IsReadyQueueEmpty(ReadyQueueInteractive)) {
 		RunReadyBackgroundInteractiveActivity(
-			m_runQueue[RunQueueReadyInteractive].front());
+			*SelectNextReadyActivity(ReadyQueueInteractive));
 		ranInteractive = true;
 	}
 
-	if (!m_runQueue[RunQueueReadyInteractive].empty()) {
+	if (!IsReadyQueueEmpty(ReadyQueueInteractive)) {
 		if (ranInteractive) {
 			UpdateYieldTimeout();
 		} else if (!m_interactiveYieldTimeout) {
@@ -739,11 +947,216 @@ void ActivityManager::CheckReadyQueue()
 	while (((GetRunningBackgroundActivitiesCount()
 				< m_backgroundConcurrencyLevel) ||
 			(m_backgroundConcurrencyLevel == UnlimitedBackgroundConcurrency))
-			&& !m_runQueue[RunQueueReady].empty()) {
-		RunReadyBackgroundActivity(m_runQueue[RunQueueReady].front());
+			&& !IsReadyQueueEmpty(ReadyQueueBackground)) {
+		RunReadyBackgroundActivity(
+			*SelectNextReadyActivity(ReadyQueueBackground));
 	}
 }
 
+void ActivityManager::QueueActivity(Activity& act, RunQueueId queue)
+{
+	act.m_runQueueId = queue;
+	act.m_queueTime = GetMonotonicMicroseconds();
+	m_runQueue[queue].push_back(act);
+}
+
+/* Removes the Activity from whichever run queue it's on, recording how long
+ * it was there against that queue and the Activity's priority. */
+void ActivityManager::DequeueActivity(Activity& act)
+{
+	if (!act.m_runQueueItem.is_linked()) {
+		return;
+	}
+
+	if ((act.m_runQueueId >= 0) && (act.m_runQueueId < RunQueueMax)) {
+		unsigned long long now = GetMonotonicMicroseconds();
+		m_queueLatency[act.m_runQueueId][act.GetPriority()].Record(
+			(now > act.m_queueTime) ? (now - act.m_queueTime) : 0);
+	}
+
+	act.m_runQueueId = RunQueueNone;
+	act.m_runQueueItem.unlink();
+	act.m_readyCreatorItem.unlink();
+}
+
+void ActivityManager::EnqueueReadyActivity(Activity& act, ReadyQueueId queue)
+{
+	LOG_AM_DEBUG("[Activity %llu] Queued ready at priority %s",
+		act.GetId(), ActivityPriorityNames[act.GetPriority()]);
+
+	act.m_runQueueId = (queue == ReadyQueueInteractive) ?
+		RunQueueReadyInteractive : RunQueueReady;
+	act.m_queueTime = GetMonotonicMicroseconds();
+	m_readyQueue[queue][act.GetPriority()].push_back(act);
+
+	boost::shared_ptr<CreatorReadyQueue>& creator =
+		m_creatorReady[queue][act.GetPriority()][act.GetCreator()];
+	if (!creator) {
+		creator = boost::make_shared<CreatorReadyQueue>();
+	}
+	creator->m_queue.push_back(act);
+}
+
+/* Selects the priority queue whose oldest Activity has the highest
+ * effective priority, which is its priority raised by one level for every
+ * m_readyAgingSeconds it has been waiting (up to "highest").  Ties go to
+ * the Activity that has waited longest, so an aged Activity eventually
+ * runs ahead of newer arrivals at any priority.  Only the front of each
+ * priority queue needs to be considered, as it's the oldest at that
+ * priority.  The Activity to run is then picked from that queue by fair
+ * share across creators. */
+Activity *ActivityManager::SelectNextReadyActivity(ReadyQueueId queue)
+{
+	unsigned long long now = GetMonotonicMicroseconds();
+
+	Activity *next = NULL;
+	int nextPriority = -1;
+	int nextQueue = -1;
+
+	for (int i = MaxActivityPriority - 1; i >= 0; i--) {
+		if (m_readyQueue[queue][i].empty()) {
+			continue;
+		}
+
+		Activity& act = m_readyQueue[queue][i].front();
+
+		int priority = i;
+		if ((m_readyAgingSeconds != NoReadyQueueAging) &&
+			(now > act.m_queueTime)) {
+			priority += (int)((now - act.m_queueTime) /
+				(m_readyAgingSeconds * 1000000ULL));
+			if (priority > ActivityPriorityHighest) {
+				priority = ActivityPriorityHighest;
+			}
+		}
+
+		if ((priority > nextPriority) || ((priority == nextPriority) &&
+			(act.m_queueTime < next->m_queueTime))) {
+			next = &act;
+			nextPriority = priority;
+			nextQueue = i;
+		}
+	}
+
+	if (!next) {
+		return NULL;
+	}
+
+	if (nextPriority != nextQueue) {
+		LOG_AM_DEBUG("Priority %s ready queue aged to %s",
+			ActivityPriorityNames[nextQueue],
+			ActivityPriorityNames[nextPriority]);
+	}
+
+	return SelectFairShareActivity(queue, nextQueue);
+}
+
+/* Deficit round robin across creators, within the selected priority queue.
+ * Each creator with Activities waiting is granted its weight in run slots
+ * per round; the oldest Activity whose creator still has a slot left this
+ * round is chosen, and charged one.  When every waiting creator has used
+ * its share, a new round begins.  Creators with nothing waiting drop out
+ * of the round (and lose any unused share), so a service that floods the
+ * queue gets no more than its weighted share of slots, while quiet
+ * services run promptly.  Only the front of each creator's queue needs to
+ * be considered, so this is linear in the number of creators waiting. */
+Activity *ActivityManager::SelectFairShareActivity(ReadyQueueId queue,
+	int priority)
+{
+	CreatorReadyMap& creators = m_creatorReady[queue][priority];
+
+	CreatorReadyMap::iterator iter = creators.begin();
+	while (iter != creators.end()) {
+		if (iter->second->m_queue.empty()) {
+			creators.erase(iter++);
+		} else {
+			++iter;
+		}
+	}
+
+	/* Weights are at least 1, so a new round always has a slot to give */
+	for (int round = 0; round < 2; round++) {
+		CreatorReadyQueue *next = NULL;
+
+		for (iter = creators.begin(); iter != creators.end(); ++iter) {
+			CreatorReadyQueue& creator = *iter->second;
+			if ((creator.m_deficit > 0) && (!next ||
+				(creator.m_queue.front().m_queueTime <
+					next->m_queue.front().m_queueTime))) {
+				next = &creator;
+			}
+		}
+
+		if (next) {
+			next->m_deficit--;
+			return &next->m_queue.front();
+		}
+
+		LOG_AM_DEBUG("Starting new fair share round for %u creators",
+			(unsigned)creators.size());
+
+		for (iter = creators.begin(); iter != creators.end(); ++iter) {
+			iter->second->m_deficit = GetCreatorWeight(iter->first);
+		}
+	}
+
+	/* Every ready Activity is on its creator's queue, so this is only
+	 * reached if the selected queue is empty */
+	if (m_readyQueue[queue][priority].empty()) {
+		return NULL;
+	} else {
+		return &m_readyQueue[queue][priority].front();
+	}
+}
+
+unsigned ActivityManager::GetCreatorWeight(const BusId& creator) const
+{
+	CreatorWeightMap::const_iterator found = m_creatorWeights.find(creator);
+	if (found != m_creatorWeights.end()) {
+		return found->second;
+	} else {
+		return DefaultCreatorWeight;
+	}
+}
+
+bool ActivityManager::IsReadyActivity(const Activity& act,
+	ReadyQueueId queue) const
+{
+	for (int i = 0; i < MaxActivityPriority; i++) {
+		for (ActivityRunQueue::const_iterator iter =
+				m_readyQueue[queue][i].begin();
+			iter != m_readyQueue[queue][i].end(); ++iter) {
+			if (&(*iter) == &act) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool ActivityManager::IsReadyQueueEmpty(ReadyQueueId queue) const
+{
+	for (int i = 0; i < MaxActivityPriority; i++) {
+		if (!m_readyQueue[queue][i].empty()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+unsigned ActivityManager::GetReadyActivitiesCount(ReadyQueueId queue) const
+{
+	size_t count = 0;
+
+	for (int i = 0; i < MaxActivityPriority; i++) {
+		count += m_readyQueue[queue][i].size();
+	}
+
+	return (unsigned)count;
+}
+
 void ActivityManager::UpdateYieldTimeout()
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -775,7 +1188,7 @@ void ActivityManager::InteractiveYieldTimeout()
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("Background interactive yield timeout triggered");
 
-	if (m_runQueue[RunQueueReadyInteractive].empty()) {
+	if (IsReadyQueueEmpty(ReadyQueueInteractive)) {
 		LOG_AM_DEBUG("Ready interactive queue is empty, cancelling yield timeout");
 		CancelYieldTimeout();
 		return;
@@ -783,7 +1196,7 @@ void ActivityManager::InteractiveYieldTimeout()
 
 	/* XXX make 1 more Activity yield, but only if there are fewer Activities
 	 * yielding than waiting in the interactive queue. */
-	unsigned waiting = (unsigned) m_runQueue[RunQueueReadyInteractive].size();
+	unsigned waiting = GetReadyActivitiesCount(ReadyQueueInteractive);
 	unsigned yielding = 0;
 
 	boost::shared_ptr<Activity> victim;
@@ -819,41 +1232,33 @@ void ActivityManager::InteractiveYieldTimeout()
 	UpdateYieldTimeout();
 }
 
-bool ActivityManager::ActivityNameComp::operator()(
-	const Activity& act1, const Activity& act2) const
-{
-	const std::string& act1Name = act1.GetName();
-	const std::string& act2Name = act2.GetName();
-
-	if (act1Name != act2Name) {
-		return act1Name < act2Name;
-	} else {
-		return act1.GetCreator() < act2.GetCreator();
-	}
-}
-
-bool ActivityManager::ActivityNameComp::operator()(
-	const ActivityKey& key, const Activity& act) const
+bool ActivityManager::ActivityIdMatch::operator()(
+	const boost::shared_ptr<Activity>& act) const
 {
-	return key < ActivityKey(act.GetName(), act.GetCreator());
+	return act->GetId() == m_id;
 }
 
-bool ActivityManager::ActivityNameComp::operator()(
-	const Activity& act, const ActivityKey& key) const
+bool ActivityManager::ActivityNameMatch::operator()(
+	const Activity *act) const
 {
-	return ActivityKey(act.GetName(), act.GetCreator()) < key;
+	if (m_nameOnly) {
+		return act->GetName() == m_name;
+	} else {
+		return (act->m_creatorHash == m_creatorHash) &&
+			(act->GetName() == m_name) && (act->GetCreator() == m_creator);
+	}
 }
 
-bool ActivityManager::ActivityNameOnlyComp::operator()(
-	const ActivityKey& key, const Activity& act) const
+bool ActivityManager::ActivityPtrMatch::operator()(
+	const Activity *act) const
 {
-	return key.first < act.GetName();
+	return act == m_act;
 }
 
-bool ActivityManager::ActivityNameOnlyComp::operator()(
-	const Activity& act, const ActivityKey& key) const
+bool ActivityManager::ActivityPtrMatch::operator()(
+	const boost::shared_ptr<Activity>& act) const
 {
-	return act.GetName() < key.first;
+	return act.get() == m_act;
 }
 
 bool ActivityManager::ActivityIdComp::operator()(
@@ -884,13 +1289,26 @@ MojErr ActivityManager::InfoToJson(MojObject& rep) const
 	MojObject queues(MojObject::TypeArray);
 
 	for (int i = 0; i < RunQueueMax; i++) {
-		if (!m_runQueue[i].empty()) {
-			MojObject activities(MojObject::TypeArray);
-
+		MojObject activities(MojObject::TypeArray);
+
+		if ((i == RunQueueReady) || (i == RunQueueReadyInteractive)) {
+			/* Ready queues are listed highest priority first */
+			ReadyQueueId readyQueue = (i == RunQueueReady) ?
+				ReadyQueueBackground : ReadyQueueInteractive;
+
+			for (int j = MaxActivityPriority - 1; j >= 0; j--) {
+				std::for_each(m_readyQueue[readyQueue][j].begin(),
+					m_readyQueue[readyQueue][j].end(),
+					boost::bind(&Activity::PushIdentityJson, _1,
+						boost::ref(activities)));
+			}
+		} else {
 			std::for_each(m_runQueue[i].begin(), m_runQueue[i].end(),
 				boost::bind(&Activity::PushIdentityJson, _1,
 					boost::ref(activities)));
+		}
 
+		if (!activities.empty()) {
 			MojObject queue;
 			err = queue.putString(_T("name"), RunQueueNames[i]);
 			MojErrCheck(err);
@@ -908,19 +1326,149 @@ MojErr ActivityManager::InfoToJson(MojObject& rep) const
 		MojErrCheck(err);
 	}
 
+	/* Scheduling passes, and how many requests they absorbed */
+	MojObject dispatch(MojObject::TypeObject);
+
+	err = dispatch.put(_T("requests"), (MojInt64)m_dispatchRequests);
+	MojErrCheck(err);
+
+	err = dispatch.put(_T("passes"), (MojInt64)m_dispatchPasses);
+	MojErrCheck(err);
+
+	err = dispatch.put(_T("coalesced"),
+		(MojInt64)(m_dispatchRequests - m_dispatchPasses));
+	MojErrCheck(err);
+
+	err = rep.put(_T("dispatch"), dispatch);
+	MojErrCheck(err);
+
+	/* Update events requested, and how many were folded into one already
+	 * waiting to be sent */
+	MojObject updates(MojObject::TypeObject);
+
+	err = updates.put(_T("requests"), (MojInt64)m_updateRequests);
+	MojErrCheck(err);
+
+	err = updates.put(_T("sent"), (MojInt64)m_updatesSent);
+	MojErrCheck(err);
+
+	err = updates.put(_T("coalesced"), (MojInt64)m_updatesCoalesced);
+	MojErrCheck(err);
+
+	err = updates.put(_T("pending"), (MojInt64)m_pendingUpdates.size());
+	MojErrCheck(err);
+
+	err = rep.put(_T("updates"), updates);
+	MojErrCheck(err);
+
+	/* Event replies built, and shared between subscribers */
+	MojObject payloads(MojObject::TypeObject);
+
+	err = Activity::EventPayloadInfoToJson(payloads);
+	MojErrCheck(err);
+
+	err = rep.put(_T("eventPayloads"), payloads);
+	MojErrCheck(err);
+
+	/* Activity JSON representations built, and reused from the cache */
+	MojObject json(MojObject::TypeObject);
+
+	err = Activity::JsonCacheInfoToJson(json);
+	MojErrCheck(err);
+
+	err = rep.put(_T("activityJson"), json);
+	MojErrCheck(err);
+
+	/* Loaded Activities whose trigger, callback, and requirements haven't
+	 * been built yet, and those that have */
+	MojObject deferred(MojObject::TypeObject);
+
+	err = Activity::DeferredSpecInfoToJson(deferred);
+	MojErrCheck(err);
+
+	err = rep.put(_T("deferredSpecs"), deferred);
+	MojErrCheck(err);
+
+	MojObject ids(MojObject::TypeObject);
+
+	err = m_idAllocator.ToJson(ids);
+	MojErrCheck(err);
+
+	err = rep.put(_T("ids"), ids);
+	MojErrCheck(err);
+
+	/* Distinct bus identities interned, released once nothing uses them */
+	err = rep.put(_T("busIds"), (MojInt64)BusId::GetSymbolCount());
+	MojErrCheck(err);
+
+	/* Activities in each state, and the state transitions seen */
+	MojObject states(MojObject::TypeObject);
+
+	err = Activity::StateInfoToJson(states);
+	MojErrCheck(err);
+
+	err = rep.put(_T("activityStates"), states);
+	MojErrCheck(err);
+
+	/* How long Activities have spent on each run queue, overall and by
+	 * priority (microseconds) */
+	MojObject latencies(MojObject::TypeArray);
+
+	for (int i = 0; i < RunQueueMax; i++) {
+		LatencyHistogram total;
+		MojObject priorities(MojObject::TypeArray);
+
+		for (int j = MaxActivityPriority - 1; j >= 0; j--) {
+			const LatencyHistogram& histogram = m_queueLatency[i][j];
+			if (!histogram.GetCount()) {
+				continue;
+			}
+
+			total.Merge(histogram);
+
+			MojObject priority(MojObject::TypeObject);
+			err = priority.putString(_T("priority"), ActivityPriorityNames[j]);
+			MojErrCheck(err);
+
+			err = histogram.ToJson(priority);
+			MojErrCheck(err);
+
+			err = priorities.push(priority);
+			MojErrCheck(err);
+		}
+
+		if (!total.GetCount()) {
+			continue;
+		}
+
+		MojObject queue(MojObject::TypeObject);
+		err = queue.putString(_T("name"), RunQueueNames[i]);
+		MojErrCheck(err);
+
+		err = total.ToJson(queue);
+		MojErrCheck(err);
+
+		err = queue.put(_T("priorities"), priorities);
+		MojErrCheck(err);
+
+		err = latencies.push(queue);
+		MojErrCheck(err);
+	}
+
+	if (!latencies.empty()) {
+		err = rep.put(_T("queueLatency"), latencies);
+		MojErrCheck(err);
+	}
+
+	/* Instantiated Activities that are no longer live (in ID order) */
 	std::vector<boost::shared_ptr<const Activity> > leaked;
 
-	boost::shared_ptr<const Activity> (Activity::*shared_from_this_ptr) () const = &Activity::shared_from_this;
-	std::set_difference(
-		boost::make_transform_iterator(m_idTable.cbegin(),
-			boost::bind(shared_from_this_ptr, _1)),
-		boost::make_transform_iterator(m_idTable.cend(),
-			boost::bind(shared_from_this_ptr, _1)),
-		boost::make_transform_iterator(m_activities.begin(),
-			boost::bind(&ActivityMap::value_type::second, _1)),
-		boost::make_transform_iterator(m_activities.end(),
-			boost::bind(&ActivityMap::value_type::second, _1)),
-		std::back_inserter(leaked));
+	for (ActivityIdTable::const_iterator iter = m_idTable.cbegin();
+		iter != m_idTable.cend(); ++iter) {
+		if (!m_activities.Find(iter->m_idHash, ActivityPtrMatch(&(*iter)))) {
+			leaked.push_back(iter->shared_from_this());
+		}
+	}
 
 	if (!leaked.empty()) {
 		MojObject leakedActivities(MojObject::TypeArray);
@@ -0,0 +1,296 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+#include "ActivitySnapshot.h"
+#include "OpenHashIndex.h"
+#include "Logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char ActivitySnapshot::Magic[8] = { 'A', 'M', 'S', 'N', 'A', 'P',
+	'\0', '\0' };
+
+ActivitySnapshot::ActivitySnapshot()
+	: m_map(NULL)
+	, m_mapLength(0)
+	, m_records(NULL)
+	, m_recordsLength(0)
+	, m_count(0)
+{
+}
+
+ActivitySnapshot::~ActivitySnapshot()
+{
+	Close();
+}
+
+size_t ActivitySnapshot::RecordSize(size_t idLength, size_t repLength)
+{
+	size_t size = sizeof(RecordHeader) + idLength + repLength;
+	return (size + RecordAlignment - 1) & ~(RecordAlignment - 1);
+}
+
+bool ActivitySnapshot::Open(const std::string& path)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	Close();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT) {
+			LOG_AM_WARNING(MSGID_SNAPSHOT_OPEN_FAIL, 2,
+				PMLOGKS("path",path.c_str()),
+				PMLOGKS("error",strerror(errno)), "");
+		}
+		return false;
+	}
+
+	struct stat st;
+	if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(Header))) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_INVALID, 1,
+			PMLOGKS("path",path.c_str()), "Snapshot is truncated");
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_OPEN_FAIL, 2,
+			PMLOGKS("path",path.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		return false;
+	}
+
+	m_map = map;
+	m_mapLength = (size_t)st.st_size;
+
+	const Header *header = (const Header *)m_map;
+	if ((memcmp(header->m_magic, Magic, sizeof(Magic)) != 0) ||
+		(header->m_version != Version) ||
+		(header->m_length != (m_mapLength - sizeof(Header)))) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_INVALID, 1,
+			PMLOGKS("path",path.c_str()),
+			"Snapshot header doesn't match this version or file length");
+		Close();
+		return false;
+	}
+
+	m_records = (const char *)m_map + sizeof(Header);
+	m_recordsLength = (size_t)header->m_length;
+
+	if (HashString(m_records, m_recordsLength) != (size_t)header->m_hash) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_INVALID, 1,
+			PMLOGKS("path",path.c_str()), "Snapshot records are corrupt");
+		Close();
+		return false;
+	}
+
+	/* Walk the records once, so Next() can trust the lengths */
+	m_count = header->m_count;
+
+	unsigned count = 0;
+	size_t offset = 0;
+	Record record;
+	while (Next(offset, record)) {
+		count++;
+	}
+
+	if ((count != header->m_count) || (offset != m_recordsLength)) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_INVALID, 1,
+			PMLOGKS("path",path.c_str()),
+			"Snapshot record count doesn't match");
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void ActivitySnapshot::Close()
+{
+	if (m_map) {
+		munmap(m_map, m_mapLength);
+	}
+
+	m_map = NULL;
+	m_mapLength = 0;
+	m_records = NULL;
+	m_recordsLength = 0;
+	m_count = 0;
+}
+
+unsigned ActivitySnapshot::GetCount() const
+{
+	return m_count;
+}
+
+bool ActivitySnapshot::Next(size_t& offset, Record& record) const
+{
+	if ((m_recordsLength - offset) < sizeof(RecordHeader)) {
+		return false;
+	}
+
+	RecordHeader header;
+	memcpy(&header, m_records + offset, sizeof(header));
+
+	size_t available = m_recordsLength - offset - sizeof(RecordHeader);
+	if (((size_t)header.m_idLength > available) ||
+		((size_t)header.m_repLength > (available - header.m_idLength))) {
+		return false;
+	}
+
+	record.m_rev = header.m_rev;
+	record.m_id = m_records + offset + sizeof(RecordHeader);
+	record.m_idLength = header.m_idLength;
+	record.m_rep = record.m_id + header.m_idLength;
+	record.m_repLength = header.m_repLength;
+
+	offset += RecordSize(header.m_idLength, header.m_repLength);
+	if (offset > m_recordsLength) {
+		offset = m_recordsLength;
+	}
+
+	return true;
+}
+
+ActivitySnapshotWriter::ActivitySnapshotWriter()
+	: m_count(0)
+{
+}
+
+ActivitySnapshotWriter::~ActivitySnapshotWriter()
+{
+}
+
+void ActivitySnapshotWriter::Add(const MojString& id, MojInt64 rev,
+	const MojString& rep)
+{
+	ActivitySnapshot::RecordHeader header;
+	header.m_rev = rev;
+	header.m_idLength = (uint32_t)id.length();
+	header.m_repLength = (uint32_t)rep.length();
+
+	size_t start = m_records.size();
+
+	m_records.append((const char *)&header, sizeof(header));
+	m_records.append(id.data(), id.length());
+	m_records.append(rep.data(), rep.length());
+	m_records.resize(start + ActivitySnapshot::RecordSize(id.length(),
+		rep.length()), '\0');
+
+	m_count++;
+}
+
+unsigned ActivitySnapshotWriter::GetCount() const
+{
+	return m_count;
+}
+
+bool ActivitySnapshotWriter::Commit(const std::string& path)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	ActivitySnapshot::Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, ActivitySnapshot::Magic, sizeof(header.m_magic));
+	header.m_version = ActivitySnapshot::Version;
+	header.m_count = m_count;
+	header.m_length = m_records.size();
+	header.m_hash = HashString(m_records.data(), m_records.size());
+
+	std::string tempPath = path + ".tmp";
+
+	int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_WRITE_FAIL, 2,
+			PMLOGKS("path",tempPath.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		return false;
+	}
+
+	const char *data[2] = { (const char *)&header, m_records.data() };
+	size_t length[2] = { sizeof(header), m_records.size() };
+
+	for (int i = 0; i < 2; i++) {
+		size_t written = 0;
+		while (written < length[i]) {
+			ssize_t ret = write(fd, data[i] + written, length[i] - written);
+			if (ret < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				LOG_AM_WARNING(MSGID_SNAPSHOT_WRITE_FAIL, 2,
+					PMLOGKS("path",tempPath.c_str()),
+					PMLOGKS("error",strerror(errno)), "");
+				close(fd);
+				unlink(tempPath.c_str());
+				return false;
+			}
+
+			written += (size_t)ret;
+		}
+	}
+
+	/* Always close, even if the sync failed */
+	int syncErr = (fsync(fd) < 0) ? errno : 0;
+	int closeErr = (close(fd) < 0) ? errno : 0;
+	if (syncErr || closeErr) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_WRITE_FAIL, 2,
+			PMLOGKS("path",tempPath.c_str()),
+			PMLOGKS("error",strerror(syncErr ? syncErr : closeErr)), "");
+		unlink(tempPath.c_str());
+		return false;
+	}
+
+	if (rename(tempPath.c_str(), path.c_str()) < 0) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_WRITE_FAIL, 2,
+			PMLOGKS("path",path.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		unlink(tempPath.c_str());
+		return false;
+	}
+
+	/* The rename is only durable once the directory is synced.  The new
+	 * snapshot is in place either way, so a failure here is just noted. */
+	std::string::size_type slash = path.rfind('/');
+	std::string directory = (slash == std::string::npos) ? "." :
+		((slash == 0) ? "/" : path.substr(0, slash));
+
+	int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if ((dirFd < 0) || (fsync(dirFd) < 0)) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_WRITE_FAIL, 2,
+			PMLOGKS("path",directory.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+	}
+
+	if (dirFd >= 0) {
+		close(dirFd);
+	}
+
+	return true;
+}
@@ -18,43 +18,208 @@
 
 #include "BusId.h"
 #include "Subscriber.h"
+#include "OpenHashIndex.h"
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+/*
+ * Interned bus identities.  Each symbol counts the BusIds that refer to it,
+ * and is released when the last of them goes away, so the anonymous
+ * (connection) identities of callers that come and go don't accumulate.
+ * Released handles are reused for new symbols.  (A deque keeps references
+ * to existing symbols stable as new ones are added.)  The null symbol,
+ * handle 0, is never released.
+ */
+class BusIdSymbolTable
+{
+public:
+	struct Symbol {
+		Symbol(const char *id, size_t len, BusIdType type, size_t hash)
+			: m_id(id, len)
+			, m_type(type)
+			, m_string(BusId::GetString(m_id, type))
+			, m_hash(hash)
+			, m_refs(0) {}
+
+		std::string	m_id;
+		BusIdType	m_type;
+		std::string	m_string;
+		size_t		m_hash;
+		unsigned	m_refs;
+	};
+
+	/* Never destroyed, so BusIds in static objects can still release
+	 * their symbols during exit */
+	static BusIdSymbolTable& Instance()
+	{
+		static BusIdSymbolTable *table = new BusIdSymbolTable;
+		return *table;
+	}
+
+	/* Returns the handle with a reference already taken for the caller */
+	unsigned Intern(const char *id, size_t len, BusIdType type)
+	{
+		size_t hash = HashCombine(HashString(id, len), (size_t)type);
+
+		const unsigned *found = m_index.Find(hash,
+			SymbolMatch(m_symbols, id, len, type));
+		if (found) {
+			AddRef(*found);
+			return *found;
+		}
+
+		unsigned handle;
+		if (!m_free.empty()) {
+			handle = m_free.back();
+			m_free.pop_back();
+			m_symbols[handle] = Symbol(id, len, type, hash);
+		} else {
+			handle = (unsigned)m_symbols.size();
+			m_symbols.push_back(Symbol(id, len, type, hash));
+		}
+
+		m_index.Insert(hash, handle);
+		AddRef(handle);
+
+		return handle;
+	}
+
+	void AddRef(unsigned handle)
+	{
+		if (handle != 0) {
+			m_symbols[handle].m_refs++;
+		}
+	}
+
+	void Release(unsigned handle)
+	{
+		if (handle == 0) {
+			return;
+		}
+
+		Symbol& symbol = m_symbols[handle];
+		if (--symbol.m_refs > 0) {
+			return;
+		}
+
+		m_index.Erase(symbol.m_hash, HandleMatch(handle));
+
+		/* Drop the strings now; the slot is refilled when it's reused */
+		symbol = Symbol("", 0, BusNull, 0);
+		m_free.push_back(handle);
+	}
+
+	const Symbol& Lookup(unsigned handle) const
+	{
+		return m_symbols[handle];
+	}
+
+	unsigned Size() const
+	{
+		return (unsigned)m_index.Size();
+	}
+
+private:
+	typedef std::deque<Symbol> SymbolQueue;
+
+	struct SymbolMatch {
+		SymbolMatch(const SymbolQueue& symbols, const char *id, size_t len,
+			BusIdType type)
+			: m_symbols(symbols), m_id(id), m_len(len), m_type(type) {}
+
+		bool operator()(unsigned handle) const
+		{
+			const Symbol& symbol = m_symbols[handle];
+			return (symbol.m_type == m_type) &&
+				(symbol.m_id.size() == m_len) &&
+				(symbol.m_id.compare(0, m_len, m_id, m_len) == 0);
+		}
+
+		const SymbolQueue&	m_symbols;
+		const char			*m_id;
+		size_t				m_len;
+		BusIdType			m_type;
+	};
+
+	struct HandleMatch {
+		HandleMatch(unsigned handle) : m_handle(handle) {}
+
+		bool operator()(unsigned handle) const
+		{
+			return (handle == m_handle);
+		}
+
+		unsigned	m_handle;
+	};
+
+	BusIdSymbolTable()
+	{
+		/* Handle 0 is reserved for the null BusId */
+		Intern("", 0, BusNull);
+	}
+
+	SymbolQueue				m_symbols;
+	std::vector<unsigned>	m_free;
+	OpenHashIndex<unsigned>	m_index;
+};
 
 BusId::BusId()
-	: m_type(BusNull)
+	: m_handle(0)
 {
 }
 
 BusId::BusId(const std::string& id, BusIdType type)
-	: m_id(id)
-	, m_type(type)
+	: m_handle(Intern(id.data(), id.size(), type))
 {
 }
 
 BusId::BusId(const char *id, BusIdType type)
-	: m_id(id)
-	, m_type(type)
+	: m_handle(Intern(id, strlen(id), type))
 {
 }
 
 BusId::BusId(const Subscriber& subscriber)
-	: m_id(subscriber.m_id.m_id)
-	, m_type(subscriber.m_id.m_type)
+	: m_handle(subscriber.m_id.m_handle)
+{
+	BusIdSymbolTable::Instance().AddRef(m_handle);
+}
+
+BusId::BusId(const BusId& rhs)
+	: m_handle(rhs.m_handle)
 {
+	BusIdSymbolTable::Instance().AddRef(m_handle);
+}
+
+BusId::~BusId()
+{
+	BusIdSymbolTable::Instance().Release(m_handle);
+}
+
+BusId::Handle BusId::Intern(const char *id, size_t len, BusIdType type)
+{
+	return BusIdSymbolTable::Instance().Intern(id, len, type);
+}
+
+unsigned BusId::GetSymbolCount()
+{
+	return BusIdSymbolTable::Instance().Size();
 }
 
 BusIdType BusId::GetType() const
 {
-	return m_type;
+	return BusIdSymbolTable::Instance().Lookup(m_handle).m_type;
 }
 
-std::string BusId::GetId() const
+const std::string& BusId::GetId() const
 {
-	return m_id;
+	return BusIdSymbolTable::Instance().Lookup(m_handle).m_id;
 }
 
-std::string BusId::GetString() const
+const std::string& BusId::GetString() const
 {
-	return GetString(m_id.c_str(), m_type);
+	return BusIdSymbolTable::Instance().Lookup(m_handle).m_string;
 }
 
 std::string BusId::GetString(const std::string& id,
@@ -75,18 +240,26 @@ std::string BusId::GetString(const char *id, BusIdType type)
 		return std::string("anonId:") + id;
 }
 
+size_t BusId::Hash() const
+{
+	return BusIdSymbolTable::Instance().Lookup(m_handle).m_hash;
+}
+
 MojErr BusId::ToJson(MojObject& rep) const
 {
 	MojErr err = MojErrNone;
 
-	if (m_type == BusApp) {
-		err = rep.putString(_T("appId"), m_id.c_str());
+	const BusIdSymbolTable::Symbol& symbol =
+		BusIdSymbolTable::Instance().Lookup(m_handle);
+
+	if (symbol.m_type == BusApp) {
+		err = rep.putString(_T("appId"), symbol.m_id.c_str());
 		MojErrCheck(err);
-	} else if (m_type == BusService) {
-		err = rep.putString(_T("serviceId"), m_id.c_str());
+	} else if (symbol.m_type == BusService) {
+		err = rep.putString(_T("serviceId"), symbol.m_id.c_str());
 		MojErrCheck(err);
 	} else {
-		err = rep.putString(_T("anonId"), m_id.c_str());
+		err = rep.putString(_T("anonId"), symbol.m_id.c_str());
 	}
 
 	return MojErrNone;
@@ -94,28 +267,32 @@ MojErr BusId::ToJson(MojObject& rep) const
 
 BusId& BusId::operator=(const Subscriber& rhs)
 {
-	m_id = rhs.m_id.m_id;
-	m_type = rhs.m_id.m_type;
+	return (*this = rhs.m_id);
+}
+
+BusId& BusId::operator=(const BusId& rhs)
+{
+	/* Reference the new symbol first, in case it's the same one */
+	BusIdSymbolTable::Instance().AddRef(rhs.m_handle);
+	BusIdSymbolTable::Instance().Release(m_handle);
+	m_handle = rhs.m_handle;
 
 	return *this;
 }
 
 bool BusId::operator<(const BusId& rhs) const
 {
-	if (m_type != rhs.m_type)
-		return (m_type < rhs.m_type);
-	else
-		return (m_id < rhs.m_id);
+	return (m_handle < rhs.m_handle);
 }
 
 bool BusId::operator!=(const BusId& rhs) const
 {
-	return ((m_id != rhs.m_id) || (m_type != rhs.m_type));
+	return (m_handle != rhs.m_handle);
 }
 
 bool BusId::operator==(const BusId& rhs) const
 {
-	return ((m_id == rhs.m_id) && (m_type == rhs.m_type));
+	return (m_handle == rhs.m_handle);
 }
 
 bool BusId::operator!=(const Subscriber& rhs) const
@@ -137,4 +314,3 @@ bool BusId::operator==(const std::string& rhs) const
 {
 	return (GetString() == rhs);
 }
-
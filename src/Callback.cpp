@@ -54,5 +54,10 @@ unsigned Callback::GetSerial() const
 void Callback::SetSerial(unsigned serial)
 {
 	m_serial = serial;
+
+	/* The serial is part of the Activity's details */
+	if (!m_activity.expired()) {
+		m_activity.lock()->InfoChanged();
+	}
 }
 
@@ -0,0 +1,277 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include "ConcurrencyController.h"
+#include "ActivityManager.h"
+#include "Logging.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+MojLogger ConcurrencyController::s_log(_T("activitymanager.concurrency"));
+
+ConcurrencyController::ConcurrencyController(
+	boost::shared_ptr<ActivityManager> am)
+	: m_am(am)
+	, m_enabled(false)
+	, m_available(true)
+	, m_minLevel(DefaultMinLevel)
+	, m_maxLevel(DefaultMaxLevel)
+	, m_lowPressure(DefaultLowPressure)
+	, m_highPressure(DefaultHighPressure)
+	, m_idleSamples(0)
+	, m_cpuPressure(0.0)
+	, m_memoryPressure(0.0)
+	, m_ioPressure(0.0)
+{
+}
+
+ConcurrencyController::~ConcurrencyController()
+{
+}
+
+void ConcurrencyController::Enable()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if (m_enabled) {
+		return;
+	}
+
+	LOG_AM_DEBUG("Enabling adaptive background concurrency, level %u to %u",
+		m_minLevel, m_maxLevel);
+
+	m_enabled = true;
+	m_available = true;
+	m_idleSamples = 0;
+
+	m_sampleTimeout = boost::make_shared<Timeout<ConcurrencyController> >(
+		shared_from_this(), DefaultSampleSeconds,
+		&ConcurrencyController::Sample);
+
+	Sample();
+}
+
+void ConcurrencyController::Disable()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if (!m_enabled) {
+		return;
+	}
+
+	LOG_AM_DEBUG("Disabling adaptive background concurrency");
+
+	m_enabled = false;
+	m_sampleTimeout.reset();
+}
+
+bool ConcurrencyController::IsEnabled() const
+{
+	return m_enabled;
+}
+
+void ConcurrencyController::SetBounds(unsigned minLevel, unsigned maxLevel)
+{
+	if ((minLevel == 0) || (maxLevel < minLevel)) {
+		throw std::runtime_error("Concurrency bounds must be at least 1, "
+			"and the maximum no less than the minimum");
+	}
+
+	LOG_AM_DEBUG("Adaptive background concurrency bounds set to %u to %u",
+		minLevel, maxLevel);
+
+	m_minLevel = minLevel;
+	m_maxLevel = maxLevel;
+}
+
+void ConcurrencyController::SetThresholds(unsigned lowPressure,
+	unsigned highPressure)
+{
+	if ((highPressure > 100) || (lowPressure >= highPressure)) {
+		throw std::runtime_error("Pressure thresholds must be percentages, "
+			"with the low threshold below the high threshold");
+	}
+
+	LOG_AM_DEBUG("Adaptive background concurrency thresholds set to %u%% and %u%%",
+		lowPressure, highPressure);
+
+	m_lowPressure = lowPressure;
+	m_highPressure = highPressure;
+}
+
+void ConcurrencyController::Sample()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if (!m_enabled) {
+		return;
+	}
+
+	bool cpu = ReadPressure("/proc/pressure/cpu", m_cpuPressure);
+	bool memory = ReadPressure("/proc/pressure/memory", m_memoryPressure);
+	bool io = ReadPressure("/proc/pressure/io", m_ioPressure);
+
+	if (!cpu && !memory && !io) {
+		LOG_AM_WARNING(MSGID_PRESSURE_UNAVAILABLE, 0,
+			"Pressure stall information not available, background concurrency will not be adapted");
+		m_available = false;
+		m_sampleTimeout.reset();
+		return;
+	}
+
+	double pressure = m_cpuPressure;
+	if (m_memoryPressure > pressure) {
+		pressure = m_memoryPressure;
+	}
+	if (m_ioPressure > pressure) {
+		pressure = m_ioPressure;
+	}
+
+	Adjust(pressure);
+
+	m_sampleTimeout->Arm();
+}
+
+void ConcurrencyController::Adjust(double pressure)
+{
+	boost::shared_ptr<ActivityManager> am = m_am.lock();
+	if (!am) {
+		return;
+	}
+
+	unsigned level = am->GetBackgroundConcurrencyLevel();
+	unsigned newLevel = level;
+
+	/* A level outside the bounds (including unlimited) was configured
+	 * explicitly, so leave it be. */
+	if ((level == ActivityManager::UnlimitedBackgroundConcurrency) ||
+		(level > m_maxLevel) || (level < m_minLevel)) {
+		LOG_AM_DEBUG("Background concurrency level %s is outside %u to %u, "
+			"not adapting it", (level ==
+				ActivityManager::UnlimitedBackgroundConcurrency) ?
+				"unlimited" : "set", m_minLevel, m_maxLevel);
+		m_idleSamples = 0;
+		return;
+	}
+
+	if (pressure >= (double)m_highPressure) {
+		m_idleSamples = 0;
+		newLevel = newLevel / 2;
+		if (newLevel < m_minLevel) {
+			newLevel = m_minLevel;
+		}
+	} else if (pressure <= (double)m_lowPressure) {
+		if (++m_idleSamples >= IdleSamplesToRaise) {
+			m_idleSamples = 0;
+			if (newLevel < m_maxLevel) {
+				newLevel++;
+			}
+		}
+	} else {
+		m_idleSamples = 0;
+	}
+
+	if (newLevel != level) {
+		LOG_AM_DEBUG("Pressure %.2f%%, background concurrency level %u -> %u",
+			pressure, level, newLevel);
+		am->SetBackgroundConcurrencyLevel(newLevel);
+	}
+}
+
+/* Reads the "some avg10" value from a PSI file, which looks like:
+ *
+ * some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ * full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ */
+bool ConcurrencyController::ReadPressure(const char *path, double& some)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return false;
+	}
+
+	char line[128];
+	bool found = false;
+
+	while (!found && fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "some avg10=%lf", &some) == 1) {
+			found = true;
+		}
+	}
+
+	fclose(file);
+
+	return found;
+}
+
+MojErr ConcurrencyController::InfoToJson(MojObject& rep) const
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	MojErr err;
+	MojObject concurrency(MojObject::TypeObject);
+
+	err = concurrency.putBool(_T("adaptive"), m_enabled);
+	MojErrCheck(err);
+
+	boost::shared_ptr<ActivityManager> am = m_am.lock();
+	if (am) {
+		err = concurrency.put(_T("level"),
+			(MojInt64)am->GetBackgroundConcurrencyLevel());
+		MojErrCheck(err);
+	}
+
+	if (m_enabled) {
+		err = concurrency.putBool(_T("available"), m_available);
+		MojErrCheck(err);
+
+		err = concurrency.put(_T("minLevel"), (MojInt64)m_minLevel);
+		MojErrCheck(err);
+
+		err = concurrency.put(_T("maxLevel"), (MojInt64)m_maxLevel);
+		MojErrCheck(err);
+
+		err = concurrency.put(_T("lowPressure"), (MojInt64)m_lowPressure);
+		MojErrCheck(err);
+
+		err = concurrency.put(_T("highPressure"), (MojInt64)m_highPressure);
+		MojErrCheck(err);
+
+		if (m_available) {
+			MojObject pressure(MojObject::TypeObject);
+
+			err = pressure.put(_T("cpu"), m_cpuPressure);
+			MojErrCheck(err);
+
+			err = pressure.put(_T("memory"), m_memoryPressure);
+			MojErrCheck(err);
+
+			err = pressure.put(_T("io"), m_ioPressure);
+			MojErrCheck(err);
+
+			err = concurrency.put(_T("pressure"), pressure);
+			MojErrCheck(err);
+		}
+	}
+
+	err = rep.put(_T("concurrency"), concurrency);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
@@ -19,6 +19,7 @@
 #include "ConnectionManagerProxy.h"
 #include "Activity.h"
 #include "MojoCall.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 
 #include <core/MojServiceRequest.h>
@@ -86,7 +87,8 @@ boost::shared_ptr<Requirement> ConnectionManagerProxy::InstantiateRequirement(
 	if (name == "internet") {
 		if ((value.type() == MojObject::TypeBool) && value.boolValue()) {
 			boost::shared_ptr<ListedRequirement> req =
-				boost::make_shared<BasicCoreListedRequirement>(
+				boost::allocate_shared<BasicCoreListedRequirement>(
+					POOL_ALLOCATOR(BasicCoreListedRequirement),
 					activity, m_internetRequirementCore,
 					m_internetRequirementCore->IsMet());
 			m_internetRequirements.push_back(*req);
@@ -102,7 +104,8 @@ boost::shared_ptr<Requirement> ConnectionManagerProxy::InstantiateRequirement(
 	} else if (name == "wan") {
 		if ((value.type() == MojObject::TypeBool) && value.boolValue()) {
 			boost::shared_ptr<ListedRequirement> req =
-				boost::make_shared<BasicCoreListedRequirement>(
+				boost::allocate_shared<BasicCoreListedRequirement>(
+					POOL_ALLOCATOR(BasicCoreListedRequirement),
 					activity, m_wanRequirementCore,
 					m_wanRequirementCore->IsMet());
 			m_wanRequirements.push_back(*req);
@@ -117,7 +120,8 @@ boost::shared_ptr<Requirement> ConnectionManagerProxy::InstantiateRequirement(
 	} else if (name == "wifi") {
 		if ((value.type() == MojObject::TypeBool) && value.boolValue()) {
 			boost::shared_ptr<ListedRequirement> req =
-				boost::make_shared<BasicCoreListedRequirement>(
+				boost::allocate_shared<BasicCoreListedRequirement>(
+					POOL_ALLOCATOR(BasicCoreListedRequirement),
 					activity, m_wifiRequirementCore,
 					m_wifiRequirementCore->IsMet());
 			m_wifiRequirements.push_back(*req);
@@ -286,6 +290,10 @@ void ConnectionManagerProxy::ConnectionManagerUpdate(MojServiceMessage *msg,
 			std::for_each(m_internetRequirements.begin(),
 				m_internetRequirements.end(),
 				boost::mem_fn(&Requirement::Unmet));
+		} else if (updated) {
+			std::for_each(m_internetRequirements.begin(),
+				m_internetRequirements.end(),
+				boost::mem_fn(&Requirement::CurrentChanged));
 		}
 	}
 
@@ -355,6 +363,9 @@ MojErr ConnectionManagerProxy::UpdateWifiStatus(const MojObject& response)
 			m_wifiRequirementCore->Unmet();
 			std::for_each(m_wifiRequirements.begin(), m_wifiRequirements.end(),
 				boost::mem_fn(&Requirement::Unmet));
+		} else if (updated) {
+			std::for_each(m_wifiRequirements.begin(), m_wifiRequirements.end(),
+				boost::mem_fn(&Requirement::CurrentChanged));
 		}
 	}
 
@@ -428,6 +439,9 @@ MojErr ConnectionManagerProxy::UpdateWANStatus(const MojObject& response)
 			m_wanRequirementCore->Unmet();
 			std::for_each(m_wanRequirements.begin(), m_wanRequirements.end(),
 				boost::mem_fn(&Requirement::Unmet));
+		} else if (updated) {
+			std::for_each(m_wanRequirements.begin(), m_wanRequirements.end(),
+				boost::mem_fn(&Requirement::CurrentChanged));
 		}
 	}
 
@@ -502,7 +516,8 @@ ConnectionManagerProxy::InstantiateConfidenceRequirement(
 	}
 
 	boost::shared_ptr<ListedRequirement> req =
-		boost::make_shared<BasicCoreListedRequirement>(
+		boost::allocate_shared<BasicCoreListedRequirement>(
+			POOL_ALLOCATOR(BasicCoreListedRequirement),
 			activity, confidenceCores[confidence],
 			confidenceCores[confidence]->IsMet());
 	confidenceLists[confidence].push_back(*req);
@@ -19,6 +19,7 @@
 #include "DefaultRequirementManager.h"
 #include "Requirement.h"
 #include "Activity.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 
 #include <stdexcept>
@@ -49,7 +50,8 @@ DefaultRequirementManager::InstantiateRequirement(
 	if (name == "never") {
 		if ((value.type() == MojObject::TypeBool) && value.boolValue()) {
 			boost::shared_ptr<ListedRequirement> req =
-				boost::make_shared<BasicCoreListedRequirement>(
+				boost::allocate_shared<BasicCoreListedRequirement>(
+					POOL_ALLOCATOR(BasicCoreListedRequirement),
 					activity, m_neverRequirementCore);
 			m_neverRequirements.push_back(*req);
 			return req;
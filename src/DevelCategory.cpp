@@ -24,22 +24,40 @@
 #include "Activity.h"
 #include "ResourceManager.h"
 #include "ContainerManager.h"
+#include "ConcurrencyController.h"
+#include "MojoDBProxy.h"
+#include "MojoDBPersistCommand.h"
+#include "OpenHashIndex.h"
+#include "MonotonicClock.h"
 #include "Logging.h"
 
+#include <map>
+#include <vector>
+
 /*!
  * \page com_palm_activitymanager_devel Service API com.palm.activitymanager/devel/
  * Private methods:
  * - \ref com_palm_activitymanager_devel_evict
  * - \ref com_palm_activitymanager_devel_run
  * - \ref com_palm_activitymanager_devel_concurrency
+ * - \ref com_palm_activitymanager_devel_adaptive_concurrency
+ * - \ref com_palm_activitymanager_devel_ready_aging
+ * - \ref com_palm_activitymanager_devel_fair_share
  * - \ref com_palm_activitymanager_devel_priority_control
+ * - \ref com_palm_activitymanager_devel_benchmark_lookup
+ * - \ref com_palm_activitymanager_devel_group_commit
  */
 
 const DevelCategoryHandler::Method DevelCategoryHandler::s_methods[] = {
 	{ _T("evict"), (Callback) &DevelCategoryHandler::Evict },
 	{ _T("run"), (Callback) &DevelCategoryHandler::Run },
 	{ _T("concurrency"), (Callback) &DevelCategoryHandler::SetConcurrency },
+	{ _T("adaptiveConcurrency"), (Callback) &DevelCategoryHandler::AdaptiveConcurrency },
+	{ _T("readyAging"), (Callback) &DevelCategoryHandler::SetReadyAging },
+	{ _T("fairShare"), (Callback) &DevelCategoryHandler::SetFairShare },
 	{ _T("priorityControl"), (Callback) &DevelCategoryHandler::PriorityControl },
+	{ _T("benchmarkLookup"), (Callback) &DevelCategoryHandler::BenchmarkLookup },
+	{ _T("groupCommit"), (Callback) &DevelCategoryHandler::GroupCommit },
 	{ NULL, NULL }
 };
 
@@ -49,11 +67,15 @@ DevelCategoryHandler::DevelCategoryHandler(
 	boost::shared_ptr<ActivityManager> am,
 	boost::shared_ptr<MojoJsonConverter> json,
 	boost::shared_ptr<MasterResourceManager> resourceManager,
-	boost::shared_ptr<ContainerManager> containerManager)
+	boost::shared_ptr<ContainerManager> containerManager,
+	boost::shared_ptr<ConcurrencyController> concurrencyController,
+	boost::shared_ptr<PersistProxy> db)
 	: m_am(am)
 	, m_json(json)
 	, m_resourceManager(resourceManager)
 	, m_containerManager(containerManager)
+	, m_concurrencyController(concurrencyController)
+	, m_db(db)
 {
 }
 
@@ -271,7 +293,9 @@ DevelCategoryHandler::Run(MojServiceMessage *msg, MojObject &payload)
 
 com.palm.activitymanager/devel/concurrency
 
-Set background Activity concurrency level for the Activity Manager.
+Set background Activity concurrency level for the Activity Manager.  This
+disables adaptive background concurrency (see
+\ref com_palm_activitymanager_devel_adaptive_concurrency).
 
 \subsection com_palm_activitymanager_devel_concurrency_syntax Syntax:
 \code
@@ -341,6 +365,9 @@ DevelCategoryHandler::SetConcurrency(MojServiceMessage *msg, MojObject &payload)
 	MojErrCheck(err);
 
 	if (unlimited || found) {
+		/* An explicit level overrides the adaptive controller */
+		m_concurrencyController->Disable();
+
 		m_am->SetBackgroundConcurrencyLevel(unlimited ?
 			ActivityManager::UnlimitedBackgroundConcurrency :
 			(unsigned int)level);
@@ -359,6 +386,350 @@ DevelCategoryHandler::SetConcurrency(MojServiceMessage *msg, MojObject &payload)
 	return MojErrNone;
 }
 
+/*!
+\page com_palm_activitymanager_devel
+\n
+\section com_palm_activitymanager_devel_adaptive_concurrency adaptiveConcurrency
+
+\e Private.
+
+com.palm.activitymanager/devel/adaptiveConcurrency
+
+Enable, disable, or configure adaptive background concurrency.  While
+enabled, the background concurrency level is halved whenever the highest of
+the cpu, memory, and io pressure stall averages (percent of time stalled
+over the last 10 seconds) reaches \e highPressure, and raised by one after
+it has stayed at or below \e lowPressure for several consecutive samples.
+A level outside \e minLevel to \e maxLevel, including unlimited, is left
+alone.  The controller is disabled at startup unless the Activity Manager
+is built with ACTIVITYMANAGER_ADAPTIVE_CONCURRENCY.
+
+\subsection com_palm_activitymanager_devel_adaptive_concurrency_syntax Syntax:
+\code
+{
+    "enabled": boolean,
+    "minLevel": int,
+    "maxLevel": int,
+    "lowPressure": int,
+    "highPressure": int
+}
+\endcode
+
+\param enabled Optional. Enable or disable the controller.
+\param minLevel Optional. Lowest concurrency level to throttle down to. If
+                specified, \e maxLevel must be too.
+\param maxLevel Optional. Highest concurrency level to raise to.
+\param lowPressure Optional. Pressure percentage at or below which the level
+                   may be raised. If specified, \e highPressure must be too.
+\param highPressure Optional. Pressure percentage at or above which the
+                    level is reduced.
+
+\subsection com_palm_activitymanager_devel_adaptive_concurrency_returns Returns:
+\code
+{
+    "errorCode": int,
+    "errorText": string,
+    "returnValue": boolean
+}
+\endcode
+
+\param errorCode Code for the error in case the call was not succesful.
+\param errorText Describes the error if the call was not succesful.
+\param returnValue Indicates if the call was succesful.
+
+\subsection com_palm_activitymanager_devel_adaptive_concurrency_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/devel/adaptiveConcurrency '{ "enabled": true, "minLevel": 1, "maxLevel": 8 }'
+\endcode
+
+Example response for a succesful call:
+\code
+{
+    "returnValue": true
+}
+\endcode
+*/
+
+MojErr
+DevelCategoryHandler::AdaptiveConcurrency(MojServiceMessage *msg,
+	MojObject &payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("AdaptiveConcurrency: %s",
+		MojoObjectJson(payload).c_str());
+
+	MojErr err;
+	bool found;
+
+	MojUInt32 minLevel, maxLevel;
+	bool foundMax = false;
+
+	found = false;
+	err = payload.get(_T("minLevel"), minLevel, found);
+	MojErrCheck(err);
+	err = payload.get(_T("maxLevel"), maxLevel, foundMax);
+	MojErrCheck(err);
+
+	if (found != foundMax) {
+		err = msg->replyError(MojErrInvalidArg, "\"minLevel\" and "
+			"\"maxLevel\" must be specified together");
+		MojErrCheck(err);
+		return MojErrNone;
+	} else if (found) {
+		m_concurrencyController->SetBounds(minLevel, maxLevel);
+	}
+
+	MojUInt32 lowPressure, highPressure;
+	bool foundHigh = false;
+
+	found = false;
+	err = payload.get(_T("lowPressure"), lowPressure, found);
+	MojErrCheck(err);
+	err = payload.get(_T("highPressure"), highPressure, foundHigh);
+	MojErrCheck(err);
+
+	if (found != foundHigh) {
+		err = msg->replyError(MojErrInvalidArg, "\"lowPressure\" and "
+			"\"highPressure\" must be specified together");
+		MojErrCheck(err);
+		return MojErrNone;
+	} else if (found) {
+		m_concurrencyController->SetThresholds(lowPressure, highPressure);
+	}
+
+	bool enabled;
+	if (payload.get(_T("enabled"), enabled)) {
+		if (enabled) {
+			m_concurrencyController->Enable();
+		} else {
+			m_concurrencyController->Disable();
+		}
+	}
+
+	err = msg->replySuccess();
+	MojErrCheck(err);
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
+/*!
+\page com_palm_activitymanager_devel
+\n
+\section com_palm_activitymanager_devel_ready_aging readyAging
+
+\e Private.
+
+com.palm.activitymanager/devel/readyAging
+
+Set how quickly ready background Activities waiting to run are aged.  Ready
+Activities are run highest priority first; a waiting Activity is treated as
+one priority level higher for every \e seconds it has waited, so lower
+priority work is not starved.
+
+\subsection com_palm_activitymanager_devel_ready_aging_syntax Syntax:
+\code
+{
+    "seconds": int,
+    "disabled": boolean
+}
+\endcode
+
+\param seconds Seconds of waiting per priority level gained. Either this is
+               required, or \e disabled must be set to true.
+\param disabled Set to true to dispatch in strict priority order, with no
+                aging.
+
+\subsection com_palm_activitymanager_devel_ready_aging_returns Returns:
+\code
+{
+    "errorCode": int,
+    "errorText": string,
+    "returnValue": boolean,
+    "previous": int
+}
+\endcode
+
+\param errorCode Code for the error in case the call was not succesful.
+\param errorText Describes the error if the call was not succesful.
+\param returnValue Indicates if the call was succesful.
+\param previous The previous aging interval, in seconds (0 if disabled).
+
+\subsection com_palm_activitymanager_devel_ready_aging_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/devel/readyAging '{ "seconds": 10 }'
+\endcode
+
+Example response for a succesful call:
+\code
+{
+    "returnValue": true,
+    "previous": 30
+}
+\endcode
+*/
+
+MojErr
+DevelCategoryHandler::SetReadyAging(MojServiceMessage *msg, MojObject &payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("SetReadyAging: %s",
+		MojoObjectJson(payload).c_str());
+
+	bool disabled = false;
+	payload.get(_T("disabled"), disabled);
+
+	MojUInt32 seconds;
+	bool found = false;
+
+	MojErr err = payload.get(_T("seconds"), seconds, found);
+	MojErrCheck(err);
+
+	if (found && (seconds == 0)) {
+		err = msg->replyError(MojErrInvalidArg, "\"seconds\" must be "
+			"greater than 0");
+		MojErrCheck(err);
+	} else if (disabled || found) {
+		unsigned int previous = m_am->SetReadyQueueAgingSeconds(disabled ?
+			ActivityManager::NoReadyQueueAging : (unsigned int)seconds);
+
+		MojObject reply(MojObject::TypeObject);
+
+		err = reply.putBool(MojServiceMessage::ReturnValueKey, true);
+		MojErrCheck(err);
+
+		err = reply.put(_T("previous"), (MojInt64)previous);
+		MojErrCheck(err);
+
+		err = msg->reply(reply);
+		MojErrCheck(err);
+	} else {
+		LOG_AM_DEBUG("Attempt to set ready queue aging did not specify \"disabled\":true or \"seconds\"");
+		err = msg->replyError(MojErrInvalidArg, "Either \"disabled\":true, "
+			"or \"seconds\":<seconds per priority level> must be specified");
+		MojErrCheck(err);
+	}
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
+/*!
+\page com_palm_activitymanager_devel
+\n
+\section com_palm_activitymanager_devel_fair_share fairShare
+
+\e Private.
+
+com.palm.activitymanager/devel/fairShare
+
+Set the weight of a creator's share of background run slots.  Ready
+Activities of the same priority are dispatched by deficit round robin across
+their creators, each creator getting \e weight slots per round.  Creators
+default to a weight of 1.
+
+\subsection com_palm_activitymanager_devel_fair_share_syntax Syntax:
+\code
+{
+    "creator": string | object,
+    "weight": int
+}
+\endcode
+
+\param creator The creator, either as an object with an \e appId or
+               \e serviceId, or as an "appId:" or "serviceId:" prefixed
+               string.
+\param weight Number of run slots per round, from 1 to 1000.
+
+\subsection com_palm_activitymanager_devel_fair_share_returns Returns:
+\code
+{
+    "errorCode": int,
+    "errorText": string,
+    "returnValue": boolean,
+    "previous": int
+}
+\endcode
+
+\param errorCode Code for the error in case the call was not succesful.
+\param errorText Describes the error if the call was not succesful.
+\param returnValue Indicates if the call was succesful.
+\param previous The creator's previous weight.
+
+\subsection com_palm_activitymanager_devel_fair_share_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/devel/fairShare '{ "creator": { "serviceId": "com.palm.service.contacts" }, "weight": 4 }'
+\endcode
+
+Example response for a succesful call:
+\code
+{
+    "returnValue": true,
+    "previous": 1
+}
+\endcode
+*/
+
+MojErr
+DevelCategoryHandler::SetFairShare(MojServiceMessage *msg, MojObject &payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("SetFairShare: %s",
+		MojoObjectJson(payload).c_str());
+
+	MojErr err;
+
+	MojObject creatorSpec;
+	if (!payload.get(_T("creator"), creatorSpec)) {
+		err = msg->replyError(MojErrInvalidArg, "\"creator\" must be "
+			"specified");
+		MojErrCheck(err);
+		return MojErrNone;
+	}
+
+	MojUInt32 weight;
+	bool found = false;
+
+	err = payload.get(_T("weight"), weight, found);
+	MojErrCheck(err);
+
+	if (!found || (weight == 0) ||
+		(weight > ActivityManager::MaxCreatorWeight)) {
+		err = msg->replyError(MojErrInvalidArg, "\"weight\" must be "
+			"specified, and from 1 to 1000");
+		MojErrCheck(err);
+		return MojErrNone;
+	}
+
+	BusId creator = MojoJsonConverter::ProcessBusId(creatorSpec);
+
+	unsigned int previous = m_am->SetCreatorWeight(creator,
+		(unsigned int)weight);
+
+	MojObject reply(MojObject::TypeObject);
+
+	err = reply.putBool(MojServiceMessage::ReturnValueKey, true);
+	MojErrCheck(err);
+
+	err = reply.put(_T("previous"), (MojInt64)previous);
+	MojErrCheck(err);
+
+	err = msg->reply(reply);
+	MojErrCheck(err);
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
 /*!
 \page com_palm_activitymanager_devel
 \n
@@ -448,6 +819,418 @@ DevelCategoryHandler::PriorityControl(MojServiceMessage *msg, MojObject& payload
 	return MojErrNone;
 }
 
+/*!
+\page com_palm_activitymanager_devel
+\n
+\section com_palm_activitymanager_devel_benchmark_lookup benchmarkLookup
+
+\e Private.
+
+com.palm.activitymanager/devel/benchmarkLookup
+
+Micro-benchmark of the Activity registry lookups.  For each table size,
+synthetic Activity IDs and name/creator pairs are loaded into both the
+ordered containers the registry used to use (\e std::map keyed by ID, and
+an ordered name/creator table) and the hashed indexes it uses now, and the
+same random sequence of lookups is timed against each.  The live registry is
+not touched.
+
+\subsection com_palm_activitymanager_devel_benchmark_lookup_syntax Syntax:
+\code
+{
+    "sizes": [int],
+    "lookups": int
+}
+\endcode
+
+\param sizes Table sizes to measure, at most 8, each from 1 to 100000.
+             Optional, defaults to 1000, 10000 and 100000.
+\param lookups Number of lookups to time at each size. Optional, defaults to
+               100000.
+
+\subsection com_palm_activitymanager_devel_benchmark_lookup_returns Returns:
+\code
+{
+    "results": [
+        {
+            "activities": int,
+            "lookups": int,
+            "idMapNs": int,
+            "idHashNs": int,
+            "nameTreeNs": int,
+            "nameHashNs": int
+        }
+    ],
+    "returnValue": boolean
+}
+\endcode
+
+\param results One entry per table size.  The \e *Ns values are the average
+               latency of a single lookup, in nanoseconds.
+\param returnValue Indicates if the call was succesful.
+
+\subsection com_palm_activitymanager_devel_benchmark_lookup_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/devel/benchmarkLookup '{ "sizes": [1000, 10000, 100000] }'
+\endcode
+
+Example response for a succesful call:
+\code
+{
+    "results": [
+        {
+            "activities": 1000,
+            "lookups": 100000,
+            "idMapNs": 61,
+            "idHashNs": 9,
+            "nameTreeNs": 412,
+            "nameHashNs": 57
+        }
+    ],
+    "returnValue": true
+}
+\endcode
+*/
+
+/* Every table size interns a creator for each 64 Activities, and runs on
+ * the main loop, so keep both the sizes and how many are measured small */
+static const unsigned MaxBenchmarkLookupSize = 100000;
+static const size_t MaxBenchmarkLookupSizes = 8;
+
+typedef std::pair<std::string, BusId> BenchmarkNameKey;
+
+struct BenchmarkIdMatch {
+	BenchmarkIdMatch(const std::vector<activityId_t>& ids, activityId_t id)
+		: m_ids(ids), m_id(id) {}
+	bool operator()(unsigned index) const { return m_ids[index] == m_id; }
+	const std::vector<activityId_t>&	m_ids;
+	activityId_t						m_id;
+};
+
+struct BenchmarkNameMatch {
+	BenchmarkNameMatch(const std::vector<BenchmarkNameKey>& keys,
+		const BenchmarkNameKey& key)
+		: m_keys(keys), m_key(key) {}
+	bool operator()(unsigned index) const {
+		return (m_keys[index].first == m_key.first) &&
+			(m_keys[index].second == m_key.second);
+	}
+	const std::vector<BenchmarkNameKey>&	m_keys;
+	const BenchmarkNameKey&					m_key;
+};
+
+static MojErr BenchmarkLookupSize(unsigned count, unsigned lookups,
+	MojObject& result)
+{
+	std::vector<activityId_t> ids;
+	std::vector<BenchmarkNameKey> keys;
+	ids.reserve(count);
+	keys.reserve(count);
+
+	std::map<activityId_t, unsigned> idMap;
+	std::map<BenchmarkNameKey, unsigned> nameTree;
+	OpenHashIndex<unsigned> idHash;
+	OpenHashIndex<unsigned> nameHash;
+
+	for (unsigned i = 0; i < count; i++) {
+		char name[32];
+		char creator[48];
+		snprintf(name, sizeof(name), "activity.%u", i % 64);
+		snprintf(creator, sizeof(creator), "com.example.app%u", i / 64);
+
+		ids.push_back((activityId_t)(i + 1));
+		keys.push_back(BenchmarkNameKey(name, BusId(creator, BusApp)));
+
+		idMap[ids[i]] = i;
+		nameTree[keys[i]] = i;
+		idHash.Insert(HashActivityId(ids[i]), i);
+		nameHash.Insert(HashCombine(HashString(keys[i].first),
+			keys[i].second.Hash()), i);
+	}
+
+	/* Same pseudo-random probe order for every container */
+	std::vector<unsigned> order;
+	order.reserve(lookups);
+	for (unsigned i = 0; i < lookups; i++) {
+		order.push_back((unsigned)(((unsigned long long)i * 2654435761ULL) %
+			count));
+	}
+
+	unsigned long long sink = 0;
+	unsigned long long start;
+
+	start = GetMonotonicNanoseconds();
+	for (unsigned i = 0; i < lookups; i++) {
+		sink += idMap.find(ids[order[i]])->second;
+	}
+	MojInt64 idMapNs = (MojInt64)(GetMonotonicNanoseconds() - start);
+
+	start = GetMonotonicNanoseconds();
+	for (unsigned i = 0; i < lookups; i++) {
+		activityId_t id = ids[order[i]];
+		sink += *idHash.Find(HashActivityId(id), BenchmarkIdMatch(ids, id));
+	}
+	MojInt64 idHashNs = (MojInt64)(GetMonotonicNanoseconds() - start);
+
+	start = GetMonotonicNanoseconds();
+	for (unsigned i = 0; i < lookups; i++) {
+		const BenchmarkNameKey& key = keys[order[i]];
+		sink += nameTree.find(BenchmarkNameKey(key.first, key.second))->second;
+	}
+	MojInt64 nameTreeNs = (MojInt64)(GetMonotonicNanoseconds() - start);
+
+	start = GetMonotonicNanoseconds();
+	for (unsigned i = 0; i < lookups; i++) {
+		const BenchmarkNameKey& key = keys[order[i]];
+		sink += *nameHash.Find(HashCombine(HashString(key.first),
+			key.second.Hash()), BenchmarkNameMatch(keys, key));
+	}
+	MojInt64 nameHashNs = (MojInt64)(GetMonotonicNanoseconds() - start);
+
+	LOG_AM_DEBUG("Lookup benchmark (%u Activities) checksum %llu", count,
+		sink);
+
+	MojErr err;
+
+	err = result.putInt(_T("activities"), (MojInt64)count);
+	MojErrCheck(err);
+
+	err = result.putInt(_T("lookups"), (MojInt64)lookups);
+	MojErrCheck(err);
+
+	err = result.putInt(_T("idMapNs"), idMapNs / lookups);
+	MojErrCheck(err);
+
+	err = result.putInt(_T("idHashNs"), idHashNs / lookups);
+	MojErrCheck(err);
+
+	err = result.putInt(_T("nameTreeNs"), nameTreeNs / lookups);
+	MojErrCheck(err);
+
+	err = result.putInt(_T("nameHashNs"), nameHashNs / lookups);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+MojErr
+DevelCategoryHandler::BenchmarkLookup(MojServiceMessage *msg, MojObject& payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("BenchmarkLookup: %s", MojoObjectJson(payload).c_str());
+
+	MojErr err;
+
+	std::vector<unsigned> sizes;
+
+	MojObject sizesJson;
+	if (payload.get(_T("sizes"), sizesJson)) {
+		for (MojObject::ConstArrayIterator iter = sizesJson.arrayBegin();
+			iter != sizesJson.arrayEnd(); ++iter) {
+			MojInt64 size = iter->intValue();
+			if ((size <= 0) || (size > (MojInt64)MaxBenchmarkLookupSize)) {
+				err = msg->replyError(MojErrInvalidArg, _T("Table sizes "
+					"must be integers from 1 to 100000"));
+				MojErrCheck(err);
+				return MojErrNone;
+			}
+			sizes.push_back((unsigned)size);
+		}
+
+		if (sizes.size() > MaxBenchmarkLookupSizes) {
+			err = msg->replyError(MojErrInvalidArg, _T("At most 8 table "
+				"sizes may be measured"));
+			MojErrCheck(err);
+			return MojErrNone;
+		}
+	} else {
+		sizes.push_back(1000);
+		sizes.push_back(10000);
+		sizes.push_back(100000);
+	}
+
+	MojUInt32 lookups = 100000;
+	bool found = false;
+	err = payload.get(_T("lookups"), lookups, found);
+	MojErrCheck(err);
+
+	if (lookups == 0) {
+		err = msg->replyError(MojErrInvalidArg, _T("\"lookups\" must be "
+			"greater than 0"));
+		MojErrCheck(err);
+		return MojErrNone;
+	}
+
+	MojObject results(MojObject::TypeArray);
+
+	for (std::vector<unsigned>::iterator iter = sizes.begin();
+		iter != sizes.end(); ++iter) {
+		MojObject result;
+		err = BenchmarkLookupSize(*iter, lookups, result);
+		MojErrCheck(err);
+
+		err = results.push(result);
+		MojErrCheck(err);
+	}
+
+	MojObject reply;
+
+	err = reply.putBool(MojServiceMessage::ReturnValueKey, true);
+	MojErrCheck(err);
+
+	err = reply.put(_T("results"), results);
+	MojErrCheck(err);
+
+	err = msg->reply(reply);
+	MojErrCheck(err);
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
+/*!
+\page com_palm_activitymanager_devel
+\n
+\section com_palm_activitymanager_devel_group_commit groupCommit
+
+\e Private.
+
+com.palm.activitymanager/devel/groupCommit
+
+Set the persistence group commit window.  Activity stores and deletes that
+are ready to be written are held for up to \e windowMs milliseconds, or until
+\e maxObjects of one kind are waiting, and then written to MojoDB with a
+single call.
+
+\subsection com_palm_activitymanager_devel_group_commit_syntax Syntax:
+\code
+{
+    "windowMs": int,
+    "maxObjects": int
+}
+\endcode
+
+\param windowMs Milliseconds to hold ready commands. 0 writes each command
+                on its own.
+\param maxObjects Optional. Number of waiting stores (or deletes) that
+                  triggers an early write. Defaults to the current limit.
+
+\subsection com_palm_activitymanager_devel_group_commit_returns Returns:
+\code
+{
+    "errorCode": int,
+    "errorText": string,
+    "returnValue": boolean,
+    "previous": object
+}
+\endcode
+
+\param errorCode Code for the error in case the call was not succesful.
+\param errorText Describes the error if the call was not succesful.
+\param returnValue Indicates if the call was succesful.
+\param previous The previous \e windowMs and \e maxObjects.
+
+\subsection com_palm_activitymanager_devel_group_commit_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.activitymanager/devel/groupCommit '{ "windowMs": 50, "maxObjects": 100 }'
+\endcode
+
+Example response for a succesful call:
+\code
+{
+    "returnValue": true,
+    "previous": {
+        "windowMs": 10,
+        "maxObjects": 64
+    }
+}
+\endcode
+*/
+
+MojErr
+DevelCategoryHandler::GroupCommit(MojServiceMessage *msg, MojObject& payload)
+{
+	ACTIVITY_SERVICEMETHOD_BEGIN();
+
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("GroupCommit: %s", MojoObjectJson(payload).c_str());
+
+	MojErr err;
+
+	boost::shared_ptr<MojoDBProxy> db =
+		boost::dynamic_pointer_cast<MojoDBProxy, PersistProxy>(m_db);
+	if (!db) {
+		err = msg->replyError(MojErrNotImplemented, "Persistence backend does not "
+			"support group commit");
+		MojErrCheck(err);
+		return MojErrNone;
+	}
+
+	MojUInt32 windowMs;
+	bool found = false;
+
+	err = payload.get(_T("windowMs"), windowMs, found);
+	MojErrCheck(err);
+
+	if (!found) {
+		err = msg->replyError(MojErrInvalidArg, "\"windowMs\" must be "
+			"specified");
+		MojErrCheck(err);
+		return MojErrNone;
+	}
+
+	/* Reports the current settings as "groupCommit" */
+	MojObject previous(MojObject::TypeObject);
+	err = db->InfoToJson(previous);
+	MojErrCheck(err);
+
+	MojObject previousGroup;
+	previous.get(_T("groupCommit"), previousGroup);
+
+	MojInt64 previousWindow = 0;
+	MojInt64 previousMax = MojoDBProxy::DefaultGroupCommitMaxObjects;
+	previousGroup.get(_T("windowMs"), previousWindow);
+	previousGroup.get(_T("maxObjects"), previousMax);
+
+	MojUInt32 maxObjects;
+	found = false;
+
+	err = payload.get(_T("maxObjects"), maxObjects, found);
+	MojErrCheck(err);
+
+	if (!found) {
+		maxObjects = (MojUInt32)previousMax;
+	}
+
+	db->SetGroupCommit(windowMs, maxObjects);
+
+	MojObject previousRep(MojObject::TypeObject);
+
+	err = previousRep.put(_T("windowMs"), previousWindow);
+	MojErrCheck(err);
+
+	err = previousRep.put(_T("maxObjects"), previousMax);
+	MojErrCheck(err);
+
+	MojObject reply(MojObject::TypeObject);
+
+	err = reply.putBool(MojServiceMessage::ReturnValueKey, true);
+	MojErrCheck(err);
+
+	err = reply.put(_T("previous"), previousRep);
+	MojErrCheck(err);
+
+	err = msg->reply(reply);
+	MojErrCheck(err);
+
+	ACTIVITY_SERVICEMETHOD_END(msg);
+
+	return MojErrNone;
+}
+
 MojErr
 DevelCategoryHandler::LookupActivity(MojServiceMessage *msg, MojObject& payload, boost::shared_ptr<Activity>& act)
 {
@@ -92,6 +92,8 @@ void IntervalSchedule::CalcNextStartTime()
 	LOG_AM_DEBUG("[Activity %lu] Next start time is %s",
 		(unsigned long)m_activity.lock()->GetId(),
 		Scheduler::TimeToString(m_nextStart, !m_local).c_str());
+
+	StatusChanged();
 }
 
 time_t IntervalSchedule::GetBaseStartTime() const
@@ -107,6 +109,7 @@ bool IntervalSchedule::IsInterval() const
 void IntervalSchedule::SetSkip(bool skip)
 {
 	m_skip = skip;
+	DefinitionChanged();
 }
 
 void IntervalSchedule::SetLastFinishedTime(time_t finished)
@@ -115,6 +118,7 @@ void IntervalSchedule::SetLastFinishedTime(time_t finished)
 	 * event is supposed to have started running, are accepted. */
 	if (((GetTime() - finished) > 0) && ((finished - m_start) > 0)) {
 		m_lastFinished = finished;
+		DefinitionChanged();
 	}
 }
 
@@ -136,6 +140,7 @@ void IntervalSchedule::InformActivityFinished()
 	 * the current time on the device */
 	if ((lastFinished - m_start) > 0) {
 		m_lastFinished = lastFinished;
+		DefinitionChanged();
 	}
 }
 
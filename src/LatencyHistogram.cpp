@@ -0,0 +1,150 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+	: m_count(0)
+	, m_max(0)
+{
+}
+
+void LatencyHistogram::Record(unsigned long long value)
+{
+	unsigned index = BucketIndex(value);
+	if (index >= m_counts.size()) {
+		m_counts.resize(index + 1, 0);
+	}
+
+	m_counts[index]++;
+	m_count++;
+
+	if (value > m_max) {
+		m_max = value;
+	}
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+	if (other.m_counts.size() > m_counts.size()) {
+		m_counts.resize(other.m_counts.size(), 0);
+	}
+
+	for (size_t i = 0; i < other.m_counts.size(); i++) {
+		m_counts[i] += other.m_counts[i];
+	}
+
+	m_count += other.m_count;
+
+	if (other.m_max > m_max) {
+		m_max = other.m_max;
+	}
+}
+
+unsigned long long LatencyHistogram::GetCount() const
+{
+	return m_count;
+}
+
+unsigned long long LatencyHistogram::GetMax() const
+{
+	return m_max;
+}
+
+unsigned long long LatencyHistogram::GetPercentile(double percentile) const
+{
+	if (!m_count) {
+		return 0;
+	}
+
+	/* Rank of the sample at the percentile, rounded up, at least 1 */
+	unsigned long long rank = (unsigned long long)
+		((percentile / 100.0) * (double)m_count + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	} else if (rank > m_count) {
+		rank = m_count;
+	}
+
+	unsigned long long seen = 0;
+	for (size_t i = 0; i < m_counts.size(); i++) {
+		seen += m_counts[i];
+		if (seen >= rank) {
+			unsigned long long upper = BucketUpperBound((unsigned)i);
+			return (upper < m_max) ? upper : m_max;
+		}
+	}
+
+	return m_max;
+}
+
+MojErr LatencyHistogram::ToJson(MojObject& rep) const
+{
+	MojErr err;
+
+	err = rep.put(_T("count"), (MojInt64)m_count);
+	MojErrCheck(err);
+
+	err = rep.put(_T("p50"), (MojInt64)GetPercentile(50.0));
+	MojErrCheck(err);
+
+	err = rep.put(_T("p95"), (MojInt64)GetPercentile(95.0));
+	MojErrCheck(err);
+
+	err = rep.put(_T("p99"), (MojInt64)GetPercentile(99.0));
+	MojErrCheck(err);
+
+	err = rep.put(_T("max"), (MojInt64)m_max);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+/* Values below SubBucketCount get a bucket each.  Above that, a value with
+ * its highest set bit at position "msb" falls in group (msb - SubBucketBits
+ * + 1), and the SubBucketBits bits just below the highest set bit select the
+ * bucket within the group. */
+unsigned LatencyHistogram::BucketIndex(unsigned long long value)
+{
+	if (value < SubBucketCount) {
+		return (unsigned)value;
+	}
+
+	unsigned msb = 0;
+	for (unsigned long long v = value; v > 1; v >>= 1) {
+		msb++;
+	}
+
+	unsigned shift = msb - SubBucketBits;
+	unsigned sub = (unsigned)((value >> shift) & (SubBucketCount - 1));
+
+	return ((shift + 1) * SubBucketCount) + sub;
+}
+
+unsigned long long LatencyHistogram::BucketUpperBound(unsigned index)
+{
+	if (index < SubBucketCount) {
+		return index;
+	}
+
+	unsigned shift = (index / SubBucketCount) - 1;
+	unsigned long long sub = index % SubBucketCount;
+	unsigned long long lower = (SubBucketCount + sub) << shift;
+
+	return lower + ((1ULL << shift) - 1);
+}
@@ -0,0 +1,187 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+#include "LogPersistCommand.h"
+#include "LogPersistProxy.h"
+#include "LogPersistToken.h"
+#include "Activity.h"
+#include "ActivityJson.h"
+#include "Logging.h"
+
+#include <stdexcept>
+
+LogPersistCommand::LogPersistCommand(boost::shared_ptr<LogPersistProxy> proxy,
+	boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<Completion> completion)
+	: PersistCommand(activity, completion)
+	, m_proxy(proxy)
+{
+}
+
+LogPersistCommand::~LogPersistCommand()
+{
+}
+
+void LogPersistCommand::Synced(bool success)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("[Activity %llu] [PersistCommand %s]: %s",
+		m_activity->GetId(), GetString().c_str(),
+		success ? "Synced" : "Failed");
+
+	Complete(success);
+}
+
+LogStoreCommand::LogStoreCommand(boost::shared_ptr<LogPersistProxy> proxy,
+	boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<Completion> completion)
+	: LogPersistCommand(proxy, activity, completion)
+{
+}
+
+LogStoreCommand::~LogStoreCommand()
+{
+}
+
+std::string LogStoreCommand::GetMethod() const
+{
+	return "Store";
+}
+
+void LogStoreCommand::Persist()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("[Activity %llu] [PersistCommand %s]: Issuing",
+		m_activity->GetId(), GetString().c_str());
+
+	try {
+		Validate(false);
+
+		boost::shared_ptr<LogPersistToken> pt =
+			boost::dynamic_pointer_cast<LogPersistToken, PersistToken>
+				(m_activity->GetPersistToken());
+
+		MojObject rep;
+		MojErr err = m_activity->ToJson(rep,
+			ACTIVITY_JSON_PERSIST | ACTIVITY_JSON_DETAIL);
+		if (err) {
+			throw std::runtime_error("Failed to encode Activity");
+		}
+
+		MojString json;
+		err = rep.toJson(json);
+		if (err) {
+			throw std::runtime_error("Failed to serialize Activity");
+		}
+
+		/* The key is assigned on the first store, and kept until the
+		 * Activity is deleted */
+		if (!pt->IsValid()) {
+			pt->Set(m_proxy->AllocateKey());
+		}
+
+		m_proxy->AppendStore(boost::dynamic_pointer_cast<LogPersistCommand,
+			PersistCommand>(shared_from_this()), pt->GetKey(), json);
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_ATMPT_UNEXPECTD_EXCPTN, 3, PMLOGKFV("activity","%llu",m_activity->GetId()),
+			  PMLOGKS("Persist_command",GetString().c_str()), PMLOGKS("Exception",except.what()),
+			  "Unexpected exception while attempting to persist");
+		Complete(false);
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PERSIST_ATMPT_UNKNWN_EXCPTN, 2, PMLOGKFV("activity","%llu",m_activity->GetId()),
+			  PMLOGKS("Persist_command",GetString().c_str()), "Unknown exception while attempting to persist");
+		Complete(false);
+	}
+}
+
+bool LogStoreCommand::Supersedes(const PersistCommand& earlier) const
+{
+	return earlier.IsStore();
+}
+
+bool LogStoreCommand::IsStore() const
+{
+	return true;
+}
+
+LogDeleteCommand::LogDeleteCommand(boost::shared_ptr<LogPersistProxy> proxy,
+	boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<Completion> completion)
+	: LogPersistCommand(proxy, activity, completion)
+{
+}
+
+LogDeleteCommand::~LogDeleteCommand()
+{
+}
+
+std::string LogDeleteCommand::GetMethod() const
+{
+	return "Delete";
+}
+
+void LogDeleteCommand::Persist()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("[Activity %llu] [PersistCommand %s]: Issuing",
+		m_activity->GetId(), GetString().c_str());
+
+	if (IsDeleteUnneeded()) {
+		Complete(true);
+		return;
+	}
+
+	try {
+		Validate(true);
+
+		boost::shared_ptr<LogPersistToken> pt =
+			boost::dynamic_pointer_cast<LogPersistToken, PersistToken>
+				(m_activity->GetPersistToken());
+
+		m_proxy->AppendDelete(boost::dynamic_pointer_cast<LogPersistCommand,
+			PersistCommand>(shared_from_this()), pt->GetKey());
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_ATMPT_UNEXPECTD_EXCPTN, 3, PMLOGKFV("activity","%llu",m_activity->GetId()),
+			  PMLOGKS("Persist_command",GetString().c_str()), PMLOGKS("Exception",except.what()),
+			  "Unexpected exception while attempting to persist");
+		Complete(false);
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PERSIST_ATMPT_UNKNWN_EXCPTN, 2, PMLOGKFV("activity","%llu",m_activity->GetId()),
+			  PMLOGKS("Persist_command",GetString().c_str()), "Unknown exception while attempting to persist");
+		Complete(false);
+	}
+}
+
+void LogDeleteCommand::Synced(bool success)
+{
+	if (success) {
+		boost::shared_ptr<LogPersistToken> pt =
+			boost::dynamic_pointer_cast<LogPersistToken, PersistToken>
+				(m_activity->GetPersistToken());
+
+		pt->Clear();
+	}
+
+	LogPersistCommand::Synced(success);
+}
+
+bool LogDeleteCommand::Supersedes(const PersistCommand& earlier) const
+{
+	return earlier.IsStore();
+}
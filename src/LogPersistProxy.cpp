@@ -0,0 +1,868 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+#include "LogPersistProxy.h"
+#include "LogPersistCommand.h"
+#include "LogPersistToken.h"
+#include "MojoJsonConverter.h"
+#include "Activity.h"
+#include "ActivityManager.h"
+#include "ServiceApp.h"
+#include "OpenHashIndex.h"
+#include "ObjectPool.h"
+#include "MonotonicClock.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <core/MojObject.h>
+
+const char *LogPersistProxy::DefaultPath =
+	"/var/lib/activitymanager/activities.log";
+
+const char LogPersistProxy::Magic[8] = { 'A', 'M', 'L', 'O', 'G', '\0',
+	'\0', '\0' };
+
+MojLogger LogPersistProxy::s_log(_T("activitymanager.log"));
+
+static bool WriteAll(int fd, const char *data, size_t length, off_t offset)
+{
+	size_t written = 0;
+	while (written < length) {
+		ssize_t ret = pwrite(fd, data + written, length - written,
+			offset + (off_t)written);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return false;
+		}
+
+		written += (size_t)ret;
+	}
+
+	return true;
+}
+
+static bool ReadAll(int fd, char *data, size_t length, off_t offset)
+{
+	size_t done = 0;
+	while (done < length) {
+		ssize_t ret = pread(fd, data + done, length - done,
+			offset + (off_t)done);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return false;
+		} else if (ret == 0) {
+			errno = EIO;
+			return false;
+		}
+
+		done += (size_t)ret;
+	}
+
+	return true;
+}
+
+LogPersistProxy::LogPersistProxy(ActivityManagerApp *app,
+	boost::shared_ptr<ActivityManager> am,
+	boost::shared_ptr<MojoJsonConverter> json,
+	const std::string& path)
+	: m_app(app)
+	, m_am(am)
+	, m_json(json)
+	, m_path(path)
+	, m_fd(-1)
+	, m_length(0)
+	, m_liveBytes(0)
+	, m_nextKey(1)
+	, m_syncNeeded(false)
+	, m_syncSource(NULL)
+	, m_compactSource(NULL)
+	, m_stores(0)
+	, m_deletes(0)
+	, m_syncs(0)
+	, m_syncTime(0)
+	, m_maxSyncTime(0)
+	, m_compactions(0)
+	, m_truncatedBytes(0)
+	, m_loadTime(0)
+{
+}
+
+LogPersistProxy::~LogPersistProxy()
+{
+	if (m_syncSource) {
+		if (!g_source_is_destroyed(m_syncSource)) {
+			g_source_destroy(m_syncSource);
+		}
+
+		m_syncSource = NULL;
+	}
+
+	if (m_compactSource) {
+		if (!g_source_is_destroyed(m_compactSource)) {
+			g_source_destroy(m_compactSource);
+		}
+
+		m_compactSource = NULL;
+	}
+
+	if (m_fd >= 0) {
+		close(m_fd);
+	}
+}
+
+boost::shared_ptr<PersistCommand>
+LogPersistProxy::PrepareStoreCommand(boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<Completion> completion)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Preparing store command for [Activity %llu]",
+		activity->GetId());
+
+	return boost::allocate_shared<LogStoreCommand>(
+		POOL_ALLOCATOR(LogStoreCommand),
+		boost::dynamic_pointer_cast<LogPersistProxy, PersistProxy>(
+			shared_from_this()), activity, completion);
+}
+
+boost::shared_ptr<PersistCommand>
+LogPersistProxy::PrepareDeleteCommand(boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<Completion> completion)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Preparing delete command for [Activity %llu]",
+		activity->GetId());
+
+	return boost::allocate_shared<LogDeleteCommand>(
+		POOL_ALLOCATOR(LogDeleteCommand),
+		boost::dynamic_pointer_cast<LogPersistProxy, PersistProxy>(
+			shared_from_this()), activity, completion);
+}
+
+boost::shared_ptr<PersistToken>
+LogPersistProxy::CreateToken()
+{
+	return boost::allocate_shared<LogPersistToken>(
+		POOL_ALLOCATOR(LogPersistToken));
+}
+
+void LogPersistProxy::LoadActivities()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Loading persisted Activities from %s", m_path.c_str());
+
+	unsigned long long start = GetMonotonicMicroseconds();
+	unsigned loaded = 0;
+
+	std::string contents;
+	if (Open(contents)) {
+		OrderVec order;
+		GetRecordOrder(order);
+
+		for (OrderVec::const_iterator iter = order.begin();
+			iter != order.end(); ++iter) {
+			/* Conflicts resolved earlier in the load may have retired
+			 * the record already */
+			RecordMap::const_iterator found = m_records.find(iter->second);
+			if (found == m_records.end()) {
+				continue;
+			}
+
+			MojObject rep;
+			MojErr err = rep.fromJson(contents.data() + found->second.m_offset +
+				sizeof(RecordHeader), found->second.m_length);
+			if (err) {
+				LOG_AM_WARNING(MSGID_PERSIST_LOG_INVALID, 2,
+					PMLOGKS("path",m_path.c_str()),
+					PMLOGKFV("key","%llu",(unsigned long long)iter->second),
+					"Failed to parse Activity record");
+				AppendTombstone(iter->second);
+				continue;
+			}
+
+			boost::shared_ptr<LogPersistToken> pt =
+				boost::allocate_shared<LogPersistToken>(
+					POOL_ALLOCATOR(LogPersistToken), iter->second);
+
+			if (LoadActivity(rep, pt)) {
+				loaded++;
+			}
+		}
+	} else {
+		/* Carry on without persistence.  Every persist command will fail,
+		 * which is logged against the Activity. */
+		LOG_AM_ERROR(MSGID_PERSIST_LOG_OPEN_FAIL, 1,
+			PMLOGKS("path",m_path.c_str()),
+			"Activities will not be persisted");
+	}
+
+	m_loadTime = GetMonotonicMicroseconds() - start;
+
+	LOG_AM_DEBUG("Loaded %u Activities from %s in %llu us", loaded,
+		m_path.c_str(), m_loadTime);
+
+	/* There is no configurator pass for this backend - static Activity
+	 * configuration is loaded into MojoDB, which it doesn't read. */
+	m_am->Enable(ActivityManager::CONFIGURATION_LOADED);
+	m_app->ready();
+}
+
+boost::shared_ptr<Activity> LogPersistProxy::LoadActivity(
+	const MojObject& rep, boost::shared_ptr<LogPersistToken> pt)
+{
+	boost::shared_ptr<Activity> act;
+
+	try {
+		act = m_json->CreateActivity(rep, Activity::PrivateBus, true);
+	} catch (const std::exception& except) {
+		LOG_AM_WARNING(MSGID_CREATE_ACTIVITY_EXCEPTION, 1, PMLOGKS("Exception",except.what()),
+			  "Activity: %s", MojoObjectJson(rep).c_str());
+		AppendTombstone(pt->GetKey());
+		return boost::shared_ptr<Activity>();
+	} catch (...) {
+		LOG_AM_WARNING(MSGID_UNKNOWN_EXCEPTION, 0, "Activity : %s. Unknown exception decoding encoded",
+			  MojoObjectJson(rep).c_str());
+		AppendTombstone(pt->GetKey());
+		return boost::shared_ptr<Activity>();
+	}
+
+	act->SetPersistToken(pt);
+
+	/* Records are loaded in the order they were written, so if another
+	 * Activity already holds this Activity's Id or Name, this one was
+	 * stored more recently, and replaces it. */
+
+	try {
+		m_am->RegisterActivityId(act);
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_ACTIVITY_ID_REG_FAIL, 1, PMLOGKFV("Activity","%llu", act->GetId()), "");
+
+		boost::shared_ptr<Activity> old = m_am->GetActivity(act->GetId());
+
+		LOG_AM_WARNING(MSGID_ACTIVITY_REPLACED, 2, PMLOGKFV("Activity","%llu",act->GetId()),
+			    PMLOGKFV("old_Activity","%llu",old->GetId()), "");
+
+		RetireActivity(old);
+		m_am->RegisterActivityId(act);
+	}
+
+	try {
+		m_am->RegisterActivityName(act);
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_ACTIVITY_NAME_REG_FAIL, 3, PMLOGKFV("Activity","%llu",act->GetId()),
+			  PMLOGKS("Creator_name",act->GetCreator().GetString().c_str()),
+			  PMLOGKS("Register_name",act->GetName().c_str()), "");
+
+		boost::shared_ptr<Activity> old = m_am->GetActivity(
+			act->GetName(), act->GetCreator());
+
+		LOG_AM_WARNING(MSGID_ACTIVITY_REPLACED, 2, PMLOGKFV("Activity","%llu",act->GetId()),
+			    PMLOGKFV("old_Activity","%llu",old->GetId()), "");
+
+		RetireActivity(old);
+		m_am->RegisterActivityName(act);
+	}
+
+	LOG_AM_DEBUG("[Activity %llu] (\"%s\"): key %llu loaded",
+		act->GetId(), act->GetName().c_str(),
+		(unsigned long long)pt->GetKey());
+
+	/* Request Activity be scheduled.  It won't transition to running
+	 * until the Activity Manager moves to the ready() and start()ed
+	 * states. */
+	m_am->StartActivity(act);
+
+	return act;
+}
+
+void LogPersistProxy::RetireActivity(boost::shared_ptr<Activity> old)
+{
+	boost::shared_ptr<LogPersistToken> oldPt =
+		boost::dynamic_pointer_cast<LogPersistToken, PersistToken>(
+			old->GetPersistToken());
+
+	AppendTombstone(oldPt->GetKey());
+	oldPt->Clear();
+
+	m_am->UnregisterActivityName(old);
+	m_am->ReleaseActivity(old);
+}
+
+MojErr LogPersistProxy::InfoToJson(MojObject& rep) const
+{
+	MojErr err;
+	MojObject log(MojObject::TypeObject);
+
+	err = log.putString(_T("path"), m_path.c_str());
+	MojErrCheck(err);
+
+	err = log.put(_T("bytes"), (MojInt64)m_length);
+	MojErrCheck(err);
+
+	err = log.put(_T("liveRecords"), (MojInt64)m_records.size());
+	MojErrCheck(err);
+
+	err = log.put(_T("liveBytes"), (MojInt64)m_liveBytes);
+	MojErrCheck(err);
+
+	err = log.put(_T("stores"), (MojInt64)m_stores);
+	MojErrCheck(err);
+
+	err = log.put(_T("deletes"), (MojInt64)m_deletes);
+	MojErrCheck(err);
+
+	err = log.put(_T("syncs"), (MojInt64)m_syncs);
+	MojErrCheck(err);
+
+	err = log.put(_T("syncUs"), (MojInt64)m_syncTime);
+	MojErrCheck(err);
+
+	err = log.put(_T("maxSyncUs"), (MojInt64)m_maxSyncTime);
+	MojErrCheck(err);
+
+	err = log.put(_T("compactions"), (MojInt64)m_compactions);
+	MojErrCheck(err);
+
+	err = log.put(_T("truncatedBytes"), (MojInt64)m_truncatedBytes);
+	MojErrCheck(err);
+
+	err = log.put(_T("loadUs"), (MojInt64)m_loadTime);
+	MojErrCheck(err);
+
+	err = rep.put(_T("log"), log);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+uint64_t LogPersistProxy::AllocateKey()
+{
+	return m_nextKey++;
+}
+
+void LogPersistProxy::AppendStore(boost::shared_ptr<LogPersistCommand> command,
+	uint64_t key, const MojString& rep)
+{
+	if (!Append(key, StoreRecord, rep.data(), rep.length())) {
+		command->Synced(false);
+		return;
+	}
+
+	m_stores++;
+	m_syncPending.push_back(command);
+}
+
+void LogPersistProxy::AppendDelete(boost::shared_ptr<LogPersistCommand> command,
+	uint64_t key)
+{
+	if (!Append(key, DeleteRecord, NULL, 0)) {
+		command->Synced(false);
+		return;
+	}
+
+	m_deletes++;
+	m_syncPending.push_back(command);
+}
+
+size_t LogPersistProxy::RecordSize(size_t length)
+{
+	size_t size = sizeof(RecordHeader) + length;
+	return (size + RecordAlignment - 1) & ~(RecordAlignment - 1);
+}
+
+uint64_t LogPersistProxy::RecordHash(uint64_t key, uint32_t type,
+	const char *data, size_t length)
+{
+	size_t hash = HashString(data, length);
+	hash = HashCombine(hash, HashActivityId(key));
+	hash = HashCombine(hash, (size_t)type);
+	hash = HashCombine(hash, length);
+	return (uint64_t)hash;
+}
+
+bool LogPersistProxy::WriteHeader(int fd)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, Magic, sizeof(header.m_magic));
+	header.m_version = Version;
+
+	return WriteAll(fd, (const char *)&header, sizeof(header), 0);
+}
+
+bool LogPersistProxy::Open(std::string& contents)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	std::string::size_type slash = m_path.rfind('/');
+	if ((slash != std::string::npos) && (slash > 0)) {
+		std::string directory = m_path.substr(0, slash);
+		if ((mkdir(directory.c_str(), 0700) < 0) && (errno != EEXIST)) {
+			LOG_AM_WARNING(MSGID_PERSIST_LOG_OPEN_FAIL, 2,
+				PMLOGKS("path",directory.c_str()),
+				PMLOGKS("error",strerror(errno)), "");
+		}
+	}
+
+	m_fd = open(m_path.c_str(), O_RDWR | O_CREAT, 0600);
+	if (m_fd < 0) {
+		LOG_AM_WARNING(MSGID_PERSIST_LOG_OPEN_FAIL, 2,
+			PMLOGKS("path",m_path.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(m_fd, &st) < 0) {
+		LOG_AM_WARNING(MSGID_PERSIST_LOG_OPEN_FAIL, 2,
+			PMLOGKS("path",m_path.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	contents.resize((size_t)st.st_size);
+	if (!contents.empty() &&
+		!ReadAll(m_fd, &contents[0], contents.size(), 0)) {
+		LOG_AM_WARNING(MSGID_PERSIST_LOG_OPEN_FAIL, 2,
+			PMLOGKS("path",m_path.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	Header header;
+	bool valid = false;
+	if (contents.size() >= sizeof(Header)) {
+		memcpy(&header, contents.data(), sizeof(header));
+		valid = (memcmp(header.m_magic, Magic, sizeof(Magic)) == 0) &&
+			(header.m_version == Version);
+	}
+
+	if (!valid) {
+		if (!contents.empty()) {
+			/* Keep the unreadable log around for inspection, rather than
+			 * overwriting it */
+			std::string invalidPath = m_path + ".invalid";
+
+			LOG_AM_WARNING(MSGID_PERSIST_LOG_INVALID, 2,
+				PMLOGKS("path",m_path.c_str()),
+				PMLOGKS("moved_to",invalidPath.c_str()),
+				"Log header doesn't match this version, starting a new log");
+
+			close(m_fd);
+			m_fd = -1;
+
+			if (rename(m_path.c_str(), invalidPath.c_str()) < 0) {
+				LOG_AM_WARNING(MSGID_PERSIST_LOG_OPEN_FAIL, 2,
+					PMLOGKS("path",m_path.c_str()),
+					PMLOGKS("error",strerror(errno)), "");
+				return false;
+			}
+
+			m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			if (m_fd < 0) {
+				LOG_AM_WARNING(MSGID_PERSIST_LOG_OPEN_FAIL, 2,
+					PMLOGKS("path",m_path.c_str()),
+					PMLOGKS("error",strerror(errno)), "");
+				return false;
+			}
+		}
+
+		contents.clear();
+
+		if (!WriteHeader(m_fd) || (fsync(m_fd) < 0)) {
+			LOG_AM_WARNING(MSGID_PERSIST_LOG_WRITE_FAIL, 2,
+				PMLOGKS("path",m_path.c_str()),
+				PMLOGKS("error",strerror(errno)), "");
+			close(m_fd);
+			m_fd = -1;
+			return false;
+		}
+
+		m_length = sizeof(Header);
+		return true;
+	}
+
+	Replay(contents);
+
+	return true;
+}
+
+void LogPersistProxy::Replay(const std::string& contents)
+{
+	size_t offset = sizeof(Header);
+
+	while ((contents.size() - offset) >= sizeof(RecordHeader)) {
+		RecordHeader header;
+		memcpy(&header, contents.data() + offset, sizeof(header));
+
+		/* A record cut short, or whose hash doesn't match, was being
+		 * written when the process stopped.  Its command never completed,
+		 * and nothing after it can be trusted. */
+		if ((RecordSize(header.m_length) > (contents.size() - offset)) ||
+			((header.m_type != StoreRecord) &&
+				(header.m_type != DeleteRecord)) ||
+			(RecordHash(header.m_key, header.m_type,
+				contents.data() + offset + sizeof(RecordHeader),
+				header.m_length) != header.m_hash)) {
+			break;
+		}
+
+		if (header.m_key >= m_nextKey) {
+			m_nextKey = header.m_key + 1;
+		}
+
+		RecordMap::iterator found = m_records.find(header.m_key);
+		if (found != m_records.end()) {
+			m_liveBytes -= RecordSize(found->second.m_length);
+			m_records.erase(found);
+		}
+
+		if (header.m_type == StoreRecord) {
+			LiveRecord live;
+			live.m_offset = (off_t)offset;
+			live.m_length = header.m_length;
+			m_records[header.m_key] = live;
+
+			m_liveBytes += RecordSize(header.m_length);
+		}
+
+		offset += RecordSize(header.m_length);
+	}
+
+	m_length = (off_t)offset;
+
+	if (offset < contents.size()) {
+		m_truncatedBytes = contents.size() - offset;
+
+		LOG_AM_WARNING(MSGID_PERSIST_LOG_TRUNCATED, 2,
+			PMLOGKS("path",m_path.c_str()),
+			PMLOGKFV("bytes","%llu",m_truncatedBytes),
+			"Discarding incomplete records at the end of the log");
+
+		if ((ftruncate(m_fd, m_length) < 0) || (fsync(m_fd) < 0)) {
+			/* Appends overwrite the discarded records anyway */
+			LOG_AM_WARNING(MSGID_PERSIST_LOG_WRITE_FAIL, 2,
+				PMLOGKS("path",m_path.c_str()),
+				PMLOGKS("error",strerror(errno)), "");
+		}
+	}
+
+	LOG_AM_DEBUG("Replayed %llu bytes of log, %u live records",
+		(unsigned long long)m_length, (unsigned)m_records.size());
+}
+
+void LogPersistProxy::GetRecordOrder(OrderVec& order) const
+{
+	order.reserve(m_records.size());
+
+	for (RecordMap::const_iterator iter = m_records.begin();
+		iter != m_records.end(); ++iter) {
+		order.push_back(std::make_pair(iter->second.m_offset, iter->first));
+	}
+
+	std::sort(order.begin(), order.end());
+}
+
+bool LogPersistProxy::Append(uint64_t key, RecordType type, const char *data,
+	size_t length)
+{
+	if (m_fd < 0) {
+		LOG_AM_ERROR(MSGID_PERSIST_LOG_WRITE_FAIL, 1,
+			PMLOGKS("path",m_path.c_str()), "Log is not open");
+		return false;
+	}
+
+	RecordHeader header;
+	memset(&header, 0, sizeof(header));
+	header.m_key = key;
+	header.m_type = type;
+	header.m_length = (uint32_t)length;
+	header.m_hash = RecordHash(key, type, data, length);
+
+	std::string record;
+	record.reserve(RecordSize(length));
+	record.append((const char *)&header, sizeof(header));
+	record.append(data, length);
+	record.resize(RecordSize(length), '\0');
+
+	if (!WriteAll(m_fd, record.data(), record.size(), m_length)) {
+		LOG_AM_ERROR(MSGID_PERSIST_LOG_WRITE_FAIL, 2,
+			PMLOGKS("path",m_path.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+
+		/* Drop whatever part of the record did make it out.  The next
+		 * append overwrites it in any case. */
+		if (ftruncate(m_fd, m_length) < 0) {
+			LOG_AM_DEBUG("Failed to truncate partial record: %s",
+				strerror(errno));
+		}
+
+		return false;
+	}
+
+	RecordMap::iterator found = m_records.find(key);
+	if (found != m_records.end()) {
+		m_liveBytes -= RecordSize(found->second.m_length);
+		m_records.erase(found);
+	}
+
+	if (type == StoreRecord) {
+		LiveRecord live;
+		live.m_offset = m_length;
+		live.m_length = (uint32_t)length;
+		m_records[key] = live;
+
+		m_liveBytes += record.size();
+	}
+
+	m_length += (off_t)record.size();
+
+	m_syncNeeded = true;
+	ScheduleSync();
+
+	return true;
+}
+
+void LogPersistProxy::AppendTombstone(uint64_t key)
+{
+	if (m_records.find(key) == m_records.end()) {
+		return;
+	}
+
+	Append(key, DeleteRecord, NULL, 0);
+}
+
+void LogPersistProxy::ScheduleSync()
+{
+	if (!m_syncSource) {
+		GSource *source = g_idle_source_new();
+		g_source_set_callback(source, LogPersistProxy::StaticSync, this,
+			NULL);
+		g_source_attach(source, g_main_context_default());
+
+		m_syncSource = source;
+	}
+}
+
+void LogPersistProxy::Sync()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	/* Completing the commands may issue the next ones, which will be
+	 * synced by the next pass */
+	SyncVec pending;
+	pending.swap(m_syncPending);
+
+	bool success = true;
+
+	if (m_syncNeeded) {
+		m_syncNeeded = false;
+
+		unsigned long long start = GetMonotonicMicroseconds();
+
+		if (fdatasync(m_fd) < 0) {
+			LOG_AM_ERROR(MSGID_PERSIST_LOG_SYNC_FAIL, 2,
+				PMLOGKS("path",m_path.c_str()),
+				PMLOGKS("error",strerror(errno)), "");
+			success = false;
+		}
+
+		unsigned long long elapsed = GetMonotonicMicroseconds() - start;
+
+		m_syncs++;
+		m_syncTime += elapsed;
+		if (elapsed > m_maxSyncTime) {
+			m_maxSyncTime = elapsed;
+		}
+
+		LOG_AM_DEBUG("Synced log for %u commands in %llu us",
+			(unsigned)pending.size(), elapsed);
+	}
+
+	for (SyncVec::iterator iter = pending.begin(); iter != pending.end();
+		++iter) {
+		(*iter)->Synced(success);
+	}
+
+	if (ShouldCompact()) {
+		ScheduleCompaction();
+	}
+}
+
+bool LogPersistProxy::ShouldCompact() const
+{
+	if (m_fd < 0) {
+		return false;
+	}
+
+	unsigned long long dead = (unsigned long long)m_length - sizeof(Header) -
+		m_liveBytes;
+
+	return (dead >= CompactMinDeadBytes) && (dead >= m_liveBytes);
+}
+
+void LogPersistProxy::ScheduleCompaction()
+{
+	if (!m_compactSource) {
+		GSource *source = g_timeout_source_new_seconds(CompactDelaySeconds);
+		g_source_set_callback(source, LogPersistProxy::StaticCompactTimeout,
+			this, NULL);
+		g_source_attach(source, g_main_context_default());
+
+		m_compactSource = source;
+	}
+}
+
+bool LogPersistProxy::Compact()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if (!ShouldCompact()) {
+		return true;
+	}
+
+	/* Records appended but not yet synced are copied too.  The new log is
+	 * synced before it replaces the old one, so their commands can still
+	 * complete from the next sync pass. */
+	unsigned long long start = GetMonotonicMicroseconds();
+
+	std::string tempPath = m_path + ".tmp";
+
+	int fd = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		LOG_AM_WARNING(MSGID_PERSIST_LOG_COMPACT_FAIL, 2,
+			PMLOGKS("path",tempPath.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		return false;
+	}
+
+	OrderVec order;
+	GetRecordOrder(order);
+
+	RecordMap records;
+	off_t length = sizeof(Header);
+	bool success = WriteHeader(fd);
+
+	std::string record;
+	for (OrderVec::const_iterator iter = order.begin();
+		success && (iter != order.end()); ++iter) {
+		const LiveRecord& live = m_records[iter->second];
+		size_t size = RecordSize(live.m_length);
+
+		record.resize(size);
+		success = ReadAll(m_fd, &record[0], size, live.m_offset) &&
+			WriteAll(fd, record.data(), size, length);
+
+		LiveRecord moved;
+		moved.m_offset = length;
+		moved.m_length = live.m_length;
+		records[iter->second] = moved;
+
+		length += (off_t)size;
+	}
+
+	success = success && (fsync(fd) == 0) &&
+		(rename(tempPath.c_str(), m_path.c_str()) == 0);
+
+	if (!success) {
+		LOG_AM_WARNING(MSGID_PERSIST_LOG_COMPACT_FAIL, 2,
+			PMLOGKS("path",m_path.c_str()),
+			PMLOGKS("error",strerror(errno)), "");
+		close(fd);
+		unlink(tempPath.c_str());
+		return false;
+	}
+
+	/* Make the rename itself durable */
+	std::string::size_type slash = m_path.rfind('/');
+	if (slash != std::string::npos) {
+		std::string directory = (slash > 0) ? m_path.substr(0, slash) : "/";
+		int dirFd = open(directory.c_str(), O_RDONLY);
+		if (dirFd >= 0) {
+			fsync(dirFd);
+			close(dirFd);
+		}
+	}
+
+	unsigned long long oldLength = (unsigned long long)m_length;
+
+	close(m_fd);
+	m_fd = fd;
+	m_length = length;
+	m_records.swap(records);
+
+	m_compactions++;
+
+	LOG_AM_DEBUG("Compacted log from %llu to %llu bytes (%u records) in "
+		"%llu us", oldLength, (unsigned long long)m_length,
+		(unsigned)m_records.size(), GetMonotonicMicroseconds() - start);
+
+	return true;
+}
+
+gboolean LogPersistProxy::StaticSync(gpointer data)
+{
+	LogPersistProxy *proxy = static_cast<LogPersistProxy *>(data);
+
+	/* Reset now, so anything appended during the pass gets a new one */
+	proxy->m_syncSource = NULL;
+
+	try {
+		proxy->Sync();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_LOG_EXCEPTION, 0, "Unhandled exception \"%s\" occurred syncing Activity log", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PERSIST_LOG_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred syncing Activity log");
+	}
+
+	return false;
+}
+
+gboolean LogPersistProxy::StaticCompactTimeout(gpointer data)
+{
+	LogPersistProxy *proxy = static_cast<LogPersistProxy *>(data);
+
+	/* Reset now, the source is destroyed when this returns false */
+	proxy->m_compactSource = NULL;
+
+	try {
+		proxy->Compact();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_LOG_EXCEPTION, 0, "Unhandled exception \"%s\" occurred compacting Activity log", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PERSIST_LOG_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred compacting Activity log");
+	}
+
+	return false;
+}
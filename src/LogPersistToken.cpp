@@ -0,0 +1,80 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+#include "LogPersistToken.h"
+
+#include <sstream>
+#include <stdexcept>
+
+LogPersistToken::LogPersistToken()
+	: m_valid(false)
+	, m_key(0)
+{
+}
+
+LogPersistToken::LogPersistToken(uint64_t key)
+	: m_valid(true)
+	, m_key(key)
+{
+}
+
+LogPersistToken::~LogPersistToken()
+{
+}
+
+bool LogPersistToken::IsValid() const
+{
+	return m_valid;
+}
+
+void LogPersistToken::Set(uint64_t key)
+{
+	if (m_valid) {
+		throw std::runtime_error("Key already set");
+	}
+
+	m_valid = true;
+	m_key = key;
+}
+
+void LogPersistToken::Clear()
+{
+	m_valid = false;
+	m_key = 0;
+}
+
+uint64_t LogPersistToken::GetKey() const
+{
+	if (!m_valid) {
+		throw std::runtime_error("Key not set");
+	}
+
+	return m_key;
+}
+
+std::string LogPersistToken::GetString() const
+{
+	if (!m_valid) {
+		return "(invalid token)";
+	} else {
+		std::stringstream tokenStr;
+		tokenStr << "(key: " << (unsigned long long)m_key << ")";
+		return tokenStr.str();
+	}
+}
@@ -20,6 +20,7 @@
 #include "MojoTrigger.h"
 #include "Activity.h"
 #include "ActivityJson.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 
 MojoCallback::MojoCallback(boost::shared_ptr<Activity> activity,
@@ -50,17 +51,18 @@ MojErr MojoCallback::Call()
 	MojErr err;
 
 	/* Populate "$activity" */
-	MojObject activityInfo;
-	err = m_activity.lock()->ActivityInfoToJson(activityInfo);
+	const MojObject *activityInfo;
+	err = activity->GetActivityInfo(activityInfo);
 	MojErrCheck(err);
 
 	MojObject params = m_params;
-	err = params.put(_T("$activity"), activityInfo);
+	err = params.put(_T("$activity"), *activityInfo);
 	MojErrCheck(err);
 
 	/* If an old MojoCall existed, it will be cancelled when its ref count
 	 * drops... */
-	m_call = boost::make_shared<MojoWeakPtrCall<MojoCallback> >(
+	m_call = boost::allocate_shared<MojoWeakPtrCall<MojoCallback> >(
+		POOL_ALLOCATOR(MojoWeakPtrCall<MojoCallback>),
 		boost::dynamic_pointer_cast<MojoCallback, Callback>
 			(shared_from_this()), &MojoCallback::HandleResponse,
 			m_service, m_url, params);
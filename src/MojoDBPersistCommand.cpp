@@ -19,12 +19,50 @@
 #include "MojoDBPersistCommand.h"
 #include "MojoDBPersistToken.h"
 #include "MojoDBProxy.h"
+#include "MojoDBRetryQueue.h"
+#include "MojoCall.h"
+#include "MojoObjectWrapper.h"
 #include "Activity.h"
 #include "ActivityJson.h"
 #include "Logging.h"
 
 #include <stdexcept>
 
+static unsigned long long s_storePuts = 0;
+static unsigned long long s_storeMerges = 0;
+static unsigned long long s_storesUnchanged = 0;
+
+/* Nothing needs to be written if the Activity's representation matches
+ * the object last written under its token. */
+static bool IsStoredCurrent(boost::shared_ptr<Activity> activity)
+{
+	if (!activity->IsPersistTokenSet()) {
+		return false;
+	}
+
+	boost::shared_ptr<MojoDBPersistToken> pt =
+		boost::dynamic_pointer_cast<MojoDBPersistToken, PersistToken>
+			(activity->GetPersistToken());
+
+	MojObject rep;
+	MojErr err = activity->ToJson(rep,
+		ACTIVITY_JSON_PERSIST | ACTIVITY_JSON_DETAIL);
+	if (err) {
+		return false;
+	}
+
+	MojObject changes(MojObject::TypeObject);
+	if (!pt->GetChanges(rep, changes) || (changes.begin() != changes.end())) {
+		return false;
+	}
+
+	LOG_AM_DEBUG("[Activity %llu] Stored object is current, nothing to "
+		"write", activity->GetId());
+
+	s_storesUnchanged++;
+	return true;
+}
+
 /*
  * palm://com.palm.db/put
  *
@@ -33,11 +71,20 @@
  *       "prop1" : VAL1, "prop2" : VAL2 },
  *     ... ]
  * }
+ *
+ * palm://com.palm.db/merge
+ *
+ * { "objects" :
+ *    [{ "_kind" : "com.palm.activity:1", "_id" : "XXX", "_rev" : 123,
+ *       "changedProp" : VAL },
+ *     ... ]
+ * }
  */
 MojoDBStoreCommand::MojoDBStoreCommand(MojService *service,
+	boost::shared_ptr<MojoDBRetryQueue> retry,
 	boost::shared_ptr<Activity> activity,
 	boost::shared_ptr<Completion> completion)
-	: MojoPersistCommand(service, "palm://com.palm.db/put", activity,
+	: MojoPersistCommand(service, retry, "palm://com.palm.db/put", activity,
 		completion)
 {
 }
@@ -51,6 +98,46 @@ std::string MojoDBStoreCommand::GetMethod() const
 	return "Store";
 }
 
+void MojoDBStoreCommand::Persist()
+{
+	if (IsStoredCurrent(m_activity)) {
+		Complete(true);
+		return;
+	}
+
+	MojoPersistCommand::Persist();
+}
+
+MojErr MojoDBStoreCommand::InfoToJson(MojObject& rep)
+{
+	MojErr err;
+	MojObject writes(MojObject::TypeObject);
+
+	err = writes.put(_T("puts"), (MojInt64)s_storePuts);
+	MojErrCheck(err);
+
+	err = writes.put(_T("merges"), (MojInt64)s_storeMerges);
+	MojErrCheck(err);
+
+	err = writes.put(_T("unchanged"), (MojInt64)s_storesUnchanged);
+	MojErrCheck(err);
+
+	err = rep.put(_T("storeWrites"), writes);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+bool MojoDBStoreCommand::Supersedes(const PersistCommand& earlier) const
+{
+	return earlier.IsStore();
+}
+
+bool MojoDBStoreCommand::IsStore() const
+{
+	return true;
+}
+
 void MojoDBStoreCommand::UpdateParams(MojObject& params)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -68,17 +155,30 @@ void MojoDBStoreCommand::UpdateParams(MojObject& params)
 			"representation");
 	}
 
+	m_rep = rep;
+
 	boost::shared_ptr<MojoDBPersistToken> pt =
 		boost::dynamic_pointer_cast<MojoDBPersistToken, PersistToken>
 			(m_activity->GetPersistToken());
+
+	MojObject object(MojObject::TypeObject);
+	if (pt->GetChanges(rep, object)) {
+		m_method = MojoURL("palm://com.palm.db/merge");
+		s_storeMerges++;
+	} else {
+		object = rep;
+		m_method = MojoURL("palm://com.palm.db/put");
+		s_storePuts++;
+	}
+
 	if (pt->IsValid()) {
-		err = pt->ToJson(rep);
+		err = pt->ToJson(object);
 	}
 
-	rep.putString(_T("_kind"), MojoDBProxy::ActivityKind);
+	object.putString(_T("_kind"), MojoDBProxy::ActivityKind);
 
 	MojObject objectsArray;
-	objectsArray.push(rep);
+	objectsArray.push(object);
 
 	params.put(_T("objects"), objectsArray);
 }
@@ -98,10 +198,19 @@ void MojoDBStoreCommand::PersistResponse(MojServiceMessage *msg,
 			PMLOGKFV("activity","%llu",m_activity->GetId()),
 			PMLOGKS("persist_command",GetString().c_str()),
 			PMLOGKS("exception",except.what()), "");
-		Complete(false);
+		FailResponse(msg, response, err);
 		return;
 	}
 
+	/* After a failed write the stored object isn't known any more, so
+	 * the next write has to be a full put. */
+	if (err) {
+		boost::shared_ptr<MojoDBPersistToken> pt =
+			boost::dynamic_pointer_cast<MojoDBPersistToken, PersistToken>
+				(m_activity->GetPersistToken());
+		pt->ClearStored();
+	}
+
 	if (!err) {
 		MojErr err2;
 		MojString id;
@@ -116,13 +225,13 @@ void MojoDBStoreCommand::PersistResponse(MojServiceMessage *msg,
 				PMLOGKFV("activity","%llu",m_activity->GetId()),
 				PMLOGKS("persist_command",GetString().c_str()),
 				"Results of MojoDB persist command not found in response");
-			Complete(false);
+			FailResponse(msg, response, err);
 			return;
 		}
 
 		if (resultArray.arrayBegin() == resultArray.arrayEnd()) {
 			LOG_AM_WARNING(MSGID_PERSIST_CMD_EMPTY_RESULTS, 0, "MojoDB persist command returned empty result set");
-			Complete(false);
+			FailResponse(msg, response, err);
 			return;
 		}
 
@@ -134,7 +243,7 @@ void MojoDBStoreCommand::PersistResponse(MojServiceMessage *msg,
 				PMLOGKFV("activity","%llu",m_activity->GetId()),
 				PMLOGKS("persist_command",GetString().c_str()),
 				"Error retreiving _id from MojoDB persist command response");
-			Complete(false);
+			FailResponse(msg, response, err);
 			return;
 		}
 
@@ -142,7 +251,7 @@ void MojoDBStoreCommand::PersistResponse(MojServiceMessage *msg,
 			LOG_AM_WARNING(MSGID_PERSIST_CMD_NO_ID, 2, PMLOGKFV("activity","%llu",m_activity->GetId()),
 				  PMLOGKS("persist_command",GetString().c_str()),
 				  "_id not found in MojoDB persist command response");
-			Complete(false);
+			FailResponse(msg, response, err);
 			return;
 		}
 
@@ -151,7 +260,7 @@ void MojoDBStoreCommand::PersistResponse(MojServiceMessage *msg,
 			LOG_AM_ERROR(MSGID_PERSIST_CMD_RESP_REV_NOT_FOUND, 2, PMLOGKFV("activity","%llu",m_activity->GetId()),
 				  PMLOGKS("persist_command",GetString().c_str()),
 				  "_rev not found in MojoDB persist command response");
-			Complete(false);
+			FailResponse(msg, response, err);
 			return;
 		}
 
@@ -165,11 +274,13 @@ void MojoDBStoreCommand::PersistResponse(MojServiceMessage *msg,
 			} else {
 				pt->Update(id, rev);
 			}
+
+			pt->SetStored(m_rep);
 		} catch (...) {
 			LOG_AM_ERROR(MSGID_PERSIST_TOKEN_VAL_UPDATE_FAIL, 2, PMLOGKFV("activity","%llu",m_activity->GetId()),
 				  PMLOGKS("persist_command",GetString().c_str()),
 				  "Failed to set or update value of persist token");
-			Complete(false);
+			FailResponse(msg, response, err);
 			return;
 		}
 	}
@@ -183,9 +294,10 @@ void MojoDBStoreCommand::PersistResponse(MojServiceMessage *msg,
  * { "ids" : [{ "XXX", "XXY", "XXZ" }] }
  */
 MojoDBDeleteCommand::MojoDBDeleteCommand(MojService *service,
+	boost::shared_ptr<MojoDBRetryQueue> retry,
 	boost::shared_ptr<Activity> activity,
 	boost::shared_ptr<Completion> completion)
-	: MojoPersistCommand(service, "palm://com.palm.db/del", activity,
+	: MojoPersistCommand(service, retry, "palm://com.palm.db/del", activity,
 		completion)
 {
 }
@@ -199,6 +311,21 @@ std::string MojoDBDeleteCommand::GetMethod() const
 	return "Delete";
 }
 
+void MojoDBDeleteCommand::Persist()
+{
+	if (IsDeleteUnneeded()) {
+		Complete(true);
+		return;
+	}
+
+	MojoPersistCommand::Persist();
+}
+
+bool MojoDBDeleteCommand::Supersedes(const PersistCommand& earlier) const
+{
+	return earlier.IsStore();
+}
+
 void MojoDBDeleteCommand::UpdateParams(MojObject& params)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -236,3 +363,599 @@ void MojoDBDeleteCommand::PersistResponse(MojServiceMessage *msg,
 	MojoPersistCommand::PersistResponse(msg, response, err);
 }
 
+MojoDBBatchCommand::MojoDBBatchCommand(boost::shared_ptr<MojoDBBatch> batch,
+	boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<Completion> completion)
+	: PersistCommand(activity, completion)
+	, m_batch(batch)
+	, m_type(PersistProxy::NoopCommandType)
+{
+}
+
+MojoDBBatchCommand::MojoDBBatchCommand(
+	boost::shared_ptr<MojoDBGroupCommit> group,
+	PersistProxy::CommandType type, boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<Completion> completion)
+	: PersistCommand(activity, completion)
+	, m_group(group)
+	, m_type(type)
+{
+}
+
+MojoDBBatchCommand::~MojoDBBatchCommand()
+{
+}
+
+void MojoDBBatchCommand::Persist()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("[Activity %llu] [PersistCommand %s]: Ready to issue "
+		"with batch", m_activity->GetId(), GetString().c_str());
+
+	if (m_batch) {
+		m_batch->CommandReady();
+		return;
+	}
+
+	if ((m_type == PersistProxy::DeleteCommandType) && IsDeleteUnneeded()) {
+		Complete(true);
+		return;
+	}
+
+	if ((m_type == PersistProxy::StoreCommandType) &&
+		IsStoredCurrent(m_activity)) {
+		Complete(true);
+		return;
+	}
+
+	boost::shared_ptr<MojoDBGroupCommit> group = m_group.lock();
+	if (!group) {
+		LOG_AM_WARNING(MSGID_PERSIST_GROUP_GONE, 1,
+			PMLOGKFV("activity","%llu",m_activity->GetId()),
+			"Group commit stage no longer exists");
+		Complete(false);
+		return;
+	}
+
+	group->CommandReady(boost::dynamic_pointer_cast<MojoDBBatchCommand,
+		PersistCommand>(shared_from_this()));
+}
+
+PersistProxy::CommandType MojoDBBatchCommand::GetType() const
+{
+	return m_type;
+}
+
+/* Only commands placed by the group commit stage can be superseded.  A
+ * command in an explicit batch is counted by that batch, and has to reach
+ * it. */
+bool MojoDBBatchCommand::Supersedes(const PersistCommand& earlier) const
+{
+	return ((m_type == PersistProxy::StoreCommandType) ||
+		(m_type == PersistProxy::DeleteCommandType)) && earlier.IsStore();
+}
+
+bool MojoDBBatchCommand::IsStore() const
+{
+	return (m_type == PersistProxy::StoreCommandType);
+}
+
+std::string MojoDBBatchCommand::GetMethod() const
+{
+	switch (m_type) {
+	case PersistProxy::StoreCommandType:
+		return "GroupStore";
+	case PersistProxy::DeleteCommandType:
+		return "GroupDelete";
+	default:
+		return "Batch";
+	}
+}
+
+MojoDBBatch::MojoDBBatch(MojService *service,
+	boost::shared_ptr<MojoDBRetryQueue> retry, PersistProxy::CommandType type)
+	: m_service(service)
+	, m_type(type)
+	, m_ready(0)
+	, m_merge(true)
+	, m_retry(retry)
+	, m_attempts(0)
+{
+}
+
+MojoDBBatch::~MojoDBBatch()
+{
+	/* Members are released as they complete, so any left here were never
+	 * going to be.  Fail them rather than stall their chains. */
+	if (!m_commands.empty()) {
+		LOG_AM_ERROR(MSGID_PERSIST_BATCH_ABANDONED, 1,
+			PMLOGKFV("commands","%u",(unsigned)m_commands.size()),
+			"Batch destroyed before completing its commands");
+
+		CommandVec commands;
+		commands.swap(m_commands);
+		m_issued.clear();
+
+		for (CommandVec::iterator iter = commands.begin();
+			iter != commands.end(); ++iter) {
+			ClearStored((*iter)->GetActivity());
+			(*iter)->Complete(false);
+		}
+	}
+}
+
+void MojoDBBatch::AddCommand(boost::shared_ptr<MojoDBBatchCommand> command)
+{
+	/* Commands placed by the group commit stage keep the batch alive until
+	 * it has completed them (the batch then drops its references, breaking
+	 * the cycle). */
+	if (!command->m_batch) {
+		command->m_groupBatch = shared_from_this();
+	}
+
+	m_commands.push_back(command);
+}
+
+void MojoDBBatch::CommandReady()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if (++m_ready == m_commands.size()) {
+		Issue();
+	}
+}
+
+void MojoDBBatch::IssueAll()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	m_ready = m_commands.size();
+	Issue();
+}
+
+void MojoDBBatch::Issue()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	MojObject objects(MojObject::TypeArray);
+	MojObject changes(MojObject::TypeArray);
+
+	/* Activities that can't be included (no token, or nothing to delete)
+	 * fail individually, the same way a single command would. */
+	CommandVec skipped;
+
+	for (CommandVec::iterator iter = m_commands.begin();
+		iter != m_commands.end(); ++iter) {
+		bool added = false;
+
+		try {
+			added = AddObject((*iter)->GetActivity(), objects, changes);
+		} catch (const std::exception& except) {
+			LOG_AM_WARNING(MSGID_PERSIST_BATCH_ITEM_SKIPPED, 2,
+				PMLOGKFV("activity","%llu",(*iter)->GetActivity()->GetId()),
+				PMLOGKS("exception",except.what()), "");
+		}
+
+		if (added) {
+			m_issued.push_back(*iter);
+		} else {
+			skipped.push_back(*iter);
+		}
+	}
+
+	boost::shared_ptr<MojoDBBatch> self = shared_from_this();
+
+	for (CommandVec::iterator iter = skipped.begin();
+		iter != skipped.end(); ++iter) {
+		(*iter)->Complete(false);
+	}
+
+	if (m_issued.empty()) {
+		m_commands.clear();
+		return;
+	}
+
+	const char *url;
+	MojObject params;
+	if (m_type == PersistProxy::StoreCommandType) {
+		if (m_merge) {
+			url = "palm://com.palm.db/merge";
+			params.put(_T("objects"), changes);
+			s_storeMerges += m_issued.size();
+		} else {
+			url = "palm://com.palm.db/put";
+			params.put(_T("objects"), objects);
+			s_storePuts += m_issued.size();
+		}
+	} else {
+		url = "palm://com.palm.db/del";
+		params.put(_T("ids"), objects);
+	}
+
+	LOG_AM_DEBUG("Issuing batched %s of %u Activities", url,
+		(unsigned)m_issued.size());
+
+	try {
+		m_call = boost::make_shared<MojoWeakPtrCall<MojoDBBatch> >(self,
+			&MojoDBBatch::BatchResponse, m_service, url, params);
+		m_retry->Issue(m_call);
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_ATMPT_UNEXPECTD_EXCPTN, 1,
+			PMLOGKS("Exception",except.what()),
+			"Unexpected exception while attempting to persist batch");
+		CompleteAll(false);
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PERSIST_ATMPT_UNKNWN_EXCPTN, 0,
+			"Unknown exception while attempting to persist batch");
+		CompleteAll(false);
+	}
+}
+
+bool MojoDBBatch::AddObject(boost::shared_ptr<Activity> activity,
+	MojObject& objects, MojObject& changes)
+{
+	if (!activity->IsPersistTokenSet()) {
+		throw std::runtime_error("Persist token for Activity is not set");
+	}
+
+	boost::shared_ptr<MojoDBPersistToken> pt =
+		boost::dynamic_pointer_cast<MojoDBPersistToken, PersistToken>
+			(activity->GetPersistToken());
+
+	if (m_type == PersistProxy::DeleteCommandType) {
+		if (!pt->IsValid()) {
+			throw std::runtime_error("Persist token for Activity is set "
+				"but not valid");
+		}
+
+		objects.push(pt->GetId());
+		return true;
+	}
+
+	MojObject rep;
+	MojErr err = activity->ToJson(rep,
+		ACTIVITY_JSON_PERSIST | ACTIVITY_JSON_DETAIL);
+	if (err) {
+		throw std::runtime_error("Failed to convert Activity to JSON "
+			"representation");
+	}
+
+	MojObject object = rep;
+	MojObject changed(MojObject::TypeObject);
+
+	if (!pt->GetChanges(rep, changed)) {
+		m_merge = false;
+	}
+
+	if (pt->IsValid()) {
+		pt->ToJson(object);
+		pt->ToJson(changed);
+	}
+
+	object.putString(_T("_kind"), MojoDBProxy::ActivityKind);
+	changed.putString(_T("_kind"), MojoDBProxy::ActivityKind);
+
+	objects.push(object);
+	changes.push(changed);
+	m_reps.push_back(rep);
+	return true;
+}
+
+void MojoDBBatch::UpdateToken(boost::shared_ptr<Activity> activity,
+	const MojObject& result)
+{
+	MojString id;
+	MojInt64 rev;
+	bool found = false;
+
+	MojErr err = result.get(_T("id"), id, found);
+	if (err || !found) {
+		throw std::runtime_error("_id not found in MojoDB batch response");
+	}
+
+	if (!result.get(_T("rev"), rev)) {
+		throw std::runtime_error("_rev not found in MojoDB batch response");
+	}
+
+	boost::shared_ptr<MojoDBPersistToken> pt =
+		boost::dynamic_pointer_cast<MojoDBPersistToken, PersistToken>
+			(activity->GetPersistToken());
+
+	if (!pt->IsValid()) {
+		pt->Set(id, rev);
+	} else {
+		pt->Update(id, rev);
+	}
+}
+
+void MojoDBBatch::BatchResponse(MojServiceMessage *msg,
+	const MojObject& response, MojErr err)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+	LOG_AM_DEBUG("Processing batch response %s",
+		MojoObjectJson(response).c_str());
+
+	if (err != MojErrNone) {
+		if (MojoCall::IsPermanentFailure(msg, response, err)) {
+			LOG_AM_WARNING(MSGID_PERSIST_CMD_RESP_FAIL, 2,
+				PMLOGKS("Errtext",MojoObjectString(response, _T("errorText")).c_str()),
+				PMLOGKFV("Errcode","%d",(int)err), "Batch failed");
+			m_retry->Responded(false);
+			CompleteAll(false);
+		} else {
+			LOG_AM_WARNING(MSGID_PERSIST_CMD_TRANSIENT_ERR, 0,
+				"Batch failed with transient error, retrying: %s",
+				MojoObjectJson(response).c_str());
+			m_retry->Retry(m_call, ++m_attempts);
+		}
+		return;
+	}
+
+	m_retry->Responded(true);
+
+	boost::shared_ptr<MojoDBBatch> self = shared_from_this();
+
+	if (m_type == PersistProxy::DeleteCommandType) {
+		for (CommandVec::iterator iter = m_issued.begin();
+			iter != m_issued.end(); ++iter) {
+			boost::shared_ptr<MojoDBPersistToken> pt =
+				boost::dynamic_pointer_cast<MojoDBPersistToken, PersistToken>
+					((*iter)->GetActivity()->GetPersistToken());
+			pt->Clear();
+		}
+
+		CompleteAll(true);
+		return;
+	}
+
+	/* put and merge return one result per object, in the order they were
+	 * passed */
+	MojObject resultArray;
+	if (!response.get(_T("results"), resultArray)) {
+		LOG_AM_WARNING(MSGID_PERSIST_CMD_NO_RESULTS, 0,
+			"Results of MojoDB batch persist command not found in response");
+		CompleteAll(false);
+		return;
+	}
+
+	CommandVec issued;
+	issued.swap(m_issued);
+	m_commands.clear();
+
+	std::vector<MojObject> reps;
+	reps.swap(m_reps);
+
+	MojObject::ConstArrayIterator result = resultArray.arrayBegin();
+	for (size_t i = 0; i < issued.size(); i++) {
+		boost::shared_ptr<MojoDBBatchCommand> command = issued[i];
+		bool succeeded = false;
+
+		if (result != resultArray.arrayEnd()) {
+			try {
+				UpdateToken(command->GetActivity(), *result);
+
+				boost::shared_ptr<MojoDBPersistToken> pt =
+					boost::dynamic_pointer_cast<MojoDBPersistToken,
+						PersistToken>(command->GetActivity()->GetPersistToken());
+				pt->SetStored(reps[i]);
+
+				succeeded = true;
+			} catch (const std::exception& except) {
+				LOG_AM_ERROR(MSGID_PERSIST_TOKEN_VAL_UPDATE_FAIL, 2,
+					PMLOGKFV("activity","%llu",command->GetActivity()->GetId()),
+					PMLOGKS("exception",except.what()),
+					"Failed to set or update value of persist token");
+			}
+			++result;
+		} else {
+			LOG_AM_WARNING(MSGID_PERSIST_BATCH_RESULTS_SHORT, 1,
+				PMLOGKFV("activity","%llu",command->GetActivity()->GetId()),
+				"No result for Activity in MojoDB batch response");
+		}
+
+		if (!succeeded) {
+			ClearStored(command->GetActivity());
+		}
+
+		command->Complete(succeeded);
+	}
+}
+
+void MojoDBBatch::CompleteAll(bool success)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	/* Completing a member may release the last outside reference to the
+	 * batch (and kick off the next command in its chain), so work from
+	 * a local copy.  Clearing the lists also breaks the reference cycle
+	 * between the batch and its members. */
+	boost::shared_ptr<MojoDBBatch> self = shared_from_this();
+
+	CommandVec issued;
+	issued.swap(m_issued);
+	m_commands.clear();
+	m_reps.clear();
+
+	for (CommandVec::iterator iter = issued.begin(); iter != issued.end();
+		++iter) {
+		if (!success) {
+			ClearStored((*iter)->GetActivity());
+		}
+
+		(*iter)->Complete(success);
+	}
+}
+
+/* After a failed write the stored object isn't known any more, so the
+ * next write has to be a full put. */
+void MojoDBBatch::ClearStored(boost::shared_ptr<Activity> activity)
+{
+	if (activity->IsPersistTokenSet()) {
+		boost::shared_ptr<MojoDBPersistToken> pt =
+			boost::dynamic_pointer_cast<MojoDBPersistToken, PersistToken>
+				(activity->GetPersistToken());
+		pt->ClearStored();
+	}
+}
+
+MojoDBGroupCommit::MojoDBGroupCommit(MojService *service,
+	boost::shared_ptr<MojoDBRetryQueue> retry, unsigned windowMs,
+	unsigned maxObjects)
+	: m_service(service)
+	, m_retry(retry)
+	, m_windowMs(windowMs)
+	, m_maxObjects(maxObjects)
+	, m_window(NULL)
+	, m_commands(0)
+	, m_batches(0)
+{
+}
+
+MojoDBGroupCommit::~MojoDBGroupCommit()
+{
+	CancelWindow();
+}
+
+void MojoDBGroupCommit::CommandReady(
+	boost::shared_ptr<MojoDBBatchCommand> command)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	PersistProxy::CommandType type = command->GetType();
+	if ((type != PersistProxy::StoreCommandType) &&
+		(type != PersistProxy::DeleteCommandType)) {
+		throw std::runtime_error("Only store and delete commands may be "
+			"group committed");
+	}
+
+	m_commands++;
+	m_pending[type].push_back(command);
+
+	if (m_pending[type].size() >= m_maxObjects) {
+		Flush(type);
+		return;
+	}
+
+	if (!m_window) {
+		LOG_AM_DEBUG("Opening %ums group commit window", m_windowMs);
+
+		GSource *source = g_timeout_source_new(m_windowMs);
+		g_source_set_callback(source, MojoDBGroupCommit::StaticWindowTimeout,
+			this, NULL);
+		g_source_attach(source, g_main_context_default());
+
+		m_window = source;
+	}
+}
+
+void MojoDBGroupCommit::Flush()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	CancelWindow();
+
+	Flush(PersistProxy::StoreCommandType);
+	Flush(PersistProxy::DeleteCommandType);
+}
+
+void MojoDBGroupCommit::Flush(PersistProxy::CommandType type)
+{
+	CommandVec commands;
+	commands.swap(m_pending[type]);
+
+	if (m_pending[PersistProxy::StoreCommandType].empty() &&
+		m_pending[PersistProxy::DeleteCommandType].empty()) {
+		CancelWindow();
+	}
+
+	if (commands.empty()) {
+		return;
+	}
+
+	LOG_AM_DEBUG("Group committing %s of %u Activities",
+		(type == PersistProxy::StoreCommandType) ? "put" : "delete",
+		(unsigned)commands.size());
+
+	boost::shared_ptr<MojoDBBatch> batch = boost::make_shared<MojoDBBatch>(
+		m_service, m_retry, type);
+
+	for (CommandVec::iterator iter = commands.begin();
+		iter != commands.end(); ++iter) {
+		batch->AddCommand(*iter);
+	}
+
+	m_batches++;
+	batch->IssueAll();
+}
+
+void MojoDBGroupCommit::SetWindow(unsigned windowMs, unsigned maxObjects)
+{
+	m_windowMs = windowMs;
+	m_maxObjects = maxObjects;
+
+	/* Don't hold anything already pending to the old window */
+	Flush();
+}
+
+unsigned MojoDBGroupCommit::GetWindowMs() const
+{
+	return m_windowMs;
+}
+
+unsigned MojoDBGroupCommit::GetMaxObjects() const
+{
+	return m_maxObjects;
+}
+
+void MojoDBGroupCommit::CancelWindow()
+{
+	if (m_window) {
+		if (!g_source_is_destroyed(m_window)) {
+			g_source_destroy(m_window);
+		}
+
+		m_window = NULL;
+	}
+}
+
+gboolean MojoDBGroupCommit::StaticWindowTimeout(gpointer data)
+{
+	MojoDBGroupCommit *group = static_cast<MojoDBGroupCommit *>(data);
+
+	/* Reset now, the source is destroyed when this returns false */
+	group->m_window = NULL;
+
+	try {
+		group->Flush();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_GROUP_EXCEPTION, 0, "Unhandled exception \"%s\" occurred during group commit", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PERSIST_GROUP_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred during group commit");
+	}
+
+	return false;
+}
+
+MojErr MojoDBGroupCommit::InfoToJson(MojObject& rep) const
+{
+	MojErr err;
+
+	err = rep.put(_T("windowMs"), (MojInt64)m_windowMs);
+	MojErrCheck(err);
+
+	err = rep.put(_T("maxObjects"), (MojInt64)m_maxObjects);
+	MojErrCheck(err);
+
+	err = rep.put(_T("commands"), (MojInt64)m_commands);
+	MojErrCheck(err);
+
+	err = rep.put(_T("batches"), (MojInt64)m_batches);
+	MojErrCheck(err);
+
+	err = rep.put(_T("pending"),
+		(MojInt64)(m_pending[PersistProxy::StoreCommandType].size() +
+			m_pending[PersistProxy::DeleteCommandType].size()));
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
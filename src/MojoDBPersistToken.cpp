@@ -26,6 +26,7 @@
 MojoDBPersistToken::MojoDBPersistToken()
 	: m_valid(false)
 	, m_rev(-1)
+	, m_storedValid(false)
 {
 }
 
@@ -33,6 +34,7 @@ MojoDBPersistToken::MojoDBPersistToken(const MojString& id, MojInt64 rev)
 	: m_valid(true)
 	, m_id(id)
 	, m_rev(rev)
+	, m_storedValid(false)
 {
 }
 
@@ -77,6 +79,8 @@ void MojoDBPersistToken::Clear()
 	m_valid = false;
 	m_id.clear();
 	m_rev = -1;
+
+	ClearStored();
 }
 
 MojInt64 MojoDBPersistToken::GetRev() const
@@ -114,6 +118,65 @@ MojErr MojoDBPersistToken::ToJson(MojObject& rep) const
 	return MojErrNone;
 }
 
+void MojoDBPersistToken::SetStored(const MojObject& rep)
+{
+	m_stored = rep;
+	m_storedValid = true;
+}
+
+void MojoDBPersistToken::ClearStored()
+{
+	m_stored.clear();
+	m_storedValid = false;
+}
+
+/* MojoDB merges nested objects property by property, so a property
+ * removed at any depth would survive a merge. */
+static bool HasRemovedProperties(const MojObject& stored,
+	const MojObject& rep)
+{
+	for (MojObject::ConstIterator iter = stored.begin();
+		iter != stored.end(); ++iter) {
+		MojObject::ConstIterator found = rep.find(iter.key().data());
+		if (found == rep.end()) {
+			return true;
+		}
+
+		if ((iter.value().type() == MojObject::TypeObject) &&
+			(found.value().type() == MojObject::TypeObject) &&
+			HasRemovedProperties(iter.value(), found.value())) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool MojoDBPersistToken::GetChanges(const MojObject& rep,
+	MojObject& changes) const
+{
+	if (!m_valid || !m_storedValid) {
+		return false;
+	}
+
+	if (HasRemovedProperties(m_stored, rep)) {
+		return false;
+	}
+
+	for (MojObject::ConstIterator iter = rep.begin(); iter != rep.end();
+		++iter) {
+		MojObject::ConstIterator found = m_stored.find(iter.key().data());
+		if ((found == m_stored.end()) || !(found.value() == iter.value())) {
+			MojErr err = changes.put(iter.key().data(), iter.value());
+			if (err) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
 std::string MojoDBPersistToken::GetString() const
 {
 	if (!m_valid) {
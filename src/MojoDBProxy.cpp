@@ -19,21 +19,30 @@
 #include "MojoDBProxy.h"
 #include "MojoDBPersistToken.h"
 #include "MojoDBPersistCommand.h"
+#include "MojoDBRetryQueue.h"
+#include "ActivitySnapshot.h"
 #include "MojoJsonConverter.h"
 #include "MojoCall.h"
 #include "ActivityJson.h"
 #include "Activity.h"
 #include "ActivityManager.h"
 #include "ServiceApp.h"
+#include "ObjectPool.h"
+#include "MonotonicClock.h"
 #include "Logging.h"
 
 #include <stdexcept>
+#include <errno.h>
+#include <sys/stat.h>
 #include <core/MojObject.h>
-#include <db/MojDbQuery.h>
 
 const char *MojoDBProxy::ActivityKind = _T("com.palm.activity:1");
 
-const int MojoDBProxy::PurgeBatchSize = MojDbQuery::MaxQueryLimit;
+const int MojoDBProxy::PurgeBatchSize = 64;
+
+const char *MojoDBProxy::SnapshotDirectory = "/var/lib/activitymanager";
+const char *MojoDBProxy::SnapshotPath =
+	"/var/lib/activitymanager/activities.snapshot";
 
 MojLogger MojoDBProxy::s_log(_T("activitymanager.mojodb"));
 
@@ -44,11 +53,65 @@ MojoDBProxy::MojoDBProxy(ActivityManagerApp *app, MojService *service,
 	, m_service(service)
 	, m_am(am)
 	, m_json(json)
+	, m_retry(boost::make_shared<MojoDBRetryQueue>())
+	, m_groupCommit(boost::make_shared<MojoDBGroupCommit>(service, m_retry,
+		DefaultGroupCommitWindowMs, DefaultGroupCommitMaxObjects))
+	, m_purgeSource(NULL)
+	, m_purgeBatch(0)
+	, m_purged(0)
+	, m_purgeFailed(0)
+	, m_purgeBatches(0)
+	, m_purgeRetries(0)
+	, m_purgeStart(0)
+	, m_purgeTime(0)
+	, m_loadStart(0)
+	, m_loadPageRequested(0)
+	, m_loadTime(0)
+	, m_readySent(false)
+	, m_snapshotSource(NULL)
+	, m_snapshotThread(NULL)
+	, m_snapshotCommittedSource(NULL)
+	, m_snapshotRewrite(false)
+	, m_snapshotLoaded(0)
+	, m_snapshotConfirmed(0)
+	, m_snapshotRemoved(0)
+	, m_snapshotLoadTime(0)
+	, m_snapshotsWritten(0)
 {
 }
 
 MojoDBProxy::~MojoDBProxy()
 {
+	if (m_snapshotSource) {
+		if (!g_source_is_destroyed(m_snapshotSource)) {
+			g_source_destroy(m_snapshotSource);
+		}
+
+		m_snapshotSource = NULL;
+	}
+
+	/* Let a write in progress finish, rather than leave a partial
+	 * temporary behind */
+	if (m_snapshotThread) {
+		g_thread_join(m_snapshotThread);
+		m_snapshotThread = NULL;
+
+		if (m_snapshotCommittedSource) {
+			if (!g_source_is_destroyed(m_snapshotCommittedSource)) {
+				g_source_destroy(m_snapshotCommittedSource);
+			}
+
+			m_snapshotCommittedSource = NULL;
+		}
+	}
+
+	if (m_purgeSource) {
+		if (!g_source_is_destroyed(m_purgeSource)) {
+			g_source_destroy(m_purgeSource);
+		}
+
+		m_purgeSource = NULL;
+	}
 }
 
 boost::shared_ptr<PersistCommand>
@@ -59,8 +122,17 @@ MojoDBProxy::PrepareStoreCommand(boost::shared_ptr<Activity> activity,
 	LOG_AM_DEBUG("Preparing put command for [Activity %llu]",
 		activity->GetId());
 
-	return boost::make_shared<MojoDBStoreCommand>(m_service,
-		activity, completion);
+	ScheduleSnapshot();
+
+	if (m_groupCommit->GetWindowMs()) {
+		return boost::allocate_shared<MojoDBBatchCommand>(
+			POOL_ALLOCATOR(MojoDBBatchCommand), m_groupCommit,
+			StoreCommandType, activity, completion);
+	}
+
+	return boost::allocate_shared<MojoDBStoreCommand>(
+		POOL_ALLOCATOR(MojoDBStoreCommand),
+		m_service, m_retry, activity, completion);
 }
 
 boost::shared_ptr<PersistCommand>
@@ -71,14 +143,179 @@ MojoDBProxy::PrepareDeleteCommand(boost::shared_ptr<Activity> activity,
 	LOG_AM_DEBUG("Preparing delete command for [Activity %llu]",
 		activity->GetId());
 
-	return boost::make_shared<MojoDBDeleteCommand>(m_service,
-		activity, completion);
+	ScheduleSnapshot();
+
+	if (m_groupCommit->GetWindowMs()) {
+		return boost::allocate_shared<MojoDBBatchCommand>(
+			POOL_ALLOCATOR(MojoDBBatchCommand), m_groupCommit,
+			DeleteCommandType, activity, completion);
+	}
+
+	return boost::allocate_shared<MojoDBDeleteCommand>(
+		POOL_ALLOCATOR(MojoDBDeleteCommand),
+		m_service, m_retry, activity, completion);
+}
+
+void
+MojoDBProxy::PrepareBatchCommands(CommandType type,
+	const ActivityVec& activities, const CompletionVec& completions,
+	CommandVec& commands)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if ((type == NoopCommandType) || (activities.size() < 2)) {
+		PersistProxy::PrepareBatchCommands(type, activities, completions,
+			commands);
+		return;
+	}
+
+	if (activities.size() != completions.size()) {
+		throw std::runtime_error("Batch must have one Completion per "
+			"Activity");
+	}
+
+	LOG_AM_DEBUG("Preparing batched %s command for %u Activities",
+		(type == StoreCommandType) ? "put" : "delete",
+		(unsigned)activities.size());
+
+	ScheduleSnapshot();
+
+	boost::shared_ptr<MojoDBBatch> batch = boost::make_shared<MojoDBBatch>(
+		m_service, m_retry, type);
+
+	for (size_t i = 0; i < activities.size(); i++) {
+		boost::shared_ptr<MojoDBBatchCommand> cmd =
+			boost::make_shared<MojoDBBatchCommand>(batch, activities[i],
+				completions[i]);
+		batch->AddCommand(cmd);
+		commands.push_back(cmd);
+	}
+}
+
+void MojoDBProxy::SetGroupCommit(unsigned windowMs, unsigned maxObjects)
+{
+	LOG_AM_DEBUG("Setting group commit window to %ums, up to %u objects",
+		windowMs, maxObjects);
+
+	m_groupCommit->SetWindow(windowMs, maxObjects ? maxObjects : 1);
+}
+
+MojErr MojoDBProxy::InfoToJson(MojObject& rep) const
+{
+	MojErr err;
+	MojObject groupCommit(MojObject::TypeObject);
+
+	err = m_groupCommit->InfoToJson(groupCommit);
+	MojErrCheck(err);
+
+	err = rep.put(_T("groupCommit"), groupCommit);
+	MojErrCheck(err);
+
+	err = MojoDBStoreCommand::InfoToJson(rep);
+	MojErrCheck(err);
+
+	MojObject retry(MojObject::TypeObject);
+
+	err = m_retry->InfoToJson(retry);
+	MojErrCheck(err);
+
+	err = rep.put(_T("retry"), retry);
+	MojErrCheck(err);
+
+	MojObject load(MojObject::TypeObject);
+
+	err = load.put(_T("totalUs"), (MojInt64)m_loadTime);
+	MojErrCheck(err);
+
+	MojInt64 activities = 0;
+	MojObject pages(MojObject::TypeArray);
+	for (LoadPageVec::const_iterator iter = m_loadPages.begin();
+		iter != m_loadPages.end(); ++iter) {
+		MojObject pageRep(MojObject::TypeObject);
+
+		err = pageRep.put(_T("activities"), (MojInt64)iter->m_activities);
+		MojErrCheck(err);
+
+		err = pageRep.put(_T("latencyUs"), (MojInt64)iter->m_latency);
+		MojErrCheck(err);
+
+		err = pageRep.put(_T("decodeUs"), (MojInt64)iter->m_decode);
+		MojErrCheck(err);
+
+		err = pages.push(pageRep);
+		MojErrCheck(err);
+
+		activities += iter->m_activities;
+	}
+
+	err = load.put(_T("activities"), activities);
+	MojErrCheck(err);
+
+	err = load.put(_T("pages"), pages);
+	MojErrCheck(err);
+
+	err = rep.put(_T("load"), load);
+	MojErrCheck(err);
+
+	MojObject snapshot(MojObject::TypeObject);
+
+#ifdef ACTIVITYMANAGER_LOAD_SNAPSHOT
+	err = snapshot.putBool(_T("enabled"), true);
+#else
+	err = snapshot.putBool(_T("enabled"), false);
+#endif
+	MojErrCheck(err);
+
+	err = snapshot.put(_T("loaded"), (MojInt64)m_snapshotLoaded);
+	MojErrCheck(err);
+
+	err = snapshot.put(_T("confirmed"), (MojInt64)m_snapshotConfirmed);
+	MojErrCheck(err);
+
+	err = snapshot.put(_T("removed"), (MojInt64)m_snapshotRemoved);
+	MojErrCheck(err);
+
+	err = snapshot.put(_T("loadUs"), (MojInt64)m_snapshotLoadTime);
+	MojErrCheck(err);
+
+	err = snapshot.put(_T("written"), (MojInt64)m_snapshotsWritten);
+	MojErrCheck(err);
+
+	err = rep.put(_T("snapshot"), snapshot);
+	MojErrCheck(err);
+
+	MojObject purge(MojObject::TypeObject);
+
+	err = purge.put(_T("pending"),
+		(MojInt64)(m_oldTokens.size() + m_purgeBatch));
+	MojErrCheck(err);
+
+	err = purge.put(_T("purged"), (MojInt64)m_purged);
+	MojErrCheck(err);
+
+	err = purge.put(_T("failed"), (MojInt64)m_purgeFailed);
+	MojErrCheck(err);
+
+	err = purge.put(_T("batches"), (MojInt64)m_purgeBatches);
+	MojErrCheck(err);
+
+	err = purge.put(_T("retries"), (MojInt64)m_purgeRetries);
+	MojErrCheck(err);
+
+	err = purge.put(_T("totalUs"), (MojInt64)m_purgeTime);
+	MojErrCheck(err);
+
+	err = rep.put(_T("purge"), purge);
+	MojErrCheck(err);
+
+	return MojErrNone;
 }
 
 boost::shared_ptr<PersistToken>
 MojoDBProxy::CreateToken()
 {
-	return boost::make_shared<MojoDBPersistToken>();
+	return boost::allocate_shared<MojoDBPersistToken>(
+		POOL_ALLOCATOR(MojoDBPersistToken));
 }
 
 void MojoDBProxy::LoadActivities()
@@ -86,9 +323,36 @@ void MojoDBProxy::LoadActivities()
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("Loading persisted Activities from MojoDB");
 
+	m_loadStart = GetMonotonicMicroseconds();
+	m_loadTime = 0;
+	m_loadPages.clear();
+
+#ifdef ACTIVITYMANAGER_LOAD_SNAPSHOT
+	/* Come online with the snapshot's Activities, rather than waiting for
+	 * every page to come in from MojoDB.  The load still runs, in the
+	 * background, and cancels any of them that have changed or been
+	 * removed since the snapshot was written. */
+	if (LoadSnapshot()) {
+#ifndef ACTIVITYMANAGER_CALL_CONFIGURATOR
+		m_am->Enable(ActivityManager::CONFIGURATION_LOADED);
+#endif
+		m_readySent = true;
+		m_app->ready();
+	}
+#endif
+
+	RequestLoadPage(MojString());
+}
+
+void MojoDBProxy::RequestLoadPage(const MojString& page)
+{
 	MojObject query;
 	query.putString(_T("from"), ActivityKind);
 
+	if (!page.empty()) {
+		query.putString(_T("page"), page);
+	}
+
 	MojObject params;
 	params.put(_T("query"), query);
 
@@ -98,6 +362,7 @@ void MojoDBProxy::LoadActivities()
 		&MojoDBProxy::ActivityLoadResults,
 		m_service, "palm://com.palm.db/find", params);
 
+	m_loadPageRequested = GetMonotonicMicroseconds();
 	m_call->Call();
 }
 
@@ -117,7 +382,10 @@ void MojoDBProxy::ActivityLoadResults(MojServiceMessage *msg,
 #ifdef ACTIVITYMANAGER_REQUIRE_DB
 			m_app->shutdown();
 #else
-			m_app->ready();
+			if (!m_readySent) {
+				m_readySent = true;
+				m_app->ready();
+			}
 #endif
 		} else {
 			LOG_AM_WARNING(MSGID_ACTIVITIES_LOAD_ERR, 0, "Error loading Activities from MojoDB, retrying: %s",
@@ -130,198 +398,269 @@ void MojoDBProxy::ActivityLoadResults(MojServiceMessage *msg,
 	/* Clear current call */
 	m_call.reset();
 
+	unsigned long long received = GetMonotonicMicroseconds();
+
+	/* Request the next page first, so MojoDB can work on it while this
+	 * page is being decoded. */
 	bool found;
 	MojErr err2;
-	MojObject results;
-	found = response.get(_T("results"), results);
+	MojString page;
+	err2 = response.get(_T("page"), page, found);
+	if (err2) {
+		LOG_AM_ERROR(MSGID_GET_PAGE_FAIL, 0, "Error getting page parameter in MojoDB query response");
+		return;
+	}
+
+	LoadPageStats stats;
+	stats.m_latency = received - m_loadPageRequested;
 
 	if (found) {
-		for (MojObject::ConstArrayIterator iter = results.arrayBegin();
-			iter != results.arrayEnd(); ++iter) {
-			const MojObject& rep = *iter;
-			MojInt64 activityId;
-
-			bool found;
-			found = rep.get(_T("activityId"), activityId);
-			if (!found) {
-				LOG_AM_WARNING(MSGID_ACTIVITYID_NOT_FOUND, 0, "activityId not found loading Activities");
-					continue;
-			}
+		LOG_AM_DEBUG("Requesting next page (\"%s\") of Activities",
+			page.data());
+		RequestLoadPage(page);
+	}
 
-			MojString id;
-			MojErr err = rep.get(_T("_id"), id, found);
-			if (err) {
-				LOG_AM_WARNING(MSGID_RETRIEVE_ID_FAIL, 0, "Error retrieving _id from results returned from MojoDB");
-				continue;
-			}
+	MojObject results;
+	if (response.get(_T("results"), results)) {
+		stats.m_activities = LoadPage(results);
+	}
 
-			if (!found) {
-				LOG_AM_WARNING(MSGID_ID_NOT_FOUND, 0, "_id not found loading Activities from MojoDB");
-				continue;
-			}
+	stats.m_decode = GetMonotonicMicroseconds() - received;
+	m_loadPages.push_back(stats);
 
-			MojInt64 rev;
-			found = rep.get(_T("_rev"), rev);
-			if (!found) {
-				LOG_AM_WARNING(MSGID_REV_NOT_FOUND, 0, "_rev not found loading Activities from MojoDB");
-				continue;
-			}
+	if (!found) {
+		m_loadTime = GetMonotonicMicroseconds() - m_loadStart;
 
-			boost::shared_ptr<MojoDBPersistToken> pt =
-				boost::make_shared<MojoDBPersistToken>(id, rev);
+		LOG_AM_DEBUG("All Activities successfully loaded from MojoDB: %u "
+			"pages in %llu us", (unsigned)m_loadPages.size(), m_loadTime);
 
-			boost::shared_ptr<Activity> act;
+		CancelStaleSnapshot();
 
-			try {
-				act = m_json->CreateActivity(rep, Activity::PrivateBus, true);
-			} catch (const std::exception& except) {
-				LOG_AM_WARNING(MSGID_CREATE_ACTIVITY_EXCEPTION, 1, PMLOGKS("Exception",except.what()),
-					  "Activity: %s", MojoObjectJson(rep).c_str());
-				m_oldTokens.push_back(pt);
-				continue;
-			} catch (...) {
-				LOG_AM_WARNING(MSGID_UNKNOWN_EXCEPTION, 0, "Activity : %s. Unknown exception decoding encoded",
-					  MojoObjectJson(rep).c_str());
-				m_oldTokens.push_back(pt);
+#ifdef ACTIVITYMANAGER_LOAD_SNAPSHOT
+		WriteSnapshot();
+#endif
+
+		/* Old Activities are purged in the background - they've already
+		 * been released, so nothing needs to wait for them to go. */
+		if (!m_oldTokens.empty()) {
+			LOG_AM_DEBUG("Scheduling purge of %u old Activities from "
+				"database", (unsigned)m_oldTokens.size());
+			m_purgeStart = GetMonotonicMicroseconds();
+			SchedulePurge();
+		}
+
+#ifdef ACTIVITYMANAGER_CALL_CONFIGURATOR
+		PrepareConfiguratorCall();
+		m_call->Call();
+#else
+		m_call.reset();
+		m_am->Enable(ActivityManager::CONFIGURATION_LOADED);
+#endif
+
+		if (!m_readySent) {
+			m_readySent = true;
+			m_app->ready();
+		}
+	}
+}
+
+/* Decode, register, and start the Activities in one page of results.
+ * Returns the number of Activities started. */
+unsigned MojoDBProxy::LoadPage(const MojObject& results)
+{
+	unsigned loaded = 0;
+
+	for (MojObject::ConstArrayIterator iter = results.arrayBegin();
+		iter != results.arrayEnd(); ++iter) {
+		const MojObject& rep = *iter;
+		MojInt64 activityId;
+
+		bool found;
+		found = rep.get(_T("activityId"), activityId);
+		if (!found) {
+			LOG_AM_WARNING(MSGID_ACTIVITYID_NOT_FOUND, 0, "activityId not found loading Activities");
 				continue;
-			}
+		}
 
-			act->SetPersistToken(pt);
-
-			/* Attempt to register this Activity's Id and Name, in order. */
-
-			try {
-				m_am->RegisterActivityId(act);
-			} catch (...) {
-				LOG_AM_ERROR(MSGID_ACTIVITY_ID_REG_FAIL, 1, PMLOGKFV("Activity","%llu", act->GetId()), "");
-
-				/* Another Activity is already registered.  Determine which
-				 * is newer, and kill the older one. */
-
-				boost::shared_ptr<Activity> old = m_am->GetActivity(
-					act->GetId());
-				boost::shared_ptr<MojoDBPersistToken> oldPt =
-					boost::dynamic_pointer_cast<MojoDBPersistToken,
-						PersistToken>(old->GetPersistToken());
-
-				if (pt->GetRev() > oldPt->GetRev()) {
-					LOG_AM_WARNING(MSGID_ACTIVITY_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
-						    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
-						    PMLOGKFV("old_Activity","%llu",old->GetId()),
-						    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
-
-					m_oldTokens.push_back(oldPt);
-					m_am->UnregisterActivityName(old);
-					m_am->ReleaseActivity(old);
-
-					m_am->RegisterActivityId(act);
-				} else {
-					LOG_AM_WARNING(MSGID_ACTIVITY_NOT_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
-						    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
-						    PMLOGKFV("old_Activity","%llu",old->GetId()),
-						    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
-
-					m_oldTokens.push_back(pt);
-					m_am->ReleaseActivity(act);
-					continue;
-				}
-			}
+		MojString id;
+		MojErr err = rep.get(_T("_id"), id, found);
+		if (err) {
+			LOG_AM_WARNING(MSGID_RETRIEVE_ID_FAIL, 0, "Error retrieving _id from results returned from MojoDB");
+			continue;
+		}
 
-			try {
-				m_am->RegisterActivityName(act);
-			} catch (...) {
-				LOG_AM_ERROR(MSGID_ACTIVITY_NAME_REG_FAIL, 3, PMLOGKFV("Activity","%llu",act->GetId()),
-					  PMLOGKS("Creator_name",act->GetCreator().GetString().c_str()),
-					  PMLOGKS("Register_name",act->GetName().c_str()), "");
-
-				/* Another Activity is already registered.  Determine which
-				 * is newer, and kill the older one. */
-
-				boost::shared_ptr<Activity> old = m_am->GetActivity(
-					act->GetName(), act->GetCreator());
-				boost::shared_ptr<MojoDBPersistToken> oldPt =
-					boost::dynamic_pointer_cast<MojoDBPersistToken,
-						PersistToken>(old->GetPersistToken());
-
-				if (pt->GetRev() > oldPt->GetRev()) {
-					LOG_AM_WARNING(MSGID_ACTIVITY_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
-						    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
-						    PMLOGKFV("old_Activity","%llu",old->GetId()),
-						    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
-
-					m_oldTokens.push_back(oldPt);
-					m_am->UnregisterActivityName(old);
-					m_am->ReleaseActivity(old);
-
-					m_am->RegisterActivityName(act);
-				} else {
-					LOG_AM_WARNING(MSGID_ACTIVITY_NOT_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
-						    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
-						    PMLOGKFV("old_Activity","%llu",old->GetId()),
-						    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
-
-					m_oldTokens.push_back(pt);
-					m_am->ReleaseActivity(act);
-					continue;
-				}
-			}
+		if (!found) {
+			LOG_AM_WARNING(MSGID_ID_NOT_FOUND, 0, "_id not found loading Activities from MojoDB");
+			continue;
+		}
 
-			LOG_AM_DEBUG("[Activity %llu] (\"%s\"): _id %s, rev %llu loaded",
-				act->GetId(), act->GetName().c_str(), id.data(),
-				(unsigned long long)rev);
+		MojInt64 rev;
+		found = rep.get(_T("_rev"), rev);
+		if (!found) {
+			LOG_AM_WARNING(MSGID_REV_NOT_FOUND, 0, "_rev not found loading Activities from MojoDB");
+			continue;
+		}
+
+		/* If the snapshot already brought this object in, keep it unless
+		 * MojoDB has a newer revision. */
+		if (IsSnapshotCurrent(id, rev, rep)) {
+			continue;
+		}
 
-			/* Request Activity be scheduled.  It won't transition to running
-			 * until after the MojoDB load finishes (and the Activity Manager
-			 * moves to the ready() and start()ed states). */
-			m_am->StartActivity(act);
+		boost::shared_ptr<MojoDBPersistToken> pt =
+			boost::allocate_shared<MojoDBPersistToken>(
+				POOL_ALLOCATOR(MojoDBPersistToken), id, rev);
+
+		if (LoadActivity(rep, pt, false)) {
+			loaded++;
 		}
 	}
 
-	MojString page;
-	err2 = response.get(_T("page"), page, found);
-	if (err2) {
-		LOG_AM_ERROR(MSGID_GET_PAGE_FAIL, 0, "Error getting page parameter in MojoDB query response");
-		return;
+	return loaded;
+}
+
+/* Record the object MojoDB holds under the token, less the properties
+ * MojoDB adds itself ("_id", "_rev", "_kind", ...), so the next write can
+ * be a merge of just what has changed since. */
+static void SetStoredFromLoaded(boost::shared_ptr<MojoDBPersistToken> pt,
+	const MojObject& rep)
+{
+	MojObject stored(MojObject::TypeObject);
+
+	for (MojObject::ConstIterator iter = rep.begin(); iter != rep.end();
+		++iter) {
+		if (iter.key().data()[0] == _T('_')) {
+			continue;
+		}
+
+		MojErr err = stored.put(iter.key().data(), iter.value());
+		if (err) {
+			return;
+		}
 	}
 
-	if (found) {
-		LOG_AM_DEBUG("Preparing to request next page (\"%s\") of Activities",
-			page.data());
+	pt->SetStored(stored);
+}
 
-		MojObject query;
-		query.putString(_T("from"), ActivityKind);
+/* Decode one persisted Activity, register its ID and name (resolving any
+ * conflict in favour of the newer revision), and start it. */
+boost::shared_ptr<Activity> MojoDBProxy::LoadActivity(const MojObject& rep,
+	boost::shared_ptr<MojoDBPersistToken> pt, bool fromSnapshot)
+{
+	boost::shared_ptr<Activity> act;
+
+	try {
+		act = m_json->CreateActivity(rep, Activity::PrivateBus, true);
+	} catch (const std::exception& except) {
+		LOG_AM_WARNING(MSGID_CREATE_ACTIVITY_EXCEPTION, 1, PMLOGKS("Exception",except.what()),
+			  "Activity: %s", MojoObjectJson(rep).c_str());
+		QueueOldToken(pt, fromSnapshot);
+		return boost::shared_ptr<Activity>();
+	} catch (...) {
+		LOG_AM_WARNING(MSGID_UNKNOWN_EXCEPTION, 0, "Activity : %s. Unknown exception decoding encoded",
+			  MojoObjectJson(rep).c_str());
+		QueueOldToken(pt, fromSnapshot);
+		return boost::shared_ptr<Activity>();
+	}
 
-		query.putString(_T("page"), page);
+	act->SetPersistToken(pt);
 
-		MojObject params;
-		params.put(_T("query"), query);
+	/* The snapshot holds the Activity as it was in memory, which may be
+	 * ahead of MojoDB, so only a MojoDB result can seed the stored object
+	 * (see IsSnapshotCurrent). */
+	if (!fromSnapshot) {
+		SetStoredFromLoaded(pt, rep);
+	}
 
-		m_call = boost::make_shared<MojoWeakPtrCall<MojoDBProxy> >(
-			boost::dynamic_pointer_cast<MojoDBProxy, PersistProxy>
-				(shared_from_this()),
-			&MojoDBProxy::ActivityLoadResults,
-			m_service, "palm://com.palm.db/find", params);
+	/* Attempt to register this Activity's Id and Name, in order. */
 
-		m_call->Call();
-	} else {
-		LOG_AM_DEBUG("All Activities successfully loaded from MojoDB");
+	try {
+		m_am->RegisterActivityId(act);
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_ACTIVITY_ID_REG_FAIL, 1, PMLOGKFV("Activity","%llu", act->GetId()), "");
 
-		if (!m_oldTokens.empty()) {
-			LOG_AM_DEBUG("Beginning purge of old Activities from database");
-			PreparePurgeCall();
-			m_call->Call();
+		/* Another Activity is already registered.  Determine which
+		 * is newer, and kill the older one. */
+
+		boost::shared_ptr<Activity> old = m_am->GetActivity(
+			act->GetId());
+		boost::shared_ptr<MojoDBPersistToken> oldPt =
+			boost::dynamic_pointer_cast<MojoDBPersistToken,
+				PersistToken>(old->GetPersistToken());
+
+		if (pt->GetRev() > oldPt->GetRev()) {
+			LOG_AM_WARNING(MSGID_ACTIVITY_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
+				    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
+				    PMLOGKFV("old_Activity","%llu",old->GetId()),
+				    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
+
+			QueueOldToken(oldPt, fromSnapshot);
+			m_am->UnregisterActivityName(old);
+			m_am->ReleaseActivity(old);
+
+			m_am->RegisterActivityId(act);
 		} else {
-#ifdef ACTIVITYMANAGER_CALL_CONFIGURATOR
-			PrepareConfiguratorCall();
-			m_call->Call();
-#else
-			m_call.reset();
-			m_am->Enable(ActivityManager::CONFIGURATION_LOADED);
-#endif
+			LOG_AM_WARNING(MSGID_ACTIVITY_NOT_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
+				    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
+				    PMLOGKFV("old_Activity","%llu",old->GetId()),
+				    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
+
+			QueueOldToken(pt, fromSnapshot);
+			m_am->ReleaseActivity(act);
+			return boost::shared_ptr<Activity>();
 		}
+	}
 
-		m_app->ready();
+	try {
+		m_am->RegisterActivityName(act);
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_ACTIVITY_NAME_REG_FAIL, 3, PMLOGKFV("Activity","%llu",act->GetId()),
+			  PMLOGKS("Creator_name",act->GetCreator().GetString().c_str()),
+			  PMLOGKS("Register_name",act->GetName().c_str()), "");
+
+		/* Another Activity is already registered.  Determine which
+		 * is newer, and kill the older one. */
+
+		boost::shared_ptr<Activity> old = m_am->GetActivity(
+			act->GetName(), act->GetCreator());
+		boost::shared_ptr<MojoDBPersistToken> oldPt =
+			boost::dynamic_pointer_cast<MojoDBPersistToken,
+				PersistToken>(old->GetPersistToken());
+
+		if (pt->GetRev() > oldPt->GetRev()) {
+			LOG_AM_WARNING(MSGID_ACTIVITY_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
+				    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
+				    PMLOGKFV("old_Activity","%llu",old->GetId()),
+				    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
+
+			QueueOldToken(oldPt, fromSnapshot);
+			m_am->UnregisterActivityName(old);
+			m_am->ReleaseActivity(old);
+
+			m_am->RegisterActivityName(act);
+		} else {
+			LOG_AM_WARNING(MSGID_ACTIVITY_NOT_REPLACED, 4, PMLOGKFV("Activity","%llu",act->GetId()),
+				    PMLOGKFV("revision","%llu",(unsigned long long)pt->GetRev()),
+				    PMLOGKFV("old_Activity","%llu",old->GetId()),
+				    PMLOGKFV("old_revision","%llu",(unsigned long long)oldPt->GetRev()), "");
+
+			QueueOldToken(pt, fromSnapshot);
+			m_am->ReleaseActivity(act);
+			return boost::shared_ptr<Activity>();
+		}
 	}
+
+	LOG_AM_DEBUG("[Activity %llu] (\"%s\"): _id %s, rev %llu loaded",
+		act->GetId(), act->GetName().c_str(), pt->GetId().data(),
+		(unsigned long long)pt->GetRev());
+
+	/* Request Activity be scheduled.  It won't transition to running
+	 * until the configuration is loaded (after the MojoDB load finishes,
+	 * or the snapshot is loaded) and the Activity Manager moves to the
+	 * ready() and start()ed states. */
+	m_am->StartActivity(act);
+
+	return act;
 }
 
 void MojoDBProxy::ActivityPurgeComplete(MojServiceMessage *msg,
@@ -330,33 +669,92 @@ void MojoDBProxy::ActivityPurgeComplete(MojServiceMessage *msg,
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 	LOG_AM_DEBUG("Purge of batch of old Activities complete");
 
-	/* If there was a transient error, re-call */
+	/* If there was a transient error, re-call after the interval.  A
+	 * permanent failure abandons the batch, but not the rest. */
 	if (err != MojErrNone) {
 		if (MojoCall::IsPermanentFailure(msg, response, err)) {
 			LOG_AM_ERROR(MSGID_ACTIVITIES_PURGE_FAILED, 0, "Purge of batch of old Activities failed: %s",
 				  MojoObjectJson(response).c_str());
-			m_call.reset();
+			m_purgeFailed += m_purgeBatch;
+			m_purgeBatch = 0;
+			m_purgeCall.reset();
 		} else {
 			LOG_AM_WARNING(MSGID_RETRY_ACTIVITY_PURGE, 0, "Purge of batch of old Activities failed, retrying: %s",
 				    MojoObjectJson(response).c_str());
-			m_call->Call();
+			m_purgeRetries++;
+			SchedulePurge();
+			return;
 		}
-		return;
+	} else {
+		m_purged += m_purgeBatch;
+		m_purgeBatch = 0;
+		m_purgeBatches++;
+		m_purgeCall.reset();
 	}
 
 	if (!m_oldTokens.empty()) {
-		PreparePurgeCall();
-		m_call->Call();
+		SchedulePurge();
 	} else {
-		LOG_AM_DEBUG("Done purging old Activities");
-#ifdef ACTIVITYMANAGER_CALL_CONFIGURATOR
-		PrepareConfiguratorCall();
-		m_call->Call();
-#else
-		m_call.reset();
-		m_am->Enable(ActivityManager::CONFIGURATION_LOADED);
-#endif
+		m_purgeTime = GetMonotonicMicroseconds() - m_purgeStart;
+
+		LOG_AM_DEBUG("Done purging old Activities: %llu purged, %llu "
+			"failed in %llu us", m_purged, m_purgeFailed, m_purgeTime);
+	}
+}
+
+void MojoDBProxy::SchedulePurge()
+{
+	if (!m_purgeSource) {
+		GSource *source = g_timeout_source_new(PurgeIntervalMs);
+		g_source_set_priority(source, G_PRIORITY_LOW);
+		g_source_set_callback(source, MojoDBProxy::StaticPurgeTimeout,
+			this, NULL);
+		g_source_attach(source, g_main_context_default());
+
+		m_purgeSource = source;
+	}
+}
+
+/* Issue the next batch, or re-issue the current one if it is being
+ * retried */
+void MojoDBProxy::PurgeBatch()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	/* The purge is only housekeeping, don't add to the load on MojoDB
+	 * while other writes are being held */
+	if (m_retry->IsPaused()) {
+		SchedulePurge();
+		return;
+	}
+
+	if (!m_purgeCall) {
+		if (m_oldTokens.empty()) {
+			return;
+		}
+
+		PreparePurgeCall();
+	}
+
+	m_purgeCall->Call();
+}
+
+gboolean MojoDBProxy::StaticPurgeTimeout(gpointer data)
+{
+	MojoDBProxy *proxy = static_cast<MojoDBProxy *>(data);
+
+	/* Reset now, the source is destroyed when this returns false */
+	proxy->m_purgeSource = NULL;
+
+	try {
+		proxy->PurgeBatch();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PURGE_EXCEPTION, 0, "Unhandled exception \"%s\" occurred purging old Activities", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PURGE_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred purging old Activities");
 	}
+
+	return false;
 }
 
 void MojoDBProxy::ActivityConfiguratorComplete(MojServiceMessage *msg,
@@ -385,7 +783,7 @@ void MojoDBProxy::PreparePurgeCall()
 	MojObject params;
 	params.put(_T("ids"), ids);
 
-	m_call = boost::make_shared<MojoWeakPtrCall<MojoDBProxy> >(
+	m_purgeCall = boost::make_shared<MojoWeakPtrCall<MojoDBProxy> >(
 		boost::dynamic_pointer_cast<MojoDBProxy, PersistProxy>
 			(shared_from_this()),
 		&MojoDBProxy::ActivityPurgeComplete,
@@ -420,8 +818,342 @@ void MojoDBProxy::PopulatePurgeIds(MojObject& ids)
 		m_oldTokens.pop_front();
 
 		ids.push(pt->GetId());
+		m_purgeBatch++;
 		if (--count == 0)
 			return;
 	}
 }
 
+/* Records loaded from the snapshot are never purged - the MojoDB load
+ * resolves them against the real objects.  A record that only exists in
+ * the snapshot is just released. */
+void MojoDBProxy::QueueOldToken(boost::shared_ptr<MojoDBPersistToken> pt,
+	bool fromSnapshot)
+{
+	if (fromSnapshot) {
+		return;
+	}
+
+	SnapshotMap::iterator found = m_snapshotActivities.find(
+		pt->GetId().data());
+	if (found != m_snapshotActivities.end()) {
+		m_snapshotActivities.erase(found);
+		return;
+	}
+
+	m_oldTokens.push_back(pt);
+}
+
+bool MojoDBProxy::IsSnapshotCurrent(const MojString& id, MojInt64 rev,
+	const MojObject& rep)
+{
+	SnapshotMap::iterator found = m_snapshotActivities.find(id.data());
+	if (found == m_snapshotActivities.end()) {
+		return false;
+	}
+
+	SnapshotEntry entry = found->second;
+	m_snapshotActivities.erase(found);
+
+	/* The token may have moved to a replacement Activity, or been written
+	 * again since startup. */
+	boost::shared_ptr<MojoDBPersistToken> pt = entry.m_token.lock();
+	if (pt && pt->IsValid() && (pt->GetRev() >= rev)) {
+		/* Not written since, so this is what MojoDB holds for it */
+		if (pt->GetRev() == rev) {
+			SetStoredFromLoaded(pt, rep);
+		}
+
+		m_snapshotConfirmed++;
+		return true;
+	}
+
+	CancelSnapshotActivity(entry, true);
+	return false;
+}
+
+/* The service may already have handed a stale snapshot Activity out, so
+ * it is cancelled like any other, and its subscribers told, rather than
+ * just dropped. */
+void MojoDBProxy::CancelSnapshotActivity(const SnapshotEntry& entry,
+	bool replaced)
+{
+	boost::shared_ptr<Activity> act = entry.m_activity.lock();
+	boost::shared_ptr<MojoDBPersistToken> pt = entry.m_token.lock();
+
+	if (!act || !pt || !act->IsPersistTokenSet() ||
+		(act->GetPersistToken() != pt)) {
+		return;
+	}
+
+	LOG_AM_DEBUG("[Activity %llu] Cancelling stale snapshot copy",
+		act->GetId());
+
+	/* The MojoDB object (if it's still there) isn't this Activity's any
+	 * more, so nothing done to it from here on may touch the object */
+	act->ClearPersistToken();
+
+	if (act->IsNameRegistered()) {
+		m_am->UnregisterActivityName(act);
+	}
+
+	act->PlugAllSubscriptions();
+	act->SetTerminateFlag(true);
+	m_am->CancelActivity(act);
+	act->UnplugAllSubscriptions();
+
+	/* Make way for the newer copy about to be loaded under the same ID.
+	 * The cancelled Activity ends once its subscribers have gone, unless
+	 * it had none and is gone already. */
+	if (replaced) {
+		try {
+			if (m_am->GetActivity(act->GetId()) == act) {
+				m_am->ReleaseActivity(act);
+			}
+		} catch (...) {
+			/* Not registered, it has been released already */
+		}
+	}
+
+	m_snapshotRemoved++;
+}
+
+/* Anything left came from the snapshot, but isn't in MojoDB any more */
+void MojoDBProxy::CancelStaleSnapshot()
+{
+	SnapshotMap remaining;
+	remaining.swap(m_snapshotActivities);
+
+	for (SnapshotMap::iterator iter = remaining.begin();
+		iter != remaining.end(); ++iter) {
+		boost::shared_ptr<MojoDBPersistToken> pt =
+			iter->second.m_token.lock();
+		if (pt && pt->IsValid() && (pt->GetRev() == iter->second.m_rev)) {
+			CancelSnapshotActivity(iter->second, false);
+		}
+	}
+}
+
+bool MojoDBProxy::LoadSnapshot()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	unsigned long long start = GetMonotonicMicroseconds();
+
+	ActivitySnapshot snapshot;
+	if (!snapshot.Open(SnapshotPath)) {
+		return false;
+	}
+
+	LOG_AM_DEBUG("Loading %u Activities from snapshot",
+		snapshot.GetCount());
+
+	size_t offset = 0;
+	ActivitySnapshot::Record record;
+	while (snapshot.Next(offset, record)) {
+		MojObject rep;
+		MojErr err = rep.fromJson(record.m_rep, record.m_repLength);
+		if (err) {
+			continue;
+		}
+
+		MojString id;
+		err = id.assign(record.m_id, record.m_idLength);
+		if (err) {
+			continue;
+		}
+
+		boost::shared_ptr<MojoDBPersistToken> pt =
+			boost::allocate_shared<MojoDBPersistToken>(
+				POOL_ALLOCATOR(MojoDBPersistToken), id,
+				(MojInt64)record.m_rev);
+
+		boost::shared_ptr<Activity> act = LoadActivity(rep, pt, true);
+		if (!act) {
+			continue;
+		}
+
+		SnapshotEntry entry;
+		entry.m_activity = act;
+		entry.m_token = pt;
+		entry.m_rev = record.m_rev;
+		m_snapshotActivities[id.data()] = entry;
+
+		m_snapshotLoaded++;
+	}
+
+	m_snapshotLoadTime = GetMonotonicMicroseconds() - start;
+
+	LOG_AM_DEBUG("Loaded %u Activities from snapshot in %llu us",
+		(unsigned)m_snapshotLoaded, m_snapshotLoadTime);
+
+	return true;
+}
+
+void MojoDBProxy::WriteSnapshot()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if (m_snapshotThread) {
+		LOG_AM_DEBUG("Snapshot write in progress, rewriting once it's done");
+		m_snapshotRewrite = true;
+		return;
+	}
+
+	boost::shared_ptr<ActivitySnapshotWriter> writer =
+		boost::make_shared<ActivitySnapshotWriter>();
+
+	ActivityManager::ActivityVec activities = m_am->GetActivities();
+	for (ActivityManager::ActivityVec::const_iterator iter =
+		activities.begin(); iter != activities.end(); ++iter) {
+		const boost::shared_ptr<const Activity>& act = *iter;
+
+		if (!act->IsPersistent() || !act->IsPersistTokenSet()) {
+			continue;
+		}
+
+		boost::shared_ptr<const MojoDBPersistToken> pt =
+			boost::dynamic_pointer_cast<const MojoDBPersistToken,
+				const PersistToken>(act->GetPersistToken());
+		if (!pt || !pt->IsValid()) {
+			continue;
+		}
+
+		MojObject rep;
+		MojErr err = act->ToJson(rep,
+			ACTIVITY_JSON_PERSIST | ACTIVITY_JSON_DETAIL);
+		if (err) {
+			continue;
+		}
+
+		MojString json;
+		err = rep.toJson(json);
+		if (err) {
+			continue;
+		}
+
+		writer->Add(pt->GetId(), pt->GetRev(), json);
+	}
+
+	if ((mkdir(SnapshotDirectory, 0700) < 0) && (errno != EEXIST)) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_WRITE_FAIL, 1,
+			PMLOGKS("path",SnapshotDirectory),
+			"Failed to create snapshot directory");
+		return;
+	}
+
+	/* Writing and syncing the file can block for a while, so it's done on
+	 * a thread of its own.  The Activities were serialized above, on the
+	 * main loop, as nothing else about them is safe to touch from
+	 * another thread. */
+	m_snapshotWriter = writer;
+
+	GError *error = NULL;
+	m_snapshotThread = g_thread_try_new("snapshot",
+		MojoDBProxy::StaticSnapshotCommit, this, &error);
+	if (!m_snapshotThread) {
+		LOG_AM_WARNING(MSGID_SNAPSHOT_THREAD_FAIL, 1,
+			PMLOGKS("error",error ? error->message : "unknown"),
+			"Writing snapshot on the main loop");
+		if (error) {
+			g_error_free(error);
+		}
+
+		if (m_snapshotWriter->Commit(SnapshotPath)) {
+			LOG_AM_DEBUG("Wrote snapshot of %u Activities",
+				m_snapshotWriter->GetCount());
+			m_snapshotsWritten++;
+		}
+
+		m_snapshotWriter.reset();
+	}
+}
+
+void MojoDBProxy::SnapshotCommitted()
+{
+	bool committed = (GPOINTER_TO_INT(g_thread_join(m_snapshotThread)) != 0);
+	m_snapshotThread = NULL;
+
+	if (committed) {
+		LOG_AM_DEBUG("Wrote snapshot of %u Activities",
+			m_snapshotWriter->GetCount());
+		m_snapshotsWritten++;
+	}
+
+	m_snapshotWriter.reset();
+
+	if (m_snapshotRewrite) {
+		m_snapshotRewrite = false;
+		ScheduleSnapshot();
+	}
+}
+
+/* Rewrite the snapshot a while after persisted Activities change, so a
+ * burst of changes costs a single write.  Anything the snapshot misses is
+ * corrected from MojoDB at the next startup. */
+void MojoDBProxy::ScheduleSnapshot()
+{
+#ifdef ACTIVITYMANAGER_LOAD_SNAPSHOT
+	if (!m_snapshotSource) {
+		GSource *source = g_timeout_source_new_seconds(SnapshotDelaySeconds);
+		g_source_set_callback(source, MojoDBProxy::StaticSnapshotTimeout,
+			this, NULL);
+		g_source_attach(source, g_main_context_default());
+
+		m_snapshotSource = source;
+	}
+#endif
+}
+
+gboolean MojoDBProxy::StaticSnapshotTimeout(gpointer data)
+{
+	MojoDBProxy *proxy = static_cast<MojoDBProxy *>(data);
+
+	/* Reset now, the source is destroyed when this returns false */
+	proxy->m_snapshotSource = NULL;
+
+	try {
+		proxy->WriteSnapshot();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_SNAPSHOT_EXCEPTION, 0, "Unhandled exception \"%s\" occurred writing Activity snapshot", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_SNAPSHOT_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred writing Activity snapshot");
+	}
+
+	return false;
+}
+
+/* Runs on the snapshot thread.  Only the writer is used here; the result
+ * goes back to the main loop through an idle source. */
+gpointer MojoDBProxy::StaticSnapshotCommit(gpointer data)
+{
+	MojoDBProxy *proxy = static_cast<MojoDBProxy *>(data);
+
+	bool committed = proxy->m_snapshotWriter->Commit(SnapshotPath);
+
+	GSource *source = g_idle_source_new();
+	g_source_set_callback(source, MojoDBProxy::StaticSnapshotCommitted,
+		proxy, NULL);
+	proxy->m_snapshotCommittedSource = source;
+	g_source_attach(source, g_main_context_default());
+
+	return GINT_TO_POINTER(committed ? 1 : 0);
+}
+
+gboolean MojoDBProxy::StaticSnapshotCommitted(gpointer data)
+{
+	MojoDBProxy *proxy = static_cast<MojoDBProxy *>(data);
+
+	/* Reset now, the source is destroyed when this returns false */
+	proxy->m_snapshotCommittedSource = NULL;
+
+	try {
+		proxy->SnapshotCommitted();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_SNAPSHOT_EXCEPTION, 0, "Unhandled exception \"%s\" occurred writing Activity snapshot", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_SNAPSHOT_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred writing Activity snapshot");
+	}
+
+	return false;
+}
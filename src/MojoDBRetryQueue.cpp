@@ -0,0 +1,402 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+#include "MojoDBRetryQueue.h"
+#include "MojoCall.h"
+#include "MonotonicClock.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <stdlib.h>
+
+MojoDBRetryQueue::MojoDBRetryQueue()
+	: m_timer(NULL)
+	, m_timerDue(0)
+	, m_state(BreakerClosed)
+	, m_consecutiveFailures(0)
+	, m_cooldownMs(BreakerCooldownMs)
+	, m_cooldownEnd(0)
+	, m_probing(false)
+	, m_issued(0)
+	, m_queued(0)
+	, m_retried(0)
+	, m_transientFailures(0)
+	, m_failed(0)
+	, m_breakerOpens(0)
+	, m_maxAttempt(0)
+{
+}
+
+MojoDBRetryQueue::~MojoDBRetryQueue()
+{
+	CancelTimer();
+}
+
+void MojoDBRetryQueue::Issue(boost::shared_ptr<MojoCall> call)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	Entry entry(call, 0);
+	if (Hold(entry)) {
+		LOG_AM_DEBUG("[Call %u] Holding MojoDB write while breaker is %s",
+			call->GetSerial(), BreakerStateToString(m_state));
+		return;
+	}
+
+	/* Errors making the first attempt are the caller's to handle.  If it
+	 * was the probe, nothing will come back for it, so let another write
+	 * probe instead. */
+	m_issued++;
+	try {
+		call->Call();
+	} catch (...) {
+		if (m_state == BreakerHalfOpen) {
+			m_probing = false;
+			Arm();
+		}
+
+		throw;
+	}
+}
+
+void MojoDBRetryQueue::Responded(bool succeeded)
+{
+	if (!succeeded) {
+		m_failed++;
+	}
+
+	m_consecutiveFailures = 0;
+
+	if (m_state != BreakerClosed) {
+		CloseBreaker();
+	}
+}
+
+void MojoDBRetryQueue::Retry(boost::shared_ptr<MojoCall> call,
+	unsigned attempt)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	m_transientFailures++;
+	m_consecutiveFailures++;
+
+	if (attempt > m_maxAttempt) {
+		m_maxAttempt = attempt;
+	}
+
+	if (m_state == BreakerHalfOpen) {
+		/* Probe failed */
+		m_cooldownMs = std::min(m_cooldownMs * 2, MaxBreakerCooldownMs);
+		OpenBreaker();
+	} else if ((m_state == BreakerClosed) &&
+		(m_consecutiveFailures >= BreakerThreshold)) {
+		m_cooldownMs = BreakerCooldownMs;
+		OpenBreaker();
+	}
+
+	Schedule(Entry(call, attempt));
+}
+
+bool MojoDBRetryQueue::IsPaused() const
+{
+	return m_state != BreakerClosed;
+}
+
+/* While the breaker is half open, the first write to go out is the probe,
+ * and everything after it is held until the probe's response comes back. */
+bool MojoDBRetryQueue::Hold(const Entry& entry)
+{
+	if (m_state == BreakerClosed) {
+		return false;
+	}
+
+	if ((m_state == BreakerHalfOpen) && !m_probing) {
+		LOG_AM_DEBUG("Probing MojoDB with a held write");
+		m_probing = true;
+		return false;
+	}
+
+	m_held.push_back(entry);
+	m_queued++;
+	return true;
+}
+
+void MojoDBRetryQueue::Schedule(const Entry& entry)
+{
+	unsigned delayMs = BaseDelayMs;
+	for (unsigned i = 1; (i < entry.m_attempt) && (delayMs < MaxDelayMs);
+		i++) {
+		delayMs *= 2;
+	}
+
+	if (delayMs > MaxDelayMs) {
+		delayMs = MaxDelayMs;
+	}
+
+	/* At least half the delay, and up to all of it */
+	delayMs = (delayMs / 2) + (unsigned)(::random() % ((delayMs / 2) + 1));
+
+	LOG_AM_DEBUG("Retrying MojoDB write (attempt %u) in %ums",
+		entry.m_attempt, delayMs);
+
+	m_retries.insert(RetryMap::value_type(GetMonotonicMicroseconds() +
+		((unsigned long long)delayMs * 1000ULL), entry));
+	Arm();
+}
+
+void MojoDBRetryQueue::Dispatch(const Entry& entry)
+{
+	boost::shared_ptr<MojoCall> call = entry.m_call.lock();
+	if (!call) {
+		/* The command that owned it is gone */
+		return;
+	}
+
+	if (Hold(entry)) {
+		return;
+	}
+
+	if (entry.m_attempt) {
+		m_retried++;
+	} else {
+		m_issued++;
+	}
+
+	try {
+		call->Call();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_RETRY_CALL_FAIL, 2,
+			PMLOGKFV("call","%u",call->GetSerial()),
+			PMLOGKS("exception",except.what()),
+			"Failed to issue MojoDB write, rescheduling");
+
+		/* Nothing will come back for it, so if it was the probe, let
+		 * another write probe instead */
+		if (m_state == BreakerHalfOpen) {
+			m_probing = false;
+		}
+
+		Schedule(Entry(entry.m_call, entry.m_attempt + 1));
+	}
+}
+
+void MojoDBRetryQueue::OpenBreaker()
+{
+	if (m_state == BreakerClosed) {
+		LOG_AM_WARNING(MSGID_PERSIST_BREAKER_OPEN, 1,
+			PMLOGKFV("failures","%u",m_consecutiveFailures),
+			"MojoDB writes failing, pausing writes");
+	} else {
+		LOG_AM_DEBUG("MojoDB probe failed, pausing writes for %ums",
+			m_cooldownMs);
+	}
+
+	m_state = BreakerOpen;
+	m_probing = false;
+	m_cooldownEnd = GetMonotonicMicroseconds() +
+		((unsigned long long)m_cooldownMs * 1000ULL);
+	m_breakerOpens++;
+
+	Arm();
+}
+
+void MojoDBRetryQueue::CloseBreaker()
+{
+	LOG_AM_INFO(MSGID_PERSIST_BREAKER_CLOSED, 1,
+		PMLOGKFV("held","%u",(unsigned)m_held.size()),
+		"MojoDB responding, resuming writes");
+
+	m_state = BreakerClosed;
+	m_probing = false;
+	m_cooldownMs = BreakerCooldownMs;
+
+	EntryList held;
+	held.swap(m_held);
+
+	for (EntryList::iterator iter = held.begin(); iter != held.end();
+		++iter) {
+		Dispatch(*iter);
+	}
+
+	Arm();
+}
+
+void MojoDBRetryQueue::ProcessTimeout()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	unsigned long long now = GetMonotonicMicroseconds();
+
+	if ((m_state == BreakerOpen) && (now >= m_cooldownEnd)) {
+		m_state = BreakerHalfOpen;
+	}
+
+	if (m_state == BreakerHalfOpen) {
+		/* The longest held write probes first */
+		while (!m_held.empty() && !m_probing) {
+			Entry entry = m_held.front();
+			m_held.pop_front();
+			Dispatch(entry);
+		}
+	}
+
+	while (!m_retries.empty() && (m_retries.begin()->first <= now)) {
+		Entry entry = m_retries.begin()->second;
+		m_retries.erase(m_retries.begin());
+		Dispatch(entry);
+	}
+
+	Arm();
+}
+
+/* Keep the timer set for the next retry, or the end of the breaker's
+ * cooldown, whichever is sooner */
+void MojoDBRetryQueue::Arm()
+{
+	bool pending = false;
+	unsigned long long due = 0;
+
+	if (!m_retries.empty()) {
+		pending = true;
+		due = m_retries.begin()->first;
+	}
+
+	if ((m_state == BreakerOpen) && (!pending || (m_cooldownEnd < due))) {
+		pending = true;
+		due = m_cooldownEnd;
+	}
+
+	/* Half open with no probe out, a held write has to be sent as one */
+	if ((m_state == BreakerHalfOpen) && !m_probing && !m_held.empty()) {
+		pending = true;
+		due = 0;
+	}
+
+	if (!pending) {
+		CancelTimer();
+		return;
+	}
+
+	if (m_timer && (m_timerDue <= due)) {
+		return;
+	}
+
+	CancelTimer();
+
+	unsigned long long now = GetMonotonicMicroseconds();
+	unsigned delayMs = (due > now) ?
+		(unsigned)((due - now + 999ULL) / 1000ULL) : 0;
+
+	GSource *source = g_timeout_source_new(delayMs);
+	g_source_set_callback(source, MojoDBRetryQueue::StaticTimeout,
+		this, NULL);
+	g_source_attach(source, g_main_context_default());
+
+	m_timer = source;
+	m_timerDue = due;
+}
+
+void MojoDBRetryQueue::CancelTimer()
+{
+	if (m_timer) {
+		if (!g_source_is_destroyed(m_timer)) {
+			g_source_destroy(m_timer);
+		}
+
+		m_timer = NULL;
+	}
+}
+
+gboolean MojoDBRetryQueue::StaticTimeout(gpointer data)
+{
+	MojoDBRetryQueue *queue = static_cast<MojoDBRetryQueue *>(data);
+
+	/* Reset now, the source is destroyed when this returns false */
+	queue->m_timer = NULL;
+
+	try {
+		queue->ProcessTimeout();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_PERSIST_RETRY_EXCEPTION, 0, "Unhandled exception \"%s\" occurred retrying MojoDB writes", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_PERSIST_RETRY_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred retrying MojoDB writes");
+	}
+
+	return false;
+}
+
+const char *MojoDBRetryQueue::BreakerStateToString(BreakerState state)
+{
+	switch (state) {
+	case BreakerClosed:
+		return "closed";
+	case BreakerOpen:
+		return "open";
+	case BreakerHalfOpen:
+		return "halfOpen";
+	}
+
+	return "unknown";
+}
+
+MojErr MojoDBRetryQueue::InfoToJson(MojObject& rep) const
+{
+	MojErr err;
+
+	err = rep.put(_T("issued"), (MojInt64)m_issued);
+	MojErrCheck(err);
+
+	err = rep.put(_T("queued"), (MojInt64)m_queued);
+	MojErrCheck(err);
+
+	err = rep.put(_T("held"), (MojInt64)m_held.size());
+	MojErrCheck(err);
+
+	err = rep.put(_T("pendingRetries"), (MojInt64)m_retries.size());
+	MojErrCheck(err);
+
+	err = rep.put(_T("retried"), (MojInt64)m_retried);
+	MojErrCheck(err);
+
+	err = rep.put(_T("transientFailures"), (MojInt64)m_transientFailures);
+	MojErrCheck(err);
+
+	err = rep.put(_T("failed"), (MojInt64)m_failed);
+	MojErrCheck(err);
+
+	err = rep.put(_T("maxAttempt"), (MojInt64)m_maxAttempt);
+	MojErrCheck(err);
+
+	MojObject breaker(MojObject::TypeObject);
+
+	err = breaker.putString(_T("state"), BreakerStateToString(m_state));
+	MojErrCheck(err);
+
+	err = breaker.put(_T("opens"), (MojInt64)m_breakerOpens);
+	MojErrCheck(err);
+
+	err = breaker.put(_T("cooldownMs"), (MojInt64)m_cooldownMs);
+	MojErrCheck(err);
+
+	err = rep.put(_T("breaker"), breaker);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
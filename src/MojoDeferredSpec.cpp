@@ -0,0 +1,121 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+#include "MojoDeferredSpec.h"
+#include "MojoJsonConverter.h"
+#include "Activity.h"
+
+#include <stdexcept>
+
+/* Built in this order, as they are for a new Activity */
+const char *MojoDeferredSpec::s_properties[] = {
+	_T("requirements"), _T("trigger"), _T("callback"), NULL
+};
+
+const unsigned MojoDeferredSpec::s_parts[] = {
+	DeferredSpec::RequirementsPart, DeferredSpec::TriggerPart,
+	DeferredSpec::CallbackPart
+};
+
+MojoDeferredSpec::MojoDeferredSpec(MojoJsonConverter *json,
+	const MojObject& spec)
+	: m_json(json)
+	, m_spec(MojObject::TypeObject)
+{
+	for (const char **prop = s_properties; *prop; prop++) {
+		MojObject value;
+		if (spec.get(*prop, value)) {
+			m_spec.put(*prop, value);
+		}
+	}
+}
+
+MojoDeferredSpec::~MojoDeferredSpec()
+{
+}
+
+unsigned MojoDeferredSpec::GetParts() const
+{
+	unsigned parts = 0;
+
+	for (int i = 0; s_properties[i]; i++) {
+		if (m_spec.contains(s_properties[i])) {
+			parts |= s_parts[i];
+		}
+	}
+
+	return parts;
+}
+
+void MojoDeferredSpec::Materialize(boost::shared_ptr<Activity> activity,
+	unsigned parts)
+{
+	MojErr err;
+
+	for (int i = 0; s_properties[i]; i++) {
+		MojObject value;
+		if (!(parts & s_parts[i]) || !m_spec.get(s_properties[i], value)) {
+			continue;
+		}
+
+		MojObject part(MojObject::TypeObject);
+		err = part.put(s_properties[i], value);
+		if (err) {
+			throw std::runtime_error("Failed to copy deferred definition");
+		}
+
+		/* Removed first, so the part built replaces it in the Activity's
+		 * JSON.  It is put back if it can't be built. */
+		bool found;
+		m_spec.del(s_properties[i], found);
+
+		try {
+			m_json->BuildDeferredProperties(activity, part);
+		} catch (...) {
+			m_spec.put(s_properties[i], value);
+			throw;
+		}
+	}
+}
+
+MojErr MojoDeferredSpec::ToJson(MojObject& rep, unsigned flags) const
+{
+	MojErr err;
+
+	for (const char **prop = s_properties; *prop; prop++) {
+		MojObject value;
+		if (m_spec.get(*prop, value)) {
+			err = rep.put(*prop, value);
+			MojErrCheck(err);
+		}
+	}
+
+	return MojErrNone;
+}
+
+bool MojoDeferredSpec::HasDeferredProperties(const MojObject& spec)
+{
+	for (const char **prop = s_properties; *prop; prop++) {
+		if (spec.contains(*prop)) {
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -20,6 +20,7 @@
 #include "Trigger.h"
 #include "MojoTriggerManager.h"
 #include "MojoCallback.h"
+#include "MojoDeferredSpec.h"
 #include "ActivityManager.h"
 #include "Schedule.h"
 #include "IntervalSchedule.h"
@@ -27,6 +28,7 @@
 #include "PowerManager.h"
 #include "Scheduler.h"
 #include "BusId.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 
 #include <stdexcept>
@@ -148,28 +150,18 @@ boost::shared_ptr<Activity> MojoJsonConverter::CreateActivity(
 		}
 
 
-		MojObject requirementSpec;
-		if (spec.get(_T("requirements"), requirementSpec)) {
-			RequirementList addedRequirements;
-			RequirementNameList removedRequirements;
-			ProcessRequirements(act, requirementSpec, removedRequirements,
-				addedRequirements);
-			UpdateRequirements(act, removedRequirements, addedRequirements);
-		}
-
-		MojObject triggerSpec;
-		if (spec.get(_T("trigger"), triggerSpec)) {
-			boost::shared_ptr<Trigger> trigger = CreateTrigger(act,
-				triggerSpec);
-			act->SetTrigger(trigger);
-		}
-
-		MojObject callbackSpec;
-		if (spec.get(_T("callback"), callbackSpec)) {
-			boost::shared_ptr<Callback> callback = CreateCallback(
-				act, callbackSpec);
-			act->SetCallback(callback);
+#ifdef ACTIVITYMANAGER_LAZY_MATERIALIZATION
+		if (reload) {
+			if (MojoDeferredSpec::HasDeferredProperties(spec)) {
+				act->SetDeferredSpec(boost::allocate_shared<MojoDeferredSpec>(
+					POOL_ALLOCATOR(MojoDeferredSpec), this, spec));
+			}
+		} else {
+			BuildDeferredProperties(act, spec);
 		}
+#else
+		BuildDeferredProperties(act, spec);
+#endif
 
 		MojObject scheduleSpec;
 		if (spec.get(_T("schedule"), scheduleSpec)) {
@@ -193,9 +185,40 @@ boost::shared_ptr<Activity> MojoJsonConverter::CreateActivity(
 	return act;
 }
 
+void MojoJsonConverter::BuildDeferredProperties(
+	boost::shared_ptr<Activity> act, const MojObject& spec)
+{
+	MojObject requirementSpec;
+	if (spec.get(_T("requirements"), requirementSpec)) {
+		RequirementList addedRequirements;
+		RequirementNameList removedRequirements;
+		ProcessRequirements(act, requirementSpec, removedRequirements,
+			addedRequirements);
+		UpdateRequirements(act, removedRequirements, addedRequirements);
+	}
+
+	MojObject triggerSpec;
+	if (spec.get(_T("trigger"), triggerSpec)) {
+		boost::shared_ptr<Trigger> trigger = CreateTrigger(act,
+			triggerSpec);
+		act->SetTrigger(trigger);
+	}
+
+	MojObject callbackSpec;
+	if (spec.get(_T("callback"), callbackSpec)) {
+		boost::shared_ptr<Callback> callback = CreateCallback(
+			act, callbackSpec);
+		act->SetCallback(callback);
+	}
+}
+
 void MojoJsonConverter::UpdateActivity(
 	boost::shared_ptr<Activity> act, const MojObject& spec)
 {
+	/* Updates apply against the built trigger, callback, and
+	 * requirements */
+	act->Materialize();
+
 	/* First, parse and create the update, so it can be applied "atomically"
 	 * Then set or reset the Activity sections, as appropriate */
 	bool clearTrigger = false;
@@ -420,7 +443,8 @@ boost::shared_ptr<Callback> MojoJsonConverter::CreateCallback(
 	/* If no params, no problem. */
 	spec.get(_T("params"), params);
 
-	boost::shared_ptr<Callback> callback = boost::make_shared<MojoCallback>(
+	boost::shared_ptr<Callback> callback = boost::allocate_shared<MojoCallback>(
+		POOL_ALLOCATOR(MojoCallback),
 		activity, m_service, url, params);
 
 	return callback;
@@ -492,14 +516,17 @@ boost::shared_ptr<Schedule> MojoJsonConverter::CreateSchedule(
 			throw std::runtime_error("An interval schedule can be specified as "
 				"normal, precise, or precise and relative.");
 		} else if (relative) {
-			intervalSchedule = boost::make_shared<RelativeIntervalSchedule>
-				(m_scheduler, activity, startTime, interval, endTime);
+			intervalSchedule = boost::allocate_shared<RelativeIntervalSchedule>
+				(POOL_ALLOCATOR(RelativeIntervalSchedule),
+					m_scheduler, activity, startTime, interval, endTime);
 		} else if (precise) {
-			intervalSchedule = boost::make_shared<PreciseIntervalSchedule>
-				(m_scheduler, activity, startTime, interval, endTime);
+			intervalSchedule = boost::allocate_shared<PreciseIntervalSchedule>
+				(POOL_ALLOCATOR(PreciseIntervalSchedule),
+					m_scheduler, activity, startTime, interval, endTime);
 		} else {
-			intervalSchedule = boost::make_shared<IntervalSchedule>
-				(m_scheduler, activity, startTime, interval, endTime);
+			intervalSchedule = boost::allocate_shared<IntervalSchedule>
+				(POOL_ALLOCATOR(IntervalSchedule),
+					m_scheduler, activity, startTime, interval, endTime);
 		}
 
 		if (skip) {
@@ -550,8 +577,8 @@ boost::shared_ptr<Schedule> MojoJsonConverter::CreateSchedule(
 				"start time");
 		}
 
-		schedule = boost::make_shared<Schedule>(m_scheduler, activity,
-			startTime);
+		schedule = boost::allocate_shared<Schedule>(POOL_ALLOCATOR(Schedule),
+			m_scheduler, activity, startTime);
 
 		if (!startIsUTC) {
 			schedule->SetLocal(true);
@@ -18,30 +18,37 @@
 
 #include "MojoPersistCommand.h"
 #include "MojoCall.h"
+#include "MojoDBRetryQueue.h"
 #include "Completion.h"
 #include "Activity.h"
 #include "MojoObjectWrapper.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 
 #include <stdexcept>
 
 MojoPersistCommand::MojoPersistCommand(MojService *service,
-	const MojoURL& method, boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<MojoDBRetryQueue> retry, const MojoURL& method,
+	boost::shared_ptr<Activity> activity,
 	boost::shared_ptr<Completion> completion)
 	: PersistCommand(activity, completion)
 	, m_service(service)
 	, m_method(method)
+	, m_retry(retry)
+	, m_attempts(0)
 {
 }
 
 MojoPersistCommand::MojoPersistCommand(MojService *service,
-	const MojoURL& method, const MojObject& params,
-	boost::shared_ptr<Activity> activity,
+	boost::shared_ptr<MojoDBRetryQueue> retry, const MojoURL& method,
+	const MojObject& params, boost::shared_ptr<Activity> activity,
 	boost::shared_ptr<Completion> completion)
 	: PersistCommand(activity, completion)
 	, m_service(service)
 	, m_method(method)
 	, m_params(params)
+	, m_retry(retry)
+	, m_attempts(0)
 {
 }
 
@@ -61,11 +68,13 @@ void MojoPersistCommand::Persist()
 		MojObject params = m_params;
 		UpdateParams(params);
 
-		m_call = boost::make_shared<MojoWeakPtrCall<MojoPersistCommand> >
-			(boost::dynamic_pointer_cast<MojoPersistCommand, PersistCommand>
+		m_call = boost::allocate_shared<MojoWeakPtrCall<MojoPersistCommand> >
+			(POOL_ALLOCATOR(MojoWeakPtrCall<MojoPersistCommand>),
+			boost::dynamic_pointer_cast<MojoPersistCommand, PersistCommand>
 				(shared_from_this()),
 			&MojoPersistCommand::PersistResponse, m_service, m_method, params);
-		m_call->Call();
+		m_attempts = 0;
+		m_retry->Issue(m_call);
 	} catch (const std::exception& except) {
 		LOG_AM_ERROR(MSGID_PERSIST_ATMPT_UNEXPECTD_EXCPTN, 3, PMLOGKFV("activity","%llu",m_activity->GetId()),
 			  PMLOGKS("Persist_command",GetString().c_str()), PMLOGKS("Exception",except.what()),
@@ -89,17 +98,30 @@ void MojoPersistCommand::PersistResponse(MojServiceMessage *msg,
 				  PMLOGKS("persist_command",GetString().c_str()),
 				  PMLOGKS("Errtext",MojoObjectString(response, _T("errorText")).c_str()),
 				  PMLOGKFV("Errcode","%d",(int)err), "");
+			m_retry->Responded(false);
 			Complete(false);
 		} else {
 			LOG_AM_WARNING(MSGID_PERSIST_CMD_TRANSIENT_ERR, 2, PMLOGKFV("activity","%llu",m_activity->GetId()),
 				    PMLOGKS("persist_command",GetString().c_str()), "Failed with transient error, retrying: %s",
 				    MojoObjectJson(response).c_str());
-			m_call->Call();
+			m_retry->Retry(m_call, ++m_attempts);
 		}
 	} else {
 		LOG_AM_DEBUG("[Activity %llu] [PersistCommand %s]: Succeeded",
 			m_activity->GetId(), GetString().c_str());
+		m_retry->Responded(true);
 		Complete(true);
 	}
 }
 
+
+void MojoPersistCommand::FailResponse(MojServiceMessage *msg,
+	const MojObject& response, MojErr err)
+{
+	if ((err == MojErrNone) ||
+		MojoCall::IsPermanentFailure(msg, response, err)) {
+		m_retry->Responded(false);
+	}
+
+	Complete(false);
+}
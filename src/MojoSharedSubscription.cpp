@@ -0,0 +1,293 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+#include "MojoSharedSubscription.h"
+#include "MojoTriggerSubscription.h"
+#include "MojoTriggerManager.h"
+#include "MojoCall.h"
+#include "Logging.h"
+
+unsigned long long MojoSharedSubscription::s_calls = 0;
+unsigned long long MojoSharedSubscription::s_responses = 0;
+unsigned long long MojoSharedSubscription::s_deliveries = 0;
+unsigned long long MojoSharedSubscription::s_replays = 0;
+
+MojoSharedSubscription::MojoSharedSubscription(
+	boost::shared_ptr<MojoTriggerManager> manager, const std::string& key,
+	MojService *service, const MojoURL& url, const MojObject& params,
+	bool usePublicBus, const std::string& requester)
+	: m_manager(manager)
+	, m_key(key)
+	, m_service(service)
+	, m_url(url)
+	, m_params(params)
+	, m_usePublicBus(usePublicBus)
+	, m_requester(requester)
+	, m_responded(false)
+	, m_joinable(true)
+	, m_replaySource(NULL)
+{
+}
+
+MojoSharedSubscription::~MojoSharedSubscription()
+{
+	CancelReplay();
+
+	boost::shared_ptr<MojoTriggerManager> manager = m_manager.lock();
+	if (manager) {
+		manager->RemoveSharedSubscription(this);
+	}
+}
+
+void MojoSharedSubscription::Attach(
+	boost::shared_ptr<MojoTriggerSubscription> subscription)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	m_subscriptions.push_back(subscription);
+
+	if (!m_call) {
+		LOG_AM_DEBUG("Subscribing to \"%s\"", m_url.GetURL().data());
+
+		m_call = boost::make_shared<MojoWeakPtrCall<MojoSharedSubscription> >(
+			shared_from_this(), &MojoSharedSubscription::ProcessResponse,
+			m_service, m_url, m_params, MojoCall::Unlimited);
+		s_calls++;
+		m_call->Call(m_usePublicBus, m_requester.c_str());
+	} else if (m_responded) {
+		LOG_AM_DEBUG("Sharing subscription to \"%s\" between %u triggers",
+			m_url.GetURL().data(), (unsigned)m_subscriptions.size());
+
+		m_replays.push_back(subscription);
+
+		if (!m_replaySource) {
+			GSource *source = g_idle_source_new();
+			g_source_set_callback(source,
+				MojoSharedSubscription::StaticReplay, this, NULL);
+			g_source_attach(source, g_main_context_default());
+
+			m_replaySource = source;
+		}
+	}
+}
+
+void MojoSharedSubscription::Detach(
+	const MojoTriggerSubscription *subscription)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	Remove(m_subscriptions, subscription);
+	Remove(m_replays, subscription);
+
+	if (m_subscriptions.empty()) {
+		LOG_AM_DEBUG("Unsubscribing from \"%s\"", m_url.GetURL().data());
+
+		CancelReplay();
+		m_call.reset();
+
+		boost::shared_ptr<MojoTriggerManager> manager = m_manager.lock();
+		if (manager) {
+			manager->RemoveSharedSubscription(this);
+		}
+	}
+}
+
+const std::string& MojoSharedSubscription::GetKey() const
+{
+	return m_key;
+}
+
+size_t MojoSharedSubscription::GetAttachedCount() const
+{
+	return m_subscriptions.size();
+}
+
+bool MojoSharedSubscription::IsJoinable() const
+{
+	return m_joinable;
+}
+
+void MojoSharedSubscription::ProcessResponse(MojServiceMessage *msg,
+	const MojObject& response, MojErr err)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	if (err != MojErrNone) {
+		if (!MojoCall::IsPermanentFailure(msg, response, err)) {
+			/* Resubscribing gets every attached subscription a new
+			 * initial response */
+			m_responded = false;
+			m_joinable = true;
+			m_replays.clear();
+			CancelReplay();
+
+			m_call->Call(m_usePublicBus, m_requester.c_str());
+			return;
+		}
+
+		/* The call is finished.  Subscriptions attaching from here on need
+		 * one of their own. */
+		m_responded = false;
+
+		boost::shared_ptr<MojoTriggerManager> manager = m_manager.lock();
+		if (manager) {
+			manager->RemoveSharedSubscription(this);
+		}
+	} else if (!m_responded) {
+		m_responded = true;
+		m_latest = response;
+	} else {
+		/* Not the initial response, so it may be an event, which a
+		 * subscription attaching now mustn't be handed */
+		m_joinable = false;
+		m_latest = MojObject();
+	}
+
+	s_responses++;
+
+	/* Anything waiting on a replay gets this newer response instead */
+	m_replays.clear();
+	CancelReplay();
+
+	/* Triggers firing will detach, and may attach again (in which case
+	 * they wait for a replay), so work from a copy. */
+	boost::shared_ptr<MojoSharedSubscription> self = shared_from_this();
+	SubscriptionList subscriptions(m_subscriptions);
+
+	for (SubscriptionList::iterator iter = subscriptions.begin();
+		iter != subscriptions.end(); ++iter) {
+		boost::shared_ptr<MojoTriggerSubscription> subscription =
+			iter->lock();
+		if (!subscription ||
+			!Contains(m_subscriptions, subscription.get()) ||
+			Contains(m_replays, subscription.get())) {
+			continue;
+		}
+
+		s_deliveries++;
+		subscription->SharedResponse(response, err);
+	}
+}
+
+void MojoSharedSubscription::Replay()
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	boost::shared_ptr<MojoSharedSubscription> self = shared_from_this();
+
+	SubscriptionList replays;
+	replays.swap(m_replays);
+
+	for (SubscriptionList::iterator iter = replays.begin();
+		iter != replays.end(); ++iter) {
+		boost::shared_ptr<MojoTriggerSubscription> subscription =
+			iter->lock();
+		if (!subscription || !m_responded || !m_joinable ||
+			!Contains(m_subscriptions, subscription.get())) {
+			continue;
+		}
+
+		s_replays++;
+		subscription->SharedResponse(m_latest, MojErrNone);
+	}
+}
+
+void MojoSharedSubscription::CancelReplay()
+{
+	if (m_replaySource) {
+		if (!g_source_is_destroyed(m_replaySource)) {
+			g_source_destroy(m_replaySource);
+		}
+
+		m_replaySource = NULL;
+	}
+}
+
+gboolean MojoSharedSubscription::StaticReplay(gpointer data)
+{
+	MojoSharedSubscription *shared =
+		static_cast<MojoSharedSubscription *>(data);
+
+	/* Reset now, the source is destroyed when this returns false */
+	shared->m_replaySource = NULL;
+
+	try {
+		shared->Replay();
+	} catch (const std::exception& except) {
+		LOG_AM_ERROR(MSGID_SHARED_SUBSCRIPTION_EXCEPTION, 0, "Unhandled exception \"%s\" occurred replaying shared subscription response", except.what());
+	} catch (...) {
+		LOG_AM_ERROR(MSGID_SHARED_SUBSCRIPTION_ERR_UNKNOWN, 0, "Unhandled exception of unknown type occurred replaying shared subscription response");
+	}
+
+	return false;
+}
+
+/* Expired entries are dropped along the way; one is left behind when an
+ * attached subscription is destroyed. */
+bool MojoSharedSubscription::Remove(SubscriptionList& subscriptions,
+	const MojoTriggerSubscription *subscription)
+{
+	bool found = false;
+
+	SubscriptionList::iterator iter = subscriptions.begin();
+	while (iter != subscriptions.end()) {
+		if (iter->expired()) {
+			iter = subscriptions.erase(iter);
+		} else if (iter->lock().get() == subscription) {
+			iter = subscriptions.erase(iter);
+			found = true;
+		} else {
+			++iter;
+		}
+	}
+
+	return found;
+}
+
+bool MojoSharedSubscription::Contains(const SubscriptionList& subscriptions,
+	const MojoTriggerSubscription *subscription)
+{
+	for (SubscriptionList::const_iterator iter = subscriptions.begin();
+		iter != subscriptions.end(); ++iter) {
+		if (iter->lock().get() == subscription) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+MojErr MojoSharedSubscription::InfoToJson(MojObject& rep)
+{
+	MojErr err;
+
+	err = rep.put(_T("calls"), (MojInt64)s_calls);
+	MojErrCheck(err);
+
+	err = rep.put(_T("responses"), (MojInt64)s_responses);
+	MojErrCheck(err);
+
+	err = rep.put(_T("deliveries"), (MojInt64)s_deliveries);
+	MojErrCheck(err);
+
+	err = rep.put(_T("replays"), (MojInt64)s_replays);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
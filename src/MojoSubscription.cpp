@@ -63,28 +63,14 @@ MojErr MojoSubscription::SendEvent(ActivityEvent_t event)
 {
 	if (m_msg.get()) {
 		MojErr err = MojErrNone;
-		MojObject eventReply;
 
-		err = eventReply.putString(_T("event"), ActivityEventNames[event]);
+		/* The reply is shared with the Activity's other subscribers */
+		const MojObject *eventReply;
+		err = m_activity->GetEventPayload(event, m_detailedEvents,
+			eventReply);
 		MojErrCheck(err);
 
-		err = eventReply.putInt(_T("activityId"), m_activity->GetId());
-		MojErrCheck(err);
-
-		err = eventReply.putBool(MojServiceMessage::ReturnValueKey, true);
-		MojErrCheck(err);
-
-		if (m_detailedEvents) {
-			MojObject details(MojObject::TypeObject);
-
-			err = m_activity->ActivityInfoToJson(details);
-			MojErrCheck(err);
-
-			err = eventReply.put(_T("$activity"), details);
-			MojErrCheck(err);
-		}
-
-		err = m_msg->reply(eventReply);
+		err = m_msg->reply(*eventReply);
 		MojErrCheck(err);
 
 		return MojErrNone;
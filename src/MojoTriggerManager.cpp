@@ -19,10 +19,62 @@
 #include "MojoTriggerManager.h"
 #include "MojoTrigger.h"
 #include "MojoTriggerSubscription.h"
+#include "MojoSharedSubscription.h"
 #include "MojoWhereMatcher.h"
+#include "MojoObjectWrapper.h"
+#include "Activity.h"
+#include "ObjectPool.h"
+#include "Logging.h"
+
+#include <map>
+
+/* JSON with the members of every object in key order, so parameters that
+ * differ only in the order they were given produce the same key */
+static void AppendCanonicalJson(const MojObject& obj, std::string& out)
+{
+	if (obj.type() == MojObject::TypeObject) {
+		typedef std::map<std::string, const MojObject *> MemberMap;
+		MemberMap members;
+
+		for (MojObject::ConstIterator iter = obj.begin(); iter != obj.end();
+			++iter) {
+			members[iter.key().data()] = &iter.value();
+		}
+
+		out += '{';
+		for (MemberMap::const_iterator iter = members.begin();
+			iter != members.end(); ++iter) {
+			if (iter != members.begin()) {
+				out += ',';
+			}
+
+			MojString key;
+			key.assign(iter->first.c_str());
+			out += MojoObjectJson(MojObject(key)).str();
+			out += ':';
+			AppendCanonicalJson(*iter->second, out);
+		}
+		out += '}';
+	} else if (obj.type() == MojObject::TypeArray) {
+		out += '[';
+		for (MojObject::ConstArrayIterator iter = obj.arrayBegin();
+			iter != obj.arrayEnd(); ++iter) {
+			if (iter != obj.arrayBegin()) {
+				out += ',';
+			}
+
+			AppendCanonicalJson(*iter, out);
+		}
+		out += ']';
+	} else {
+		out += MojoObjectJson(obj).str();
+	}
+}
 
 MojoTriggerManager::MojoTriggerManager(MojService *service)
 	: m_service(service)
+	, m_attached(0)
+	, m_joined(0)
 {
 }
 
@@ -35,7 +87,8 @@ boost::shared_ptr<Trigger> MojoTriggerManager::CreateKeyedTrigger(
 	const MojObject& params, const MojString& key)
 {
 	boost::shared_ptr<MojoMatcher> matcher =
-		boost::make_shared<MojoKeyMatcher>(key);
+		boost::allocate_shared<MojoKeyMatcher>(POOL_ALLOCATOR(MojoKeyMatcher),
+			key);
 
 	return CreateTrigger(activity, url, params, matcher);
 }
@@ -45,7 +98,8 @@ boost::shared_ptr<Trigger> MojoTriggerManager::CreateBasicTrigger(
 	const MojObject& params)
 {
 	boost::shared_ptr<MojoMatcher> matcher =
-		boost::make_shared<MojoSimpleMatcher>();
+		boost::allocate_shared<MojoSimpleMatcher>(
+			POOL_ALLOCATOR(MojoSimpleMatcher));
 
 	return CreateTrigger(activity, url, params, matcher);
 }
@@ -55,7 +109,8 @@ boost::shared_ptr<Trigger> MojoTriggerManager::CreateCompareTrigger(
 	const MojObject& params, const MojString& key, const MojObject& value)
 {
 	boost::shared_ptr<MojoMatcher> matcher =
-		boost::make_shared<MojoCompareMatcher>(key, value);
+		boost::allocate_shared<MojoCompareMatcher>(
+			POOL_ALLOCATOR(MojoCompareMatcher), key, value);
 
 	return CreateTrigger(activity, url, params, matcher);
 }
@@ -65,7 +120,8 @@ boost::shared_ptr<Trigger> MojoTriggerManager::CreateWhereTrigger(
 	const MojObject& params, const MojObject& where)
 {
 	boost::shared_ptr<MojoMatcher> matcher =
-		boost::make_shared<MojoNewWhereMatcher>(where);
+		boost::allocate_shared<MojoNewWhereMatcher>(
+			POOL_ALLOCATOR(MojoNewWhereMatcher), where);
 
 	return CreateTrigger(activity, url, params, matcher);
 }
@@ -75,14 +131,126 @@ boost::shared_ptr<Trigger> MojoTriggerManager::CreateTrigger(
 	const MojObject& params, boost::shared_ptr<MojoMatcher> matcher)
 {
 	boost::shared_ptr<MojoExclusiveTrigger> trigger =
-		boost::make_shared<MojoExclusiveTrigger>(activity, matcher);
+		boost::allocate_shared<MojoExclusiveTrigger>(
+			POOL_ALLOCATOR(MojoExclusiveTrigger),
+			activity, matcher);
 
 	boost::shared_ptr<MojoTriggerSubscription> subscription =
-		boost::make_shared<MojoExclusiveTriggerSubscription>(trigger,
-			m_service, url, params);
+		boost::allocate_shared<MojoExclusiveTriggerSubscription>(
+			POOL_ALLOCATOR(MojoExclusiveTriggerSubscription),
+			trigger, shared_from_this(), m_service, url, params);
 
 	trigger->SetSubscription(subscription);
 
 	return trigger;
 }
 
+boost::shared_ptr<MojoSharedSubscription>
+MojoTriggerManager::AttachSubscription(
+	boost::shared_ptr<MojoTriggerSubscription> subscription,
+	const MojoURL& url, const MojObject& params,
+	boost::shared_ptr<const Activity> activity)
+{
+	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
+
+	/* Calls are made on behalf of the Activity's creator, on its bus, so
+	 * only triggers that would make exactly the same call may share one. */
+	bool usePublicBus = (activity->GetBusType() == Activity::PublicBus);
+	const std::string& requester = activity->GetCreator().GetId();
+
+	std::string key = GetSubscriptionKey(url, params, usePublicBus,
+		requester);
+
+	boost::shared_ptr<MojoSharedSubscription> shared;
+
+	SharedMap::iterator found = m_shared.find(key);
+	if (found != m_shared.end()) {
+		shared = found->second.lock();
+	}
+
+	/* A call that has moved past its initial response can't give a new
+	 * subscription the response its own call would start with, so that
+	 * gets a new call, which replaces it under the key */
+	if (shared && !shared->IsJoinable()) {
+		shared.reset();
+	}
+
+	if (shared) {
+		m_joined++;
+	} else {
+		shared = boost::make_shared<MojoSharedSubscription>(
+			shared_from_this(), key, m_service, url, params, usePublicBus,
+			requester);
+		m_shared[key] = shared;
+	}
+
+	m_attached++;
+	shared->Attach(subscription);
+
+	return shared;
+}
+
+void MojoTriggerManager::RemoveSharedSubscription(
+	const MojoSharedSubscription *shared)
+{
+	SharedMap::iterator found = m_shared.find(shared->GetKey());
+	if (found == m_shared.end()) {
+		return;
+	}
+
+	/* A failed call may already have been replaced under the same key */
+	boost::shared_ptr<MojoSharedSubscription> current = found->second.lock();
+	if (!current || (current.get() == shared)) {
+		m_shared.erase(found);
+	}
+}
+
+std::string MojoTriggerManager::GetSubscriptionKey(const MojoURL& url,
+	const MojObject& params, bool usePublicBus, const std::string& requester)
+{
+	std::string key = url.GetString();
+	key += '\n';
+	key += usePublicBus ? "public:" : "private:";
+	key += requester;
+	key += '\n';
+	AppendCanonicalJson(params, key);
+
+	return key;
+}
+
+MojErr MojoTriggerManager::InfoToJson(MojObject& rep) const
+{
+	MojErr err;
+	MojObject subscriptions(MojObject::TypeObject);
+
+	err = subscriptions.put(_T("upstream"), (MojInt64)m_shared.size());
+	MojErrCheck(err);
+
+	MojInt64 attached = 0;
+	for (SharedMap::const_iterator iter = m_shared.begin();
+		iter != m_shared.end(); ++iter) {
+		boost::shared_ptr<MojoSharedSubscription> shared =
+			iter->second.lock();
+		if (shared) {
+			attached += shared->GetAttachedCount();
+		}
+	}
+
+	err = subscriptions.put(_T("attached"), attached);
+	MojErrCheck(err);
+
+	err = subscriptions.put(_T("attaches"), (MojInt64)m_attached);
+	MojErrCheck(err);
+
+	err = subscriptions.put(_T("joined"), (MojInt64)m_joined);
+	MojErrCheck(err);
+
+	err = MojoSharedSubscription::InfoToJson(subscriptions);
+	MojErrCheck(err);
+
+	err = rep.put(_T("triggerSubscriptions"), subscriptions);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
@@ -18,7 +18,10 @@
 
 #include "MojoTriggerSubscription.h"
 #include "MojoTrigger.h"
+#include "MojoTriggerManager.h"
+#include "MojoSharedSubscription.h"
 #include "MojoCall.h"
+#include "ObjectPool.h"
 
 MojLogger MojoTriggerSubscription::s_log(_T("activitymanager.triggersubscription"));
 
@@ -34,6 +37,9 @@ MojoTriggerSubscription::MojoTriggerSubscription(
 
 MojoTriggerSubscription::~MojoTriggerSubscription()
 {
+	if (m_shared) {
+		m_shared->Detach(this);
+	}
 }
 
 const MojoURL& MojoTriggerSubscription::GetURL() const
@@ -44,8 +50,9 @@ const MojoURL& MojoTriggerSubscription::GetURL() const
 void MojoTriggerSubscription::Subscribe()
 {
 	if (!m_call) {
-		m_call = boost::make_shared<MojoWeakPtrCall<MojoTriggerSubscription> >
-			(shared_from_this(), &MojoTriggerSubscription::ProcessResponse,
+		m_call = boost::allocate_shared<MojoWeakPtrCall<MojoTriggerSubscription> >
+			(POOL_ALLOCATOR(MojoWeakPtrCall<MojoTriggerSubscription>),
+			shared_from_this(), &MojoTriggerSubscription::ProcessResponse,
 			m_service, m_url, m_params, MojoCall::Unlimited);
 		m_call->Call();
 	}
@@ -56,11 +63,26 @@ void MojoTriggerSubscription::Unsubscribe()
 	if (m_call) {
 		m_call.reset();
 	}
+
+	if (m_shared) {
+		boost::shared_ptr<MojoSharedSubscription> shared = m_shared;
+		m_shared.reset();
+		shared->Detach(this);
+	}
 }
 
 bool MojoTriggerSubscription::IsSubscribed() const
 {
-	return m_call;
+	return m_call || m_shared;
+}
+
+void MojoTriggerSubscription::SharedResponse(const MojObject& response,
+	MojErr err)
+{
+	boost::shared_ptr<MojoTrigger> trigger = m_trigger.lock();
+	if (trigger) {
+		trigger->ProcessResponse(response, err);
+	}
 }
 
 void MojoTriggerSubscription::ProcessResponse(MojServiceMessage *msg,
@@ -92,9 +114,11 @@ MojErr MojoTriggerSubscription::ToJson(MojObject& rep, unsigned flags) const
 }
 
 MojoExclusiveTriggerSubscription::MojoExclusiveTriggerSubscription(
-	boost::shared_ptr<MojoExclusiveTrigger> trigger, MojService *service,
+	boost::shared_ptr<MojoExclusiveTrigger> trigger,
+	boost::shared_ptr<MojoTriggerManager> manager, MojService *service,
 	const MojoURL& url, const MojObject& params)
 	: MojoTriggerSubscription(trigger, service, url, params)
+	, m_manager(manager)
 {
 }
 
@@ -104,13 +128,28 @@ MojoExclusiveTriggerSubscription::~MojoExclusiveTriggerSubscription()
 
 void MojoExclusiveTriggerSubscription::Subscribe()
 {
-	if (!m_call) {
-		m_call = boost::make_shared<MojoWeakPtrCall<MojoTriggerSubscription> >
-			(shared_from_this(),
-			&MojoExclusiveTriggerSubscription::ProcessResponse,
-			m_service, m_url, m_params, MojoCall::Unlimited);
-		m_call->Call(boost::dynamic_pointer_cast<MojoExclusiveTrigger,
-			MojoTrigger>(m_trigger.lock())->GetActivity());
+	if (IsSubscribed()) {
+		return;
+	}
+
+	boost::shared_ptr<Activity> activity =
+		boost::dynamic_pointer_cast<MojoExclusiveTrigger, MojoTrigger>
+			(m_trigger.lock())->GetActivity();
+
+#ifdef ACTIVITYMANAGER_SHARED_TRIGGER_SUBSCRIPTIONS
+	boost::shared_ptr<MojoTriggerManager> manager = m_manager.lock();
+	if (manager) {
+		m_shared = manager->AttachSubscription(shared_from_this(), m_url,
+			m_params, activity);
+		return;
 	}
+#endif
+
+	m_call = boost::allocate_shared<MojoWeakPtrCall<MojoTriggerSubscription> >
+		(POOL_ALLOCATOR(MojoWeakPtrCall<MojoTriggerSubscription>),
+		shared_from_this(),
+		&MojoExclusiveTriggerSubscription::ProcessResponse,
+		m_service, m_url, m_params, MojoCall::Unlimited);
+	m_call->Call(activity);
 }
 
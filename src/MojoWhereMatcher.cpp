@@ -23,8 +23,10 @@
 
 MojoNewWhereMatcher::MojoNewWhereMatcher(const MojObject& where)
 	: m_where(where)
+	, m_root(0)
 {
 	ValidateClauses(m_where);
+	m_root = Compile(m_where, AndMode);
 }
 
 MojoNewWhereMatcher::~MojoNewWhereMatcher()
@@ -35,7 +37,7 @@ bool MojoNewWhereMatcher::Match(const MojObject& response)
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
 
-	MatchResult result = CheckClause(m_where, response, AndMode);
+	MatchResult result = Evaluate(m_root, response);
 	if (result == Matched) {
 		LOG_AM_DEBUG("Where Matcher: Response %s matches",
 			MojoObjectJson(response).c_str());
@@ -47,6 +49,11 @@ bool MojoNewWhereMatcher::Match(const MojObject& response)
 	}
 }
 
+bool MojoNewWhereMatcher::MatchInterpreted(const MojObject& response) const
+{
+	return CheckClause(m_where, response, AndMode) == Matched;
+}
+
 MojErr MojoNewWhereMatcher::ToJson(MojObject& rep, unsigned long flags) const
 {
 	MojErr err;
@@ -442,3 +449,250 @@ MojoNewWhereMatcher::MatchResult MojoNewWhereMatcher::CheckMatch(
 	}
 }
 
+
+/* The clauses have already been validated, so they are known to be well
+ * formed here. */
+unsigned MojoNewWhereMatcher::Compile(const MojObject& clause, MatchMode mode)
+{
+	if (clause.type() == MojObject::TypeArray) {
+		std::vector<unsigned> children;
+		for (MojObject::ConstArrayIterator iter = clause.arrayBegin();
+			iter != clause.arrayEnd(); ++iter) {
+			children.push_back(Compile(*iter, mode));
+		}
+
+		Node node;
+		node.m_compare = false;
+		node.m_mode = mode;
+		node.m_first = (unsigned)m_children.size();
+		node.m_count = (unsigned)children.size();
+		node.m_path = false;
+		node.m_op = EqualOp;
+		node.m_value = 0;
+		node.m_where = 0;
+
+		m_children.insert(m_children.end(), children.begin(),
+			children.end());
+		m_nodes.push_back(node);
+		return (unsigned)(m_nodes.size() - 1);
+	}
+
+	MojObject subClause;
+	if (clause.get(_T("and"), subClause)) {
+		return Compile(subClause, AndMode);
+	} else if (clause.get(_T("or"), subClause)) {
+		return Compile(subClause, OrMode);
+	}
+
+	return CompileComparison(clause, mode);
+}
+
+unsigned MojoNewWhereMatcher::CompileComparison(const MojObject& clause,
+	MatchMode mode)
+{
+	MojObject prop;
+	MojObject op;
+	MojObject val;
+
+	clause.get(_T("prop"), prop);
+	clause.get(_T("op"), op);
+	clause.get(_T("val"), val);
+
+	Node node;
+	node.m_compare = true;
+	node.m_mode = mode;
+	node.m_first = (unsigned)m_keys.size();
+
+	MojString keyStr;
+	MojErr err;
+
+	if (prop.type() == MojObject::TypeString) {
+		node.m_path = false;
+
+		err = prop.stringValue(keyStr);
+		if (err) {
+			throw std::runtime_error("Failed to convert property lookup key "
+				"to string");
+		}
+
+		m_keys.push_back(keyStr);
+	} else {
+		node.m_path = true;
+
+		for (MojObject::ConstArrayIterator iter = prop.arrayBegin();
+			iter != prop.arrayEnd(); ++iter) {
+			err = iter->stringValue(keyStr);
+			if (err) {
+				throw std::runtime_error("Failed to convert property lookup "
+					"key to string");
+			}
+
+			m_keys.push_back(keyStr);
+		}
+	}
+
+	node.m_count = (unsigned)m_keys.size() - node.m_first;
+	node.m_op = CompileOp(op);
+	node.m_value = (unsigned)m_values.size();
+	node.m_where = 0;
+
+	m_values.push_back(val);
+
+	if (node.m_op == WhereOp) {
+		node.m_where = Compile(val, AndMode);
+	}
+
+	m_nodes.push_back(node);
+	return (unsigned)(m_nodes.size() - 1);
+}
+
+MojoNewWhereMatcher::CompareOp MojoNewWhereMatcher::CompileOp(
+	const MojObject& op)
+{
+	MojString opStr;
+	MojErr err = op.stringValue(opStr);
+	if (err) {
+		throw std::runtime_error("Failed to convert operation to string "
+			"value");
+	}
+
+	if (opStr == "<") {
+		return LessOp;
+	} else if (opStr == "<=") {
+		return LessEqualOp;
+	} else if (opStr == "=") {
+		return EqualOp;
+	} else if (opStr == "!=") {
+		return NotEqualOp;
+	} else if (opStr == ">=") {
+		return GreaterEqualOp;
+	} else if (opStr == ">") {
+		return GreaterOp;
+	} else if (opStr == "where") {
+		return WhereOp;
+	} else {
+		throw std::runtime_error("Unknown comparison operator in where "
+			"clause");
+	}
+}
+
+MojoNewWhereMatcher::MatchResult MojoNewWhereMatcher::Evaluate(
+	unsigned index, const MojObject& response) const
+{
+	const Node& node = m_nodes[index];
+
+	if (node.m_compare) {
+		if (node.m_path) {
+			return EvaluatePath(node, node.m_first, response);
+		}
+
+		if (response.type() != MojObject::TypeObject) {
+			return NoProperty;
+		}
+
+		MojObject::ConstIterator found =
+			response.find(m_keys[node.m_first].data());
+		if (found == response.end()) {
+			return NoProperty;
+		}
+
+		return EvaluateComparison(node, found.value());
+	}
+
+	for (unsigned i = node.m_first; i < (node.m_first + node.m_count); i++) {
+		MatchResult result = Evaluate(m_children[i], response);
+
+		if (node.m_mode == AndMode) {
+			if (result != Matched) {
+				return NotMatched;
+			}
+		} else {
+			if (result == Matched) {
+				return Matched;
+			}
+		}
+	}
+
+	return (node.m_mode == AndMode) ? Matched : NotMatched;
+}
+
+MojoNewWhereMatcher::MatchResult MojoNewWhereMatcher::EvaluatePath(
+	const Node& node, unsigned key, const MojObject& response) const
+{
+	const MojObject *onion = &response;
+
+	for (; key < (node.m_first + node.m_count); key++) {
+		if (onion->type() == MojObject::TypeArray) {
+			/* Every element is looked up with the rest of the path */
+			for (MojObject::ConstArrayIterator iter = onion->arrayBegin();
+				iter != onion->arrayEnd(); ++iter) {
+				MatchResult result = EvaluatePath(node, key, *iter);
+
+				if (node.m_mode == AndMode) {
+					if (result != Matched) {
+						return NotMatched;
+					}
+				} else {
+					if (result == Matched) {
+						return Matched;
+					}
+				}
+			}
+
+			return (node.m_mode == AndMode) ? Matched : NotMatched;
+		} else if (onion->type() == MojObject::TypeObject) {
+			MojObject::ConstIterator found = onion->find(m_keys[key].data());
+			if (found == onion->end()) {
+				return NoProperty;
+			}
+
+			onion = &found.value();
+		} else {
+			return NoProperty;
+		}
+	}
+
+	return EvaluateComparison(node, *onion);
+}
+
+MojoNewWhereMatcher::MatchResult MojoNewWhereMatcher::EvaluateComparison(
+	const Node& node, const MojObject& rhs) const
+{
+	const MojObject& val = m_values[node.m_value];
+	bool result;
+
+	switch (node.m_op) {
+	case LessOp:
+		result = (rhs < val);
+		break;
+	case LessEqualOp:
+		result = (rhs <= val);
+		break;
+	case EqualOp:
+		result = (rhs == val);
+		break;
+	case NotEqualOp:
+		result = (rhs != val);
+		break;
+	case GreaterEqualOp:
+		result = (rhs >= val);
+		break;
+	case GreaterOp:
+		result = (rhs > val);
+		break;
+	case WhereOp:
+		/* Same as CheckMatch: a nested where clause only fails if the
+		 * property is missing */
+		result = (Evaluate(node.m_where, rhs) != NoProperty);
+		break;
+	default:
+		throw std::runtime_error("Unknown comparison operator in where "
+			"clause");
+	}
+
+	if (result) {
+		return Matched;
+	} else {
+		return NotMatched;
+	}
+}
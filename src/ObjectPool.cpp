@@ -0,0 +1,156 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2009-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include "ObjectPool.h"
+#include "Logging.h"
+
+ObjectPool *ObjectPool::s_pools = NULL;
+
+/* Blocks are aligned to the strictest fundamental alignment any of the
+ * pooled types (or their shared counts) could need */
+static const size_t PoolBlockAlignment = 2 * sizeof(void *);
+
+ObjectPool::ObjectPool(const char *name, size_t objectSize)
+	: m_name(name)
+	, m_objectSize(objectSize)
+	, m_freeList(NULL)
+	, m_allocations(0)
+	, m_frees(0)
+	, m_slabs(0)
+	, m_nextPool(s_pools)
+{
+	size_t size = (objectSize < sizeof(FreeBlock)) ?
+		sizeof(FreeBlock) : objectSize;
+	m_blockSize = (size + PoolBlockAlignment - 1) &
+		~(PoolBlockAlignment - 1);
+
+	s_pools = this;
+}
+
+void *ObjectPool::Allocate()
+{
+	if (!m_freeList) {
+		AllocateSlab();
+	}
+
+	FreeBlock *block = m_freeList;
+	m_freeList = block->m_next;
+
+	m_allocations++;
+
+	return block;
+}
+
+void ObjectPool::Free(void *block)
+{
+	if (!block) {
+		return;
+	}
+
+	FreeBlock *freed = static_cast<FreeBlock *>(block);
+	freed->m_next = m_freeList;
+	m_freeList = freed;
+
+	m_frees++;
+}
+
+void ObjectPool::AllocateSlab()
+{
+	char *slab = static_cast<char *>(::operator new(m_blockSize * SlabBlocks));
+
+	/* Thread the new blocks onto the free list in address order */
+	for (unsigned i = SlabBlocks; i > 0; i--) {
+		FreeBlock *block = reinterpret_cast<FreeBlock *>(
+			slab + ((i - 1) * m_blockSize));
+		block->m_next = m_freeList;
+		m_freeList = block;
+	}
+
+	m_slabs++;
+
+	LOG_AM_DEBUG("[Pool %s] Allocated slab %u (%u blocks of %zu bytes)",
+		m_name, m_slabs, SlabBlocks, m_blockSize);
+}
+
+MojErr ObjectPool::ToJson(MojObject& rep) const
+{
+	MojErr err;
+
+	err = rep.putString(_T("type"), m_name);
+	MojErrCheck(err);
+
+	err = rep.putInt(_T("size"), (MojInt64)m_blockSize);
+	MojErrCheck(err);
+
+	err = rep.putInt(_T("allocations"), (MojInt64)m_allocations);
+	MojErrCheck(err);
+
+	err = rep.putInt(_T("live"), (MojInt64)(m_allocations - m_frees));
+	MojErrCheck(err);
+
+	err = rep.putInt(_T("slabs"), (MojInt64)m_slabs);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+MojErr ObjectPool::InfoToJson(MojObject& rep)
+{
+	MojErr err;
+
+	unsigned long long allocations = 0;
+	unsigned long long live = 0;
+	unsigned long long slabs = 0;
+
+	MojObject pools(MojObject::TypeArray);
+
+	for (const ObjectPool *pool = s_pools; pool; pool = pool->m_nextPool) {
+		allocations += pool->m_allocations;
+		live += pool->m_allocations - pool->m_frees;
+		slabs += pool->m_slabs;
+
+		MojObject poolJson;
+		err = pool->ToJson(poolJson);
+		MojErrCheck(err);
+
+		err = pools.push(poolJson);
+		MojErrCheck(err);
+	}
+
+	MojObject allocationsJson;
+
+	/* "allocations" is the number of objects handed out by the pools;
+	 * "heapAllocations" is the number of times the pools went to the heap
+	 * for them. */
+	err = allocationsJson.putInt(_T("allocations"), (MojInt64)allocations);
+	MojErrCheck(err);
+
+	err = allocationsJson.putInt(_T("heapAllocations"), (MojInt64)slabs);
+	MojErrCheck(err);
+
+	err = allocationsJson.putInt(_T("live"), (MojInt64)live);
+	MojErrCheck(err);
+
+	err = allocationsJson.put(_T("pools"), pools);
+	MojErrCheck(err);
+
+	err = rep.put(_T("allocations"), allocationsJson);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
@@ -26,10 +26,15 @@
 
 MojLogger PersistCommand::s_log(_T("activitymanager.persistcommand"));
 
+unsigned long long PersistCommand::s_supersededByStore = 0;
+unsigned long long PersistCommand::s_supersededByDelete = 0;
+unsigned long long PersistCommand::s_deletesSkipped = 0;
+
 PersistCommand::PersistCommand(boost::shared_ptr<Activity> activity,
 	boost::shared_ptr<Completion> completion)
 	: m_activity(activity)
 	, m_completion(completion)
+	, m_dropped(false)
 {
 }
 
@@ -63,19 +68,151 @@ void PersistCommand::Append(boost::shared_ptr<PersistCommand> command)
 			"to itself");
 	}
 
-	boost::shared_ptr<PersistCommand> target;
+	boost::shared_ptr<PersistCommand> target = FindTail();
+
+	if (target == command) {
+		LOG_AM_WARNING( MSGID_APPEND_CREATE_LOOP, 2, PMLOGKS("persist_command",command->GetString().c_str()),
+			PMLOGKS("persist_command",target->GetString().c_str()),"Append Failed");
+		throw std::runtime_error("Attempt to append Persist Command would "
+			"create a loop");
+	}
+
+	/* The first command in the chain may already have been issued, so
+	 * never try to replace it. */
+	if ((target == shared_from_this()) || !Coalesce(target, command)) {
+		target->m_next = command;
+		command->m_prev = target;
+	}
+
+	m_tail = command->FindTail();
+}
+
+boost::shared_ptr<PersistCommand> PersistCommand::GetTail()
+{
+	return FindTail();
+}
+
+bool PersistCommand::Supersedes(const PersistCommand& earlier) const
+{
+	return false;
+}
+
+bool PersistCommand::IsStore() const
+{
+	return false;
+}
+
+MojErr PersistCommand::InfoToJson(MojObject& rep)
+{
+	MojErr err;
+	MojObject counters(MojObject::TypeObject);
+
+	err = counters.put(_T("supersededByStore"),
+		(MojInt64)s_supersededByStore);
+	MojErrCheck(err);
+
+	err = counters.put(_T("supersededByDelete"),
+		(MojInt64)s_supersededByDelete);
+	MojErrCheck(err);
 
-	for (target = shared_from_this(); target->m_next;
-		target = target->m_next) {
+	err = counters.put(_T("deletesSkipped"), (MojInt64)s_deletesSkipped);
+	MojErrCheck(err);
+
+	err = counters.put(_T("writesSaved"), (MojInt64)(s_supersededByStore +
+		s_supersededByDelete + s_deletesSkipped));
+	MojErrCheck(err);
+
+	err = rep.put(_T("persistCoalescing"), counters);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+/* Find the last command in the chain, starting from the last tail seen
+ * (unless that command has since been dropped from the chain). */
+boost::shared_ptr<PersistCommand> PersistCommand::FindTail()
+{
+	boost::shared_ptr<PersistCommand> target = m_tail.lock();
+	if (!target || target->m_dropped) {
+		target = shared_from_this();
+	}
+
+	for (; target->m_next; target = target->m_next) {
 		if (target->m_next == shared_from_this()) {
-			LOG_AM_WARNING( MSGID_APPEND_CREATE_LOOP, 2, PMLOGKS("persist_command",command->GetString().c_str()),
-                PMLOGKS("persist_command",target->GetString().c_str()),"Append Failed");
+			LOG_AM_WARNING( MSGID_APPEND_CREATE_LOOP, 2, PMLOGKS("persist_command",GetString().c_str()),
+				PMLOGKS("persist_command",target->GetString().c_str()),"Append Failed");
 			throw std::runtime_error("Attempt to append Persist Command would "
 				"create a loop");
 		}
 	}
 
-	target->m_next = command;
+	return target;
+}
+
+/* Replace the tail of the chain with the new command, if the new command
+ * supersedes it.  Only commands that aren't the first hooked by their
+ * Activity can be replaced - any other command is still waiting for an
+ * earlier one, so hasn't been issued. */
+bool PersistCommand::Coalesce(boost::shared_ptr<PersistCommand> tail,
+	boost::shared_ptr<PersistCommand> command)
+{
+	if ((tail->m_activity != command->m_activity) ||
+		!command->Supersedes(*tail)) {
+		return false;
+	}
+
+	if (tail->m_activity->GetHookedPersistCommand() == tail) {
+		return false;
+	}
+
+	boost::shared_ptr<PersistCommand> prev = tail->m_prev.lock();
+	if (!prev) {
+		return false;
+	}
+
+	LOG_AM_DEBUG("[Activity %llu] [PersistCommand %s]: Superseded by "
+		"[PersistCommand %s]", tail->m_activity->GetId(),
+		tail->GetString().c_str(), command->GetString().c_str());
+
+	prev->m_next = command;
+	command->m_prev = prev;
+
+	CompletionList completions;
+	completions.swap(tail->m_superseded);
+	completions.push_back(tail->m_completion);
+	command->m_superseded.splice(command->m_superseded.begin(), completions);
+
+	tail->m_prev.reset();
+	tail->m_dropped = true;
+
+	if (command->IsStore()) {
+		s_supersededByStore++;
+	} else {
+		s_supersededByDelete++;
+	}
+
+	tail->m_activity->DropPersistCommand(tail);
+
+	return true;
+}
+
+bool PersistCommand::IsDeleteUnneeded()
+{
+	if (m_superseded.empty()) {
+		return false;
+	}
+
+	if (m_activity->IsPersistTokenSet() &&
+		m_activity->GetPersistToken()->IsValid()) {
+		return false;
+	}
+
+	LOG_AM_DEBUG("[Activity %llu] [PersistCommand %s]: Activity was never "
+		"stored, nothing to delete", m_activity->GetId(),
+		GetString().c_str());
+
+	s_deletesSkipped++;
+	return true;
 }
 
 void PersistCommand::Complete(bool success)
@@ -84,20 +221,16 @@ void PersistCommand::Complete(bool success)
 
 	/* All steps of Complete must execute, including launching the next
 	 * command in the chain.  All exceptions must be handled locally. */
-	try {
-		m_completion->Complete(success);
-	} catch (const std::exception& except) {
-		LOG_AM_WARNING(MSGID_CMD_COMPLETE_EXCEPTION,3,
-			PMLOGKFV("activity","%llu",m_activity->GetId()),
-		    PMLOGKS("persist_command",GetString().c_str()),
-			PMLOGKS("exception",except.what()),"Unexpected exception while trying to complete");
-	} catch (...) {
-		LOG_AM_WARNING(MSGID_CMD_COMPLETE_EXCEPTION,2,
-			PMLOGKFV("activity","%llu",m_activity->GetId()),
-		    PMLOGKS("persist_command",GetString().c_str()),"exception while trying to complete");
+	CompletionList superseded;
+	superseded.swap(m_superseded);
 
+	for (CompletionList::iterator iter = superseded.begin();
+		iter != superseded.end(); ++iter) {
+		RunCompletion(*iter, success);
 	}
 
+	RunCompletion(m_completion, success);
+
 	/* Tricky order here.  Unhooking this command will probably destroy it,
 	 * so we have to pick up a local reference to the next command in the
 	 * chain because we won't be able to access the object property.
@@ -129,6 +262,24 @@ void PersistCommand::Complete(bool success)
 	}
 }
 
+void PersistCommand::RunCompletion(boost::shared_ptr<Completion> completion,
+	bool success)
+{
+	try {
+		completion->Complete(success);
+	} catch (const std::exception& except) {
+		LOG_AM_WARNING(MSGID_CMD_COMPLETE_EXCEPTION,3,
+			PMLOGKFV("activity","%llu",m_activity->GetId()),
+		    PMLOGKS("persist_command",GetString().c_str()),
+			PMLOGKS("exception",except.what()),"Unexpected exception while trying to complete");
+	} catch (...) {
+		LOG_AM_WARNING(MSGID_CMD_COMPLETE_EXCEPTION,2,
+			PMLOGKFV("activity","%llu",m_activity->GetId()),
+		    PMLOGKS("persist_command",GetString().c_str()),"exception while trying to complete");
+
+	}
+}
+
 void PersistCommand::Validate(bool checkTokenValid) const
 {
 	LOG_AM_TRACE("Entering function %s", __FUNCTION__);
@@ -19,6 +19,7 @@
 #include "PersistProxy.h"
 #include "PersistCommand.h"
 #include "Activity.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 
 #include <stdexcept>
@@ -50,6 +51,27 @@ PersistProxy::PrepareCommand(CommandType type,
 	throw std::runtime_error("Attempt to create command of unknown type");
 }
 
+void
+PersistProxy::PrepareBatchCommands(CommandType type,
+	const ActivityVec& activities, const CompletionVec& completions,
+	CommandVec& commands)
+{
+	if (activities.size() != completions.size()) {
+		throw std::runtime_error("Batch must have one Completion per "
+			"Activity");
+	}
+
+	for (size_t i = 0; i < activities.size(); i++) {
+		commands.push_back(PrepareCommand(type, activities[i],
+			completions[i]));
+	}
+}
+
+MojErr PersistProxy::InfoToJson(MojObject& rep) const
+{
+	return MojErrNone;
+}
+
 boost::shared_ptr<PersistCommand>
 PersistProxy::PrepareNoopCommand(boost::shared_ptr<Activity> activity,
 	boost::shared_ptr<Completion> completion)
@@ -58,6 +80,7 @@ PersistProxy::PrepareNoopCommand(boost::shared_ptr<Activity> activity,
 	LOG_AM_DEBUG("Preparing noop command for [Activity %llu]",
 		activity->GetId());
 
-	return boost::make_shared<NoopCommand>(activity, completion);
+	return boost::allocate_shared<NoopCommand>(POOL_ALLOCATOR(NoopCommand),
+		activity, completion);
 }
 
@@ -21,6 +21,7 @@
 #include "MojoCall.h"
 #include "Activity.h"
 #include "ActivityJson.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 #include <stdexcept>
 
@@ -64,7 +65,8 @@ boost::shared_ptr<Requirement> PowerdProxy::InstantiateRequirement(
 		}
 
 		boost::shared_ptr<ListedRequirement> req =
-			boost::make_shared<BasicCoreListedRequirement>(
+			boost::allocate_shared<BasicCoreListedRequirement>(
+				POOL_ALLOCATOR(BasicCoreListedRequirement),
 				activity, m_chargingRequirementCore,
 				m_chargingRequirementCore->IsMet());
 
@@ -77,7 +79,8 @@ boost::shared_ptr<Requirement> PowerdProxy::InstantiateRequirement(
 		}
 
 		boost::shared_ptr<ListedRequirement> req =
-			boost::make_shared<BasicCoreListedRequirement>(
+			boost::allocate_shared<BasicCoreListedRequirement>(
+				POOL_ALLOCATOR(BasicCoreListedRequirement),
 				activity, m_dockedRequirementCore,
 				m_dockedRequirementCore->IsMet());
 
@@ -93,7 +96,9 @@ boost::shared_ptr<Requirement> PowerdProxy::InstantiateRequirement(
 		MojInt64 percent = value.intValue();
 
 		boost::shared_ptr<BatteryRequirement> req =
-			boost::make_shared<BatteryRequirement>(activity, percent,
+			boost::allocate_shared<BatteryRequirement>(
+				POOL_ALLOCATOR(BatteryRequirement),
+				activity, percent,
 				boost::dynamic_pointer_cast<PowerdProxy,
 					RequirementManager>(shared_from_this()),
 				(m_batteryPercent >= percent));
@@ -438,6 +443,12 @@ void PowerdProxy::BatteryStatusSignal(MojServiceMessage *msg,
 		 * the state of the associated battery requirement. */
 		m_batteryPercent = batteryPercent;
 
+		/* Every battery requirement reports the current level, including
+		 * unmet ones that won't see an update */
+		if (batteryPercent != oldBatteryPercent) {
+			Activity::AllInfoChanged();
+		}
+
 		if (batteryPercent < oldBatteryPercent) {
 			BatteryRequirement::MultiTable::iterator newWatermark =
 				m_batteryRequirements.upper_bound(batteryPercent,
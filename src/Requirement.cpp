@@ -28,6 +28,17 @@ Requirement::Requirement(boost::shared_ptr<Activity> activity, bool met)
 
 Requirement::~Requirement()
 {
+	/* Normally removed through RemoveRequirement.  If not, and the
+	 * Activity isn't being destroyed itself, its requirements (and
+	 * perhaps its state) change here. */
+	if (m_activityListItem.is_linked()) {
+		m_activityListItem.unlink();
+
+		boost::shared_ptr<Activity> activity = m_activity.lock();
+		if (activity) {
+			activity->MemberUnlinked();
+		}
+	}
 }
 
 void Requirement::Met()
@@ -55,6 +66,11 @@ void Requirement::Updated()
 	m_activity.lock()->RequirementUpdated(shared_from_this());
 }
 
+void Requirement::CurrentChanged()
+{
+	m_activity.lock()->InfoChanged();
+}
+
 bool Requirement::IsMet() const
 {
 	return m_met;
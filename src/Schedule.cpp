@@ -96,6 +96,8 @@ void Schedule::Queue()
 
 	m_scheduled = false;
 	m_scheduler->AddItem(shared_from_this());
+
+	StatusChanged();
 }
 
 void Schedule::UnQueue()
@@ -106,6 +108,8 @@ void Schedule::UnQueue()
 
 	m_scheduler->RemoveItem(shared_from_this());
 	m_scheduled = false;
+
+	StatusChanged();
 }
 
 bool Schedule::IsQueued() const
@@ -120,6 +124,8 @@ void Schedule::Scheduled()
 		m_activity.lock()->GetId());
 
 	m_scheduled = true;
+	StatusChanged();
+
 	m_activity.lock()->Scheduled();
 }
 
@@ -143,6 +149,21 @@ bool Schedule::ShouldReschedule() const
 void Schedule::SetLocal(bool local)
 {
 	m_local = local;
+	DefinitionChanged();
+}
+
+void Schedule::DefinitionChanged() const
+{
+	if (!m_activity.expired()) {
+		m_activity.lock()->DefinitionChanged();
+	}
+}
+
+void Schedule::StatusChanged() const
+{
+	if (!m_activity.expired()) {
+		m_activity.lock()->StatusChanged();
+	}
 }
 
 bool Schedule::IsLocal() const
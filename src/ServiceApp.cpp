@@ -26,6 +26,7 @@
 #include "GlibScheduler.h"
 #include "PowerdScheduler.h"
 #include "MojoDBProxy.h"
+#include "LogPersistProxy.h"
 #include "RequirementManager.h"
 #include "DefaultRequirementManager.h"
 #include "ConnectionManagerProxy.h"
@@ -35,6 +36,7 @@
 #include "ResourceManager.h"
 #include "ControlGroupManager.h"
 #include "LunaBusProxy.h"
+#include "ConcurrencyController.h"
 #include <nyx/nyx_client.h>
 #include <glib.h>
 
@@ -178,6 +180,8 @@ MojErr ActivityManagerApp::open()
 #endif
 
 		m_am = boost::make_shared<ActivityManager>(m_resourceManager);
+		m_concurrencyController =
+			boost::make_shared<ConcurrencyController>(m_am);
 
 		m_requirementManager = boost::make_shared<MasterRequirementManager>();
 		boost::shared_ptr<DefaultRequirementManager> defaultRequirementManager =
@@ -202,7 +206,12 @@ MojErr ActivityManagerApp::open()
 		m_json = boost::make_shared<MojoJsonConverter>(&m_service, m_am,
 			m_scheduler, m_triggerManager, m_requirementManager,
 			m_powerManager);
+#ifdef ACTIVITYMANAGER_LOG_PERSISTENCE
+		m_db = boost::make_shared<LogPersistProxy>(this, m_am, m_json,
+			LogPersistProxy::DefaultPath);
+#else
 		m_db = boost::make_shared<MojoDBProxy>(this, &m_client, m_am, m_json);
+#endif
 
 #ifndef WEBOS_TARGET_MACHINE_IMPL_SIMULATOR
 		boost::shared_ptr<ConnectionManagerProxy> cmp =
@@ -261,6 +270,11 @@ MojErr ActivityManagerApp::ready()
 	/* Subscribe to timezone notifications. */
 	m_scheduler->Enable();
 
+#ifdef ACTIVITYMANAGER_ADAPTIVE_CONCURRENCY
+	/* Start adapting background concurrency to system pressure */
+	m_concurrencyController->Enable();
+#endif
+
 #if !defined(WEBOS_TARGET_MACHINE_IMPL_SIMULATOR)
 	char *upstart_job = getenv("UPSTART_JOB");
 	if (upstart_job) {
@@ -327,7 +341,7 @@ MojErr ActivityManagerApp::online()
 	 *	palm://com.palm.activitymanager/... */
 	m_handler.reset(new ActivityCategoryHandler(m_db, m_json, m_am,
 		m_triggerManager, m_powerManager, m_resourceManager,
-		m_controlGroupManager));
+		m_controlGroupManager, m_concurrencyController));
 	MojAllocCheck(m_handler.get());
 
 	err = m_handler->Init();
@@ -354,7 +368,8 @@ MojErr ActivityManagerApp::online()
 	 *  palm://com.palm.activitymanager/devel/... */
 
 	m_develHandler.reset(new DevelCategoryHandler(m_am, m_json,
-		m_resourceManager, m_controlGroupManager));
+		m_resourceManager, m_controlGroupManager, m_concurrencyController,
+		m_db));
 
 	MojAllocCheck(m_develHandler.get());
 
@@ -46,7 +46,7 @@ const BusId& Subscriber::GetId() const
 	return m_id;
 }
 
-std::string Subscriber::GetString() const
+const std::string& Subscriber::GetString() const
 {
 	return m_id.GetString();
 }
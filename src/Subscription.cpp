@@ -34,6 +34,12 @@ Subscription::Subscription(boost::shared_ptr<Activity> activity,
 
 Subscription::~Subscription()
 {
+	/* Normally removed through RemoveSubscription.  If not, the Activity
+	 * loses a subscriber here, which can change its state. */
+	if (m_item.is_linked()) {
+		m_item.unlink();
+		m_activity->MemberUnlinked();
+	}
 }
 
 void Subscription::HandleCancelWrapper()
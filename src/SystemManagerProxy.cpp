@@ -20,6 +20,7 @@
 #include "ActivityManager.h"
 #include "Activity.h"
 #include "MojoCall.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 #include <stdexcept>
 #include <time.h>
@@ -57,7 +58,8 @@ boost::shared_ptr<Requirement> SystemManagerProxy::InstantiateRequirement(
 	if (name == "bootup") {
 		if ((value.type() == MojObject::TypeBool) && value.boolValue()) {
 			boost::shared_ptr<ListedRequirement> req =
-				boost::make_shared<BasicCoreListedRequirement>(
+				boost::allocate_shared<BasicCoreListedRequirement>(
+					POOL_ALLOCATOR(BasicCoreListedRequirement),
 					activity, m_bootupRequirementCore);
 			m_bootupRequirements.push_back(*req);
 			return req;
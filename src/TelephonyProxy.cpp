@@ -19,6 +19,7 @@
 #include "TelephonyProxy.h"
 #include "Activity.h"
 #include "MojoCall.h"
+#include "ObjectPool.h"
 #include "Logging.h"
 #include <stdexcept>
 
@@ -53,7 +54,8 @@ boost::shared_ptr<Requirement> TelephonyProxy::InstantiateRequirement(
 	if (name == "telephony") {
 		if ((value.type() == MojObject::TypeBool) && value.boolValue()) {
 			boost::shared_ptr<ListedRequirement> req =
-				boost::make_shared<BasicCoreListedRequirement>(
+				boost::allocate_shared<BasicCoreListedRequirement>(
+					POOL_ALLOCATOR(BasicCoreListedRequirement),
 					activity, m_telephonyRequirementCore,
 					m_telephonyRequirementCore->IsMet());
 			m_telephonyRequirements.push_back(*req);
@@ -22,6 +22,7 @@
 #include "MojoSubscription.h"
 #include "MojoWhereMatcher.h"
 #include "Activity.h"
+#include "MonotonicClock.h"
 #include "Logging.h"
 #include <stdexcept>
 
@@ -151,22 +152,39 @@ TestCategoryHandler::Leak(MojServiceMessage *msg, MojObject &payload)
 
 com.palm.activitymanager/test/where
 
-Wake Callback.
+Test a response against a where clause, as a trigger would.  If iterations
+are requested, the match is also timed, both with the compiled clause
+program triggers use and by walking the clause JSON as was done before.
 
 \subsection com_palm_activitymanager_test_where_syntax Syntax:
 \code
 {
+    "response": object,
+    "where": object | [object],
+    "iterations": int
 }
 \endcode
 
-\param
+\param response The response to test.
+\param where The where clause, as given in a trigger.
+\param iterations Number of times to time each evaluation.  Optional.
 
 \subsection com_palm_activitymanager_test_where_returns Returns:
 \code
-
+{
+    "matched": boolean,
+    "iterations": int,
+    "compiledNs": int,
+    "interpretedNs": int,
+    "agree": boolean
+}
 \endcode
 
-\param
+\param matched Whether the response matched.
+\param iterations Evaluations timed, if requested.
+\param compiledNs Average nanoseconds per compiled evaluation.
+\param interpretedNs Average nanoseconds per evaluation walking the JSON.
+\param agree Whether both evaluations gave the same result.
 
 \subsection com_palm_activitymanager_test_where_examples Examples:
 \code
@@ -208,6 +226,44 @@ TestCategoryHandler::WhereMatchTest(MojServiceMessage *msg, MojObject &payload)
 	MojErr err = reply.putBool(_T("matched"), matched);
 	MojErrCheck(err);
 
+	MojInt64 iterations = 0;
+	payload.get(_T("iterations"), iterations);
+
+	if (iterations > 0) {
+		unsigned compiledMatches = 0;
+		unsigned interpretedMatches = 0;
+		unsigned long long start;
+
+		start = GetMonotonicNanoseconds();
+		for (MojInt64 i = 0; i < iterations; i++) {
+			if (matcher.Match(response)) {
+				compiledMatches++;
+			}
+		}
+		MojInt64 compiledNs = (MojInt64)(GetMonotonicNanoseconds() - start);
+
+		start = GetMonotonicNanoseconds();
+		for (MojInt64 i = 0; i < iterations; i++) {
+			if (matcher.MatchInterpreted(response)) {
+				interpretedMatches++;
+			}
+		}
+		MojInt64 interpretedNs = (MojInt64)(GetMonotonicNanoseconds() - start);
+
+		err = reply.putInt(_T("iterations"), iterations);
+		MojErrCheck(err);
+
+		err = reply.putInt(_T("compiledNs"), compiledNs / iterations);
+		MojErrCheck(err);
+
+		err = reply.putInt(_T("interpretedNs"), interpretedNs / iterations);
+		MojErrCheck(err);
+
+		err = reply.putBool(_T("agree"),
+			compiledMatches == interpretedMatches);
+		MojErrCheck(err);
+	}
+
 	err = msg->reply(reply);
 	MojErrCheck(err);
 